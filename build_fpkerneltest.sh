@@ -0,0 +1,9 @@
+CFLAGS="-I./ -march=armv8-a -mfloat-abi=hard -mfpu=neon-fp-armv8 -O3"
+REF="-DSOFTFLOAT_GENERIC_POLY -DEvalPoly=ref_EvalPoly -DEvenPoly=ref_EvenPoly -DOddPoly=ref_OddPoly -DnormalizeFloatx80Subnormal=ref_normalizeFloatx80Subnormal -Dsf_fsincos=ref_sf_fsincos\
+ -Dfloatx80_fsin=ref_floatx80_fsin -Dfloatx80_fcos=ref_floatx80_fcos -Dfloatx80_ftan=ref_floatx80_ftan -Dfloatx80_scale=ref_floatx80_scale\
+ -Dfyl2xp1=ref_fyl2xp1 -Dfloatx80_flognp1=ref_floatx80_flognp1 -Dfloatx80_flogn=ref_floatx80_flogn\
+ -Dfloatx80_flog2=ref_floatx80_flog2 -Dfloatx80_flog10=ref_floatx80_flog10"
+gcc $CFLAGS $REF -c softfloat/fsincos.c -o fpkerneltest_ref_fsincos.o
+gcc $CFLAGS $REF -c softfloat/fyl2x.c -o fpkerneltest_ref_fyl2x.o
+gcc $CFLAGS fpkerneltest.c softfloat/softfloat.c softfloat/fsincos.c softfloat/fyl2x.c fpkerneltest_ref_fsincos.o fpkerneltest_ref_fyl2x.o -o fpkerneltest -lm
+rm -f fpkerneltest_ref_fsincos.o fpkerneltest_ref_fyl2x.o
@@ -0,0 +1 @@
+gcc fputest.c softfloat/softfloat.c softfloat/fsincos.c softfloat/fyl2x.c -I./ -o fputest -march=armv8-a -mfloat-abi=hard -mfpu=neon-fp-armv8 -O2 -lm
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #define M68K_CPU_TYPES M68K_CPU_TYPE_SCC68070
 
@@ -35,6 +36,12 @@ const char *config_item_names[CONFITEM_NUM] = {
   "platform",
   "setvar",
   "kbfile",
+  "fpu",
+  "idlesleep",
+  "profile",
+  "trace",
+  "snapshot",
+  "debugger",
 };
 
 const char *mapcmd_names[MAPCMD_NUM] = {
@@ -169,6 +176,18 @@ void get_next_string(char *str, char *str_out, int *strpos, char separator) {
   }
 }
 
+// Mapped RAM comes straight from mmap, zeroed and page aligned, so that a snapshot
+// restore can map the saved pages over it (see snapshot/snapshot.c).
+unsigned char *alloc_mapped_ram(unsigned int size) {
+  void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return (data == MAP_FAILED) ? NULL : (unsigned char *)data;
+}
+
+void free_mapped_ram(unsigned char *data, unsigned int size) {
+  munmap(data, size);
+}
+
 void add_mapping(struct emulator_config *cfg, unsigned int type, unsigned int addr, unsigned int size, int mirr_addr, char *filename, char *map_id) {
   unsigned int index = 0, file_size = 0;
   FILE *in = NULL;
@@ -196,12 +215,11 @@ void add_mapping(struct emulator_config *cfg, unsigned int type, unsigned int ad
   switch(type) {
     case MAPTYPE_RAM:
       printf("[CFG] Allocating %d bytes for RAM mapping (%d MB)...\n", size, size / 1024 / 1024);
-      cfg->map_data[index] = (unsigned char *)malloc(size);
+      cfg->map_data[index] = alloc_mapped_ram(size);
       if (!cfg->map_data[index]) {
         printf("[CFG] ERROR: Unable to allocate memory for mapped RAM!\n");
         goto mapping_failed;
       }
-      memset(cfg->map_data[index], 0x00, size);
       break;
     case MAPTYPE_ROM:
       in = fopen(filename, "rb");
@@ -375,6 +393,68 @@ struct emulator_config *load_config_file(char *filename) {
         strcpy(cfg->keyboard_file, cur_cmd);
         printf("[CFG] Set keyboard event source file to %s.\n", cfg->keyboard_file);
         break;
+      case CONFITEM_FPU:
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        cfg->fpu_mode = (strcmp(cur_cmd, "fast") == 0) ? M68K_FPU_FAST : M68K_FPU_EXACT;
+        printf("[CFG] Set FPU mode to %s.\n", (cfg->fpu_mode == M68K_FPU_FAST) ? "fast" : "exact");
+        break;
+      case CONFITEM_IDLESLEEP:
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        if (strcmp(cur_cmd, "off") == 0) {
+          cfg->idle_sleep = 0;
+          cfg->idle_sleep_set = 1;
+          printf("[CFG] Disabled idle sleep.\n");
+        } else if (cur_cmd[0] == '\0' || cur_cmd[0] == '-') {
+          printf("[CFG] Invalid idle sleep timeout %s, use a number of usec or off.\n", cur_cmd);
+        } else {
+          cfg->idle_sleep = get_int(cur_cmd);
+          cfg->idle_sleep_set = 1;
+          printf("[CFG] Set idle sleep timeout to %u usec.\n", cfg->idle_sleep);
+        }
+        break;
+      case CONFITEM_PROFILE:
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        cfg->profile_file = (char *)calloc(1, strlen(cur_cmd) + 1);
+        strcpy(cfg->profile_file, cur_cmd);
+        cur_cmd[0] = '\0';
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        if (cur_cmd[0])
+          cfg->profile_interval = get_int(cur_cmd);
+        printf("[CFG] Enabled guest profiling to %s.\n", cfg->profile_file);
+        break;
+      case CONFITEM_TRACE:
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        cfg->trace_file = (char *)calloc(1, strlen(cur_cmd) + 1);
+        strcpy(cfg->trace_file, cur_cmd);
+        cur_cmd[0] = '\0';
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        if (cur_cmd[0])
+          cfg->trace_size = get_int(cur_cmd);
+        printf("[CFG] Enabled instruction trace to %s.\n", cfg->trace_file);
+        break;
+      case CONFITEM_SNAPSHOT:
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        cfg->snapshot_file = (char *)calloc(1, strlen(cur_cmd) + 1);
+        strcpy(cfg->snapshot_file, cur_cmd);
+        cfg->snapshot_chip_size = 2 * SIZE_MEGA;
+        cur_cmd[0] = '\0';
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        if (cur_cmd[0] && strcmp(cur_cmd, "restore") != 0) {
+          cfg->snapshot_chip_size = get_int(cur_cmd);
+          cur_cmd[0] = '\0';
+          get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        }
+        cfg->snapshot_restore = (strcmp(cur_cmd, "restore") == 0) ? 1 : 0;
+        printf("[CFG] Enabled snapshots to %s (%d KB Chip RAM)%s.\n", cfg->snapshot_file, cfg->snapshot_chip_size / SIZE_KILO,
+               cfg->snapshot_restore ? ", restoring at startup" : "");
+        break;
+      case CONFITEM_DEBUGGER:
+        cfg->debugger_port = 1234;
+        get_next_string(parse_line, cur_cmd, &str_pos, ' ');
+        if (cur_cmd[0])
+          cfg->debugger_port = get_int(cur_cmd);
+        printf("[CFG] Enabled gdb remote debugging on port %d.\n", cfg->debugger_port);
+        break;
       case CONFITEM_PLATFORM: {
         char platform_name[128], platform_sub[128];
         memset(platform_name, 0x00, 128);
@@ -417,8 +497,12 @@ struct emulator_config *load_config_file(char *filename) {
   load_failed:;
   if (cfg) {
     for (int i = 0; i < MAX_NUM_MAPPED_ITEMS; i++) {
-      if (cfg->map_data[i])
-        free(cfg->map_data[i]);
+      if (cfg->map_data[i]) {
+        if (cfg->map_type[i] == MAPTYPE_RAM)
+          free_mapped_ram(cfg->map_data[i], cfg->map_size[i]);
+        else
+          free(cfg->map_data[i]);
+      }
       cfg->map_data[i] = NULL;
     }
     free(cfg);
@@ -3,6 +3,7 @@
 
 #include "m68k.h"
 
+#include <stdio.h>
 #include <unistd.h>
 
 #define MAX_NUM_MAPPED_ITEMS 8
@@ -40,6 +41,12 @@ typedef enum {
   CONFITEM_PLATFORM,
   CONFITEM_SETVAR,
   CONFITEM_KBFILE,
+  CONFITEM_FPU,
+  CONFITEM_IDLESLEEP,
+  CONFITEM_PROFILE,
+  CONFITEM_TRACE,
+  CONFITEM_SNAPSHOT,
+  CONFITEM_DEBUGGER,
   CONFITEM_NUM,
 } config_items;
 
@@ -53,6 +60,7 @@ typedef enum {
 
 struct emulator_config {
   unsigned int cpu_type;
+  unsigned int fpu_mode;
 
   unsigned char map_type[MAX_NUM_MAPPED_ITEMS];
   unsigned long map_offset[MAX_NUM_MAPPED_ITEMS];
@@ -71,6 +79,16 @@ struct emulator_config {
   unsigned char mouse_enabled, mouse_autoconnect, keyboard_enabled, keyboard_grab, keyboard_autoconnect;
 
   unsigned int loop_cycles;
+  unsigned int idle_sleep;
+  unsigned char idle_sleep_set;
+  char *profile_file;
+  unsigned int profile_interval;
+  char *trace_file;
+  unsigned int trace_size;
+  char *snapshot_file;
+  unsigned int snapshot_chip_size;
+  unsigned char snapshot_restore;
+  unsigned int debugger_port;
   unsigned int mapped_low, mapped_high;
   unsigned int custom_low, custom_high;
 };
@@ -89,6 +107,8 @@ struct platform_config {
   void (*handle_reset)(struct emulator_config *cfg);
   void (*shutdown)(struct emulator_config *cfg);
   void (*setvar)(struct emulator_config *cfg, char *var, char *val);
+  int (*save_state)(struct emulator_config *cfg, FILE *out);
+  int (*load_state)(struct emulator_config *cfg, FILE *in);
 };
 
 unsigned int get_m68k_cpu_type(char *name);
@@ -99,5 +119,7 @@ int handle_mapped_write(struct emulator_config *cfg, unsigned int addr, unsigned
 int get_named_mapped_item(struct emulator_config *cfg, char *name);
 int get_mapped_item_by_address(struct emulator_config *cfg, uint32_t address);
 unsigned int get_int(char *str);
+unsigned char *alloc_mapped_ram(unsigned int size);
+void free_mapped_ram(unsigned char *data, unsigned int size);
 
 #endif /* _CONFIG_FILE_H */
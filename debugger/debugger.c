@@ -0,0 +1,323 @@
+// Debugger behind the GDB remote stub (see gdb-remote.c).
+//
+// Nothing is checked per instruction.  Breakpoints replace the CPU core's jump
+// table slot of the opcode at their PC (see m68k_set_breakpoint()).  Watchpoints
+// on mapped RAM and ROM protect the host pages behind them, PROT_READ for writes
+// and PROT_NONE for reads.  The page fault handler notes the access, lets it
+// through and ends the timeslice, the page is protected again once the
+// instruction is done.  Watchpoints anywhere else (Chip RAM, registers, RTG)
+// are checked by the memory access functions, only while one of them is set.
+// The CPU thread stops in debugger_cpu_poll() after the timeslice ends, and
+// waits there for the stub to resume it.
+
+#include "config_file/config_file.h"
+#include "m68k.h"
+#include "snapshot/snapshot.h"
+#include "debugger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct watchpoint {
+  uint32_t addr;
+  uint32_t len;
+  int type;
+  uint8_t *host; // NULL outside of mapped memory
+};
+
+enum { RESUME_NONE, RESUME_CONTINUE, RESUME_STEP };
+
+volatile int debugger_pending;
+volatile int debugger_watch_bus;
+
+static struct emulator_config *dbg_cfg;
+static struct watchpoint watchpoints[DEBUGGER_MAX_WATCHPOINTS];
+static int num_watchpoints;
+static long page_size;
+static struct sigaction prev_segv;
+
+// Set by the fault handler, the breakpoint callback and the bus check, handled by the CPU thread.
+static volatile int watch_armed, stop_request, breakpoint_hit, rearm;
+static volatile int watch_hit = -1;
+static volatile uint32_t watch_hit_addr;
+static volatile pid_t cpu_tid;
+
+static pthread_mutex_t stop_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resume_cond = PTHREAD_COND_INITIALIZER;
+static int cpu_stopped, resume_action;
+static struct debugger_stop last_stop;
+static int stop_pipe[2] = { -1, -1 };
+
+extern uint8_t end_signal;
+void cpu_idle_wake();
+
+static uint8_t *host_address(uint32_t addr, uint32_t len) {
+  for (int i = 0; i < MAX_NUM_MAPPED_ITEMS; i++) {
+    if ((dbg_cfg->map_type[i] == MAPTYPE_RAM || dbg_cfg->map_type[i] == MAPTYPE_ROM) && dbg_cfg->map_data[i] && addr >= dbg_cfg->map_offset[i] && addr + len <= dbg_cfg->map_offset[i] + dbg_cfg->map_size[i])
+      return dbg_cfg->map_data[i] + (addr - dbg_cfg->map_offset[i]);
+  }
+  return NULL;
+}
+
+static inline uint8_t *page_of(const void *p) {
+  return (uint8_t *)((uintptr_t)p & ~(uintptr_t)(page_size - 1));
+}
+
+// Strictest protection any watchpoint on the page needs, -1 if there is none.
+static int watch_protection(uint8_t *page) {
+  int prot = -1;
+
+  for (int i = 0; i < num_watchpoints; i++) {
+    struct watchpoint *w = &watchpoints[i];
+    if (!w->host || page < page_of(w->host) || page > page_of(w->host + w->len - 1))
+      continue;
+    prot = (w->type == DEBUG_WATCH_WRITE && prot != PROT_NONE) ? PROT_READ : PROT_NONE;
+  }
+  return prot;
+}
+
+static void protect_watchpoints(int arm) {
+  debugger_watch_bus = 0;
+  for (int i = 0; i < num_watchpoints; i++) {
+    struct watchpoint *w = &watchpoints[i];
+    if (!w->host) {
+      debugger_watch_bus = arm;
+      continue;
+    }
+    for (uint8_t *page = page_of(w->host); page <= page_of(w->host + w->len - 1); page += page_size)
+      mprotect(page, page_size, arm ? watch_protection(page) : snapshot_page_protection(page));
+  }
+  watch_armed = arm;
+}
+
+static void debugger_fault(int sig, siginfo_t *info, void *context) {
+  uint8_t *addr = info->si_addr;
+  int hit = -1;
+
+  if (watch_armed && watch_protection(page_of(addr)) != -1) {
+    if (syscall(SYS_gettid) == cpu_tid) {
+      // Word and longword accesses starting a few bytes early still touch the watched bytes.
+      for (int i = 0; i < num_watchpoints && hit == -1; i++) {
+        struct watchpoint *w = &watchpoints[i];
+        if (w->host && addr + 3 >= w->host && addr < w->host + w->len)
+          hit = i;
+      }
+      if (hit != -1 && watch_hit == -1) {
+        watch_hit = hit;
+        watch_hit_addr = watchpoints[hit].addr + (addr > watchpoints[hit].host ? addr - watchpoints[hit].host : 0);
+      }
+      m68k_end_timeslice();
+    }
+    // Let this access through, the CPU thread protects the page again after the instruction.
+    snapshot_touch(page_of(addr), page_size);
+    mprotect(page_of(addr), page_size, PROT_READ | PROT_WRITE);
+    rearm = 1;
+    debugger_pending = 1;
+    return;
+  }
+
+  // Changed page tracking for snapshots, or a real crash.
+  if (prev_segv.sa_flags & SA_SIGINFO)
+    prev_segv.sa_sigaction(sig, info, context);
+  else
+    signal(sig, SIG_DFL);
+}
+
+static void debugger_breakpoint(unsigned int pc) {
+  (void)pc;
+  breakpoint_hit = 1;
+  debugger_pending = 1;
+}
+
+void debugger_bus_access(uint32_t address, uint32_t size, int write) {
+  for (int i = 0; i < num_watchpoints; i++) {
+    struct watchpoint *w = &watchpoints[i];
+    if (w->host || address + size <= w->addr || address >= w->addr + w->len)
+      continue;
+    if ((w->type == DEBUG_WATCH_WRITE && !write) || (w->type == DEBUG_WATCH_READ && write))
+      continue;
+    if (watch_hit == -1) {
+      watch_hit = i;
+      watch_hit_addr = (address > w->addr) ? address : w->addr;
+    }
+    debugger_pending = 1;
+    m68k_end_timeslice();
+    return;
+  }
+}
+
+void debugger_touch(void *data, uint32_t size) {
+  if (!watch_armed || !size)
+    return;
+
+  for (uint8_t *page = page_of(data); page <= page_of((uint8_t *)data + size - 1); page += page_size) {
+    if (watch_protection(page) != -1) {
+      mprotect(page, page_size, PROT_READ | PROT_WRITE);
+      rearm = 1;
+      debugger_pending = 1;
+    }
+  }
+}
+
+// Parks the CPU thread until the stub resumes it, single steps stop again right away.
+static void cpu_stop(struct debugger_stop *stop) {
+  struct timespec timeout;
+  int action;
+
+  for (;;) {
+    protect_watchpoints(0);
+    pthread_mutex_lock(&stop_mutex);
+    last_stop = *stop;
+    cpu_stopped = 1;
+    resume_action = RESUME_NONE;
+    if (write(stop_pipe[1], "S", 1) == -1)
+      printf("[DBG] Failed to notify the debugger: %s\n", strerror(errno));
+    while (resume_action == RESUME_NONE && !end_signal) {
+      clock_gettime(CLOCK_REALTIME, &timeout);
+      timeout.tv_nsec += 100000000;
+      if (timeout.tv_nsec >= 1000000000) {
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&resume_cond, &stop_mutex, &timeout);
+    }
+    action = resume_action;
+    cpu_stopped = 0;
+    pthread_mutex_unlock(&stop_mutex);
+
+    stop_request = breakpoint_hit = rearm = 0;
+    watch_hit = -1;
+    protect_watchpoints(num_watchpoints != 0);
+    m68k_skip_breakpoint(m68k_get_reg(NULL, M68K_REG_PC));
+    if (action != RESUME_STEP)
+      return;
+
+    m68k_execute(1);
+    memset(stop, 0, sizeof(*stop));
+    stop->reason = DEBUG_STOP_STEP;
+    if (watch_hit != -1) {
+      stop->reason = DEBUG_STOP_WATCH;
+      stop->watch_type = watchpoints[watch_hit].type;
+      stop->watch_addr = watch_hit_addr;
+    }
+  }
+}
+
+void debugger_cpu_poll(void) {
+  struct debugger_stop stop;
+
+  debugger_pending = 0;
+  cpu_tid = syscall(SYS_gettid);
+  if (rearm) {
+    rearm = 0;
+    protect_watchpoints(1);
+  }
+
+  memset(&stop, 0, sizeof(stop));
+  if (watch_hit != -1) {
+    stop.reason = DEBUG_STOP_WATCH;
+    stop.watch_type = watchpoints[watch_hit].type;
+    stop.watch_addr = watch_hit_addr;
+  }
+  else if (breakpoint_hit)
+    stop.reason = DEBUG_STOP_BREAKPOINT;
+  else if (stop_request)
+    stop.reason = DEBUG_STOP_INTERRUPT;
+
+  if (stop.reason != DEBUG_STOP_NONE)
+    cpu_stop(&stop);
+}
+
+void debugger_request_stop(void) {
+  stop_request = 1;
+  debugger_pending = 1;
+  m68k_end_timeslice();
+  cpu_idle_wake();
+}
+
+void debugger_resume(int step) {
+  pthread_mutex_lock(&stop_mutex);
+  if (cpu_stopped) {
+    resume_action = step ? RESUME_STEP : RESUME_CONTINUE;
+    pthread_cond_signal(&resume_cond);
+  }
+  pthread_mutex_unlock(&stop_mutex);
+}
+
+int debugger_stop_fd(void) {
+  return stop_pipe[0];
+}
+
+int debugger_get_stop(struct debugger_stop *stop) {
+  char c;
+  int stopped;
+
+  while (read(stop_pipe[0], &c, 1) == 1);
+  pthread_mutex_lock(&stop_mutex);
+  stopped = cpu_stopped;
+  *stop = last_stop;
+  pthread_mutex_unlock(&stop_mutex);
+  return stopped ? 0 : -1;
+}
+
+int debugger_add_watchpoint(uint32_t addr, uint32_t len, int type) {
+  if (num_watchpoints == DEBUGGER_MAX_WATCHPOINTS || !len)
+    return -1;
+
+  struct watchpoint *w = &watchpoints[num_watchpoints++];
+  w->addr = addr;
+  w->len = len;
+  w->type = type;
+  w->host = host_address(addr, len);
+  return 0;
+}
+
+int debugger_remove_watchpoint(uint32_t addr, uint32_t len, int type) {
+  for (int i = 0; i < num_watchpoints; i++) {
+    if (watchpoints[i].addr == addr && watchpoints[i].len == len && watchpoints[i].type == type) {
+      watchpoints[i] = watchpoints[--num_watchpoints];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+void debugger_clear(void) {
+  m68k_clear_breakpoints();
+  num_watchpoints = 0;
+}
+
+int debugger_init(struct emulator_config *cfg) {
+  struct sigaction sa;
+
+  if (!cfg->debugger_port)
+    return 0;
+
+  dbg_cfg = cfg;
+  page_size = sysconf(_SC_PAGESIZE);
+  if (pipe(stop_pipe) == -1 || fcntl(stop_pipe[0], F_SETFL, O_NONBLOCK) == -1) {
+    printf("[DBG] Failed to create stop notification pipe: %s\n", strerror(errno));
+    return -1;
+  }
+
+  // Installed after the snapshot one, faults that aren't on watched pages are passed on to it.
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = debugger_fault;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGSEGV, &sa, &prev_segv) == -1) {
+    printf("[DBG] Failed to install page fault handler: %s\n", strerror(errno));
+    return -1;
+  }
+
+  m68k_set_breakpoint_callback(debugger_breakpoint);
+  return gdb_remote_init(cfg, cfg->debugger_port);
+}
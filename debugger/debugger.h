@@ -0,0 +1,52 @@
+#include <stdint.h>
+
+struct emulator_config;
+
+#define DEBUGGER_MAX_WATCHPOINTS 16
+
+enum debugger_watch_type {
+  DEBUG_WATCH_WRITE,
+  DEBUG_WATCH_READ,
+  DEBUG_WATCH_ACCESS,
+};
+
+enum debugger_stop_reason {
+  DEBUG_STOP_NONE,
+  DEBUG_STOP_INTERRUPT,
+  DEBUG_STOP_BREAKPOINT,
+  DEBUG_STOP_STEP,
+  DEBUG_STOP_WATCH,
+};
+
+struct debugger_stop {
+  int reason;
+  int watch_type;
+  uint32_t watch_addr;
+};
+
+// Set when the CPU thread has to call debugger_cpu_poll() after m68k_execute() returns.
+extern volatile int debugger_pending;
+// Set while there are watchpoints outside of mapped memory, the memory access functions
+// then have to call debugger_bus_access().
+extern volatile int debugger_watch_bus;
+
+int debugger_init(struct emulator_config *cfg);
+void debugger_cpu_poll(void);
+void debugger_bus_access(uint32_t address, uint32_t size, int write);
+
+// Has to be called before the kernel writes into mapped memory, e.g. read() from a disk image,
+// a watched page would make the write fail.
+void debugger_touch(void *data, uint32_t size);
+
+// Used by the GDB remote stub.  Everything but debugger_request_stop() and debugger_resume()
+// needs the CPU thread to be stopped.  debugger_stop_fd() becomes readable when it stops,
+// debugger_get_stop() then tells why.
+void debugger_request_stop(void);
+void debugger_resume(int step);
+int debugger_stop_fd(void);
+int debugger_get_stop(struct debugger_stop *stop);
+int debugger_add_watchpoint(uint32_t addr, uint32_t len, int type);
+int debugger_remove_watchpoint(uint32_t addr, uint32_t len, int type);
+void debugger_clear(void);
+
+int gdb_remote_init(struct emulator_config *cfg, int port);
@@ -0,0 +1,382 @@
+// GDB remote protocol stub for the debugger (see debugger.c).
+//
+// Listens on localhost only, connect with "target remote localhost:<port>"
+// from an m68k gdb, over ssh port forwarding from another machine.  Connecting
+// stops the 68k, detaching or closing the connection removes all breakpoints
+// and watchpoints and lets it run on.  Registers are the 18 integer ones in
+// gdb's m68k order (d0-d7, a0-a7, sr, pc).  Memory is accessed like the 68k
+// would, including the side effects of reading chipset registers.
+
+#include "emulator.h"
+#include "config_file/config_file.h"
+#include "m68k.h"
+#include "debugger.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define GDB_PACKET_SIZE 0x1000
+#define GDB_NUM_REGS 18
+
+static int listen_fd = -1, conn_fd = -1;
+static char packet[GDB_PACKET_SIZE + 1], reply[GDB_PACKET_SIZE + 1];
+static uint8_t in_buf[256];
+static int in_pos, in_len;
+
+extern uint8_t end_signal;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static uint32_t parse_hex(const char **p) {
+  uint32_t value = 0;
+  int digit;
+
+  while ((digit = hex_value(**p)) != -1) {
+    value = (value << 4) | digit;
+    (*p)++;
+  }
+  return value;
+}
+
+static char *put_hex(char *p, uint32_t value, int bytes) {
+  for (int i = bytes * 2 - 1; i >= 0; i--)
+    *p++ = hex_digits[(value >> (i * 4)) & 0x0F];
+  *p = '\0';
+  return p;
+}
+
+// Next byte from the connection, -1 once it is closed.
+static int get_byte() {
+  if (in_pos == in_len) {
+    in_len = read(conn_fd, in_buf, sizeof(in_buf));
+    in_pos = 0;
+    if (in_len <= 0) {
+      in_len = 0;
+      return -1;
+    }
+  }
+  return in_buf[in_pos++];
+}
+
+static int send_packet(const char *data) {
+  char head[1] = { '$' }, tail[3] = { '#' };
+  uint8_t sum = 0;
+  size_t len = strlen(data);
+
+  for (size_t i = 0; i < len; i++)
+    sum += data[i];
+  tail[1] = hex_digits[sum >> 4];
+  tail[2] = hex_digits[sum & 0x0F];
+  if (write(conn_fd, head, 1) != 1 || write(conn_fd, data, len) != (ssize_t)len || write(conn_fd, tail, 3) != 3)
+    return -1;
+  return 0;
+}
+
+// Reads one packet into packet[], returns -1 when the connection is gone.  Acks are not waited for,
+// everything goes over TCP anyway.
+static int get_packet() {
+  int c, len;
+  uint8_t sum;
+
+  for (;;) {
+    while ((c = get_byte()) != '$') {
+      if (c == -1)
+        return -1;
+    }
+
+    len = 0;
+    sum = 0;
+    while ((c = get_byte()) != '#') {
+      if (c == -1)
+        return -1;
+      if (len < GDB_PACKET_SIZE)
+        packet[len++] = c;
+      sum += c;
+    }
+    packet[len] = '\0';
+
+    int hi = hex_value(get_byte()), lo = hex_value(get_byte());
+    if (hi != -1 && lo != -1 && ((hi << 4) | lo) == sum) {
+      if (write(conn_fd, "+", 1) != 1)
+        return -1;
+      return 0;
+    }
+    if (write(conn_fd, "-", 1) != 1)
+      return -1;
+  }
+}
+
+static m68k_register_t gdb_reg(int n) {
+  if (n < 16)
+    return M68K_REG_D0 + n;
+  return (n == 16) ? M68K_REG_SR : M68K_REG_PC;
+}
+
+static void stop_reply(struct debugger_stop *stop) {
+  static const char *watch_names[] = { "watch", "rwatch", "awatch" };
+
+  if (stop->reason == DEBUG_STOP_WATCH)
+    sprintf(reply, "T05%s:%x;", watch_names[stop->watch_type], stop->watch_addr);
+  else
+    sprintf(reply, "T%02x", stop->reason == DEBUG_STOP_INTERRUPT ? 2 : 5);
+}
+
+// Waits for the CPU thread to stop, returns -1 if the connection closed or the emulator is quitting.
+static int wait_stop(struct debugger_stop *stop, int watch_conn) {
+  struct pollfd fds[2] = { { debugger_stop_fd(), POLLIN, 0 }, { conn_fd, POLLIN, 0 } };
+
+  while (!end_signal) {
+    // While running gdb only sends a break (^C) to stop the target.
+    while (watch_conn && in_pos < in_len) {
+      if (in_buf[in_pos++] == 0x03)
+        debugger_request_stop();
+    }
+    if (poll(fds, watch_conn ? 2 : 1, 100) < 0 && errno != EINTR)
+      return -1;
+    if ((fds[0].revents & POLLIN) && debugger_get_stop(stop) == 0)
+      return 0;
+    if (watch_conn && (fds[1].revents & (POLLIN | POLLHUP))) {
+      if (get_byte() == -1)
+        return -1;
+      in_pos--;
+    }
+  }
+  return -1;
+}
+
+static void read_memory(const char *args) {
+  uint32_t addr = parse_hex(&args), len;
+  char *p = reply;
+
+  args++;
+  len = parse_hex(&args);
+  if (len > GDB_PACKET_SIZE / 2)
+    len = GDB_PACKET_SIZE / 2;
+  for (uint32_t i = 0; i < len; i++)
+    p = put_hex(p, m68k_read_memory_8(addr + i), 1);
+}
+
+static void write_memory(const char *args) {
+  uint32_t addr = parse_hex(&args), len;
+
+  args++;
+  len = parse_hex(&args);
+  if (*args++ != ':') {
+    strcpy(reply, "E01");
+    return;
+  }
+  for (uint32_t i = 0; i < len && args[0] && args[1]; i++, args += 2)
+    m68k_write_memory_8(addr + i, (hex_value(args[0]) << 4) | hex_value(args[1]));
+  strcpy(reply, "OK");
+}
+
+static void set_point(const char *args, int insert) {
+  int type = *args++ - '0';
+  uint32_t addr, len;
+  int ret;
+
+  args++;
+  addr = parse_hex(&args);
+  args++;
+  len = parse_hex(&args);
+
+  if (type == 0 || type == 1)
+    ret = insert ? m68k_set_breakpoint(addr) : m68k_clear_breakpoint(addr);
+  else if (type >= 2 && type <= 4)
+    ret = insert ? debugger_add_watchpoint(addr, len, type - 2 + DEBUG_WATCH_WRITE) :
+                   debugger_remove_watchpoint(addr, len, type - 2 + DEBUG_WATCH_WRITE);
+  else {
+    reply[0] = '\0';
+    return;
+  }
+  strcpy(reply, ret == 0 ? "OK" : "E01");
+}
+
+// Handles one packet while the CPU is stopped.  Returns 1 if it was resumed, -1 to close the connection.
+static int handle_packet(struct debugger_stop *stop) {
+  const char *args = packet + 1;
+  char *p = reply;
+  int n;
+
+  reply[0] = '\0';
+  switch (packet[0]) {
+    case '?':
+      stop_reply(stop);
+      break;
+    case 'g':
+      for (n = 0; n < GDB_NUM_REGS; n++)
+        p = put_hex(p, m68k_get_reg(NULL, gdb_reg(n)), 4);
+      break;
+    case 'G':
+      for (n = 0; n < GDB_NUM_REGS && strlen(args) >= 8; n++, args += 8) {
+        char word[9];
+        const char *w = word;
+        memcpy(word, args, 8);
+        word[8] = '\0';
+        m68k_set_reg(gdb_reg(n), parse_hex(&w));
+      }
+      strcpy(reply, "OK");
+      break;
+    case 'p':
+      n = parse_hex(&args);
+      if (n < GDB_NUM_REGS)
+        put_hex(reply, m68k_get_reg(NULL, gdb_reg(n)), 4);
+      else
+        strcpy(reply, "E01");
+      break;
+    case 'P':
+      n = parse_hex(&args);
+      if (n < GDB_NUM_REGS && *args++ == '=') {
+        m68k_set_reg(gdb_reg(n), parse_hex(&args));
+        strcpy(reply, "OK");
+      } else
+        strcpy(reply, "E01");
+      break;
+    case 'm':
+      read_memory(args);
+      break;
+    case 'M':
+      write_memory(args);
+      break;
+    case 'c':
+    case 's':
+      if (*args)
+        m68k_set_reg(M68K_REG_PC, parse_hex(&args));
+      debugger_resume(packet[0] == 's');
+      return 1;
+    case 'Z':
+    case 'z':
+      set_point(args, packet[0] == 'Z');
+      break;
+    case 'H':
+    case 'T':
+      strcpy(reply, "OK");
+      break;
+    case 'q':
+      if (strncmp(packet, "qSupported", 10) == 0)
+        sprintf(reply, "PacketSize=%x", GDB_PACKET_SIZE);
+      else if (strcmp(packet, "qAttached") == 0)
+        strcpy(reply, "1");
+      else if (strcmp(packet, "qC") == 0)
+        strcpy(reply, "QC1");
+      else if (strcmp(packet, "qfThreadInfo") == 0)
+        strcpy(reply, "m1");
+      else if (strcmp(packet, "qsThreadInfo") == 0)
+        strcpy(reply, "l");
+      break;
+    case 'D':
+      send_packet("OK");
+      return -1;
+    case 'k':
+      return -1;
+    default:
+      break;
+  }
+
+  if (send_packet(reply) == -1)
+    return -1;
+  return 0;
+}
+
+static void serve_connection() {
+  struct debugger_stop stop;
+  int ret;
+
+  debugger_request_stop();
+  if (wait_stop(&stop, 0) == -1)
+    return;
+
+  for (;;) {
+    if (get_packet() == -1)
+      return;
+    ret = handle_packet(&stop);
+    if (ret == -1)
+      return;
+    if (ret == 1) {
+      if (wait_stop(&stop, 1) == -1)
+        return;
+      stop_reply(&stop);
+      if (send_packet(reply) == -1)
+        return;
+    }
+  }
+}
+
+static void *gdb_remote_task(void *arg) {
+  int one = 1;
+  (void)arg;
+
+  while (!end_signal) {
+    conn_fd = accept(listen_fd, NULL, NULL);
+    if (conn_fd == -1) {
+      if (errno != EINTR)
+        usleep(100000);
+      continue;
+    }
+    setsockopt(conn_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    in_pos = in_len = 0;
+    printf("[DBG] Debugger connected, stopping the CPU.\n");
+
+    serve_connection();
+
+    debugger_clear();
+    debugger_resume(0);
+    close(conn_fd);
+    conn_fd = -1;
+    printf("[DBG] Debugger disconnected, CPU running.\n");
+  }
+  return NULL;
+}
+
+int gdb_remote_init(struct emulator_config *cfg, int port) {
+  struct sockaddr_in addr;
+  pthread_t tid;
+  int one = 1, err;
+  (void)cfg;
+
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd == -1) {
+    printf("[DBG] Failed to create debugger socket: %s\n", strerror(errno));
+    return -1;
+  }
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listen_fd, 1) == -1) {
+    printf("[DBG] Failed to listen on port %d: %s\n", port, strerror(errno));
+    close(listen_fd);
+    listen_fd = -1;
+    return -1;
+  }
+
+  err = pthread_create(&tid, NULL, &gdb_remote_task, NULL);
+  if (err != 0) {
+    printf("[DBG] Cannot create debugger thread: [%s]\n", strerror(err));
+    return -1;
+  }
+  pthread_setname_np(tid, "pistorm: gdb");
+  printf("[DBG] Waiting for gdb on localhost:%d\n", port);
+  return 0;
+}
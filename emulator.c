@@ -5,6 +5,7 @@
 
 #include "platforms/amiga/Gayle.h"
 #include "platforms/amiga/amiga-registers.h"
+#include "platforms/amiga/amiga-snapshot.h"
 #include "platforms/amiga/rtg/rtg.h"
 #include "platforms/amiga/hunk-reloc.h"
 #include "platforms/amiga/piscsi/piscsi.h"
@@ -12,10 +13,14 @@
 #include "platforms/amiga/net/pi-net.h"
 #include "platforms/amiga/net/pi-net-enums.h"
 #include "gpio/ps_protocol.h"
+#include "profiler/profiler.h"
+#include "debugger/debugger.h"
+#include "snapshot/snapshot.h"
 
 #include <assert.h>
 #include <dirent.h>
 #include <endian.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
@@ -29,6 +34,7 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #define KEY_POLL_INTERVAL_MSEC 5000
@@ -62,6 +68,8 @@ uint32_t do_disasm = 0, old_level;
 uint32_t last_irq = 8, last_last_irq = 8;
 
 uint8_t end_signal = 0;
+// Set by the first SIGINT, the CPU thread stops and exits the emulator (sigint_exit()).
+volatile sig_atomic_t sigint_received = 0;
 
 char disasm_buf[4096];
 
@@ -112,6 +120,76 @@ uint16_t irq_delay = 0;
 unsigned int amiga_reset=0, amiga_reset_last=0;
 unsigned int do_reset=0;
 
+// Idle sleep: while the 68k sits in STOP or a branch to self, the CPU thread blocks
+// until the IPL thread sees an interrupt, a host event comes in or idle_sleep_usec runs out.
+unsigned int idle_sleep_usec = 1000;
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond;
+static volatile int idle_state = 0; // 0 = running, 1 = sleeping, 2 = woken up
+static struct timespec idle_wake_time, cpu_start_time;
+uint64_t idle_sleeps = 0, idle_wakeups = 0, idle_nsec = 0, idle_wake_nsec = 0, idle_wake_max_nsec = 0;
+
+static inline uint64_t timespec_diff_ns(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1000000000ULL + b->tv_nsec - a->tv_nsec;
+}
+
+void cpu_idle_init() {
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&idle_cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+// Called from other threads whenever something happened the CPU thread should look at.
+// Costs a barrier and a load while the CPU is busy.
+void cpu_idle_wake() {
+  __sync_synchronize();
+  if (idle_state) {
+    pthread_mutex_lock(&idle_mutex);
+    if (idle_state == 1) {
+      clock_gettime(CLOCK_MONOTONIC, &idle_wake_time);
+      idle_state = 2;
+      pthread_cond_signal(&idle_cond);
+    }
+    pthread_mutex_unlock(&idle_mutex);
+  }
+}
+
+static void cpu_idle_wait() {
+  struct timespec start, deadline, now;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  deadline.tv_sec = start.tv_sec + idle_sleep_usec / 1000000;
+  deadline.tv_nsec = start.tv_nsec + (idle_sleep_usec % 1000000) * 1000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&idle_mutex);
+  idle_state = 1;
+  __sync_synchronize();
+  while (idle_state == 1 && !irq && !do_reset && !end_signal) {
+    if (pthread_cond_timedwait(&idle_cond, &idle_mutex, &deadline) == ETIMEDOUT)
+      break;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (idle_state == 2) {
+    uint64_t latency = timespec_diff_ns(&idle_wake_time, &now);
+    idle_wakeups++;
+    idle_wake_nsec += latency;
+    if (latency > idle_wake_max_nsec)
+      idle_wake_max_nsec = latency;
+  }
+  idle_state = 0;
+  pthread_mutex_unlock(&idle_mutex);
+
+  idle_sleeps++;
+  idle_nsec += timespec_diff_ns(&start, &now);
+}
+
 void *ipl_task(void *args) {
   printf("IPL thread running\n");
   uint16_t old_irq = 0;
@@ -123,6 +201,7 @@ void *ipl_task(void *args) {
     if (!(value & (1 << PIN_IPL_ZERO))) {
       irq = 1;
       old_irq = irq_delay;
+      cpu_idle_wake();
       //NOP
       M68K_END_TIMESLICE;
       NOP
@@ -152,6 +231,7 @@ void *ipl_task(void *args) {
           printf("Amiga Reset is down...\n");
           do_reset=1;
           M68K_END_TIMESLICE;
+          cpu_idle_wake();
         }
         else
         {
@@ -181,10 +261,79 @@ void *ipl_task(void *args) {
   return args;
 }
 
+// Set from the keyboard thread, the trace is started and stopped on the CPU thread.
+static volatile int itrace_toggle = 0;
+
+static void toggle_itrace() {
+#if M68K_ITRACE
+  const char *file = cfg->trace_file ? cfg->trace_file : "trace.bin";
+
+  if (m68k_itrace_active()) {
+    unsigned long long records = m68k_itrace_stop();
+    printf("[CPU] Stopped instruction trace, %llu instructions recorded to %s.\n", records, file);
+  } else if (m68k_itrace_start(file, cfg->trace_size ? cfg->trace_size : 64) == 0) {
+    printf("[CPU] Recording instruction trace to %s.\n", file);
+  } else {
+    printf("[CPU] Failed to start instruction trace to %s.\n", file);
+  }
+#else
+  printf("[CPU] Instruction trace is not available, build with M68K_ITRACE enabled.\n");
+#endif
+}
+
+// Set from the keyboard thread, snapshots are saved and restored on the CPU thread between timeslices.
+enum { SNAPSHOT_NONE, SNAPSHOT_SAVE, SNAPSHOT_RESTORE };
+static volatile int snapshot_request = SNAPSHOT_NONE;
+
+static void handle_snapshot_request() {
+  int request = snapshot_request;
+
+  snapshot_request = SNAPSHOT_NONE;
+  if (!cfg->snapshot_file) {
+    printf("[SNAP] No snapshot file configured.\n");
+    return;
+  }
+  // VRAM is saved and restored with the memory regions, before rtg_save_state()/rtg_load_state() run.
+  rtg_fifo_poll();
+  rtg_blitter_wait();
+  if (request == SNAPSHOT_SAVE) {
+    snapshot_save(cfg, cfg->snapshot_file);
+  } else {
+    // Start from a reset Amiga, the restore puts the chipset and the expansion boards back.
+    cpu_pulse_reset();
+    snapshot_restore(cfg, cfg->snapshot_file);
+  }
+}
+
+// Every m68k_execute() on the CPU thread goes through here, a stopped debugger keeps the CPU thread
+// in debugger_cpu_poll() until it resumes.
+static inline void cpu_execute(int cycles) {
+  m68k_execute(cycles);
+  if (debugger_pending)
+    debugger_cpu_poll();
+}
+
+static void write_opcode_stats() {
+#if M68K_OPCODE_STATS
+  if (m68k_opcode_stats_write("opstats.txt") == 0)
+    printf("[CPU] Wrote opcode statistics to opstats.txt\n");
+#endif
+}
+
+void sigint_exit(int sig_num);
+
 void *cpu_task() {
   m68k_pulse_reset();
+  clock_gettime(CLOCK_MONOTONIC, &cpu_start_time);
+  if (cfg->snapshot_file && cfg->snapshot_restore && access(cfg->snapshot_file, R_OK) == 0)
+    snapshot_restore(cfg, cfg->snapshot_file);
+  if (cfg->trace_file)
+    toggle_itrace();
 
 cpu_loop:
+  if (debugger_pending)
+    debugger_cpu_poll();
+
   if (mouse_hook_enabled) {
     get_mouse_status(&mouse_dx, &mouse_dy, &mouse_buttons, &mouse_extra);
   }
@@ -198,11 +347,18 @@ cpu_loop:
     printf("%.8X (%.8X)]] %s\n", m68k_get_reg(NULL, M68K_REG_PC), (m68k_get_reg(NULL, M68K_REG_PC) & 0xFFFFFF), disasm_buf);
     if (do_disasm)
       do_disasm--;
-    m68k_execute(1);
+    cpu_execute(1);
   }
   else {
-    if (cpu_emulation_running)
-      m68k_execute(loop_cycles);
+    if (cpu_emulation_running) {
+      cpu_execute(loop_cycles);
+      profiler_tick();
+      rtg_fifo_poll();
+    }
+  }
+
+  if (idle_sleep_usec && !irq && (!cpu_emulation_running || m68k_cpu_idle())) {
+    cpu_idle_wait();
   }
 
   if (irq) {
@@ -212,7 +368,7 @@ cpu_loop:
         last_last_irq = last_irq;
         M68K_SET_IRQ(last_irq);
       }
-      m68k_execute(5);
+      cpu_execute(5);
     }
     if (gayleirq && int2_enabled) {
       write16(0xdff09c, 0x8000 | (1 << 3) && last_irq != 2);
@@ -222,7 +378,7 @@ cpu_loop:
     }
     M68K_SET_IRQ(0);
     last_last_irq = 0;
-    m68k_execute(5);
+    cpu_execute(5);
   }
   /*else {
     if (last_irq != 0) {
@@ -231,6 +387,14 @@ cpu_loop:
       last_irq = 0;
     }
   }*/
+  if (itrace_toggle) {
+    itrace_toggle = 0;
+    toggle_itrace();
+  }
+
+  if (snapshot_request)
+    handle_snapshot_request();
+
   if (do_reset) {
     cpu_pulse_reset();
     m68k_pulse_reset();
@@ -257,12 +421,20 @@ cpu_loop:
     mouse_extra = 0x00;
   }
 
-  if (end_signal)
+  if (end_signal || sigint_received)
 	  goto stop_cpu_emulation;
 
   goto cpu_loop;
 
 stop_cpu_emulation:
+  profiler_dump();
+  write_opcode_stats();
+#if M68K_ITRACE
+  if (m68k_itrace_active())
+    toggle_itrace();
+#endif
+  if (sigint_received)
+    sigint_exit(sigint_received);
   printf("[CPU] End of CPU thread\n");
   return (void *)NULL;
 }
@@ -299,6 +471,8 @@ key_loop:
     goto key_loop;
   }
 
+  cpu_idle_wake();
+
   while (get_key_char(&c, &c_code, &c_type)) {
     if (c && c == cfg->keyboard_toggle_key && !kb_hook_enabled) {
       kb_hook_enabled = 1;
@@ -351,8 +525,23 @@ key_loop:
       if (c == 'q') {
         printf("Quitting and exiting emulator.\n");
 	      end_signal = 1;
+        cpu_idle_wake();
         goto key_end;
       }
+      if (c == 'p') {
+        profiler_request_dump();
+      }
+      if (c == 't') {
+        itrace_toggle = 1;
+      }
+      if (c == 'w') {
+        snapshot_request = SNAPSHOT_SAVE;
+        M68K_END_TIMESLICE;
+      }
+      if (c == 'l') {
+        snapshot_request = SNAPSHOT_RESTORE;
+        M68K_END_TIMESLICE;
+      }
       if (c == 'd') {
         realtime_disassembly ^= 1;
         do_disasm = 1;
@@ -406,11 +595,7 @@ void stop_cpu_emulation(uint8_t disasm_cur) {
 unsigned int ovl;
 static volatile unsigned char maprom;
 
-void sigint_handler(int sig_num) {
-  //if (sig_num) { }
-  //cpu_emulation_running = 0;
-
-  //return;
+void sigint_exit(int sig_num) {
   printf("Received sigint %d, exiting.\n", sig_num);
   if (mouse_fd != -1)
     close(mouse_fd);
@@ -423,10 +608,28 @@ void sigint_handler(int sig_num) {
 
   printf("IRQs triggered: %lld\n", trig_irq);
   printf("IRQs serviced: %lld\n", serv_irq);
+  if (idle_sleeps) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("CPU thread idle: %.1f%% of run time in %llu sleeps, %llu wakeups, wake latency avg %llu usec max %llu usec\n",
+           idle_nsec * 100.0 / timespec_diff_ns(&cpu_start_time, &now), (unsigned long long)idle_sleeps,
+           (unsigned long long)idle_wakeups, (unsigned long long)(idle_wakeups ? idle_wake_nsec / idle_wakeups / 1000 : 0),
+           (unsigned long long)(idle_wake_max_nsec / 1000));
+  }
 
   exit(0);
 }
 
+// The profile and the opcode counters are written by the CPU thread on its way out, which then calls
+// sigint_exit().  A second SIGINT exits from here, in case the CPU thread doesn't get there.
+void sigint_handler(int sig_num) {
+  if (!sigint_received) {
+    sigint_received = sig_num;
+    return;
+  }
+  sigint_exit(sig_num);
+}
+
 int main(int argc, char *argv[]) {
   int g;
   //const struct sched_param priority = {99};
@@ -481,6 +684,7 @@ int main(int argc, char *argv[]) {
   if (cfg) {
     if (cfg->cpu_type) cpu_type = cfg->cpu_type;
     if (cfg->loop_cycles) loop_cycles = cfg->loop_cycles;
+    if (cfg->idle_sleep_set) idle_sleep_usec = cfg->idle_sleep;
 
     if (!cfg->platform)
       cfg->platform = make_platform_config("none", "generic");
@@ -569,7 +773,12 @@ int main(int argc, char *argv[]) {
   m68k_init();
   printf("Setting CPU type to %d.\n", cpu_type);
   m68k_set_cpu_type(cpu_type);
+  m68k_set_fpu_mode(cfg->fpu_mode);
   cpu_pulse_reset();
+  cpu_idle_init();
+  profiler_init(cfg, cpu_type);
+  snapshot_init(cfg);
+  debugger_init(cfg);
 
   pthread_t ipl_tid, cpu_tid, kbd_tid;
   int err;
@@ -671,6 +880,9 @@ void cdtv_dmac_write(uint32_t address, uint32_t value, uint8_t type);
   }
 
 unsigned int m68k_read_memory_8(unsigned int address) {
+  if (debugger_watch_bus)
+    debugger_bus_access(address, 1, 0);
+
   PLATFORM_CHECK_READ(OP_TYPE_BYTE);
 
   /*if (address >= 0xE90000 && address < 0xF00000) {
@@ -733,6 +945,9 @@ unsigned int m68k_read_memory_8(unsigned int address) {
 }
 
 unsigned int m68k_read_memory_16(unsigned int address) {
+  if (debugger_watch_bus)
+    debugger_bus_access(address, 2, 0);
+
   PLATFORM_CHECK_READ(OP_TYPE_WORD);
 
   /*if (m68k_get_reg(NULL, M68K_REG_PC) >= 0x080032F0 && m68k_get_reg(NULL, M68K_REG_PC) <= 0x080032F0 + 0x4000) {
@@ -783,6 +998,9 @@ unsigned int m68k_read_memory_16(unsigned int address) {
 }
 
 unsigned int m68k_read_memory_32(unsigned int address) {
+  if (debugger_watch_bus)
+    debugger_bus_access(address, 4, 0);
+
   PLATFORM_CHECK_READ(OP_TYPE_LONGWORD);
 
   /*if (m68k_get_reg(NULL, M68K_REG_PC) >= 0x080032F0 && m68k_get_reg(NULL, M68K_REG_PC) <= 0x080032F0 + 0x4000) {
@@ -841,6 +1059,9 @@ unsigned int m68k_read_memory_32(unsigned int address) {
   }
 
 void m68k_write_memory_8(unsigned int address, unsigned int value) {
+  if (debugger_watch_bus)
+    debugger_bus_access(address, 1, 1);
+
   PLATFORM_CHECK_WRITE(OP_TYPE_BYTE);
 
   /*if (address >= 0xE90000 && address < 0xF00000) {
@@ -861,11 +1082,15 @@ void m68k_write_memory_8(unsigned int address, unsigned int value) {
   if (address & 0xFF000000)
     return;
 
+  amiga_shadow_cia_write(address, value);
   write8((uint32_t)address, value);
   return;
 }
 
 void m68k_write_memory_16(unsigned int address, unsigned int value) {
+  if (debugger_watch_bus)
+    debugger_bus_access(address, 2, 1);
+
   PLATFORM_CHECK_WRITE(OP_TYPE_WORD);
 
   /*if (address >= 0xE90000 && address < 0xF00000) {
@@ -899,11 +1124,15 @@ void m68k_write_memory_16(unsigned int address, unsigned int value) {
   if (address & 0x01)
     printf("Unaligned WORD write!\n");
 
+  amiga_shadow_custom_write(address, value);
   write16((uint32_t)address, value);
   return;
 }
 
 void m68k_write_memory_32(unsigned int address, unsigned int value) {
+  if (debugger_watch_bus)
+    debugger_bus_access(address, 4, 1);
+
   PLATFORM_CHECK_WRITE(OP_TYPE_LONGWORD);
 
   /*if (address >= 0xE90000 && address < 0xF00000) {
@@ -920,6 +1149,8 @@ void m68k_write_memory_32(unsigned int address, unsigned int value) {
   if (address & 0x01)
     printf("Unaligned LONGWORD write!\n");
 
+  amiga_shadow_custom_write(address, value >> 16);
+  amiga_shadow_custom_write(address + 2, value & 0xFFFF);
   write16(address, value >> 16);
   write16(address + 2, value);
   return;
@@ -0,0 +1,166 @@
+// fpkerneltest - checks the softfloat transcendental kernels against the
+// generic float128 reference and benchmarks both.
+//
+// build_fpkerneltest.sh compiles softfloat/fsincos.c and softfloat/fyl2x.c
+// a second time with SOFTFLOAT_GENERIC_POLY and every exported symbol
+// prefixed with ref_, which gives the plain softfloat implementation the
+// streamlined polynomial code has to match bit for bit.
+//
+// The comparison walks every exponent (both signs, denormals, infinities
+// and NaNs included) with a set of edge and random mantissas, then a dense
+// random sweep of the range the FPU actually sees, in all four rounding
+// modes, and checks results and exception flags.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "m68kcpu.h"
+
+floatx80 ref_floatx80_flognp1(floatx80 a);
+floatx80 ref_floatx80_flogn(floatx80 a);
+floatx80 ref_floatx80_flog2(floatx80 a);
+floatx80 ref_floatx80_flog10(floatx80 a);
+int ref_floatx80_fsin(floatx80 *a);
+int ref_floatx80_fcos(floatx80 *a);
+int ref_floatx80_ftan(floatx80 *a);
+
+#define EDGE_MANTISSAS 8
+#define BENCH_SAMPLES 100000
+
+struct kernel {
+  const char *name;
+  int fn;
+};
+
+static struct kernel kernels[] = {
+  { "FSIN", 0 },
+  { "FCOS", 1 },
+  { "FTAN", 2 },
+  { "FLOGN", 3 },
+  { "FLOGNP1", 4 },
+  { "FLOG2", 5 },
+  { "FLOG10", 6 },
+};
+
+static const int8 rounding_modes[] = {
+  float_round_nearest_even, float_round_to_zero, float_round_down, float_round_up
+};
+
+static const uint64 edge_mantissas[EDGE_MANTISSAS] = {
+  U64(0x8000000000000000), U64(0xffffffffffffffff), U64(0x8000000000000001), U64(0xc90fdaa22168c234),
+  U64(0xb504f333f9de6484), U64(0xaaaaaaaaaaaaaaaa), U64(0x0000000000000001), U64(0x4000000000000000),
+};
+
+static uint64 rng_state = U64(0x9e3779b97f4a7c15);
+
+static uint64 rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static floatx80 run(int fn, int ref, floatx80 a) {
+  switch (fn) {
+    case 0: ref ? ref_floatx80_fsin(&a) : floatx80_fsin(&a); return a;
+    case 1: ref ? ref_floatx80_fcos(&a) : floatx80_fcos(&a); return a;
+    case 2: ref ? ref_floatx80_ftan(&a) : floatx80_ftan(&a); return a;
+    case 3: return ref ? ref_floatx80_flogn(a) : floatx80_flogn(a);
+    case 4: return ref ? ref_floatx80_flognp1(a) : floatx80_flognp1(a);
+    case 5: return ref ? ref_floatx80_flog2(a) : floatx80_flog2(a);
+    case 6: return ref ? ref_floatx80_flog10(a) : floatx80_flog10(a);
+  }
+  return a;
+}
+
+static unsigned long long checked, mismatches;
+
+static void compare(int fn, floatx80 a) {
+  floatx80 r, s;
+  int8 rflags, sflags;
+
+  float_exception_flags = 0;
+  r = run(fn, 1, a);
+  rflags = float_exception_flags;
+  float_exception_flags = 0;
+  s = run(fn, 0, a);
+  sflags = float_exception_flags;
+  checked++;
+
+  if (r.high != s.high || r.low != s.low || rflags != sflags) {
+    if (mismatches++ < 10) {
+      printf("  %s(%04X.%016llX) rm %d: ref %04X.%016llX/%02X new %04X.%016llX/%02X\n",
+             kernels[fn].name, a.high, (unsigned long long)a.low, float_rounding_mode,
+             r.high, (unsigned long long)r.low, rflags, s.high, (unsigned long long)s.low, sflags);
+    }
+  }
+}
+
+static double elapsed_ns(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+  int random_mantissas = (argc > 1) ? atoi(argv[1]) : 8;
+  int dense = (argc > 2) ? atoi(argv[2]) : 1000000;
+  static floatx80 bench_in[BENCH_SAMPLES];
+  struct timespec t0, t1, t2;
+
+  printf("Comparing against the generic softfloat kernels, %d random mantissas per exponent, %d dense samples.\n",
+         random_mantissas, dense);
+
+  for (unsigned int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    unsigned long long before = mismatches;
+    checked = 0;
+
+    for (unsigned int m = 0; m < sizeof(rounding_modes); m++) {
+      float_rounding_mode = rounding_modes[m];
+
+      for (int exp = 0; exp <= 0xffff; exp++) {
+        floatx80 a;
+        a.high = exp;
+        for (int i = 0; i < EDGE_MANTISSAS + random_mantissas; i++) {
+          a.low = (i < EDGE_MANTISSAS) ? edge_mantissas[i] : (rng() | (exp & 0x7fff ? U64(0x8000000000000000) : 0));
+          compare(k, a);
+        }
+      }
+
+      // the range the kernels are built for
+      for (int i = 0; i < dense / 4; i++) {
+        floatx80 a;
+        a.high = (rng() & 0x8000) | (0x3fc0 + rng() % 0x50);
+        a.low = rng() | U64(0x8000000000000000);
+        compare(k, a);
+      }
+    }
+
+    printf("%-8s %12llu values, %llu mismatches\n", kernels[k].name, checked, mismatches - before);
+  }
+
+  float_rounding_mode = float_round_nearest_even;
+  float_exception_flags = 0;
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    bench_in[i].high = 0x3ff0 + rng() % 0x10;
+    bench_in[i].low = rng() | U64(0x8000000000000000);
+  }
+
+  printf("\n%-8s %12s %12s %8s\n", "kernel", "ref ns/op", "new ns/op", "speedup");
+  for (unsigned int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    volatile uint64 sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+      sink += run(k, 1, bench_in[i]).low;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+      sink += run(k, 0, bench_in[i]).low;
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    double ns_ref = elapsed_ns(&t0, &t1) / BENCH_SAMPLES;
+    double ns_new = elapsed_ns(&t1, &t2) / BENCH_SAMPLES;
+    printf("%-8s %12.1f %12.1f %7.2fx\n", kernels[k].name, ns_ref, ns_new, ns_ref / ns_new);
+  }
+
+  return mismatches ? 1 : 0;
+}
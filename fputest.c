@@ -0,0 +1,129 @@
+// fputest - accuracy and speed report for the "fpu fast" mode.
+//
+// Runs every opcode that has a fast kernel in m68kfpu_fast.h over random
+// operands, compares against the exact softfloat result and prints the
+// worst relative error (and the number of mantissa bits it still gets
+// right) together with the time per operation of both paths.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "m68kcpu.h"
+#include "m68kfpu_fast.h"
+
+#define SAMPLES 200000
+
+struct fpu_op {
+  int opmode;
+  const char *name;
+  double lo, hi;
+};
+
+// The trig ranges stay inside +-0.5, below the point where softfloat's
+// fsincos.c starts its argument reduction, so only the kernels are compared.
+static struct fpu_op ops[] = {
+  { 0x04, "FSQRT",   0.0,    1e6 },
+  { 0x06, "FLOGNP1", -0.99,  1e3 },
+  { 0x0e, "FSIN",    -0.49,  0.49 },
+  { 0x0f, "FTAN",    -0.49,  0.49 },
+  { 0x14, "FLOGN",   1e-6,   1e6 },
+  { 0x15, "FLOG10",  1e-6,   1e6 },
+  { 0x16, "FLOG2",   1e-6,   1e6 },
+  { 0x1d, "FCOS",    -0.49,  0.49 },
+  { 0x20, "FDIV",    -1e6,   1e6 },
+  { 0x22, "FADD",    -1e6,   1e6 },
+  { 0x23, "FMUL",    -1e6,   1e6 },
+  { 0x28, "FSUB",    -1e6,   1e6 },
+};
+
+static floatx80 src[SAMPLES], dst[SAMPLES], exact[SAMPLES], fast[SAMPLES];
+
+static floatx80 exact_op(int opmode, floatx80 d, floatx80 s) {
+  switch (opmode) {
+    case 0x04: return floatx80_sqrt(s);
+    case 0x06: return floatx80_flognp1(s);
+    case 0x0e: floatx80_fsin(&s); return s;
+    case 0x0f: floatx80_ftan(&s); return s;
+    case 0x14: return floatx80_flogn(s);
+    case 0x15: return floatx80_flog10(s);
+    case 0x16: return floatx80_flog2(s);
+    case 0x1d: floatx80_fcos(&s); return s;
+    case 0x20: return floatx80_div(d, s);
+    case 0x22: return floatx80_add(d, s);
+    case 0x23: return floatx80_mul(d, s);
+    case 0x28: return floatx80_sub(d, s);
+  }
+  return s;
+}
+
+// Random value in [lo, hi) with a full 64 bit mantissa, so the inputs
+// themselves are not representable as doubles.
+static floatx80 random_x80(double lo, double hi) {
+  floatx80 r = fpu_fast_from_double(lo + (hi - lo) * ((double)rand() / RAND_MAX));
+  if ((r.high & 0x7fff) != 0)
+    r.low |= (uint64)(rand() & 0x7ff);
+  return r;
+}
+
+static double elapsed_ns(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+  struct timespec t0, t1, t2;
+  int samples = (argc > 1) ? atoi(argv[1]) : SAMPLES;
+
+  if (samples <= 0 || samples > SAMPLES)
+    samples = SAMPLES;
+
+  float_rounding_mode = float_round_nearest_even;
+  floatx80_rounding_precision = 80;
+
+  printf("%-8s %14s %10s %12s %12s %8s\n", "op", "max rel err", "good bits", "exact ns/op", "fast ns/op", "speedup");
+
+  for (unsigned int i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+    struct fpu_op *op = &ops[i];
+    double max_err = 0.0;
+
+    srand(1234 + i);
+    for (int n = 0; n < samples; n++) {
+      src[n] = random_x80(op->lo, op->hi);
+      dst[n] = random_x80(op->lo, op->hi);
+      // keep the divisor away from zero
+      if (op->opmode == 0x20 && fabs(fpu_fast_to_double(src[n])) < 1e-3)
+        src[n] = fpu_fast_from_double(1.0);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int n = 0; n < samples; n++)
+      exact[n] = exact_op(op->opmode, dst[n], src[n]);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (int n = 0; n < samples; n++) {
+      fast[n] = dst[n];
+      fpu_fast_op(op->opmode, &fast[n], src[n], 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    for (int n = 0; n < samples; n++) {
+      double e = fabs(fpu_fast_to_double(exact[n]));
+      double diff = fabs(fpu_fast_to_double(floatx80_sub(fast[n], exact[n])));
+      double err;
+
+      if (e == 0.0)
+        err = diff;
+      else
+        err = diff / e;
+      if (err > max_err)
+        max_err = err;
+    }
+
+    double ns_exact = elapsed_ns(&t0, &t1) / samples;
+    double ns_fast = elapsed_ns(&t1, &t2) / samples;
+    printf("%-8s %14.3e %10.1f %12.1f %12.1f %7.1fx\n", op->name, max_err,
+           (max_err > 0.0) ? -log2(max_err) : 64.0, ns_exact, ns_fast, ns_exact / ns_fast);
+  }
+
+  return 0;
+}
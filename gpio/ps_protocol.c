@@ -115,6 +115,47 @@ void ps_write_16(unsigned int address, unsigned int data) {
     ;
 }
 
+// Writes size bytes of big endian words to the bus, e.g. to restore Chip RAM.
+// The data pins stay outputs for the whole block and the data register is only
+// written when the word differs from the one before, which mostly zeroed
+// memory benefits from.
+void ps_write_block_16(unsigned int address, const uint8_t *data, unsigned int size) {
+  unsigned int last = 0x10000;
+
+  *(gpio + 0) = GPFSEL0_OUTPUT;
+  *(gpio + 1) = GPFSEL1_OUTPUT;
+  *(gpio + 2) = GPFSEL2_OUTPUT;
+
+  for (unsigned int i = 0; i + 1 < size; i += 2, address += 2) {
+    unsigned int word = (data[i] << 8) | data[i + 1];
+
+    if (word != last) {
+      *(gpio + 7) = (word << 8) | (REG_DATA << PIN_A0);
+      *(gpio + 7) = 1 << PIN_WR;
+      *(gpio + 10) = 1 << PIN_WR;
+      *(gpio + 10) = 0xffffec;
+      last = word;
+    }
+
+    *(gpio + 7) = ((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0);
+    *(gpio + 7) = 1 << PIN_WR;
+    *(gpio + 10) = 1 << PIN_WR;
+    *(gpio + 10) = 0xffffec;
+
+    *(gpio + 7) = ((0x0000 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0);
+    *(gpio + 7) = 1 << PIN_WR;
+    *(gpio + 10) = 1 << PIN_WR;
+    *(gpio + 10) = 0xffffec;
+
+    while (*(gpio + 13) & (1 << PIN_TXN_IN_PROGRESS))
+      ;
+  }
+
+  *(gpio + 0) = GPFSEL0_INPUT;
+  *(gpio + 1) = GPFSEL1_INPUT;
+  *(gpio + 2) = GPFSEL2_INPUT;
+}
+
 void ps_write_8(unsigned int address, unsigned int data) {
   if ((address & 1) == 0)
     data = data + (data << 8);  // EVEN, A0=0,UDS
@@ -6,6 +6,8 @@
 #ifndef _PS_PROTOCOL_H
 #define _PS_PROTOCOL_H
 
+#include <stdint.h>
+
 #define PIN_TXN_IN_PROGRESS 0
 #define PIN_IPL_ZERO 1
 #define PIN_A0 2
@@ -68,6 +70,7 @@ unsigned int ps_read_32(unsigned int address);
 void ps_write_8(unsigned int address, unsigned int data);
 void ps_write_16(unsigned int address, unsigned int data);
 void ps_write_32(unsigned int address, unsigned int data);
+void ps_write_block_16(unsigned int address, const uint8_t *data, unsigned int size);
 
 unsigned int ps_read_status_reg();
 void ps_write_status_reg(unsigned int value);
@@ -315,6 +315,57 @@ void m68k_set_instr_hook_callback(void  (*callback)(unsigned int pc));
  */
 void m68k_set_cpu_type(unsigned int cpu_type);
 
+/* Select how FPU arithmetic is done.  M68K_FPU_EXACT (default) uses
+ * softfloat 80-bit extended precision for everything, M68K_FPU_FAST does
+ * the common arithmetic and transcendental ops with host doubles.
+ */
+enum
+{
+	M68K_FPU_EXACT,
+	M68K_FPU_FAST
+};
+void m68k_set_fpu_mode(unsigned int mode);
+
+/* Returns nonzero if the CPU can't make progress until the next interrupt:
+ * it is sitting in STOP, or the last timeslice ran into a branch to self
+ * (the hint is cleared by this call).
+ */
+int m68k_cpu_idle(void);
+
+/* Opcode statistics, only available when built with M68K_OPCODE_STATS.
+ * m68k_opcode_stats_write() writes the counters collected so far as a
+ * plain text report sorted by execution count, returns 0 on success.
+ */
+void m68k_opcode_stats_reset(void);
+int m68k_opcode_stats_write(const char *filename);
+
+/* Binary instruction trace, only available when built with M68K_ITRACE.
+ * m68k_itrace_start() records every instruction m68k_execute() runs from
+ * now on into a ring of size_mb megabytes mmap'd from filename (see
+ * m68ktrace.h, decode it with m68ktrace), returns 0 on success.
+ * m68k_itrace_stop() closes the file and returns the number of records
+ * written.  Both must be called from the thread that runs m68k_execute().
+ */
+int m68k_itrace_start(const char *filename, unsigned int size_mb);
+unsigned long long m68k_itrace_stop(void);
+int m68k_itrace_active(void);
+
+/* Breakpoints, at most M68K_MAX_BREAKPOINTS.  The CPU stops in front of the
+ * instruction at pc: m68k_execute() returns right away and the callback is
+ * called with pc.  The opcode at pc is read again before every timeslice, so
+ * code loaded or changed there later is caught as well.  That costs one read
+ * per breakpoint and timeslice while any are set, over the bus for code that
+ * isn't in host memory.  m68k_skip_breakpoint() lets the next
+ * instruction run if it is at pc, to resume from a breakpoint.  Only call
+ * these from the thread that runs m68k_execute(), or while it is stopped.
+ */
+#define M68K_MAX_BREAKPOINTS 64
+int m68k_set_breakpoint(unsigned int pc);
+int m68k_clear_breakpoint(unsigned int pc);
+void m68k_clear_breakpoints(void);
+void m68k_skip_breakpoint(unsigned int pc);
+void m68k_set_breakpoint_callback(void (*callback)(unsigned int pc));
+
 /* Do whatever initialisations the core requires.  Should be called
  * at least once at init time.
  */
@@ -373,6 +424,12 @@ unsigned int m68k_get_context(void* dst);
 /* set the current cpu context */
 void m68k_set_context(void* dst);
 
+/* Set the current cpu context from one saved by an earlier run of the same
+ * binary (e.g. a snapshot file).  Host pointers in it are not used and the
+ * interrupt inputs start out released.
+ */
+void m68k_restore_context(void* src);
+
 /* Register the CPU state information */
 void m68k_state_register(const char *type, int index);
 
@@ -267,6 +267,18 @@ void m68ki_build_opcode_table(void)
 			m68ki_cycles[k][ostruct->match] = ostruct->cycles[k];
 		ostruct++;
 	}
+
+#if M68K_FUSE_INSTRUCTIONS && !M68K_OPCODE_STATS
+	/* Superinstructions generated from m68k_fuse.txt, if there was one */
+	for(i = 0; m68ki_fused_handler_table[i].opcode_handler; i++)
+	{
+		for(j = 0; j < 0x10000; j++)
+		{
+			if(m68ki_instruction_jump_table[j] == m68ki_fused_handler_table[i].opcode_handler)
+				m68ki_instruction_jump_table[j] = m68ki_fused_handler_table[i].fused_handler;
+		}
+	}
+#endif
 }
 
 
@@ -3179,9 +3191,12 @@ M68KMAKE_OP(bra, 8, ., .)
 {
 	m68ki_trace_t0();				   /* auto-disable (see m68kcpu.h) */
 	m68ki_branch_8(MASK_OUT_ABOVE_8(REG_IR));
-// TODO: review this...
-//	if(REG_PC == REG_PPC)
-//		USE_ALL_CYCLES();
+	if(REG_PC == REG_PPC)
+	{
+		/* Branch to self, only an interrupt gets us out of here */
+		m68ki_cpu.idle_hint = 1;
+		USE_ALL_CYCLES();
+	}
 }
 
 
@@ -3191,9 +3206,11 @@ M68KMAKE_OP(bra, 16, ., .)
 	REG_PC -= 2;
 	m68ki_trace_t0();			   /* auto-disable (see m68kcpu.h) */
 	m68ki_branch_16(offset);
-// TODO: review this...
-//	if(REG_PC == REG_PPC)
-//		USE_ALL_CYCLES();
+	if(REG_PC == REG_PPC)
+	{
+		m68ki_cpu.idle_hint = 1;
+		USE_ALL_CYCLES();
+	}
 }
 
 
@@ -4514,6 +4531,8 @@ M68KMAKE_OP(dbf, 16, ., .)
 		m68ki_trace_t0();			   /* auto-disable (see m68kcpu.h) */
 		m68ki_branch_16(offset);
 		USE_CYCLES(CYC_DBCC_F_NOEXP);
+		if(offset == 0xfffc)
+			m68ki_dbf_bulk(r_dst);	/* one word loop body */
 		return;
 	}
 	REG_PC += 2;
@@ -7098,6 +7117,7 @@ M68KMAKE_OP(movec, 32, rc, .)
 					{
 						m68ki_cpu.pmmu_enabled = 0;
 					}
+					pmmu_tlb_flush();
 					return;
 				}
 				m68ki_exception_illegal();
@@ -7106,6 +7126,7 @@ M68KMAKE_OP(movec, 32, rc, .)
 				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
 				{
 					m68ki_cpu.mmu_itt0 = REG_DA[(word2 >> 12) & 15];
+					pmmu_tlb_flush();
 					return;
 				}
 				m68ki_exception_illegal();
@@ -7114,6 +7135,7 @@ M68KMAKE_OP(movec, 32, rc, .)
 				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
 				{
 					m68ki_cpu.mmu_itt1 = REG_DA[(word2 >> 12) & 15];
+					pmmu_tlb_flush();
 					return;
 				}
 				m68ki_exception_illegal();
@@ -7122,6 +7144,7 @@ M68KMAKE_OP(movec, 32, rc, .)
 				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
 				{
 					m68ki_cpu.mmu_dtt0 = REG_DA[(word2 >> 12) & 15];
+					pmmu_tlb_flush();
 					return;
 				}
 				m68ki_exception_illegal();
@@ -7130,6 +7153,7 @@ M68KMAKE_OP(movec, 32, rc, .)
 				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
 				{
 					m68ki_cpu.mmu_dtt1 = REG_DA[(word2 >> 12) & 15];
+					pmmu_tlb_flush();
 					return;
 				}
 				m68ki_exception_illegal();
@@ -7146,6 +7170,7 @@ M68KMAKE_OP(movec, 32, rc, .)
 				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
 				{
 					m68ki_cpu.mmu_urp_aptr = REG_DA[(word2 >> 12) & 15];
+					pmmu_tlb_flush();
 					return;
 				}
 				m68ki_exception_illegal();
@@ -7154,6 +7179,7 @@ M68KMAKE_OP(movec, 32, rc, .)
 				if (CPU_TYPE_IS_040_PLUS(CPU_TYPE))
 				{
 					m68ki_cpu.mmu_srp_aptr = REG_DA[(word2 >> 12) & 15];
+					pmmu_tlb_flush();
 					return;
 				}
 				m68ki_exception_illegal();
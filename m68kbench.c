@@ -0,0 +1,459 @@
+// m68kbench - benchmarks the Musashi CPU core without the PiStorm hardware.
+//
+// Links m68kcpu.c/m68kops.c against a flat 16 MB big endian RAM instead of
+// the GPIO bus and runs the built-in kernels below, or 68k binaries given on
+// the command line, on every CPU type the config file knows about.  For each
+// one it reports the instruction rate (MIPS) and emulated 68k cycles per
+// second, so core optimizations can be compared on any Linux box:
+//
+//   make bench CFLAGS="-O3 -I."        (drop the Pi specific flags on x86)
+//
+// A benchmark is loaded at $4000 and started in supervisor mode with the
+// stack at $80000.  It ends by executing STOP (or a branch to itself).  The
+// instruction count is measured once per CPU type by single stepping, the
+// timed runs then execute in normal timeslices like the emulator does.
+// Every exception vector points at a STOP too, a benchmark that takes one
+// (e.g. an FPU instruction on a CPU without FPU) is reported as failed.
+//
+// usage: m68kbench [-c cpu] [-r runs] [-n] [file.bin ...]
+//   -c  only benchmark one CPU type, e.g. 68030
+//   -r  timed runs per benchmark, the fastest one is reported (default 3)
+//   -n  don't map the RAM as a Musashi fast range, so every access goes
+//       through the m68k_read/write_memory_* callbacks
+//
+// Built with make bench OPSTATS=1 it also writes opstats.txt, whose [pair]
+// section is where the instruction pairs in m68k_fuse.txt come from.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "m68k.h"
+#include "m68kcpu.h"
+
+#define MEM_SIZE (16 * 1024 * 1024)
+#define LOAD_ADDRESS 0x4000
+#define EXCEPTION_ADDRESS 0x3000
+#define STACK_ADDRESS 0x80000
+#define TIMESLICE 300
+#define TIMEOUT_SEC 60
+
+// Same names and order as cpu_types[] in config_file.c
+static const char *cpu_names[] = {
+  "68000", "68010", "68EC020", "68020", "68EC030", "68030", "68EC040", "68LC040", "68040", "SCC68070",
+};
+
+// The host mapped range tables normally live in emulator.c.
+unsigned char read_ranges;
+unsigned int read_addr[8];
+unsigned int read_upper[8];
+unsigned char *read_data[8];
+unsigned char write_ranges;
+unsigned int write_addr[8];
+unsigned int write_upper[8];
+unsigned char *write_data[8];
+
+static uint8_t *mem;
+
+unsigned int m68k_read_memory_8(unsigned int address) {
+  return mem[address & (MEM_SIZE - 1)];
+}
+
+unsigned int m68k_read_memory_16(unsigned int address) {
+  address &= MEM_SIZE - 2;
+  return (mem[address] << 8) | mem[address + 1];
+}
+
+unsigned int m68k_read_memory_32(unsigned int address) {
+  return (m68k_read_memory_16(address) << 16) | m68k_read_memory_16(address + 2);
+}
+
+void m68k_write_memory_8(unsigned int address, unsigned int value) {
+  mem[address & (MEM_SIZE - 1)] = value;
+}
+
+void m68k_write_memory_16(unsigned int address, unsigned int value) {
+  address &= MEM_SIZE - 2;
+  mem[address] = value >> 8;
+  mem[address + 1] = value;
+}
+
+void m68k_write_memory_32(unsigned int address, unsigned int value) {
+  m68k_write_memory_16(address, value >> 16);
+  m68k_write_memory_16(address + 2, value);
+}
+
+void cpu_pulse_reset(void) {
+}
+
+int cpu_irq_ack(int level) {
+  return level;
+}
+
+static const uint16_t bench_memcpy[] = {
+  0x2E3C, 0x0000, 0x07D0,                  // move.l  #2000, D7
+  // pass:
+  0x41F9, 0x0010, 0x0000,                  // lea     $100000, A0
+  0x43F9, 0x0011, 0x0000,                  // lea     $110000, A1
+  0x303C, 0x03FF,                          // move.w  #1023, D0
+  // copy:
+  0x22D8,                                  // move.l  (A0)+, (A1)+
+  0x51C8, 0xFFFC,                          // dbra    D0, copy
+  0x5387,                                  // subq.l  #1, D7
+  0x66E6,                                  // bne.s   pass
+  0x4E72, 0x2700,                          // stop    #$2700
+};
+
+static const uint16_t bench_sieve[] = {
+  0x2E3C, 0x0000, 0x0028,                  // move.l  #40, D7
+  // pass:
+  0x41F9, 0x0010, 0x0000,                  // lea     $100000, A0
+  0x303C, 0x1FFD,                          // move.w  #8189, D0
+  // fill:
+  0x10FC, 0x0001,                          // move.b  #1, (A0)+
+  0x51C8, 0xFFFA,                          // dbra    D0, fill
+  0x7400,                                  // moveq   #0, D2
+  0x7600,                                  // moveq   #0, D3
+  0x41F9, 0x0010, 0x0000,                  // lea     $100000, A0
+  // outer:
+  0x4A30, 0x3000,                          // tst.b   (0,A0,D3.w)
+  0x671A,                                  // beq.s   next
+  0x3803,                                  // move.w  D3, D4
+  0xD844,                                  // add.w   D4, D4
+  0x5644,                                  // addq.w  #3, D4
+  0x3A03,                                  // move.w  D3, D5
+  0xDA44,                                  // add.w   D4, D5
+  // inner:
+  0xBA7C, 0x1FFE,                          // cmp.w   #8190, D5
+  0x6C08,                                  // bge.s   found
+  0x4230, 0x5000,                          // clr.b   (0,A0,D5.w)
+  0xDA44,                                  // add.w   D4, D5
+  0x60F2,                                  // bra.s   inner
+  // found:
+  0x5242,                                  // addq.w  #1, D2
+  // next:
+  0x5243,                                  // addq.w  #1, D3
+  0xB67C, 0x1FFE,                          // cmp.w   #8190, D3
+  0x6DD8,                                  // blt.s   outer
+  0x5387,                                  // subq.l  #1, D7
+  0x66B8,                                  // bne.s   pass
+  0x4E72, 0x2700,                          // stop    #$2700
+};
+
+static const uint16_t bench_integer[] = {
+  0x2E3C, 0x0000, 0x0190,                  // move.l  #400, D7
+  // pass:
+  0x7000,                                  // moveq   #0, D0
+  0x3C3C, 0x00FF,                          // move.w  #255, D6
+  // body:
+  0x2206,                                  // move.l  D6, D1
+  0xC2FC, 0x000D,                          // mulu.w  #13, D1
+  0xD081,                                  // add.l   D1, D0
+  0x2400,                                  // move.l  D0, D2
+  0x84FC, 0x0007,                          // divu.w  #7, D2
+  0x4842,                                  // swap    D2
+  0x0242, 0x0003,                          // andi.w  #3, D2
+  0xE5A8,                                  // lsl.l   D2, D0
+  0xB380,                                  // eor.l   D1, D0
+  0x6100, 0x000E,                          // bsr.w   func
+  0x51CE, 0xFFE2,                          // dbra    D6, body
+  0x5387,                                  // subq.l  #1, D7
+  0x66D6,                                  // bne.s   pass
+  0x4E72, 0x2700,                          // stop    #$2700
+  // func:
+  0x48E7, 0x6000,                          // movem.l D1-D2, -(A7)
+  0x41F9, 0x0010, 0x0000,                  // lea     $100000, A0
+  0x43F9, 0x0010, 0x0100,                  // lea     $100100, A1
+  0x720F,                                  // moveq   #15, D1
+  // cmp:
+  0xB308,                                  // cmpm.b  (A0)+, (A1)+
+  0x56C9, 0xFFFC,                          // dbne    D1, cmp
+  0x4CDF, 0x0006,                          // movem.l (A7)+, D1-D2
+  0x4E75,                                  // rts
+};
+
+static const uint16_t bench_fpu[] = {
+  0x2E3C, 0x0000, 0x00C8,                  // move.l  #200, D7
+  0xF23C, 0x4000, 0x0000, 0x0001,          // fmove.l #1, FP0
+  0xF23C, 0x4080, 0x0000, 0x0003,          // fmove.l #3, FP1
+  // pass:
+  0x3C3C, 0x00FF,                          // move.w  #255, D6
+  // body:
+  0xF200, 0x0422,                          // fadd.x  FP1, FP0
+  0xF200, 0x0423,                          // fmul.x  FP1, FP0
+  0xF200, 0x0420,                          // fdiv.x  FP1, FP0
+  0xF200, 0x0420,                          // fdiv.x  FP1, FP0
+  0xF200, 0x0104,                          // fsqrt.x FP0, FP2
+  0xF200, 0x098E,                          // fsin.x  FP2, FP3
+  0xF200, 0x0994,                          // flogn.x FP2, FP3
+  0x51CE, 0xFFE2,                          // dbra    D6, body
+  0x5387,                                  // subq.l  #1, D7
+  0x66D8,                                  // bne.s   pass
+  0x4E72, 0x2700,                          // stop    #$2700
+};
+
+// The memcpy loop over 64 pages (32 source, 32 destination) with the PMMU on.  The kernels build
+// identity mapped 4K page tables for the low 4 MB at $90000 first, so every access is translated.
+static const uint16_t bench_pmmu030[] = {
+  0x41F9, 0x0009, 0x1000,                  // lea     $91000, A0
+  0x7001,                                  // moveq   #1, D0
+  0x323C, 0x03FF,                          // move.w  #1023, D1
+  // page:
+  0x20C0,                                  // move.l  D0, (A0)+
+  0xD0BC, 0x0000, 0x1000,                  // add.l   #$1000, D0
+  0x51C9, 0xFFF6,                          // dbra    D1, page
+  0x23FC, 0x0009, 0x1002, 0x0009, 0x0000,  // move.l  #$91002, $90000
+  0x41F9, 0x0008, 0xF000,                  // lea     $8F000, A0
+  0x20BC, 0x7FFF, 0x0002,                  // move.l  #$7FFF0002, (A0)
+  0x217C, 0x0009, 0x0000, 0x0004,          // move.l  #$90000, 4(A0)
+  0xF010, 0x4C00,                          // pmove   (A0), CRP
+  0x20BC, 0x80C0, 0xAA00,                  // move.l  #$80C0AA00, (A0)
+  0xF010, 0x4000,                          // pmove   (A0), TC
+  0x2E3C, 0x0000, 0x0040,                  // move.l  #64, D7
+  // pass:
+  0x41F9, 0x0010, 0x0000,                  // lea     $100000, A0
+  0x43F9, 0x0012, 0x0000,                  // lea     $120000, A1
+  0x303C, 0x7FFF,                          // move.w  #32767, D0
+  // copy:
+  0x22D8,                                  // move.l  (A0)+, (A1)+
+  0x51C8, 0xFFFC,                          // dbra    D0, copy
+  0x5387,                                  // subq.l  #1, D7
+  0x66E6,                                  // bne.s   pass
+  0x4E72, 0x2700,                          // stop    #$2700
+};
+
+static const uint16_t bench_pmmu040[] = {
+  0x41F9, 0x0009, 0x1000,                  // lea     $91000, A0
+  0x7001,                                  // moveq   #1, D0
+  0x323C, 0x03FF,                          // move.w  #1023, D1
+  // page:
+  0x20C0,                                  // move.l  D0, (A0)+
+  0xD0BC, 0x0000, 0x1000,                  // add.l   #$1000, D0
+  0x51C9, 0xFFF6,                          // dbra    D1, page
+  0x41F9, 0x0009, 0x0200,                  // lea     $90200, A0
+  0x203C, 0x0009, 0x1002,                  // move.l  #$91002, D0
+  0x720F,                                  // moveq   #15, D1
+  // pointer:
+  0x20C0,                                  // move.l  D0, (A0)+
+  0xD0BC, 0x0000, 0x0100,                  // add.l   #$100, D0
+  0x51C9, 0xFFF6,                          // dbra    D1, pointer
+  0x23FC, 0x0009, 0x0202, 0x0009, 0x0000,  // move.l  #$90202, $90000
+  0x203C, 0x0009, 0x0000,                  // move.l  #$90000, D0
+  0x4E7B, 0x0806,                          // movec   D0, URP
+  0x4E7B, 0x0807,                          // movec   D0, SRP
+  0x203C, 0x0000, 0x8000,                  // move.l  #$8000, D0
+  0x4E7B, 0x0003,                          // movec   D0, TC
+  0x2E3C, 0x0000, 0x0040,                  // move.l  #64, D7
+  // pass:
+  0x41F9, 0x0010, 0x0000,                  // lea     $100000, A0
+  0x43F9, 0x0012, 0x0000,                  // lea     $120000, A1
+  0x303C, 0x7FFF,                          // move.w  #32767, D0
+  // copy:
+  0x22D8,                                  // move.l  (A0)+, (A1)+
+  0x51C8, 0xFFFC,                          // dbra    D0, copy
+  0x5387,                                  // subq.l  #1, D7
+  0x66E6,                                  // bne.s   pass
+  0x4E72, 0x2700,                          // stop    #$2700
+};
+
+struct benchmark {
+  const char *name;
+  const uint16_t *code;
+  unsigned int words;
+  uint8_t *file;
+  size_t file_size;
+  int needs_fpu;
+  int needs_pmmu;                          // 30 or 40, the PMMU the kernel programs
+};
+
+#define KERNEL(n, fpu, pmmu) { #n, bench_##n, sizeof(bench_##n) / sizeof(uint16_t), NULL, 0, fpu, pmmu }
+
+static struct benchmark kernels[] = {
+  KERNEL(memcpy, 0, 0),
+  KERNEL(sieve, 0, 0),
+  KERNEL(integer, 0, 0),
+  KERNEL(fpu, 1, 0),
+  KERNEL(pmmu030, 0, 30),
+  KERNEL(pmmu040, 0, 40),
+};
+
+static double elapsed_sec(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static void load_benchmark(struct benchmark *b) {
+  memset(mem, 0x00, MEM_SIZE);
+  for (unsigned int vector = 2; vector < 256; vector++)
+    m68k_write_memory_32(vector * 4, EXCEPTION_ADDRESS);
+  m68k_write_memory_16(EXCEPTION_ADDRESS, 0x4E72);
+  m68k_write_memory_16(EXCEPTION_ADDRESS + 2, 0x2700);
+  if (b->file) {
+    memcpy(mem + LOAD_ADDRESS, b->file, b->file_size);
+  } else {
+    for (unsigned int i = 0; i < b->words; i++)
+      m68k_write_memory_16(LOAD_ADDRESS + i * 2, b->code[i]);
+  }
+
+  m68k_pulse_reset();
+  m68k_set_reg(M68K_REG_A7, STACK_ADDRESS);
+  m68k_set_reg(M68K_REG_PC, LOAD_ADDRESS);
+  // burn the reset cycles here so they don't show up as an instruction
+  m68k_execute(0);
+}
+
+// Runs a benchmark to its STOP, single stepping if instructions is non-NULL.
+// Returns the run time in seconds, -1 on timeout or -2 if it took an exception.
+static double run_benchmark(struct benchmark *b, uint64_t *instructions, uint64_t *cycles) {
+  struct timespec start, now;
+  uint64_t slices = 0;
+
+  load_benchmark(b);
+  *cycles = 0;
+  if (instructions)
+    *instructions = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (!m68k_cpu_idle()) {
+    if (instructions) {
+      *cycles += m68k_execute(1);
+      (*instructions)++;
+    } else {
+      *cycles += m68k_execute(TIMESLICE);
+    }
+
+    if ((++slices & 0xFFFF) == 0) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (elapsed_sec(&start, &now) > TIMEOUT_SEC)
+        return -1;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  if (m68k_get_reg(NULL, M68K_REG_PC) == EXCEPTION_ADDRESS + 4)
+    return -2;
+  return elapsed_sec(&start, &now);
+}
+
+static int load_file(struct benchmark *b, char *filename) {
+  FILE *in = fopen(filename, "rb");
+  long size;
+
+  if (!in) {
+    printf("Can't open %s.\n", filename);
+    return -1;
+  }
+  fseek(in, 0, SEEK_END);
+  size = ftell(in);
+  fseek(in, 0, SEEK_SET);
+  if (size <= 0 || size > STACK_ADDRESS - LOAD_ADDRESS) {
+    printf("%s doesn't fit between $%X and the stack.\n", filename, LOAD_ADDRESS);
+    fclose(in);
+    return -1;
+  }
+
+  memset(b, 0x00, sizeof(*b));
+  b->name = filename;
+  b->file = malloc(size);
+  b->file_size = size;
+  if (!b->file || fread(b->file, size, 1, in) != 1) {
+    printf("Can't read %s.\n", filename);
+    fclose(in);
+    return -1;
+  }
+  fclose(in);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  struct benchmark *benchmarks = kernels;
+  int num_benchmarks = sizeof(kernels) / sizeof(kernels[0]);
+  int num_cpus = sizeof(cpu_names) / sizeof(cpu_names[0]);
+  int only_cpu = -1, runs = 3, fast_ranges = 1, num_files = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      i++;
+      for (int c = 0; c < num_cpus; c++) {
+        if (strcmp(argv[i], cpu_names[c]) == 0)
+          only_cpu = c;
+      }
+      if (only_cpu == -1) {
+        printf("Unknown CPU type %s.\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+      if (runs < 1)
+        runs = 1;
+    } else if (strcmp(argv[i], "-n") == 0) {
+      fast_ranges = 0;
+    } else if (argv[i][0] == '-') {
+      printf("usage: %s [-c cpu] [-r runs] [-n] [file.bin ...]\n", argv[0]);
+      return 1;
+    } else {
+      if (!num_files)
+        benchmarks = calloc(argc, sizeof(struct benchmark));
+      if (!benchmarks || load_file(&benchmarks[num_files], argv[i]) != 0)
+        return 1;
+      num_files++;
+    }
+  }
+  if (num_files)
+    num_benchmarks = num_files;
+
+  mem = calloc(1, MEM_SIZE);
+  if (!mem) {
+    printf("Failed to allocate memory for the 68k RAM.\n");
+    return 1;
+  }
+
+  m68k_init();
+  if (fast_ranges)
+    m68k_add_ram_range(0, MEM_SIZE, mem);
+
+  printf("\n%-12s %-9s %14s %9s %9s %10s\n", "benchmark", "cpu", "instructions", "seconds", "MIPS", "Mcycles/s");
+  for (int n = 0; n < num_benchmarks; n++) {
+    struct benchmark *b = &benchmarks[n];
+
+    for (int c = 0; c < num_cpus; c++) {
+      uint64_t instructions, cycles;
+      double best = -1;
+
+      if (only_cpu != -1 && c != only_cpu)
+        continue;
+
+      m68k_set_cpu_type(c + 1);
+      if (b->needs_fpu && !m68ki_cpu.has_fpu) {
+        printf("%-12s %-9s %14s\n", b->name, cpu_names[c], "no FPU");
+        continue;
+      }
+      if (b->needs_pmmu && (!m68ki_cpu.has_pmmu ||
+                            (b->needs_pmmu == 40) != !!CPU_TYPE_IS_040_PLUS(m68ki_cpu.cpu_type))) {
+        printf("%-12s %-9s %14s\n", b->name, cpu_names[c], (b->needs_pmmu == 40) ? "no 040 PMMU" : "no 030 PMMU");
+        continue;
+      }
+
+      best = run_benchmark(b, &instructions, &cycles);
+      for (int r = 0; r < runs && best >= 0; r++) {
+        double t = run_benchmark(b, NULL, &cycles);
+        if (r == 0 || t < best)
+          best = t;
+      }
+      if (best < 0) {
+        printf("%-12s %-9s %14s\n", b->name, cpu_names[c], (best == -1) ? "timeout" : "exception");
+        continue;
+      }
+
+      printf("%-12s %-9s %14llu %9.3f %9.2f %10.2f\n", b->name, cpu_names[c], (unsigned long long)instructions,
+             best, instructions / best / 1e6, cycles / best / 1e6);
+    }
+  }
+
+#if M68K_OPCODE_STATS
+  if (m68k_opcode_stats_write("opstats.txt") == 0)
+    printf("\nWrote opcode statistics to opstats.txt\n");
+#endif
+
+  return 0;
+}
@@ -188,6 +188,57 @@
 #define M68K_EMULATE_PMMU   OPT_ON
 
 
+/* If ON, count how often each opcode is executed and time one out of every
+ * 1 << M68K_OPCODE_STATS_TIME_SHIFT instructions, for the report written by
+ * m68k_opcode_stats_write().  Build with "make OPSTATS=1" to turn it on.
+ */
+#ifndef M68K_OPCODE_STATS
+#define M68K_OPCODE_STATS           OPT_OFF
+#endif
+#define M68K_OPCODE_STATS_TIME      OPT_ON
+#define M68K_OPCODE_STATS_TIME_SHIFT 8
+
+/* If ON, m68k_itrace_start() can record every executed instruction with its
+ * changed registers and memory accesses into a binary ring file (see
+ * m68ktrace.h).  While no trace is running this costs one test per
+ * instruction and memory access.
+ */
+#ifndef M68K_ITRACE
+#define M68K_ITRACE                 OPT_ON
+#endif
+
+/* If ON, install the fused handlers m68kmake generated for the instruction
+ * pairs listed in m68k_fuse.txt.  Not used in M68K_OPCODE_STATS builds, which
+ * have to see every instruction on its own.
+ */
+#ifndef M68K_FUSE_INSTRUCTIONS
+#define M68K_FUSE_INSTRUCTIONS      OPT_ON
+#endif
+
+/* If ON, add/sub/cmp handlers leave V and C to be computed when they are
+ * read (see m68ki_lazy_vc()).  Build with "make LAZYFLAGS=1" to turn it on.
+ */
+#ifndef M68K_LAZY_FLAGS
+#define M68K_LAZY_FLAGS             OPT_OFF
+#endif
+
+/* If ON, dbf loops around a single move.x (Ay)+,(Ax)+ or clr.x (Ay)+ over
+ * mapped RAM/ROM ranges are run as one memmove/memset per timeslice (see
+ * m68ki_dbf_bulk()).  Not used in M68K_OPCODE_STATS builds either.
+ */
+#ifndef M68K_BULK_LOOPS
+#define M68K_BULK_LOOPS             OPT_ON
+#endif
+
+/* If ON, instruction fetches keep a host pointer to the mapped range (or with
+ * the PMMU on, the page) the PC is in, so sequential fetches don't look the
+ * PC up again (see m68ki_fetch_ptr()).
+ */
+#ifndef M68K_HOST_FETCH
+#define M68K_HOST_FETCH             OPT_ON
+#endif
+
+
 /* ----------------------------- COMPATIBILITY ---------------------------- */
 
 /* The following options set optimizations that violate the current ANSI
@@ -51,6 +51,21 @@ extern void m68ki_build_opcode_table(void);
 #include "m68kfpu.c"
 #include "m68kmmu.h" // uses some functions from m68kfpu.c which are static !
 
+#include <stddef.h>
+
+#if M68K_OPCODE_STATS
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#endif
+
+#if M68K_ITRACE
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 /* ======================================================================== */
 /* ================================= DATA ================================= */
 /* ======================================================================== */
@@ -635,7 +650,8 @@ unsigned int m68k_get_reg(void* context, m68k_register_t regnum)
 		case M68K_REG_A6:	return cpu->dar[14];
 		case M68K_REG_A7:	return cpu->dar[15];
 		case M68K_REG_PC:	return MASK_OUT_ABOVE_32(cpu->pc);
-		case M68K_REG_SR:	return	cpu->t1_flag					|
+		case M68K_REG_SR:	m68ki_lazy_flags_resolve(cpu);
+							return	cpu->t1_flag					|
 									cpu->t0_flag							|
 									(cpu->s_flag << 11)					|
 									(cpu->m_flag << 11)					|
@@ -953,14 +969,695 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 	}
 }
 
+void m68k_set_fpu_mode(unsigned int mode)
+{
+	m68ki_cpu.fpu_fast = (mode == M68K_FPU_FAST);
+}
+
+int m68k_cpu_idle(void)
+{
+	int idle = (CPU_STOPPED & STOP_LEVEL_STOP) || m68ki_cpu.idle_hint;
+
+	m68ki_cpu.idle_hint = 0;
+	return idle;
+}
+
 uint m68k_get_address_mask() {
 	return m68ki_cpu.address_mask;
 }
 
+#if M68K_OPCODE_STATS
+
+static uint64 m68ki_opcode_count[0x10000];  /* executions per jump table slot */
+static uint64 m68ki_opcode_ns[0x10000];     /* wall time of the timed executions */
+static uint   m68ki_opcode_timed[0x10000];  /* number of timed executions */
+static uint   m68ki_opcode_sample;
+
+/* Consecutive opcode pairs, the input for choosing superinstructions (see m68k_fuse.txt) */
+#define M68K_OPCODE_PAIR_SLOTS 0x40000
+#define M68K_OPCODE_PAIR_PROBES 32
+
+typedef struct
+{
+	uint key;    /* previous opcode << 16 | opcode */
+	uint used;
+	uint64 count;
+} m68ki_opcode_pair_slot;
+
+static m68ki_opcode_pair_slot m68ki_opcode_pairs[M68K_OPCODE_PAIR_SLOTS];
+static uint64 m68ki_opcode_pairs_dropped;
+static uint   m68ki_opcode_prev;
+
+static inline void m68ki_opcode_pair_add(uint key)
+{
+	uint hash = (key * 0x9e3779b1) >> 14;
+	int i;
+
+	for(i = 0; i < M68K_OPCODE_PAIR_PROBES; i++)
+	{
+		m68ki_opcode_pair_slot *slot = &m68ki_opcode_pairs[(hash + i) & (M68K_OPCODE_PAIR_SLOTS - 1)];
+		if(slot->key == key && slot->used)
+		{
+			slot->count++;
+			return;
+		}
+		if(!slot->used)
+		{
+			slot->key = key;
+			slot->used = 1;
+			slot->count = 1;
+			return;
+		}
+	}
+	m68ki_opcode_pairs_dropped++;
+}
+
+/* Run the handler for REG_IR, timing one call out of every 1 << M68K_OPCODE_STATS_TIME_SHIFT */
+static inline void m68ki_opcode_stats_dispatch(void)
+{
+	uint ir = REG_IR;
+
+	m68ki_opcode_count[ir]++;
+	m68ki_opcode_pair_add((m68ki_opcode_prev << 16) | ir);
+	m68ki_opcode_prev = ir;
+#if M68K_OPCODE_STATS_TIME
+	if((++m68ki_opcode_sample & ((1 << M68K_OPCODE_STATS_TIME_SHIFT) - 1)) == 0)
+	{
+		struct timespec t0, t1;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		m68ki_instruction_jump_table[ir]();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		m68ki_opcode_ns[ir] += (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+		m68ki_opcode_timed[ir]++;
+		return;
+	}
+#endif
+	m68ki_instruction_jump_table[ir]();
+}
+
+typedef struct
+{
+	const char *name;
+	uint64 count;
+	double ns;
+} m68ki_opcode_stat;
+
+/* Highest count first, ties broken by name so the report is stable */
+static int m68ki_opcode_stat_compare(const void *a, const void *b)
+{
+	const m68ki_opcode_stat *sa = a, *sb = b;
+
+	if(sa->count != sb->count)
+		return (sa->count < sb->count) ? 1 : -1;
+	return strcmp(sa->name, sb->name);
+}
+
+static int m68ki_opcode_info_compare(const void *a, const void *b)
+{
+	uintptr_t ha = (uintptr_t)(*(const m68ki_opcode_info_struct * const *)a)->opcode_handler;
+	uintptr_t hb = (uintptr_t)(*(const m68ki_opcode_info_struct * const *)b)->opcode_handler;
+
+	return (ha > hb) - (ha < hb);
+}
+
+static void m68ki_opcode_stat_add(m68ki_opcode_stat *list, int *length, const char *name, uint64 count, double ns)
+{
+	int i;
+
+	for(i = 0; i < *length; i++)
+	{
+		if(strcmp(list[i].name, name) == 0)
+			break;
+	}
+	if(i == *length)
+	{
+		list[i].name = name;
+		list[i].count = 0;
+		list[i].ns = 0;
+		(*length)++;
+	}
+	list[i].count += count;
+	list[i].ns += ns;
+}
+
+static void m68ki_opcode_stat_print(FILE *out, const char *title, m68ki_opcode_stat *list, int length, int max_lines, uint64 total, double total_ns)
+{
+	int i;
+
+	qsort(list, length, sizeof(list[0]), m68ki_opcode_stat_compare);
+	fprintf(out, "\n[%s]\n%-28s %14s %8s %8s %8s\n", title, "name", "count", "count%", "time%", "ns/op");
+	for(i = 0; i < length && i < max_lines && list[i].count; i++)
+	{
+		fprintf(out, "%-28s %14llu %8.3f %8.3f %8.1f\n", list[i].name, (unsigned long long)list[i].count,
+			list[i].count * 100.0 / total, total_ns ? list[i].ns * 100.0 / total_ns : 0.0,
+			list[i].count ? list[i].ns / list[i].count : 0.0);
+	}
+}
+
+/* Cost of the clock_gettime() pair around a timed handler, subtracted from every sample */
+static double m68ki_opcode_timer_overhead(void)
+{
+	struct timespec t0, t1;
+	uint64 ns, best = ~0ULL;
+	int i;
+
+	for(i = 0; i < 1000; i++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+		if(ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+void m68k_opcode_stats_reset(void)
+{
+	memset(m68ki_opcode_count, 0, sizeof(m68ki_opcode_count));
+	memset(m68ki_opcode_ns, 0, sizeof(m68ki_opcode_ns));
+	memset(m68ki_opcode_timed, 0, sizeof(m68ki_opcode_timed));
+	memset(m68ki_opcode_pairs, 0, sizeof(m68ki_opcode_pairs));
+	m68ki_opcode_pairs_dropped = 0;
+}
+
+typedef struct
+{
+	uint64 key;  /* first handler index * number of handlers + second handler index */
+	uint64 count;
+} m68ki_handler_pair;
+
+static int m68ki_handler_pair_compare_key(const void *a, const void *b)
+{
+	const m68ki_handler_pair *pa = a, *pb = b;
+
+	return (pa->key > pb->key) - (pa->key < pb->key);
+}
+
+static int m68ki_handler_pair_compare_count(const void *a, const void *b)
+{
+	const m68ki_handler_pair *pa = a, *pb = b;
+
+	if(pa->count != pb->count)
+		return (pa->count < pb->count) ? 1 : -1;
+	return m68ki_handler_pair_compare_key(a, b);
+}
+
+/* Sum up the opcode pairs per pair of handlers and print the busiest ones */
+static void m68ki_opcode_pair_print(FILE *out, const m68ki_opcode_info_struct **sorted, const int *opcode_index, int num_handlers, int max_lines, uint64 total)
+{
+	m68ki_handler_pair *pairs;
+	int i, num_pairs = 0, merged = 0;
+
+	pairs = malloc(M68K_OPCODE_PAIR_SLOTS * sizeof(*pairs));
+	if(!pairs)
+		return;
+
+	for(i = 0; i < M68K_OPCODE_PAIR_SLOTS; i++)
+	{
+		const m68ki_opcode_pair_slot *slot = &m68ki_opcode_pairs[i];
+		if(!slot->used)
+			continue;
+		pairs[num_pairs].key = (uint64)opcode_index[slot->key >> 16] * num_handlers + opcode_index[slot->key & 0xffff];
+		pairs[num_pairs].count = slot->count;
+		num_pairs++;
+	}
+
+	qsort(pairs, num_pairs, sizeof(*pairs), m68ki_handler_pair_compare_key);
+	for(i = 0; i < num_pairs; i++)
+	{
+		if(merged && pairs[merged - 1].key == pairs[i].key)
+			pairs[merged - 1].count += pairs[i].count;
+		else
+			pairs[merged++] = pairs[i];
+	}
+	qsort(pairs, merged, sizeof(*pairs), m68ki_handler_pair_compare_count);
+
+	fprintf(out, "\n[pair top%d]\n%-20s %-20s %14s %8s\n", max_lines, "first", "second", "count", "count%");
+	for(i = 0; i < merged && i < max_lines; i++)
+	{
+		fprintf(out, "%-20s %-20s %14llu %8.3f\n", sorted[pairs[i].key / num_handlers]->name,
+			sorted[pairs[i].key % num_handlers]->name, (unsigned long long)pairs[i].count,
+			pairs[i].count * 100.0 / total);
+	}
+
+	free(pairs);
+}
+
+/* Report layout (version 2): a header with the totals, then one section per
+ * grouping - handler, mnemonic, addressing mode and the 256 busiest opcode
+ * words - each sorted by count.  Time is the measured ns/op of the timed
+ * samples times the execution count, so it is an estimate.  The last section
+ * lists the 256 most frequent pairs of consecutive handlers.
+ */
+int m68k_opcode_stats_write(const char *filename)
+{
+	static const m68ki_opcode_info_struct unknown = {0, "unknown", "unknown", 0, ""};
+	const m68ki_opcode_info_struct **sorted;
+	m68ki_opcode_stat *handlers, *mnemonics, *modes, *opcodes;
+	char (*opcode_names)[48];
+	int *opcode_index;
+	int num_info, num_mnemonics = 0, num_modes = 0, num_opcodes = 0;
+	uint64 total = 0, timed = 0;
+	double total_ns = 0, overhead = m68ki_opcode_timer_overhead();
+	FILE *out;
+	int i;
+
+	for(num_info = 0; m68ki_opcode_info_table[num_info].opcode_handler; num_info++)
+		;
+
+	/* one extra slot for opcodes whose handler isn't in the table */
+	sorted = malloc((num_info + 1) * sizeof(*sorted));
+	handlers = malloc((num_info + 1) * sizeof(*handlers));
+	mnemonics = malloc((num_info + 1) * sizeof(*mnemonics));
+	modes = malloc((num_info + 1) * sizeof(*modes));
+	opcodes = malloc(0x10000 * sizeof(*opcodes));
+	opcode_names = malloc(0x10000 * sizeof(*opcode_names));
+	opcode_index = malloc(0x10000 * sizeof(*opcode_index));
+	out = fopen(filename, "w");
+	if(!sorted || !handlers || !mnemonics || !modes || !opcodes || !opcode_names || !opcode_index || !out)
+	{
+		if(out)
+			fclose(out);
+		free(sorted);
+		free(handlers);
+		free(mnemonics);
+		free(modes);
+		free(opcodes);
+		free(opcode_names);
+		free(opcode_index);
+		return -1;
+	}
+
+	for(i = 0; i < num_info; i++)
+		sorted[i] = &m68ki_opcode_info_table[i];
+	qsort(sorted, num_info, sizeof(*sorted), m68ki_opcode_info_compare);
+	sorted[num_info] = &unknown;
+	for(i = 0; i <= num_info; i++)
+	{
+		handlers[i].name = sorted[i]->name;
+		handlers[i].count = 0;
+		handlers[i].ns = 0;
+	}
+
+	for(i = 0; i < 0x10000; i++)
+	{
+		const m68ki_opcode_info_struct key = {m68ki_instruction_jump_table[i], 0, 0, 0, 0};
+		const m68ki_opcode_info_struct *keyp = &key, **found;
+		int index;
+		double ns;
+
+		opcode_index[i] = num_info;
+		if(!m68ki_opcode_count[i])
+			continue;
+
+		found = bsearch(&keyp, sorted, num_info, sizeof(*sorted), m68ki_opcode_info_compare);
+		index = found ? found - sorted : num_info;
+		opcode_index[i] = index;
+		ns = 0;
+		if(m68ki_opcode_timed[i])
+		{
+			ns = (double)m68ki_opcode_ns[i] / m68ki_opcode_timed[i] - overhead;
+			ns = (ns > 0) ? ns * m68ki_opcode_count[i] : 0;
+		}
+
+		total += m68ki_opcode_count[i];
+		timed += m68ki_opcode_timed[i];
+		total_ns += ns;
+
+		handlers[index].count += m68ki_opcode_count[i];
+		handlers[index].ns += ns;
+
+		snprintf(opcode_names[num_opcodes], sizeof(opcode_names[0]), "%04x:%s", i, sorted[index]->name);
+		opcodes[num_opcodes].name = opcode_names[num_opcodes];
+		opcodes[num_opcodes].count = m68ki_opcode_count[i];
+		opcodes[num_opcodes].ns = ns;
+		num_opcodes++;
+	}
+
+	for(i = 0; i <= num_info; i++)
+	{
+		if(!handlers[i].count)
+			continue;
+		m68ki_opcode_stat_add(mnemonics, &num_mnemonics, sorted[i]->mnemonic, handlers[i].count, handlers[i].ns);
+		m68ki_opcode_stat_add(modes, &num_modes, sorted[i]->ea[0] ? sorted[i]->ea : "-", handlers[i].count, handlers[i].ns);
+	}
+
+	fprintf(out, "# m68k opcode stats v2\n");
+	fprintf(out, "instructions %llu\n", (unsigned long long)total);
+	fprintf(out, "timed %llu\n", (unsigned long long)timed);
+	fprintf(out, "timer_overhead_ns %.0f\n", overhead);
+	fprintf(out, "estimated_ns %.0f\n", total_ns);
+	fprintf(out, "pairs_dropped %llu\n", (unsigned long long)m68ki_opcode_pairs_dropped);
+	if(total)
+	{
+		m68ki_opcode_stat_print(out, "handler", handlers, num_info + 1, num_info + 1, total, total_ns);
+		m68ki_opcode_stat_print(out, "mnemonic", mnemonics, num_mnemonics, num_mnemonics, total, total_ns);
+		m68ki_opcode_stat_print(out, "ea", modes, num_modes, num_modes, total, total_ns);
+		m68ki_opcode_stat_print(out, "opcode", opcodes, num_opcodes, 256, total, total_ns);
+		m68ki_opcode_pair_print(out, sorted, opcode_index, num_info + 1, 256, total);
+	}
+
+	fclose(out);
+	free(sorted);
+	free(handlers);
+	free(mnemonics);
+	free(modes);
+	free(opcodes);
+	free(opcode_names);
+	free(opcode_index);
+	return 0;
+}
+
+#endif /* M68K_OPCODE_STATS */
+
+#if M68K_ITRACE
+
+m68ki_itrace_struct m68ki_itrace;
+
+static int m68ki_itrace_fd = -1;
+static uint8_t *m68ki_itrace_map;
+static size_t m68ki_itrace_map_size;
+static struct m68k_itrace_header *m68ki_itrace_header;
+static struct m68k_itrace_block *m68ki_itrace_block;
+
+static void m68ki_itrace_regs(uint *regs)
+{
+	memcpy(regs, REG_DA, 16 * sizeof(uint));
+	regs[16] = m68ki_get_sr();
+}
+
+static void m68ki_itrace_next_block(void)
+{
+	struct m68k_itrace_header *h = m68ki_itrace_header;
+	uint64_t seq = m68ki_itrace_block ? h->block_seq + 1 : 0;
+
+	m68ki_itrace_block = (struct m68k_itrace_block *)(m68ki_itrace_map + M68K_ITRACE_HEADER_SIZE +
+	                     (seq % h->num_blocks) * h->block_size);
+	m68ki_itrace_block->used = 0;
+	m68ki_itrace_block->records = 0;
+	m68ki_itrace_block->seq = seq;
+	h->block_seq = seq;
+}
+
+/* Append the instruction collected since m68ki_itrace_begin() to the ring */
+void m68ki_itrace_end(void)
+{
+	struct m68k_itrace_record *rec;
+	uint regs[M68K_ITRACE_NUM_REGS];
+	uint32_t *values;
+	uint8_t *p;
+	uint i, size, mask = 0, num_regs = 0;
+
+	m68ki_itrace_regs(regs);
+	for(i = 0; i < M68K_ITRACE_NUM_REGS; i++)
+		if(regs[i] != m68ki_itrace.regs[i])
+		{
+			mask |= 1 << i;
+			num_regs++;
+		}
+
+	size = sizeof(*rec) + ((m68ki_itrace.num_words * 2 + 3) & ~3) + num_regs * 4 +
+	       m68ki_itrace.num_mem * sizeof(struct m68k_itrace_mem);
+	if(sizeof(*m68ki_itrace_block) + m68ki_itrace_block->used + size > m68ki_itrace_header->block_size)
+		m68ki_itrace_next_block();
+
+	p = (uint8_t *)(m68ki_itrace_block + 1) + m68ki_itrace_block->used;
+	rec = (struct m68k_itrace_record *)p;
+	rec->pc = m68ki_itrace.pc;
+	rec->num_words = m68ki_itrace.num_words;
+	rec->num_mem = m68ki_itrace.num_mem;
+	rec->flags = m68ki_itrace.flags;
+	rec->reserved = 0;
+	rec->reg_mask = mask;
+	p += sizeof(*rec);
+
+	memcpy(p, m68ki_itrace.words, m68ki_itrace.num_words * 2);
+	if(m68ki_itrace.num_words & 1)
+		((uint16_t *)p)[m68ki_itrace.num_words] = 0;
+	p += (m68ki_itrace.num_words * 2 + 3) & ~3;
+
+	values = (uint32_t *)p;
+	for(i = 0; i < M68K_ITRACE_NUM_REGS; i++)
+		if(mask & (1 << i))
+		{
+			*values++ = regs[i];
+			m68ki_itrace.regs[i] = regs[i];
+		}
+
+	memcpy(values, m68ki_itrace.mem, m68ki_itrace.num_mem * sizeof(struct m68k_itrace_mem));
+
+	m68ki_itrace_block->used += size;
+	m68ki_itrace_block->records++;
+	m68ki_itrace_header->records++;
+
+	m68ki_itrace.num_words = 0;
+	m68ki_itrace.num_mem = 0;
+	m68ki_itrace.flags = 0;
+}
+
+int m68k_itrace_start(const char *filename, unsigned int size_mb)
+{
+	uint num_blocks = size_mb * (1024 * 1024 / M68K_ITRACE_BLOCK_SIZE);
+	struct m68k_itrace_header *h;
+
+	if(m68ki_itrace.active)
+		m68k_itrace_stop();
+	if(num_blocks < 2)
+		num_blocks = 2;
+
+	m68ki_itrace_fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(m68ki_itrace_fd == -1)
+		return -1;
+
+	m68ki_itrace_map_size = M68K_ITRACE_HEADER_SIZE + (size_t)num_blocks * M68K_ITRACE_BLOCK_SIZE;
+	if(ftruncate(m68ki_itrace_fd, m68ki_itrace_map_size) != 0)
+		goto fail;
+	m68ki_itrace_map = mmap(NULL, m68ki_itrace_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m68ki_itrace_fd, 0);
+	if(m68ki_itrace_map == MAP_FAILED)
+		goto fail;
+
+	h = m68ki_itrace_header = (struct m68k_itrace_header *)m68ki_itrace_map;
+	memcpy(h->magic, M68K_ITRACE_MAGIC, sizeof(h->magic));
+	h->version = M68K_ITRACE_VERSION;
+	h->cpu_type = m68k_get_reg(NULL, M68K_REG_CPU_TYPE);
+	h->block_size = M68K_ITRACE_BLOCK_SIZE;
+	h->num_blocks = num_blocks;
+	h->records = 0;
+	m68ki_itrace_regs(m68ki_itrace.regs);
+	memcpy(h->regs, m68ki_itrace.regs, sizeof(h->regs));
+
+	m68ki_itrace_block = NULL;
+	m68ki_itrace_next_block();
+
+	m68ki_itrace.num_words = 0;
+	m68ki_itrace.num_mem = 0;
+	m68ki_itrace.flags = 0;
+	m68ki_itrace.active = 1;
+	return 0;
+
+fail:
+	close(m68ki_itrace_fd);
+	m68ki_itrace_fd = -1;
+	return -1;
+}
+
+unsigned long long m68k_itrace_stop(void)
+{
+	unsigned long long records;
+
+	if(!m68ki_itrace.active)
+		return 0;
+
+	m68ki_itrace.active = 0;
+	records = m68ki_itrace_header->records;
+	munmap(m68ki_itrace_map, m68ki_itrace_map_size);
+	close(m68ki_itrace_fd);
+	m68ki_itrace_fd = -1;
+	m68ki_itrace_header = NULL;
+	m68ki_itrace_block = NULL;
+	return records;
+}
+
+int m68k_itrace_active(void)
+{
+	return m68ki_itrace.active;
+}
+
+#endif /* M68K_ITRACE */
+
+/* Breakpoints.  Arming one replaces the jump table slot of the opcode found at
+ * its PC with m68ki_breakpoint_trap(), so only instructions sharing that
+ * opcode pay for the PC compare and nothing at all is checked while none are
+ * set.  Fused handlers look up their second half in the jump table as well
+ * and leave a patched slot to the main loop.  The code at a breakpoint may
+ * only be loaded, or be rewritten, after it was set, so the opcode there is
+ * read again before every timeslice (m68ki_breakpoint_refresh()).
+ */
+typedef struct
+{
+	uint pc;
+	uint opcode;
+	void (*handler)(void); /* the slot's handler before it was patched */
+} m68ki_breakpoint_struct;
+
+static m68ki_breakpoint_struct m68ki_breakpoints[M68K_MAX_BREAKPOINTS];
+static int m68ki_num_breakpoints;
+static uint m68ki_breakpoint_skip = 1; /* odd, no instruction starts there */
+static void (*m68ki_breakpoint_callback)(unsigned int pc);
+
+void m68ki_breakpoint_trap(void)
+{
+	void (*handler)(void) = m68ki_exception_illegal;
+	uint pc = REG_PPC;
+	int hit = 0;
+	int i;
+
+	for(i = 0; i < m68ki_num_breakpoints; i++)
+	{
+		if(m68ki_breakpoints[i].opcode != REG_IR)
+			continue;
+		handler = m68ki_breakpoints[i].handler;
+		if(m68ki_breakpoints[i].pc == pc)
+			hit = 1;
+	}
+
+	if(hit && pc == m68ki_breakpoint_skip)
+		m68ki_breakpoint_skip = 1;
+	else if(hit)
+	{
+		/* Stop in front of the instruction, it runs when execution resumes.
+		 * The slice ends here, without the cycles of the instruction that
+		 * m68k_execute() takes off after the handler.
+		 */
+		REG_PC = pc;
+		m68ki_clear_trace();
+		m68ki_initial_cycles -= GET_CYCLES();
+		SET_CYCLES(CYC_INSTRUCTION[REG_IR]);
+		if(m68ki_breakpoint_callback)
+			m68ki_breakpoint_callback(pc);
+		return;
+	}
+	handler();
+}
+
+/* Point the slot of the breakpoint's opcode at the trap, keeping the handler
+ * it had before.  Another breakpoint on the same opcode already has that.
+ */
+static void m68ki_breakpoint_patch(m68ki_breakpoint_struct *bp)
+{
+	int i;
+
+	bp->handler = m68ki_instruction_jump_table[bp->opcode];
+	for(i = 0; i < m68ki_num_breakpoints; i++)
+	{
+		if(&m68ki_breakpoints[i] != bp && m68ki_breakpoints[i].opcode == bp->opcode)
+		{
+			bp->handler = m68ki_breakpoints[i].handler;
+			break;
+		}
+	}
+	m68ki_instruction_jump_table[bp->opcode] = m68ki_breakpoint_trap;
+}
+
+/* Give the slot of opcode its handler back, unless a breakpoint still uses it */
+static void m68ki_breakpoint_unpatch(uint opcode, void (*handler)(void))
+{
+	int i;
+
+	for(i = 0; i < m68ki_num_breakpoints; i++)
+		if(m68ki_breakpoints[i].opcode == opcode)
+			return;
+	m68ki_instruction_jump_table[opcode] = handler;
+}
+
+/* Move breakpoints whose code changed to the slot of the opcode there now */
+static void m68ki_breakpoint_refresh(void)
+{
+	int i;
+
+	for(i = 0; i < m68ki_num_breakpoints; i++)
+	{
+		m68ki_breakpoint_struct *bp = &m68ki_breakpoints[i];
+		uint opcode = m68k_read_disassembler_16(bp->pc);
+		uint old_opcode = bp->opcode;
+
+		if(opcode == old_opcode)
+			continue;
+		bp->opcode = opcode;
+		m68ki_breakpoint_unpatch(old_opcode, bp->handler);
+		m68ki_breakpoint_patch(bp);
+	}
+}
+
+int m68k_set_breakpoint(unsigned int pc)
+{
+	m68ki_breakpoint_struct *bp;
+	int i;
+
+	pc = ADDRESS_68K(pc);
+	if(pc & 1)
+		return -1;
+	for(i = 0; i < m68ki_num_breakpoints; i++)
+		if(m68ki_breakpoints[i].pc == pc)
+			return 0;
+	if(m68ki_num_breakpoints == M68K_MAX_BREAKPOINTS)
+		return -1;
+
+	bp = &m68ki_breakpoints[m68ki_num_breakpoints++];
+	bp->pc = pc;
+	bp->opcode = m68k_read_disassembler_16(pc);
+	m68ki_breakpoint_patch(bp);
+	return 0;
+}
+
+int m68k_clear_breakpoint(unsigned int pc)
+{
+	m68ki_breakpoint_struct bp;
+	int i;
+
+	pc = ADDRESS_68K(pc);
+	for(i = 0; i < m68ki_num_breakpoints; i++)
+		if(m68ki_breakpoints[i].pc == pc)
+			break;
+	if(i == m68ki_num_breakpoints)
+		return -1;
+
+	bp = m68ki_breakpoints[i];
+	m68ki_breakpoints[i] = m68ki_breakpoints[--m68ki_num_breakpoints];
+	m68ki_breakpoint_unpatch(bp.opcode, bp.handler);
+	return 0;
+}
+
+void m68k_clear_breakpoints(void)
+{
+	while(m68ki_num_breakpoints)
+		m68k_clear_breakpoint(m68ki_breakpoints[0].pc);
+}
+
+void m68k_skip_breakpoint(unsigned int pc)
+{
+	m68ki_breakpoint_skip = ADDRESS_68K(pc);
+}
+
+void m68k_set_breakpoint_callback(void (*callback)(unsigned int pc))
+{
+	m68ki_breakpoint_callback = callback;
+}
+
 /* Execute some instructions until we use up num_cycles clock cycles */
 /* ASG: removed per-instruction interrupt checks */
 int m68k_execute(int num_cycles)
 {
+	/* Only a branch to self in this slice counts for m68k_cpu_idle(), the
+	 * caller doesn't ask after every slice.
+	 */
+	m68ki_cpu.idle_hint = 0;
+
+	if(m68ki_num_breakpoints)
+		m68ki_breakpoint_refresh();
+
 	/* eat up any reset cycles */
 	if (RESET_CYCLES) {
 	    int rc = RESET_CYCLES;
@@ -1010,11 +1707,25 @@ int m68k_execute(int num_cycles)
 			}
 #endif
 
+#if M68K_ITRACE
+			if(m68ki_itrace.active)
+				m68ki_itrace_begin();
+#endif
+
 			/* Read an instruction and call its handler */
 			REG_IR = m68ki_read_imm_16();
+#if M68K_OPCODE_STATS
+			m68ki_opcode_stats_dispatch();
+#else
 			m68ki_instruction_jump_table[REG_IR]();
+#endif
 			USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
 
+#if M68K_ITRACE
+			if(m68ki_itrace.active)
+				m68ki_itrace_end();
+#endif
+
 			/* Trace m68k_exception, if necessary */
 			m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */
 		} while(GET_CYCLES() > 0);
@@ -1196,6 +1907,26 @@ unsigned int m68k_get_context(void* dst)
 void m68k_set_context(void* src)
 {
 	if(src) m68ki_cpu = *(m68ki_cpu_core*)src;
+	pmmu_tlb_flush();
+}
+
+void m68k_restore_context(void* src)
+{
+	m68ki_cpu_core cpu = *(m68ki_cpu_core*)src;
+
+	/* Cycle tables and callbacks are addresses in this process, keep ours */
+	cpu.cyc_instruction = m68ki_cpu.cyc_instruction;
+	cpu.cyc_exception = m68ki_cpu.cyc_exception;
+	memcpy(&cpu.int_ack_callback, &m68ki_cpu.int_ack_callback,
+	       sizeof(m68ki_cpu) - offsetof(m68ki_cpu_core, int_ack_callback));
+
+	/* The host drives the IPL lines again from what the hardware reports */
+	cpu.int_level = 0;
+	cpu.virq_state = 0;
+	cpu.nmi_pending = FALSE;
+
+	m68ki_cpu = cpu;
+	pmmu_tlb_flush();
 }
 
 #if M68K_SEPARATE_READS
@@ -1253,6 +1984,63 @@ inline unsigned int  m68k_read_pcrelative_32(unsigned int address) {
 }
 #endif
 
+/* Looks up where m68ki_fetch_ptr() gets instructions from.  Without the PMMU
+ * that's the whole mapped range holding the PC, with it the soft-TLB page.
+ * The limit leaves room for the longest fetch, so the caller only has to
+ * check the start.  A PC on the bus is remembered as a miss instead, so code
+ * running there doesn't repeat the lookup on every fetch.
+ */
+unsigned char *m68ki_fetch_fill(void)
+{
+	uint pc = REG_PC;
+	uint base, size;
+	unsigned char *host = NULL;
+
+#if M68K_EMULATE_PMMU
+	if (PMMU_ENABLED)
+	{
+		uint phys;
+
+		size = 1 << m68ki_cpu.mmu_tlb_shift;
+		base = pc & ~(size - 1);
+		/* Not translated yet, the slow path fills the soft-TLB */
+		if (!pmmu_tlb_lookup(base, FLAG_S | FUNCTION_CODE_USER_PROGRAM, 1, 1, &phys, &host))
+			return NULL;
+	}
+	else
+#endif
+	{
+		uint upper = 0xFFFFFFFF;
+
+		base = 0;
+		for (int i = 0; i < read_ranges && !host; i++) {
+			if (pc >= read_addr[i] && pc < read_upper[i]) {
+				base = read_addr[i];
+				upper = read_upper[i];
+				host = read_data[i];
+			}
+			else if (read_upper[i] <= pc && read_upper[i] > base)
+				base = read_upper[i];
+			else if (read_addr[i] > pc && read_addr[i] < upper)
+				upper = read_addr[i];
+		}
+		size = upper - base;
+	}
+
+	if (!host)
+	{
+		m68ki_cpu.fetch_miss_base = base;
+		m68ki_cpu.fetch_miss_limit = size;
+		return NULL;
+	}
+	if (size <= M68K_FETCH_MAX)
+		return NULL;
+	m68ki_cpu.fetch_base = base;
+	m68ki_cpu.fetch_host = host;
+	m68ki_cpu.fetch_limit = size - (M68K_FETCH_MAX - 1);
+	return pc - base < m68ki_cpu.fetch_limit ? host + (pc - base) : NULL;
+}
+
 void m68k_add_ram_range(uint32_t addr, uint32_t upper, unsigned char *ptr)
 {
 	if ((addr == 0 && upper == 0) || upper < addr)
@@ -1271,6 +2059,7 @@ void m68k_add_ram_range(uint32_t addr, uint32_t upper, unsigned char *ptr)
 			}
 			if (changed) {
 				printf("[MUSASHI] Adjusted mapped write range %d: %.8X-%.8X (%p)\n", write_ranges, addr, upper, ptr);
+				pmmu_tlb_flush();
 			}
 			return;
 		}
@@ -1296,6 +2085,9 @@ void m68k_add_ram_range(uint32_t addr, uint32_t upper, unsigned char *ptr)
 	else {
 		printf("Can't Musashi map more than eight RAM write ranges.\n");
 	}
+
+	/* soft-TLB host pointers may now point at a different range */
+	pmmu_tlb_flush();
 }
 
 void m68k_add_rom_range(uint32_t addr, uint32_t upper, unsigned char *ptr)
@@ -1316,6 +2108,7 @@ void m68k_add_rom_range(uint32_t addr, uint32_t upper, unsigned char *ptr)
 			}
 			if (changed) {
 				printf("[MUSASHI] Adjusted mapped read range %d: %.8X-%.8X (%p)\n", read_ranges, addr, upper, ptr);
+				pmmu_tlb_flush();
 			}
 			return;
 		}
@@ -1331,6 +2124,8 @@ void m68k_add_rom_range(uint32_t addr, uint32_t upper, unsigned char *ptr)
 	else {
 		printf("Can't Musashi map more than eight RAM/ROM read ranges.\n");
 	}
+
+	pmmu_tlb_flush();
 }
 
 /* ======================================================================== */
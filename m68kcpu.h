@@ -44,6 +44,7 @@ extern "C" {
 
 #include <setjmp.h>
 #include <stdio.h>
+#include <string.h>
 
 /* ======================================================================== */
 /* ==================== ARCHITECTURE-DEPENDANT DEFINES ==================== */
@@ -150,7 +151,12 @@ typedef uint32 uint64;
 /* ======================================================================== */
 
 /* MMU constants */
-#define MMU_ATC_ENTRIES 22    // 68851 has 64, 030 has 22
+#define MMU_ATC_SETS    16    // ATC is hashed on logical page ^ fc
+#define MMU_ATC_WAYS    4     // entries per set, replaced round-robin
+#define MMU_ATC_ENTRIES (MMU_ATC_SETS * MMU_ATC_WAYS)    // 68851 has 64, 030 has 22
+
+/* Soft-TLB constants, second level cache of translated pages */
+#define MMU_TLB_ENTRIES 256   // per direction (read/write), direct mapped
 
 /* instruction cache constants */
 #define M68K_IC_SIZE 128
@@ -369,8 +375,13 @@ typedef uint32 uint64;
 #define FLAG_X           m68ki_cpu.x_flag
 #define FLAG_N           m68ki_cpu.n_flag
 #define FLAG_Z           m68ki_cpu.not_z_flag
+#if M68K_LAZY_FLAGS
+#define FLAG_V           (*m68ki_lazy_flag(&m68ki_cpu.v_flag))
+#define FLAG_C           (*m68ki_lazy_flag(&m68ki_cpu.c_flag))
+#else
 #define FLAG_V           m68ki_cpu.v_flag
 #define FLAG_C           m68ki_cpu.c_flag
+#endif
 #define FLAG_INT_MASK    m68ki_cpu.int_mask
 
 #define CPU_INT_LEVEL    m68ki_cpu.int_level /* ASG: changed from CPU_INTS_PENDING */
@@ -473,8 +484,9 @@ typedef uint32 uint64;
 
 
 #if !M68K_SEPARATE_READS
-#define m68k_read_immediate_16(A) m68ki_read_program_16(A)
-#define m68k_read_immediate_32(A) m68ki_read_program_32(A)
+/* Instruction fetches are not memory accesses as far as the trace is concerned */
+#define m68k_read_immediate_16(A) m68ki_read_16_fc_untraced(A, FLAG_S | FUNCTION_CODE_USER_PROGRAM)
+#define m68k_read_immediate_32(A) m68ki_read_32_fc_untraced(A, FLAG_S | FUNCTION_CODE_USER_PROGRAM)
 
 #define m68k_read_pcrelative_8(A) m68ki_read_program_8(A)
 #define m68k_read_pcrelative_16(A) m68ki_read_program_16(A)
@@ -965,6 +977,11 @@ typedef struct
 	uint not_z_flag;   /* Zero, inverted for speedups */
 	uint v_flag;       /* Overflow */
 	uint c_flag;       /* Carry */
+	uint lazy_flags;   /* M68KI_LAZY_V/C: still to be computed from lazy_op */
+	uint lazy_op;      /* M68KI_LAZY_ADD_8 ... M68KI_LAZY_SUB_32 */
+	uint lazy_src;     /* Operands and result of lazy_op */
+	uint lazy_dst;
+	uint lazy_res;
 	uint int_mask;     /* I0-I2 */
 	uint int_level;    /* State of interrupt pins IPL0-IPL2 -- ASG: changed from ints_pending */
 	uint stopped;      /* Stopped state */
@@ -978,6 +995,8 @@ typedef struct
 	int    has_fpu;    /* Indicates if a FPU available */
 	int    pmmu_enabled; /* Indicates if the PMMU is enabled */
 	int    fpu_just_reset; /* Indicates the FPU was just reset */
+	int    fpu_fast;   /* Use host doubles for common FPU arithmetic */
+	int    idle_hint;  /* Set by a branch to self in the last m68k_execute() */
 	uint reset_cycles;
 
 	/* Clocks required for instructions / exceptions */
@@ -1004,7 +1023,7 @@ typedef struct
 	uint mmu_urp_aptr;    /* 040 only */
 	uint mmu_sr_040;
 	uint mmu_atc_tag[MMU_ATC_ENTRIES], mmu_atc_data[MMU_ATC_ENTRIES];
-	uint mmu_atc_rr;
+	uint8 mmu_atc_rr[MMU_ATC_SETS];
 	uint mmu_tt0, mmu_tt1;
 	uint mmu_itt0, mmu_itt1, mmu_dtt0, mmu_dtt1;
 	uint mmu_acr0, mmu_acr1, mmu_acr2, mmu_acr3;
@@ -1023,6 +1042,20 @@ typedef struct
 
 	uint8 mmu_tablewalk;             /* set when MMU walks page tables */
 	uint mmu_last_logical_addr;
+
+	/* Soft-TLB, indexed [rw][page]: logical page + fc -> physical page and host pointer */
+	uint mmu_tlb_shift;              /* page size used for the soft-TLB tags */
+	uint mmu_tlb_tag[2][MMU_TLB_ENTRIES];
+	uint mmu_tlb_phys[2][MMU_TLB_ENTRIES];
+	unsigned char *mmu_tlb_host[2][MMU_TLB_ENTRIES];
+
+	/* Host memory instruction fetches come from, see m68ki_fetch_ptr() */
+	uint fetch_base;                 /* PC the host pointer belongs to */
+	uint fetch_limit;                /* bytes valid from fetch_base on, 0 if none */
+	unsigned char *fetch_host;
+	uint fetch_miss_base;            /* last region the PC was on the bus in */
+	uint fetch_miss_limit;
+
 	uint ic_address[M68K_IC_SIZE];   /* instruction cache address data */
 	uint ic_data[M68K_IC_SIZE];      /* instruction cache content data */
 	uint8 ic_valid[M68K_IC_SIZE];     /* instruction cache valid flags */
@@ -1059,12 +1092,149 @@ extern uint           m68ki_aerr_address;
 extern uint           m68ki_aerr_write_mode;
 extern uint           m68ki_aerr_fc;
 
+
+/* ------------------------- Lazy Condition Codes ------------------------- */
+
+/* With M68K_LAZY_FLAGS, add/sub handlers only record their operands with
+ * m68ki_lazy_vc() and V and C are computed when something reads them (Bcc,
+ * Scc, DBcc, the SR, ...).  m68kmake writes every other V or C store in
+ * the handlers as m68ki_set_flag_v/c(), which drops the pending flag
+ * instead.  Without M68K_LAZY_FLAGS all of these are the plain stores.
+ */
+#define M68KI_LAZY_V 1
+#define M68KI_LAZY_C 2
+
+enum
+{
+	M68KI_LAZY_ADD_8,
+	M68KI_LAZY_ADD_16,
+	M68KI_LAZY_ADD_32,
+	M68KI_LAZY_SUB_8,
+	M68KI_LAZY_SUB_16,
+	M68KI_LAZY_SUB_32
+};
+
+static inline void m68ki_lazy_flags_resolve(m68ki_cpu_core* cpu)
+{
+	uint src = cpu->lazy_src;
+	uint dst = cpu->lazy_dst;
+	uint res = cpu->lazy_res;
+	uint v;
+	uint c;
+
+	if(!cpu->lazy_flags)
+		return;
+	switch(cpu->lazy_op)
+	{
+		case M68KI_LAZY_ADD_8:  v = VFLAG_ADD_8(src, dst, res);  c = CFLAG_8(res); break;
+		case M68KI_LAZY_ADD_16: v = VFLAG_ADD_16(src, dst, res); c = CFLAG_16(res); break;
+		case M68KI_LAZY_ADD_32: v = VFLAG_ADD_32(src, dst, res); c = CFLAG_ADD_32(src, dst, res); break;
+		case M68KI_LAZY_SUB_8:  v = VFLAG_SUB_8(src, dst, res);  c = CFLAG_8(res); break;
+		case M68KI_LAZY_SUB_16: v = VFLAG_SUB_16(src, dst, res); c = CFLAG_16(res); break;
+		default:                v = VFLAG_SUB_32(src, dst, res); c = CFLAG_SUB_32(src, dst, res); break;
+	}
+	if(cpu->lazy_flags & M68KI_LAZY_V)
+		cpu->v_flag = v;
+	if(cpu->lazy_flags & M68KI_LAZY_C)
+		cpu->c_flag = c;
+	cpu->lazy_flags = 0;
+}
+
+#if M68K_LAZY_FLAGS
+
+static inline uint* m68ki_lazy_flag(uint* flag)
+{
+	if(m68ki_cpu.lazy_flags)
+		m68ki_lazy_flags_resolve(&m68ki_cpu);
+	return flag;
+}
+
+static inline void m68ki_lazy_store(uint op, uint src, uint dst, uint res)
+{
+	m68ki_cpu.lazy_op = op;
+	m68ki_cpu.lazy_src = src;
+	m68ki_cpu.lazy_dst = dst;
+	m68ki_cpu.lazy_res = res;
+	m68ki_cpu.lazy_flags = M68KI_LAZY_V | M68KI_LAZY_C;
+}
+
+static inline uint m68ki_set_flag_v(uint value)
+{
+	m68ki_cpu.lazy_flags &= ~M68KI_LAZY_V;
+	return m68ki_cpu.v_flag = value;
+}
+
+static inline uint m68ki_set_flag_c(uint value)
+{
+	m68ki_cpu.lazy_flags &= ~M68KI_LAZY_C;
+	return m68ki_cpu.c_flag = value;
+}
+
+#define m68ki_lazy_vc_ADD_8(S, D, R)  m68ki_lazy_store(M68KI_LAZY_ADD_8, S, D, R)
+#define m68ki_lazy_vc_ADD_16(S, D, R) m68ki_lazy_store(M68KI_LAZY_ADD_16, S, D, R)
+#define m68ki_lazy_vc_ADD_32(S, D, R) m68ki_lazy_store(M68KI_LAZY_ADD_32, S, D, R)
+#define m68ki_lazy_vc_SUB_8(S, D, R)  m68ki_lazy_store(M68KI_LAZY_SUB_8, S, D, R)
+#define m68ki_lazy_vc_SUB_16(S, D, R) m68ki_lazy_store(M68KI_LAZY_SUB_16, S, D, R)
+#define m68ki_lazy_vc_SUB_32(S, D, R) m68ki_lazy_store(M68KI_LAZY_SUB_32, S, D, R)
+
+#else
+
+#define m68ki_set_flag_v(A) (FLAG_V = (A))
+#define m68ki_set_flag_c(A) (FLAG_C = (A))
+
+#define m68ki_lazy_vc_ADD_8(S, D, R)  (FLAG_V = VFLAG_ADD_8(S, D, R), FLAG_C = CFLAG_8(R))
+#define m68ki_lazy_vc_ADD_16(S, D, R) (FLAG_V = VFLAG_ADD_16(S, D, R), FLAG_C = CFLAG_16(R))
+#define m68ki_lazy_vc_ADD_32(S, D, R) (FLAG_V = VFLAG_ADD_32(S, D, R), FLAG_C = CFLAG_ADD_32(S, D, R))
+#define m68ki_lazy_vc_SUB_8(S, D, R)  (FLAG_V = VFLAG_SUB_8(S, D, R), FLAG_C = CFLAG_8(R))
+#define m68ki_lazy_vc_SUB_16(S, D, R) (FLAG_V = VFLAG_SUB_16(S, D, R), FLAG_C = CFLAG_16(R))
+#define m68ki_lazy_vc_SUB_32(S, D, R) (FLAG_V = VFLAG_SUB_32(S, D, R), FLAG_C = CFLAG_SUB_32(S, D, R))
+
+#endif /* M68K_LAZY_FLAGS */
+
+#define m68ki_lazy_vc(OP, S, D, R) m68ki_lazy_vc_##OP(S, D, R)
+
 /* Forward declarations to keep some of the macros happy */
 static inline uint m68ki_read_16_fc (uint address, uint fc);
 static inline uint m68ki_read_32_fc (uint address, uint fc);
+static inline uint m68ki_read_16_fc_untraced(uint address, uint fc);
+static inline uint m68ki_read_32_fc_untraced(uint address, uint fc);
 static inline uint m68ki_get_ea_ix(uint An);
 static inline void m68ki_check_interrupts(void);            /* ASG: check for interrupts */
 
+#if M68K_OPCODE_STATS
+/* One entry per generated opcode handler, written by m68kmake */
+typedef struct
+{
+	void (*opcode_handler)(void);
+	const char *name;     /* handler name without the m68k_op_ prefix */
+	const char *mnemonic;
+	unsigned char size;
+	const char *ea;       /* addressing mode the handler is specialised for, if any */
+} m68ki_opcode_info_struct;
+
+extern const m68ki_opcode_info_struct m68ki_opcode_info_table[];
+#endif /* M68K_OPCODE_STATS */
+
+#if M68K_ITRACE
+#include "m68ktrace.h"
+
+/* Instruction trace record being built, flushed by m68ki_itrace_end() */
+typedef struct
+{
+	uint active;
+	uint pc;
+	uint num_words;
+	uint num_mem;
+	uint flags;
+	uint regs[M68K_ITRACE_NUM_REGS];  /* state after the previous record */
+	uint16_t words[M68K_ITRACE_MAX_WORDS];
+	struct m68k_itrace_mem mem[M68K_ITRACE_MAX_MEM];
+} m68ki_itrace_struct;
+
+extern m68ki_itrace_struct m68ki_itrace;
+void m68ki_itrace_end(void);
+#endif /* M68K_ITRACE */
+
 /* quick disassembly (used for logging) */
 char* m68ki_disassemble_quick(unsigned int pc, unsigned int cpu_type);
 
@@ -1074,6 +1244,50 @@ char* m68ki_disassemble_quick(unsigned int pc, unsigned int cpu_type);
 /* ======================================================================== */
 
 
+/* --------------------------- Instruction Trace -------------------------- */
+
+#if M68K_ITRACE
+/* Called before an instruction is fetched.  Leftover instruction words mean
+ * the previous one never reached m68ki_itrace_end(), it was thrown out by a
+ * bus or address error and gets flushed now.
+ */
+static inline void m68ki_itrace_begin(void)
+{
+	if(m68ki_itrace.num_words)
+	{
+		m68ki_itrace.flags |= M68K_ITRACE_ABORTED;
+		m68ki_itrace_end();
+	}
+	m68ki_itrace.pc = REG_PC;
+}
+
+static inline void m68ki_itrace_word(uint value)
+{
+	if(m68ki_itrace.active && m68ki_itrace.num_words < M68K_ITRACE_MAX_WORDS)
+		m68ki_itrace.words[m68ki_itrace.num_words++] = value;
+}
+
+static inline void m68ki_itrace_mem(uint address, uint value, uint info)
+{
+	if(m68ki_itrace.active)
+	{
+		if(m68ki_itrace.num_mem < M68K_ITRACE_MAX_MEM)
+		{
+			struct m68k_itrace_mem *m = &m68ki_itrace.mem[m68ki_itrace.num_mem++];
+			m->address = address;
+			m->value = value;
+			m->info = info;
+		}
+		else
+			m68ki_itrace.flags |= M68K_ITRACE_MEM_OVERFLOW;
+	}
+}
+#else
+#define m68ki_itrace_word(A)
+#define m68ki_itrace_mem(A, B, C)
+#endif /* M68K_ITRACE */
+
+
 /* ---------------------------- Read Immediate ---------------------------- */
 
 extern unsigned char read_ranges;
@@ -1095,6 +1309,56 @@ inline void m68ki_ic_clear()
 }
 
 extern uint32 pmmu_translate_addr(uint32 addr_in, const uint16 rw);
+extern void pmmu_tlb_flush(void);
+
+/* Soft-TLB lookup for a translated access of size bytes.  On a hit the
+ * physical address is returned in *phys and *host points at the data when
+ * the page is backed by a mapped RAM/ROM range (NULL if it's on the bus).
+ * Accesses straddling a page boundary always miss.
+ */
+static inline int pmmu_tlb_lookup(uint address, uint fc, uint rw, uint size, uint *phys, unsigned char **host)
+{
+	uint shift = m68ki_cpu.mmu_tlb_shift;
+	uint page = address >> shift;
+	uint idx = (page ^ (fc << 5)) & (MMU_TLB_ENTRIES - 1);
+
+	if (m68ki_cpu.mmu_tlb_tag[rw][idx] != ((page << 3) | fc) || ((address + size - 1) >> shift) != page)
+		return 0;
+
+	address -= page << shift;
+	*phys = m68ki_cpu.mmu_tlb_phys[rw][idx] + address;
+	*host = m68ki_cpu.mmu_tlb_host[rw][idx] ? m68ki_cpu.mmu_tlb_host[rw][idx] + address : NULL;
+	return 1;
+}
+
+/* Longest read from m68ki_fetch_ptr(): a long immediate plus the prefetch */
+#define M68K_FETCH_MAX 6
+
+unsigned char *m68ki_fetch_fill(void);
+
+/* Drop the cached fetch region.  Needed whenever the memory map, the PMMU
+ * translation or the function code of program fetches changes.
+ */
+static inline void m68ki_fetch_invalidate(void)
+{
+	m68ki_cpu.fetch_limit = 0;
+	m68ki_cpu.fetch_miss_limit = 0;
+}
+
+/* Host pointer to the (up to M68K_FETCH_MAX) bytes at REG_PC, NULL if they
+ * aren't in mapped memory.  As long as the PC stays in the cached region this
+ * is only the bounds check, it's looked up again on leaving it.
+ */
+static inline unsigned char *m68ki_fetch_ptr(void)
+{
+	uint offset = REG_PC - m68ki_cpu.fetch_base;
+
+	if(offset < m68ki_cpu.fetch_limit)
+		return m68ki_cpu.fetch_host + offset;
+	if(REG_PC - m68ki_cpu.fetch_miss_base < m68ki_cpu.fetch_miss_limit)
+		return NULL;
+	return m68ki_fetch_fill();
+}
 
 // read immediate word using the instruction cache
 
@@ -1105,6 +1369,16 @@ static inline uint32 m68ki_ic_readimm16(uint32 address)
 		// 68020 series I-cache (MC68020 User's Manual, Section 4 - On-Chip Cache Memory)
 		if (CPU_TYPE & (CPU_TYPE_EC020 | CPU_TYPE_020))
 		{
+			// code running from host memory gains nothing from the cache, so
+			// fetch it directly and keep the cache lines for bus-backed code
+			// (with the PMMU on the address is logical, the cache fill below
+			// translates it)
+			for (int i = 0; i < read_ranges && !PMMU_ENABLED; i++) {
+				if(address >= read_addr[i] && address < read_upper[i]) {
+					return be16toh(((unsigned short *)(read_data[i] + (address - read_addr[i])))[0]);
+				}
+			}
+
 			uint32 tag = (address >> 8) | (m68ki_cpu.s_flag ? 0x1000000 : 0);
 			int idx = (address >> 2) & 0x3f;    // 1-of-64 select
 
@@ -1117,7 +1391,7 @@ static inline uint32 m68ki_ic_readimm16(uint32 address)
 					return m68k_read_immediate_16(address);
 				}
 
-				uint32 data = m68ki_read_32(address & ~3);
+				uint32 data = m68ki_read_32_fc_untraced(address & ~3, FLAG_S | FUNCTION_CODE_USER_PROGRAM);
 
 				//printf("m68k: doing cache fill at %08x (tag %08x idx %d)\n", address, tag, idx);
 
@@ -1152,17 +1426,29 @@ static inline uint32 m68ki_ic_readimm16(uint32 address)
 /* Handles all immediate reads, does address error check, function code setting,
  * and prefetching if they are enabled in m68kconf.h
  */
-static inline uint m68ki_read_imm_16(void)
+static inline uint m68ki_read_imm_16_untraced(void)
 {
 	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
-	m68ki_cpu.mmu_tmp_fc = FLAG_S | FUNCTION_CODE_USER_PROGRAM;
-	m68ki_cpu.mmu_tmp_rw = 1;
-	m68ki_cpu.mmu_tmp_sz = M68K_SZ_WORD;
 	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
 
 #if M68K_EMULATE_PREFETCH
 {
 	uint result;
+#if M68K_HOST_FETCH
+	unsigned short *host = (unsigned short *)m68ki_fetch_ptr();
+	if(host)
+	{
+		result = (REG_PC == CPU_PREF_ADDR) ? MASK_OUT_ABOVE_16(CPU_PREF_DATA) : be16toh(host[0]);
+		REG_PC += 2;
+		CPU_PREF_ADDR = REG_PC;
+		CPU_PREF_DATA = be16toh(host[1]);
+		return result;
+	}
+#endif /* M68K_HOST_FETCH */
+
+	m68ki_cpu.mmu_tmp_fc = FLAG_S | FUNCTION_CODE_USER_PROGRAM;
+	m68ki_cpu.mmu_tmp_rw = 1;
+	m68ki_cpu.mmu_tmp_sz = M68K_SZ_WORD;
 	if(REG_PC != CPU_PREF_ADDR)
 	{
 		CPU_PREF_DATA = m68ki_ic_readimm16(REG_PC);
@@ -1180,7 +1466,18 @@ static inline uint m68ki_read_imm_16(void)
 	return result;
 }
 #else
+#if M68K_HOST_FETCH
+	unsigned short *host = (unsigned short *)m68ki_fetch_ptr();
+	if(host)
+	{
+		REG_PC += 2;
+		return be16toh(host[0]);
+	}
+#endif /* M68K_HOST_FETCH */
 
+	m68ki_cpu.mmu_tmp_fc = FLAG_S | FUNCTION_CODE_USER_PROGRAM;
+	m68ki_cpu.mmu_tmp_rw = 1;
+	m68ki_cpu.mmu_tmp_sz = M68K_SZ_WORD;
 	uint32_t address = ADDRESS_68K(REG_PC);
 	REG_PC += 2;
 
@@ -1194,13 +1491,20 @@ static inline uint m68ki_read_imm_16(void)
 #endif /* M68K_EMULATE_PREFETCH */
 }
 
+static inline uint m68ki_read_imm_16(void)
+{
+	uint value = m68ki_read_imm_16_untraced();
+	m68ki_itrace_word(value);
+	return value;
+}
+
 static inline uint m68ki_read_imm_8(void)
 {
 	/* map read immediate 8 to read immediate 16 */
 	return MASK_OUT_ABOVE_8(m68ki_read_imm_16());
 }
 
-static inline uint m68ki_read_imm_32(void)
+static inline uint m68ki_read_imm_32_untraced(void)
 {
 #if M68K_SEPARATE_READS
 #if M68K_EMULATE_PMMU
@@ -1213,11 +1517,24 @@ static inline uint m68ki_read_imm_32(void)
 	uint temp_val;
 
 	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+
+#if M68K_HOST_FETCH
+	unsigned short *host = (unsigned short *)m68ki_fetch_ptr();
+	if(host)
+	{
+		temp_val = (REG_PC == CPU_PREF_ADDR) ? MASK_OUT_ABOVE_16(CPU_PREF_DATA) : be16toh(host[0]);
+		temp_val = (temp_val << 16) | be16toh(host[1]);
+		REG_PC += 4;
+		CPU_PREF_ADDR = REG_PC;
+		CPU_PREF_DATA = be16toh(host[2]);
+		return temp_val;
+	}
+#endif /* M68K_HOST_FETCH */
+
 	m68ki_cpu.mmu_tmp_fc = FLAG_S | FUNCTION_CODE_USER_PROGRAM;
 	m68ki_cpu.mmu_tmp_rw = 1;
 	m68ki_cpu.mmu_tmp_sz = M68K_SZ_LONG;
-	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
-
 	if(REG_PC != CPU_PREF_ADDR)
 	{
 		CPU_PREF_ADDR = REG_PC;
@@ -1237,6 +1554,14 @@ static inline uint m68ki_read_imm_32(void)
 #else
 	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
+#if M68K_HOST_FETCH
+	unsigned int *host = (unsigned int *)m68ki_fetch_ptr();
+	if(host)
+	{
+		REG_PC += 4;
+		return be32toh(host[0]);
+	}
+#endif /* M68K_HOST_FETCH */
 	uint32_t address = ADDRESS_68K(REG_PC);
 	REG_PC += 4;
 	for (int i = 0; i < read_ranges; i++) {
@@ -1249,6 +1574,14 @@ static inline uint m68ki_read_imm_32(void)
 #endif /* M68K_EMULATE_PREFETCH */
 }
 
+static inline uint m68ki_read_imm_32(void)
+{
+	uint value = m68ki_read_imm_32_untraced();
+	m68ki_itrace_word(value >> 16);
+	m68ki_itrace_word(value & 0xffff);
+	return value;
+}
+
 /* ------------------------- Top level read/write ------------------------- */
 
 /* Handles all memory accesses (except for immediate reads if they are
@@ -1258,7 +1591,7 @@ static inline uint m68ki_read_imm_32(void)
  * code if they are enabled in m68kconf.h.
  */
 
-static inline uint m68ki_read_8_fc(uint address, uint fc)
+static inline uint m68ki_read_8_fc_untraced(uint address, uint fc)
 {
 	(void)fc;
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
@@ -1268,7 +1601,15 @@ static inline uint m68ki_read_8_fc(uint address, uint fc)
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address,1);
+	{
+		unsigned char *host;
+		if (!pmmu_tlb_lookup(address, fc, 1, 1, &address, &host))
+			address = pmmu_translate_addr(address,1);
+		else if (host)
+		{
+			return host[0];
+		}
+	}
 #endif
 
 	for (int i = 0; i < read_ranges; i++) {
@@ -1279,7 +1620,7 @@ static inline uint m68ki_read_8_fc(uint address, uint fc)
 
 	return m68k_read_memory_8(ADDRESS_68K(address));
 }
-static inline uint m68ki_read_16_fc(uint address, uint fc)
+static inline uint m68ki_read_16_fc_untraced(uint address, uint fc)
 {
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_cpu.mmu_tmp_fc = fc;
@@ -1289,7 +1630,15 @@ static inline uint m68ki_read_16_fc(uint address, uint fc)
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address,1);
+	{
+		unsigned char *host;
+		if (!pmmu_tlb_lookup(address, fc, 1, 2, &address, &host))
+			address = pmmu_translate_addr(address,1);
+		else if (host)
+		{
+			return be16toh(((unsigned short *)host)[0]);
+		}
+	}
 #endif
 
 	for (int i = 0; i < read_ranges; i++) {
@@ -1300,7 +1649,7 @@ static inline uint m68ki_read_16_fc(uint address, uint fc)
 
 	return m68k_read_memory_16(ADDRESS_68K(address));
 }
-static inline uint m68ki_read_32_fc(uint address, uint fc)
+static inline uint m68ki_read_32_fc_untraced(uint address, uint fc)
 {
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_cpu.mmu_tmp_fc = fc;
@@ -1310,7 +1659,15 @@ static inline uint m68ki_read_32_fc(uint address, uint fc)
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address,1);
+	{
+		unsigned char *host;
+		if (!pmmu_tlb_lookup(address, fc, 1, 4, &address, &host))
+			address = pmmu_translate_addr(address,1);
+		else if (host)
+		{
+			return be32toh(((unsigned int *)host)[0]);
+		}
+	}
 #endif
 
 	for (int i = 0; i < read_ranges; i++) {
@@ -1322,8 +1679,29 @@ static inline uint m68ki_read_32_fc(uint address, uint fc)
 	return m68k_read_memory_32(ADDRESS_68K(address));
 }
 
+/* The trace records the logical address the instruction asked for */
+static inline uint m68ki_read_8_fc(uint address, uint fc)
+{
+	uint value = m68ki_read_8_fc_untraced(address, fc);
+	m68ki_itrace_mem(address, value, 1);
+	return value;
+}
+static inline uint m68ki_read_16_fc(uint address, uint fc)
+{
+	uint value = m68ki_read_16_fc_untraced(address, fc);
+	m68ki_itrace_mem(address, value, 2);
+	return value;
+}
+static inline uint m68ki_read_32_fc(uint address, uint fc)
+{
+	uint value = m68ki_read_32_fc_untraced(address, fc);
+	m68ki_itrace_mem(address, value, 4);
+	return value;
+}
+
 static inline void m68ki_write_8_fc(uint address, uint fc, uint value)
 {
+	m68ki_itrace_mem(address, MASK_OUT_ABOVE_8(value), 1 | M68K_ITRACE_WRITE);
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_cpu.mmu_tmp_fc = fc;
 	m68ki_cpu.mmu_tmp_rw = 0;
@@ -1331,7 +1709,16 @@ static inline void m68ki_write_8_fc(uint address, uint fc, uint value)
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address,0);
+	{
+		unsigned char *host;
+		if (!pmmu_tlb_lookup(address, fc, 0, 1, &address, &host))
+			address = pmmu_translate_addr(address,0);
+		else if (host)
+		{
+			host[0] = (unsigned char)value;
+			return;
+		}
+	}
 #endif
 
 	for (int i = 0; i < write_ranges; i++) {
@@ -1345,6 +1732,7 @@ static inline void m68ki_write_8_fc(uint address, uint fc, uint value)
 }
 static inline void m68ki_write_16_fc(uint address, uint fc, uint value)
 {
+	m68ki_itrace_mem(address, MASK_OUT_ABOVE_16(value), 2 | M68K_ITRACE_WRITE);
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_cpu.mmu_tmp_fc = fc;
 	m68ki_cpu.mmu_tmp_rw = 0;
@@ -1353,7 +1741,16 @@ static inline void m68ki_write_16_fc(uint address, uint fc, uint value)
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address,0);
+	{
+		unsigned char *host;
+		if (!pmmu_tlb_lookup(address, fc, 0, 2, &address, &host))
+			address = pmmu_translate_addr(address,0);
+		else if (host)
+		{
+			((short *)host)[0] = htobe16(value);
+			return;
+		}
+	}
 #endif
 
 	for (int i = 0; i < write_ranges; i++) {
@@ -1367,6 +1764,7 @@ static inline void m68ki_write_16_fc(uint address, uint fc, uint value)
 }
 static inline void m68ki_write_32_fc(uint address, uint fc, uint value)
 {
+	m68ki_itrace_mem(address, value, 4 | M68K_ITRACE_WRITE);
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_cpu.mmu_tmp_fc = fc;
 	m68ki_cpu.mmu_tmp_rw = 0;
@@ -1375,7 +1773,16 @@ static inline void m68ki_write_32_fc(uint address, uint fc, uint value)
 
 #if M68K_EMULATE_PMMU
 	if (PMMU_ENABLED)
-	    address = pmmu_translate_addr(address,0);
+	{
+		unsigned char *host;
+		if (!pmmu_tlb_lookup(address, fc, 0, 4, &address, &host))
+			address = pmmu_translate_addr(address,0);
+		else if (host)
+		{
+			((int *)host)[0] = htobe32(value);
+			return;
+		}
+	}
 #endif
 
 	for (int i = 0; i < write_ranges; i++) {
@@ -1396,6 +1803,7 @@ static inline void m68ki_write_32_fc(uint address, uint fc, uint value)
  */
 static inline void m68ki_write_32_pd_fc(uint address, uint fc, uint value)
 {
+	m68ki_itrace_mem(address, value, 4 | M68K_ITRACE_WRITE);
 	m68ki_set_fc(fc); /* auto-disable (see m68kcpu.h) */
 	m68ki_cpu.mmu_tmp_fc = fc;
 	m68ki_cpu.mmu_tmp_rw = 0;
@@ -1411,6 +1819,198 @@ static inline void m68ki_write_32_pd_fc(uint address, uint fc, uint value)
 }
 #endif
 
+/* --------------------------- Superinstructions -------------------------- */
+
+extern void (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
+
+/* Used by the fused handlers m68kmake generates from m68k_fuse.txt, after
+ * the first instruction of a pair ran.  Nonzero if the main loop would start
+ * the next instruction right away and nothing needs to see the boundary: cycles
+ * left, not stopped, not tracing.  The next opcode is then in CPU_PREF_DATA;
+ * after a jump it is fetched here, exactly as m68ki_read_imm_16() would, unless
+ * the fetch could fault.
+ */
+static inline int m68ki_fuse_allowed(void)
+{
+#if M68K_EMULATE_PREFETCH && !defined(M68K_BUSERR_THING)
+	if(CPU_STOPPED || m68ki_tracing || FLAG_T1 || (REG_PC & 1) ||
+#if M68K_ITRACE
+	   m68ki_itrace.active ||
+#endif
+	   GET_CYCLES() <= (int)CYC_INSTRUCTION[REG_IR])
+		return 0;
+
+	if(CPU_PREF_ADDR != REG_PC)
+	{
+#if M68K_EMULATE_PMMU
+		if(PMMU_ENABLED)
+			return 0;
+#endif
+		m68ki_cpu.mmu_tmp_fc = FLAG_S | FUNCTION_CODE_USER_PROGRAM;
+		m68ki_cpu.mmu_tmp_rw = 1;
+		m68ki_cpu.mmu_tmp_sz = M68K_SZ_WORD;
+		CPU_PREF_DATA = m68ki_ic_readimm16(REG_PC);
+		CPU_PREF_ADDR = REG_PC;
+	}
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/* What the main loop does between two instructions: charge the first one's
+ * base cycles and fetch the second.
+ */
+static inline void m68ki_fuse_fetch(void)
+{
+	USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
+	m68ki_use_data_space(); /* auto-disable (see m68kcpu.h) */
+	m68ki_instr_hook(REG_PC); /* auto-disable (see m68kcpu.h) */
+	REG_PPC = REG_PC;
+	REG_IR = m68ki_read_imm_16();
+}
+
+
+/* ---------------------------- Bulk DBF Loops ---------------------------- */
+
+void m68ki_breakpoint_trap(void); /* jump table slots with a breakpoint on their opcode */
+
+/* Host pointer to len bytes at address if they all lie in one mapped range,
+ * NULL otherwise.
+ */
+static inline unsigned char *m68ki_host_read_ptr(uint address, uint len)
+{
+	for (int i = 0; i < read_ranges; i++) {
+		if(address >= read_addr[i] && address < read_upper[i]) {
+			if(len > read_upper[i] - address)
+				return NULL;
+			return read_data[i] + (address - read_addr[i]);
+		}
+	}
+	return NULL;
+}
+
+static inline unsigned char *m68ki_host_write_ptr(uint address, uint len)
+{
+	for (int i = 0; i < write_ranges; i++) {
+		if(address >= write_addr[i] && address < write_upper[i]) {
+			if(len > write_upper[i] - address)
+				return NULL;
+			return write_data[i] + (address - write_addr[i]);
+		}
+	}
+	return NULL;
+}
+
+/* Called by dbf when it branches back to a one word loop body right before
+ * it.  If the body is move.x (Ay)+,(Ax)+ or clr.x (Ay)+ over mapped memory,
+ * runs as many more iterations as the main loop would before the timeslice
+ * ends with a single memmove/memset, and leaves registers, flags, PC and
+ * cycles exactly as running them one by one would have.  Anything else is
+ * left to the normal per-instruction path: the bus, an unmasked interrupt,
+ * the PMMU, tracing, overlapping copies that would smear.
+ */
+static inline void m68ki_dbf_bulk(uint* r_cnt)
+{
+#if M68K_BULK_LOOPS && !M68K_OPCODE_STATS
+	unsigned char* host_op;
+	unsigned char* src = NULL;
+	unsigned char* dst;
+	uint* r_src = NULL;
+	uint* r_dst;
+	uint op, size, count, len, last;
+	sint body, iteration, budget;
+
+	if(m68ki_tracing || FLAG_T1 || m68ki_cpu.nmi_pending || CPU_INT_LEVEL > FLAG_INT_MASK ||
+#if M68K_ITRACE
+	   m68ki_itrace.active ||
+#endif
+#if M68K_EMULATE_PMMU
+	   PMMU_ENABLED ||
+#endif
+	   (host_op = m68ki_host_read_ptr(REG_PC, 2)) == NULL)
+		return;
+
+	op = be16toh(((unsigned short *)host_op)[0]);
+	switch(op & 0xf1f8)
+	{
+		case 0x10d8: size = 1; break;	/* move.b (Ay)+,(Ax)+ */
+		case 0x30d8: size = 2; break;	/* move.w (Ay)+,(Ax)+ */
+		case 0x20d8: size = 4; break;	/* move.l (Ay)+,(Ax)+ */
+		default:
+			switch(op & 0xfff8)
+			{
+				case 0x4218: size = 1; break;	/* clr.b (Ay)+ */
+				case 0x4258: size = 2; break;	/* clr.w (Ay)+ */
+				case 0x4298: size = 4; break;	/* clr.l (Ay)+ */
+				default: return;
+			}
+	}
+	if(m68ki_instruction_jump_table[op] == m68ki_breakpoint_trap)
+		return;
+	r_dst = &REG_A[op & 7];
+	if((op & 0xf000) != 0x4000)
+	{
+		r_src = r_dst;
+		r_dst = &REG_A[(op >> 9) & 7];
+		if(r_src == r_dst || (size == 1 && r_src == &REG_A[7]))
+			return;
+	}
+	if(size == 1 && r_dst == &REG_A[7])
+		return;	/* (A7)+ steps by 2 for bytes */
+
+	/* Iterations (body + taken dbf) the main loop would still start in this
+	 * timeslice, after this dbf's base cycles are charged, and that leave
+	 * the counter at 0 or more.
+	 */
+	body = CYC_INSTRUCTION[op];
+	iteration = body + CYC_INSTRUCTION[REG_IR] + CYC_DBCC_F_NOEXP;
+	budget = GET_CYCLES() - (sint)CYC_INSTRUCTION[REG_IR];
+	if(budget <= body)
+		return;
+	count = (budget - body - 1) / iteration + 1;
+	if(count > MASK_OUT_ABOVE_16(*r_cnt))
+		count = MASK_OUT_ABOVE_16(*r_cnt);
+	if(count < 2)
+		return;
+
+#if M68K_EMULATE_ADDRESS_ERROR
+	if(size > 1 && ((*r_dst | (r_src ? *r_src : 0)) & 1))
+		return;
+#endif
+	len = count * size;
+	if((dst = m68ki_host_write_ptr(*r_dst, len)) == NULL)
+		return;
+	if(r_src)
+	{
+		/* A forward copy is a memmove unless the destination starts inside the source */
+		if((src = m68ki_host_read_ptr(*r_src, len)) == NULL || (dst > src && dst < src + len))
+			return;
+		memmove(dst, src, len);
+		*r_src += len;
+
+		last = (size == 1) ? dst[len - 1] :
+		       (size == 2) ? be16toh(((unsigned short *)(dst + len - 2))[0]) :
+		                     be32toh(((unsigned int *)(dst + len - 4))[0]);
+		FLAG_N = (size == 1) ? NFLAG_8(last) : (size == 2) ? NFLAG_16(last) : NFLAG_32(last);
+		FLAG_Z = last;
+	}
+	else
+	{
+		memset(dst, 0, len);
+		FLAG_N = NFLAG_CLEAR;
+		FLAG_Z = ZFLAG_SET;
+	}
+	FLAG_V = VFLAG_CLEAR;
+	FLAG_C = CFLAG_CLEAR;
+	*r_dst += len;
+	*r_cnt = MASK_OUT_BELOW_16(*r_cnt) | (MASK_OUT_ABOVE_16(*r_cnt) - count);
+	USE_CYCLES(count * iteration);
+#else
+	(void)r_cnt;
+#endif
+}
+
 /* --------------------- Effective Address Calculation -------------------- */
 
 /* The program counter relative addressing modes cause operands to be
@@ -1699,6 +2299,7 @@ static inline void m68ki_set_s_flag(uint value)
 	REG_SP_BASE[FLAG_S | ((FLAG_S>>1) & FLAG_M)] = REG_SP;
 	/* Set the S flag */
 	FLAG_S = value;
+	m68ki_fetch_invalidate();
 	/* Set the new stack pointer */
 	REG_SP = REG_SP_BASE[FLAG_S | ((FLAG_S>>1) & FLAG_M)];
 }
@@ -1713,6 +2314,7 @@ static inline void m68ki_set_sm_flag(uint value)
 	/* Set the S and M flags */
 	FLAG_S = value & SFLAG_SET;
 	FLAG_M = value & MFLAG_SET;
+	m68ki_fetch_invalidate();
 	/* Set the new stack pointer */
 	REG_SP = REG_SP_BASE[FLAG_S | ((FLAG_S>>1) & FLAG_M)];
 }
@@ -1723,6 +2325,7 @@ static inline void m68ki_set_sm_flag_nosp(uint value)
 	/* Set the S and M flags */
 	FLAG_S = value & SFLAG_SET;
 	FLAG_M = value & MFLAG_SET;
+	m68ki_fetch_invalidate();
 }
 
 
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#include "m68kfpu_fast.h"
+
 extern void exit(int);
 
 static void fatalerror(char *format, ...) {
@@ -1388,7 +1390,17 @@ static void fpgen_rm_reg(uint16 w2)
 		source = REG_FP[src];
 	}
 
-
+	// fast mode: common ops on host doubles, only when rounding to nearest
+	if (m68ki_cpu.fpu_fast && float_rounding_mode == float_round_nearest_even)
+	{
+		int cycles = fpu_fast_op(opmode, &REG_FP[dst], source, floatx80_rounding_precision == 32);
+		if (cycles)
+		{
+			SET_CONDITION_CODES(REG_FP[dst]);
+			USE_CYCLES(cycles);
+			return;
+		}
+	}
 
 	switch (opmode)
 	{
@@ -0,0 +1,106 @@
+/*
+    m68kfpu_fast.h - host double precision kernels for the "fast" FPU mode
+
+    The FPU register file stays in 80-bit floatx80 format, so FMOVE/FMOVEM
+    to memory, FSAVE and friends behave exactly as before.  In fast mode the
+    common arithmetic and transcendental opcodes convert their operands to
+    host doubles, compute with the Pi's FPU/libm and round the result back
+    into the register, trading the low 11 bits of the extended mantissa for
+    speed.
+*/
+
+#ifndef M68KFPU_FAST__HEADER
+#define M68KFPU_FAST__HEADER
+
+#include <math.h>
+#include <string.h>
+
+/* floatx80 -> double.  Normal numbers within double range are converted
+ * inline with round-to-nearest-even, everything else goes through softfloat.
+ */
+static inline double fpu_fast_to_double(floatx80 a)
+{
+	int exp = a.high & 0x7fff;
+	double d;
+
+	if (exp > 0x3fff - 1023 && exp < 0x3fff + 1024 && (a.low >> 63))
+	{
+		uint64 mant = a.low << 1;
+		uint64 rem = mant & 0xfff;
+		uint64 bits = ((uint64)(a.high & 0x8000) << 48) | ((uint64)(exp - 0x3fff + 1023) << 52) | (mant >> 12);
+
+		// a carry out of the mantissa correctly bumps the exponent
+		if (rem > 0x800 || (rem == 0x800 && (bits & 1)))
+		{
+			bits++;
+		}
+		memcpy(&d, &bits, sizeof(d));
+		return d;
+	}
+
+	{
+		uint64 bits = floatx80_to_float64(a);
+		memcpy(&d, &bits, sizeof(d));
+	}
+	return d;
+}
+
+/* double -> floatx80, always exact */
+static inline floatx80 fpu_fast_from_double(double d)
+{
+	uint64 bits;
+	int exp;
+	floatx80 r;
+
+	memcpy(&bits, &d, sizeof(bits));
+	exp = (bits >> 52) & 0x7ff;
+
+	if (exp == 0 || exp == 0x7ff)
+	{
+		return float64_to_floatx80(bits);
+	}
+
+	r.high = ((bits >> 48) & 0x8000) | (exp - 1023 + 0x3fff);
+	r.low = U64(0x8000000000000000) | (bits << 11);
+	return r;
+}
+
+/* Runs opmode on host doubles.  Returns the instruction's cycle count, or 0
+ * if the opcode has no fast kernel and must take the softfloat path.
+ * single is set when FPCR asks for single precision rounding.
+ */
+static inline int fpu_fast_op(int opmode, floatx80 *dst, floatx80 source, int single)
+{
+	double s = fpu_fast_to_double(source);
+	double r;
+	int cycles;
+
+	switch (opmode)
+	{
+		case 0x04:	r = sqrt(s);		cycles = 109;	break;	// FSQRT
+		case 0x06:	r = log1p(s);		cycles = 594;	break;	// FLOGNP1
+		case 0x0e:	r = sin(s);		cycles = 75;	break;	// FSIN
+		case 0x0f:	r = tan(s);		cycles = 75;	break;	// FTAN
+		case 0x14:	r = log(s);		cycles = 548;	break;	// FLOGN
+		case 0x15:	r = log10(s);		cycles = 604;	break;	// FLOG10
+		case 0x16:	r = log2(s);		cycles = 604;	break;	// FLOG2
+		case 0x1d:	r = cos(s);		cycles = 75;	break;	// FCOS
+		case 0x60:				// FSDIVS
+		case 0x20:	r = fpu_fast_to_double(*dst) / s;	cycles = 43;	break;	// FDIV
+		case 0x22:	r = fpu_fast_to_double(*dst) + s;	cycles = 9;	break;	// FADD
+		case 0x63:				// FSMULS
+		case 0x23:	r = fpu_fast_to_double(*dst) * s;	cycles = 11;	break;	// FMUL
+		case 0x28:	r = fpu_fast_to_double(*dst) - s;	cycles = 9;	break;	// FSUB
+		default:
+			return 0;
+	}
+
+	if (single)
+	{
+		r = (float)r;
+	}
+	*dst = fpu_fast_from_double(r);
+	return cycles;
+}
+
+#endif /* M68KFPU_FAST__HEADER */
@@ -40,11 +40,21 @@
  * It requires an input file to function (default m68k_in.c), but you can
  * specify your own like so:
  *
- * m68kmake <output path> <input file>
+ * m68kmake <output path> <input file> <fuse list>
  *
  * where output path is the path where the output files should be placed, and
  * input file is the file to use for input.
  *
+ * The optional fuse list (default m68k_fuse.txt, skipped if it doesn't exist)
+ * names pairs of opcode handlers that often run back to back.  For every
+ * handler that starts a pair a fused handler is generated, which runs it and
+ * then goes straight on to the second handler if the next opcode is one of
+ * its partners, saving a trip through the main loop and the indirect call.
+ *
+ * The V and C flag stores in the handlers are written so that the core can
+ * compute those flags lazily (M68K_LAZY_FLAGS in m68kconf.h), see
+ * rewrite_lazy_flags().
+ *
  * If you modify the input file greatly from its released form, you may have
  * to tweak the configuration section a bit since I'm using static allocation
  * to keep things simple.
@@ -88,11 +98,13 @@ static const char g_version[] = "4.60";
 #define EA_ALLOWED_LENGTH                11	/* Max length of ea allowed str */
 #define MAX_OPCODE_INPUT_TABLE_LENGTH  1000	/* Max length of opcode handler tbl */
 #define MAX_OPCODE_OUTPUT_TABLE_LENGTH 3000	/* Max length of opcode handler tbl */
+#define MAX_FUSE_PAIRS                  256	/* Max number of fused handler pairs */
 
 /* Default filenames */
 #define FILENAME_INPUT      "m68k_in.c"
 #define FILENAME_PROTOTYPE  "m68kops.h"
 #define FILENAME_TABLE      "m68kops.c"
+#define FILENAME_FUSE       "m68k_fuse.txt"
 
 
 /* Identifier sequences recognized by this program */
@@ -178,6 +190,7 @@ enum
 typedef struct
 {
 	char name[MAX_NAME_LENGTH];           /* opcode handler name */
+	char mnemonic[MAX_NAME_LENGTH];       /* opcode name from the input table */
 	unsigned char size;                   /* Size of operation */
 	char spec_proc[MAX_SPEC_PROC_LENGTH]; /* Special processing mode */
 	char spec_ea[MAX_SPEC_EA_LENGTH];     /* Specified effective addressing mode */
@@ -209,6 +222,14 @@ typedef struct
 } body_struct;
 
 
+/* A pair of handlers to fuse, names include the m68k_op_ prefix */
+typedef struct
+{
+	char first[MAX_NAME_LENGTH];
+	char second[MAX_NAME_LENGTH];
+} fuse_pair_struct;
+
+
 /* Holds a sequence of search / replace strings */
 typedef struct
 {
@@ -231,12 +252,20 @@ opcode_struct* find_opcode(char* name, int size, char* spec_proc, char* spec_ea)
 opcode_struct* find_illegal_opcode(void);
 int extract_opcode_info(char* src, char* name, int* size, char* spec_proc, char* spec_ea);
 void add_replace_string(replace_struct* replace, char* search_str, char* replace_str);
+int is_ident_char(char c);
+int find_flag_store(char* line, const char* flag);
+int expression_length(char* str);
+void rewrite_flag_stores(char* line);
+int is_nz_store(char* line);
+int is_c_store(char* line, char* c_store);
+void rewrite_lazy_flags(char lines[][MAX_LINE_LENGTH*2+1], int length);
 void write_body(FILE* filep, body_struct* body, replace_struct* replace);
 void get_base_name(char* base_name, opcode_struct* op);
 void write_function_name(FILE* filep, char* base_name);
 void add_opcode_output_table_entry(opcode_struct* op, char* name);
 static int DECL_SPEC compare_nof_true_bits(const void* aptr, const void* bptr);
 void print_opcode_output_table(FILE* filep);
+void print_opcode_info_table(FILE* filep);
 void write_table_entry(FILE* filep, opcode_struct* op);
 void set_opcode_struct(opcode_struct* src, opcode_struct* dst, int ea_mode);
 void generate_opcode_handler(FILE* filep, body_struct* body, replace_struct* replace, opcode_struct* opinfo, int ea_mode);
@@ -245,6 +274,8 @@ void generate_opcode_cc_variants(FILE* filep, body_struct* body, replace_struct*
 void process_opcode_handlers(FILE* filep);
 void populate_table(void);
 void read_insert(char* insert);
+void read_fuse_list(void);
+void process_fused_handlers(FILE* filep);
 
 
 
@@ -254,6 +285,7 @@ void read_insert(char* insert);
 
 /* Name of the input file */
 char g_input_filename[M68K_MAX_PATH] = FILENAME_INPUT;
+char g_fuse_filename[M68K_MAX_PATH] = FILENAME_FUSE;
 
 /* File handles */
 FILE* g_input_file = NULL;
@@ -270,6 +302,10 @@ opcode_struct g_opcode_input_table[MAX_OPCODE_INPUT_TABLE_LENGTH];
 opcode_struct g_opcode_output_table[MAX_OPCODE_OUTPUT_TABLE_LENGTH];
 int g_opcode_output_table_length = 0;
 
+/* Handler pairs to fuse */
+fuse_pair_struct g_fuse_pairs[MAX_FUSE_PAIRS];
+int g_fuse_pairs_length = 0;
+
 const ea_info_struct g_ea_info_table[13] =
 {/* fname    ea        mask  match */
 	{"",     "",       0x00, 0x00}, /* EA_MODE_NONE */
@@ -731,9 +767,154 @@ void add_replace_string(replace_struct* replace, char* search_str, char* replace
 	strcpy(replace->replace[replace->length++][1], replace_str);
 }
 
+/* Lazy condition codes (see M68K_LAZY_FLAGS in m68kconf.h).
+ *
+ * A V store from one of the add/sub macros that is followed by the matching
+ * C store, with only N and Z stores in between, becomes a single
+ * m68ki_lazy_vc() call that records the operands instead.  Every other
+ * store to V or C is turned into m68ki_set_flag_v/c(), so the core can tell
+ * a write, which drops the pending flag, from a read, which has to compute
+ * it first.  With M68K_LAZY_FLAGS off these expand to the plain stores.
+ */
+int is_ident_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Offset of the first store to flag (FLAG_V or FLAG_C) in line, or -1 */
+int find_flag_store(char* line, const char* flag)
+{
+	char* ptr = line;
+	char* end;
+
+	while((ptr = strstr(ptr, flag)) != NULL)
+	{
+		end = ptr + strlen(flag);
+		if((ptr == line || !is_ident_char(ptr[-1])) && !is_ident_char(*end))
+		{
+			end += skip_spaces(end);
+			if(end[0] == '=' && end[1] != '=')
+				return ptr - line;
+		}
+		ptr++;
+	}
+	return -1;
+}
+
+/* Length of the expression at str, up to a ; or , outside of parentheses or
+ * an unmatched ).  -1 if the statement doesn't end on this line.
+ */
+int expression_length(char* str)
+{
+	int depth = 0;
+	char* ptr;
+
+	for(ptr=str;*ptr;ptr++)
+	{
+		if(*ptr == '(')
+			depth++;
+		else if(*ptr == ')' && --depth < 0)
+			return ptr - str;
+		else if((*ptr == ';' || *ptr == ',') && depth == 0)
+			return ptr - str;
+	}
+	return -1;
+}
+
+/* FLAG_V = x; -> m68ki_set_flag_v(x); and the same for FLAG_C */
+void rewrite_flag_stores(char* line)
+{
+	static const char* flags[2][2] = {{"FLAG_V", "m68ki_set_flag_v"}, {"FLAG_C", "m68ki_set_flag_c"}};
+	char temp_buff[MAX_LINE_LENGTH*2+1];
+	char* expr;
+	int offset;
+	int length;
+	int i;
+
+	for(i=0;i<2;i++)
+	{
+		while((offset = find_flag_store(line, flags[i][0])) >= 0)
+		{
+			expr = strchr(line + offset, '=') + 1;
+			expr += skip_spaces(expr);
+			if((length = expression_length(expr)) < 0)
+				break;
+			sprintf(temp_buff, "%.*s%s(%.*s)%s", offset, line, flags[i][1], length, expr, expr + length);
+			strcpy(line, temp_buff);
+		}
+	}
+}
+
+int is_nz_store(char* line)
+{
+	char* ptr = line + strspn(line, " \t");
+
+	return strncmp(ptr, "FLAG_N = ", 9) == 0 || strncmp(ptr, "FLAG_Z = ", 9) == 0 || strncmp(ptr, "FLAG_Z |= ", 10) == 0;
+}
+
+/* FLAG_C = c_store or FLAG_X = FLAG_C = c_store */
+int is_c_store(char* line, char* c_store)
+{
+	char* ptr = line + strspn(line, " \t");
+
+	return (strncmp(ptr, "FLAG_C = ", 9) == 0 && strcmp(ptr + 9, c_store) == 0) ||
+	       (strncmp(ptr, "FLAG_X = FLAG_C = ", 18) == 0 && strcmp(ptr + 18, c_store) == 0);
+}
+
+/* Turn the V and C stores of add/sub results into m68ki_lazy_vc() calls */
+void rewrite_lazy_flags(char lines[][MAX_LINE_LENGTH*2+1], int length)
+{
+	char op[MAX_LINE_LENGTH+1];
+	char src[MAX_LINE_LENGTH+1];
+	char dst[MAX_LINE_LENGTH+1];
+	char res[MAX_LINE_LENGTH+1];
+	char c_store[MAX_LINE_LENGTH*2+1];
+	char tail[MAX_LINE_LENGTH+1];
+	char* ptr;
+	int indent;
+	int size;
+	int i;
+	int j;
+
+	for(i=0;i<length;i++)
+	{
+		indent = strspn(lines[i], " \t");
+		tail[0] = 0;
+		if(sscanf(lines[i] + indent, "FLAG_V = VFLAG_%3[A-Z]_%d(%[^,], %[^,], %[^)]);%s", op, &size, src, dst, res, tail) != 5)
+			continue;
+		if(strcmp(op, "ADD") != 0 && strcmp(op, "SUB") != 0)
+			continue;
+
+		if(size == 32)
+			sprintf(c_store, "CFLAG_%s_32(%s, %s, %s);", op, src, dst, res);
+		else
+			sprintf(c_store, "CFLAG_%d(%s);", size, res);
+
+		/* The C store may come before or after the V store */
+		for(j=i+1;j<length && is_nz_store(lines[j]);j++)
+			;
+		if(j == length || !is_c_store(lines[j], c_store))
+		{
+			for(j=i-1;j>=0 && is_nz_store(lines[j]);j--)
+				;
+			if(j < 0 || !is_c_store(lines[j], c_store))
+				continue;
+		}
+
+		ptr = lines[j] + strspn(lines[j], " \t");
+		if(strncmp(ptr, "FLAG_C = ", 9) == 0)
+			lines[j][0] = 0;
+		else
+			sprintf(ptr, "FLAG_X = %s", c_store);
+
+		sprintf(lines[i] + indent, "m68ki_lazy_vc(%s_%d, %s, %s, %s);", op, size, src, dst, res);
+	}
+}
+
 /* Write a function body while replacing any selected strings */
 void write_body(FILE* filep, body_struct* body, replace_struct* replace)
 {
+	static char lines[MAX_BODY_LENGTH][MAX_LINE_LENGTH*2+1];
 	int i;
 	int j;
 	char* ptr;
@@ -765,7 +946,17 @@ void write_body(FILE* filep, body_struct* body, replace_struct* replace)
 			if(!found)
 				error_exit("Unknown " ID_BASE " directive [%s]", output);
 		}
-		fprintf(filep, "%s\n", output);
+		strcpy(lines[i], output);
+	}
+
+	rewrite_lazy_flags(lines, body->length);
+	for(i=0;i<body->length;i++)
+	{
+		/* A C store folded into m68ki_lazy_vc() */
+		if(body->body[i][0] != 0 && lines[i][0] == 0)
+			continue;
+		rewrite_flag_stores(lines[i]);
+		fprintf(filep, "%s\n", lines[i]);
 	}
 	fprintf(filep, "\n\n");
 }
@@ -797,6 +988,7 @@ void add_opcode_output_table_entry(opcode_struct* op, char* name)
 	ptr = g_opcode_output_table + g_opcode_output_table_length++;
 
 	*ptr = *op;
+	strcpy(ptr->mnemonic, op->name);
 	strcpy(ptr->name, name);
 	ptr->bits = num_bits(ptr->op_mask);
 }
@@ -825,6 +1017,24 @@ void print_opcode_output_table(FILE* filep)
 		write_table_entry(filep, g_opcode_output_table+i);
 }
 
+/* Write the handler name table used by the M68K_OPCODE_STATS report */
+void print_opcode_info_table(FILE* filep)
+{
+	int i;
+	opcode_struct* op;
+
+	fprintf(filep, "#if M68K_OPCODE_STATS\n");
+	fprintf(filep, "const m68ki_opcode_info_struct m68ki_opcode_info_table[] =\n{\n");
+	for(i=0;i<g_opcode_output_table_length;i++)
+	{
+		op = g_opcode_output_table+i;
+		fprintf(filep, "\t{%-28s, \"%s\", \"%s\", %2d, \"%s\"},\n",
+			op->name, op->name + strlen("m68k_op_"), op->mnemonic, op->size,
+			strcmp(op->spec_ea, UNSPECIFIED) != 0 ? op->spec_ea : "");
+	}
+	fprintf(filep, "\t{0, 0, 0, 0, 0}\n};\n#endif /* M68K_OPCODE_STATS */\n\n");
+}
+
 /* Write an entry in the opcode handler table */
 void write_table_entry(FILE* filep, opcode_struct* op)
 {
@@ -1209,6 +1419,134 @@ void read_insert(char* insert)
 
 
 
+/* Is name the first handler of any fused pair? */
+static int is_fused_first(char* name)
+{
+	int i;
+
+	for(i=0;i<g_fuse_pairs_length;i++)
+		if(strcmp(g_fuse_pairs[i].first, name) == 0)
+			return 1;
+	return 0;
+}
+
+static int is_output_handler(char* name)
+{
+	int i;
+
+	for(i=0;i<g_opcode_output_table_length;i++)
+		if(strcmp(g_opcode_output_table[i].name, name) == 0)
+			return 1;
+	return 0;
+}
+
+/* Read the handler pairs to fuse.  One pair per line, handler names as in the
+ * [pair] section of the M68K_OPCODE_STATS report, # starts a comment.
+ */
+void read_fuse_list(void)
+{
+	char line[MAX_LINE_LENGTH+1];
+	char first[MAX_LINE_LENGTH+1];
+	char second[MAX_LINE_LENGTH+1];
+	FILE* filep;
+	int line_number = 0;
+	int i;
+
+	if((filep = fopen(g_fuse_filename, "rt")) == NULL)
+		return;
+
+	while(fgets(line, MAX_LINE_LENGTH, filep) != NULL)
+	{
+		line_number++;
+		if(strchr(line, '#') != NULL)
+			*strchr(line, '#') = 0;
+		if(sscanf(line, "%s %s", first, second) != 2)
+			continue;
+
+		if(g_fuse_pairs_length >= MAX_FUSE_PAIRS)
+			error_exit("%s: too many pairs", g_fuse_filename);
+		if(strlen(first) + 8 >= MAX_NAME_LENGTH || strlen(second) + 8 >= MAX_NAME_LENGTH)
+			error_exit("%s:%d: handler name too long", g_fuse_filename, line_number);
+
+		sprintf(g_fuse_pairs[g_fuse_pairs_length].first, "m68k_op_%s", first);
+		sprintf(g_fuse_pairs[g_fuse_pairs_length].second, "m68k_op_%s", second);
+		if(!is_output_handler(g_fuse_pairs[g_fuse_pairs_length].first))
+			error_exit("%s:%d: unknown handler %s", g_fuse_filename, line_number, first);
+		if(!is_output_handler(g_fuse_pairs[g_fuse_pairs_length].second))
+			error_exit("%s:%d: unknown handler %s", g_fuse_filename, line_number, second);
+		for(i=0;i<g_fuse_pairs_length;i++)
+			if(strcmp(g_fuse_pairs[i].first, g_fuse_pairs[g_fuse_pairs_length].first) == 0 &&
+			   strcmp(g_fuse_pairs[i].second, g_fuse_pairs[g_fuse_pairs_length].second) == 0)
+				error_exit("%s:%d: duplicate pair %s %s", g_fuse_filename, line_number, first, second);
+		g_fuse_pairs_length++;
+	}
+
+	fclose(filep);
+}
+
+/* Write one fused handler per distinct first handler, and the table
+ * m68ki_build_opcode_table() installs them from (empty without a fuse list).
+ * The second handler is recognized by its jump table entry, which is the
+ * fused one if it starts a pair itself, but always called in its plain form
+ * so fused handlers never nest.
+ */
+void process_fused_handlers(FILE* filep)
+{
+	int i;
+	int j;
+
+	fprintf(filep, "#if M68K_FUSE_INSTRUCTIONS && !M68K_OPCODE_STATS\n\n");
+	for(i=0;i<g_fuse_pairs_length;i++)
+	{
+		for(j=0;j<i;j++)
+			if(strcmp(g_fuse_pairs[j].first, g_fuse_pairs[i].first) == 0)
+				break;
+		if(j == i)
+			fprintf(filep, "static void %s_fused(void);\n", g_fuse_pairs[i].first);
+	}
+	fprintf(filep, "\n\n");
+	for(i=0;i<g_fuse_pairs_length;i++)
+	{
+		char* first = g_fuse_pairs[i].first;
+
+		for(j=0;j<i;j++)
+			if(strcmp(g_fuse_pairs[j].first, first) == 0)
+				break;
+		if(j < i)
+			continue;
+
+		fprintf(filep, "static void %s_fused(void)\n{\n", first);
+		fprintf(filep, "\t%s();\n", first);
+		fprintf(filep, "\tif(m68ki_fuse_allowed())\n\t{\n");
+		fprintf(filep, "\t\tvoid (*next)(void) = m68ki_instruction_jump_table[MASK_OUT_ABOVE_16(CPU_PREF_DATA)];\n\n");
+		for(j=i;j<g_fuse_pairs_length;j++)
+		{
+			char* second = g_fuse_pairs[j].second;
+
+			if(strcmp(g_fuse_pairs[j].first, first) != 0)
+				continue;
+			fprintf(filep, "\t\t%sif(next == %s%s)\n\t\t{\n", j == i ? "" : "else ", second, is_fused_first(second) ? "_fused" : "");
+			fprintf(filep, "\t\t\tm68ki_fuse_fetch();\n");
+			fprintf(filep, "\t\t\t%s();\n\t\t}\n", second);
+		}
+		fprintf(filep, "\t}\n}\n\n\n");
+	}
+
+	fprintf(filep, "/* Jump table entries of the first handler of a pair are replaced by the fused one */\n");
+	fprintf(filep, "static const struct\n{\n\tvoid (*opcode_handler)(void);\n\tvoid (*fused_handler)(void);\n} m68ki_fused_handler_table[] =\n{\n");
+	for(i=0;i<g_fuse_pairs_length;i++)
+	{
+		for(j=0;j<i;j++)
+			if(strcmp(g_fuse_pairs[j].first, g_fuse_pairs[i].first) == 0)
+				break;
+		if(j == i)
+			fprintf(filep, "\t{%s, %s_fused},\n", g_fuse_pairs[i].first, g_fuse_pairs[i].first);
+	}
+	fprintf(filep, "\t{0, 0}\n};\n\n#endif /* M68K_FUSE_INSTRUCTIONS && !M68K_OPCODE_STATS */\n\n");
+}
+
+
+
 /* ======================================================================== */
 /* ============================= MAIN FUNCTION ============================ */
 /* ======================================================================== */
@@ -1252,6 +1590,8 @@ int main(int argc, char **argv)
 			strcat(output_path, "/");
 		if(argc > 2)
 			strcpy(g_input_filename, argv[2]);
+		if(argc > 3)
+			strcpy(g_fuse_filename, argv[3]);
 	}
 
 
@@ -1353,6 +1693,8 @@ int main(int argc, char **argv)
 
 			fprintf(g_table_file, "%s\n\n", ophandler_header_insert);
 			process_opcode_handlers(g_table_file);
+			read_fuse_list();
+			process_fused_handlers(g_table_file);
 			fprintf(g_table_file, "%s\n\n", ophandler_footer_insert);
 
 			ophandler_body_read = 1;
@@ -1380,6 +1722,7 @@ int main(int argc, char **argv)
 			fprintf(g_table_file, "%s\n\n", table_header_insert);
 			print_opcode_output_table(g_table_file);
 			fprintf(g_table_file, "%s\n\n", table_footer_insert);
+			print_opcode_info_table(g_table_file);
 
 			fprintf(g_prototype_file, "%s\n\n", prototype_footer_insert);
 
@@ -1397,6 +1740,8 @@ int main(int argc, char **argv)
 	fclose(g_input_file);
 
 	printf("Generated %d opcode handlers from %d primitives\n", g_num_functions, g_num_primitives);
+	if(g_fuse_pairs_length)
+		printf("Fused %d handler pairs from %s\n", g_fuse_pairs_length, g_fuse_filename);
 
 	return 0;
 }
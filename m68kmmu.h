@@ -129,6 +129,94 @@ void pmmu_set_buserror(uint32 addr_in)
 }
 
 
+// pmmu_atc_set: index of the first entry of the ATC set holding this page
+static inline int pmmu_atc_set(uint32 logical, int fc, int ps)
+{
+	return (((logical >> ps) ^ (fc << 2)) & (MMU_ATC_SETS - 1)) * MMU_ATC_WAYS;
+}
+
+// pmmu_tlb_flush: invalidate the whole soft-TLB and pick up the current page size
+void pmmu_tlb_flush()
+{
+	if (CPU_TYPE_IS_040_PLUS(m68ki_cpu.cpu_type))
+	{
+		m68ki_cpu.mmu_tlb_shift = (m68ki_cpu.mmu_tc & 0x4000) ? 13 : 12;
+	}
+	else
+	{
+		m68ki_cpu.mmu_tlb_shift = (m68ki_cpu.mmu_tc >> 20) & 0xf;
+	}
+	memset(m68ki_cpu.mmu_tlb_tag, 0xff, sizeof(m68ki_cpu.mmu_tlb_tag));
+	m68ki_fetch_invalidate();
+}
+
+// pmmu_tlb_flush_page: drop the soft-TLB entries of one logical page
+static void pmmu_tlb_flush_page(uint32 page, int fc)
+{
+	uint32 idx = (page ^ (fc << 5)) & (MMU_TLB_ENTRIES - 1);
+
+	for (int rw = 0; rw < 2; rw++)
+	{
+		if (m68ki_cpu.mmu_tlb_tag[rw][idx] == ((page << 3) | fc))
+		{
+			m68ki_cpu.mmu_tlb_tag[rw][idx] = ~0;
+		}
+	}
+	m68ki_fetch_invalidate();
+}
+
+// pmmu_atc_evict: invalidate an ATC entry along with the soft-TLB pages it backs
+static void pmmu_atc_evict(int i)
+{
+	uint32 e = m68ki_cpu.mmu_atc_tag[i];
+	int ps = (m68ki_cpu.mmu_tc >> 20) & 0xf;
+
+	if (e & M68K_MMU_ATC_VALID)
+	{
+		pmmu_tlb_flush_page((e & M68K_MMU_ATC_MASK) >> (ps - 8), (e >> 24) & 7);
+	}
+	m68ki_cpu.mmu_atc_tag[i] = 0;
+}
+
+// pmmu_tlb_add: cache a completed translation in the soft-TLB
+void pmmu_tlb_add(uint32 logical, uint32 physical, int fc, int rw)
+{
+	uint32 shift = m68ki_cpu.mmu_tlb_shift;
+	uint32 page = logical >> shift;
+	uint32 idx = (page ^ (fc << 5)) & (MMU_TLB_ENTRIES - 1);
+	uint32 phys = (physical >> shift) << shift;
+	uint32 phys_end = phys + ((1 << shift) - 1);
+	unsigned char *host = NULL;
+
+	// only hand out a host pointer if the whole page lives in one range
+	if (rw)
+	{
+		for (int i = 0; i < read_ranges; i++)
+		{
+			if (phys >= read_addr[i] && phys_end < read_upper[i])
+			{
+				host = read_data[i] + (phys - read_addr[i]);
+				break;
+			}
+		}
+	}
+	else
+	{
+		for (int i = 0; i < write_ranges; i++)
+		{
+			if (phys >= write_addr[i] && phys_end < write_upper[i])
+			{
+				host = write_data[i] + (phys - write_addr[i]);
+				break;
+			}
+		}
+	}
+
+	m68ki_cpu.mmu_tlb_tag[rw][idx] = (page << 3) | fc;
+	m68ki_cpu.mmu_tlb_phys[rw][idx] = phys;
+	m68ki_cpu.mmu_tlb_host[rw][idx] = host;
+}
+
 // pmmu_atc_add: adds this address to the ATC
 void pmmu_atc_add(uint32 logical, uint32 physical, int fc, int rw)
 {
@@ -136,6 +224,7 @@ void pmmu_atc_add(uint32 logical, uint32 physical, int fc, int rw)
 	int ps = (m68ki_cpu.mmu_tc >> 20) & 0xf;
 	uint32 atc_tag = M68K_MMU_ATC_VALID | ((fc & 7) << 24) | ((logical >> ps) << (ps - 8));
 	uint32 atc_data = (physical >> ps) << (ps - 8);
+	int set = pmmu_atc_set(logical, fc, ps);
 
 	if (m68ki_cpu.mmu_tmp_sr & (M68K_MMU_SR_BUS_ERROR|M68K_MMU_SR_INVALID|M68K_MMU_SR_SUPERVISOR_ONLY))
 	{
@@ -153,7 +242,7 @@ void pmmu_atc_add(uint32 logical, uint32 physical, int fc, int rw)
 	}
 
 	// first see if this is already in the cache
-	for (int i = 0; i < MMU_ATC_ENTRIES; i++)
+	for (int i = set; i < set + MMU_ATC_WAYS; i++)
 	{
 		// if tag bits and function code match, don't add
 		if (m68ki_cpu.mmu_atc_tag[i] == atc_tag)
@@ -166,7 +255,7 @@ void pmmu_atc_add(uint32 logical, uint32 physical, int fc, int rw)
 
 	// find an open entry
 	int found = -1;
-	for (int i = 0; i < MMU_ATC_ENTRIES; i++)
+	for (int i = set; i < set + MMU_ATC_WAYS; i++)
 	{
 		if (!(m68ki_cpu.mmu_atc_tag[i] & M68K_MMU_ATC_VALID))
 		{
@@ -175,15 +264,14 @@ void pmmu_atc_add(uint32 logical, uint32 physical, int fc, int rw)
 		}
 	}
 
-	// did we find an entry?  steal one by round-robin then
+	// did we find an entry?  steal one from this set by round-robin then
 	if (found == -1)
 	{
-		found = m68ki_cpu.mmu_atc_rr++;
+		uint8 *rr = &m68ki_cpu.mmu_atc_rr[set / MMU_ATC_WAYS];
 
-		if (m68ki_cpu.mmu_atc_rr >= MMU_ATC_ENTRIES)
-		{
-			m68ki_cpu.mmu_atc_rr = 0;
-		}
+		found = set + *rr;
+		*rr = (*rr + 1) % MMU_ATC_WAYS;
+		pmmu_atc_evict(found);
 	}
 
 	// add the entry
@@ -201,7 +289,9 @@ void pmmu_atc_flush()
 //	std::fill(std::begin(m68ki_cpu.mmu_atc_tag), std::end(m68ki_cpu.mmu_atc_tag), 0);
 	for(int i=0;i<MMU_ATC_ENTRIES;i++)
 		m68ki_cpu.mmu_atc_tag[i]=0;
-	m68ki_cpu.mmu_atc_rr = 0;
+	for(int i=0;i<MMU_ATC_SETS;i++)
+		m68ki_cpu.mmu_atc_rr[i]=0;
+	pmmu_tlb_flush();
 }
 
 int fc_from_modes(uint16 modes);
@@ -229,7 +319,7 @@ void pmmu_atc_flush_fc_ea(uint16 modes)
 			if ((e & M68K_MMU_ATC_VALID) && ((e >> 24) & fcmask) == fc)
 			{
 				MMULOG(("flushing entry %08x\n", e));
-				m68ki_cpu.mmu_atc_tag[i] = 0;
+				pmmu_atc_evict(i);
 			}
 		}
 		break;
@@ -247,7 +337,7 @@ void pmmu_atc_flush_fc_ea(uint16 modes)
 				( (e << ps) == (ea >> 8 << ps) ))
 			{
 				MMULOG(("flushing entry %08x\n", e));
-				m68ki_cpu.mmu_atc_tag[i] = 0;
+				pmmu_atc_evict(i);
 			}
 		}
 		break;
@@ -265,8 +355,9 @@ uint16 pmmu_atc_lookup(uint32 addr_in, int fc, uint16 rw,
 	MMULOG(("%s: LOOKUP addr_in=%08x, fc=%d, ptest=%d, rw=%d\n", __func__, addr_in, fc, ptest,rw));
 	unsigned int ps = (m68ki_cpu.mmu_tc >> 20) & 0xf;
 	uint32 atc_tag = M68K_MMU_ATC_VALID | ((fc & 7) << 24) | ((addr_in >> ps) << (ps - 8));
+	int set = pmmu_atc_set(addr_in, fc, ps);
 
-	for (int i = 0; i < MMU_ATC_ENTRIES; i++)
+	for (int i = set; i < set + MMU_ATC_WAYS; i++)
 	{
 
 		if (m68ki_cpu.mmu_atc_tag[i] != atc_tag)
@@ -285,7 +376,7 @@ uint16 pmmu_atc_lookup(uint32 addr_in, int fc, uint16 rw,
 			// entry, and creating a new entry with the M bit set.
 			if (!(atc_data & M68K_MMU_ATC_MODIFIED))
 			{
-				m68ki_cpu.mmu_atc_tag[i] = 0;
+				pmmu_atc_evict(i);
 				continue;
 			}
 		}
@@ -894,6 +985,12 @@ uint32 pmmu_translate_addr(uint32 addr_in, uint16 rw)
 		addr_out = pmmu_translate_addr_with_fc(addr_in, m68ki_cpu.mmu_tmp_fc, rw,7,0,0);
 		MMULOG(("ADDRIN %08X, ADDROUT %08X\n", addr_in, addr_out));
 	}
+
+	// remember good translations so the next access to this page skips the ATC
+	if (!m68ki_cpu.mmu_tmp_buserror_occurred)
+	{
+		pmmu_tlb_add(addr_in, addr_out, m68ki_cpu.mmu_tmp_fc, rw);
+	}
 	return addr_out;
 }
 
@@ -1058,6 +1155,7 @@ void m68851_pmove_put(uint32 ea, uint16 modes)
 			MMULOG(("WRITE TT1 = 0x%08x\n", m68ki_cpu.mmu_tt1));
 			m68ki_cpu.mmu_tt1 = temp;
 		}
+		pmmu_tlb_flush();
 		break;
 
 		// FIXME: unreachable
@@ -1108,6 +1206,10 @@ void m68851_pmove_put(uint32 ea, uint16 modes)
 			{
 				pmmu_atc_flush();
 			}
+			else    // the ATC survives, but the soft-TLB page size may have changed
+			{
+				pmmu_tlb_flush();
+			}
 			break;
 
 		case 2: // supervisor root pointer
@@ -1126,6 +1228,10 @@ void m68851_pmove_put(uint32 ea, uint16 modes)
 			{
 				pmmu_atc_flush();
 			}
+			else
+			{
+				pmmu_tlb_flush();
+			}
 			break;
 
 		case 3: // CPU root pointer
@@ -1144,6 +1250,10 @@ void m68851_pmove_put(uint32 ea, uint16 modes)
 			{
 				pmmu_atc_flush();
 			}
+			else
+			{
+				pmmu_tlb_flush();
+			}
 			break;
 
 		case 7: // MC68851 Access Control Register
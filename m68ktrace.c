@@ -0,0 +1,195 @@
+// m68ktrace - decodes the binary instruction trace written by m68k_itrace_start().
+//
+// Puts the ring back in order, disassembles every record with m68kdasm.c
+// and prints the registers it changed and the memory it touched:
+//
+//   00F800D2  41F9 00DF F000        lea     $dff000.l, A0             A0=00DFF000
+//                                   W.w 00DFF09A 7FFF
+//
+// Registers are listed with their new value.  With -r every record is
+// followed by the complete register set as far as it is known: once the
+// ring has wrapped, the start state in the file header is gone and a
+// register only becomes known when an instruction changes it.
+//
+// usage: m68ktrace [-n records] [-r] trace.bin
+//   -n  only show the last n records
+//   -r  print all registers after every record
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "m68k.h"
+#include "m68ktrace.h"
+
+static const char *reg_names[M68K_ITRACE_NUM_REGS] = {
+  "D0", "D1", "D2", "D3", "D4", "D5", "D6", "D7",
+  "A0", "A1", "A2", "A3", "A4", "A5", "A6", "A7", "SR",
+};
+
+static uint32_t regs[M68K_ITRACE_NUM_REGS], regs_known;
+static int show_regs;
+
+// m68k_disassemble_raw() takes the instruction from the record, these are
+// only here to satisfy the linker.
+unsigned int m68k_read_disassembler_16(unsigned int address) {
+  (void)address;
+  return 0;
+}
+
+unsigned int m68k_read_disassembler_32(unsigned int address) {
+  (void)address;
+  return 0;
+}
+
+static void print_regs(void) {
+  for (int i = 0; i < M68K_ITRACE_NUM_REGS; i++) {
+    if (regs_known & (1 << i))
+      printf("%s%s:%.*X", (i % 8) ? " " : (i ? "\n  " : "  "), reg_names[i], (i == 16) ? 4 : 8, regs[i]);
+    else
+      printf("%s%s:%s", (i % 8) ? " " : (i ? "\n  " : "  "), reg_names[i], (i == 16) ? "????" : "????????");
+  }
+  printf("\n");
+}
+
+// Returns the size of the record.
+static uint32_t print_record(uint8_t *p, unsigned int cpu_type, int show) {
+  struct m68k_itrace_record *rec = (struct m68k_itrace_record *)p;
+  uint16_t *words = (uint16_t *)(rec + 1);
+  uint32_t *values = (uint32_t *)((uint8_t *)words + ((rec->num_words * 2 + 3) & ~3));
+  struct m68k_itrace_mem *mem;
+  uint8_t code[(M68K_ITRACE_MAX_WORDS + 1) * 2];
+  char disasm[256], line[512];
+  int len, i;
+
+  for (i = 0; i < M68K_ITRACE_NUM_REGS; i++) {
+    if (rec->reg_mask & (1 << i))
+      regs[i] = *values++;
+  }
+  regs_known |= rec->reg_mask;
+  mem = (struct m68k_itrace_mem *)values;
+
+  if (show) {
+    memset(code, 0x00, sizeof(code));
+    for (i = 0; i < rec->num_words; i++) {
+      code[i * 2] = words[i] >> 8;
+      code[i * 2 + 1] = words[i] & 0xFF;
+    }
+    if (rec->num_words)
+      m68k_disassemble_raw(disasm, rec->pc, code, NULL, cpu_type);
+    else
+      strcpy(disasm, "(no instruction)");
+
+    len = sprintf(line, "%.8X ", rec->pc);
+    for (i = 0; i < rec->num_words && i < 5; i++)
+      len += sprintf(line + len, " %.4X", words[i]);
+    len += sprintf(line + len, "%s", (rec->num_words > 5) ? "+" : "");
+    printf("%-34s %-28s", line, disasm);
+
+    for (i = 0; i < M68K_ITRACE_NUM_REGS; i++) {
+      if (rec->reg_mask & (1 << i))
+        printf(" %s=%.*X", reg_names[i], (i == 16) ? 4 : 8, regs[i]);
+    }
+    if (rec->flags & M68K_ITRACE_ABORTED)
+      printf(" [aborted]");
+    printf("\n");
+
+    for (i = 0; i < rec->num_mem; i++) {
+      int size = mem[i].info & 0xFF;
+      printf("%34s %c.%c %.8X %.*X\n", "", (mem[i].info & M68K_ITRACE_WRITE) ? 'W' : 'R',
+             (size == 1) ? 'b' : (size == 2) ? 'w' : 'l', mem[i].address, size * 2, mem[i].value);
+    }
+    if (rec->flags & M68K_ITRACE_MEM_OVERFLOW)
+      printf("%34s (more memory accesses not recorded)\n", "");
+    if (show_regs)
+      print_regs();
+  }
+
+  return sizeof(*rec) + ((rec->num_words * 2 + 3) & ~3) + __builtin_popcount(rec->reg_mask) * 4 +
+         rec->num_mem * sizeof(struct m68k_itrace_mem);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long long last = 0, total = 0, n = 0, skip;
+  struct m68k_itrace_header *h;
+  struct stat st;
+  uint64_t first_seq;
+  uint8_t *map;
+  int opt, fd;
+
+  while ((opt = getopt(argc, argv, "n:r")) != -1) {
+    switch (opt) {
+      case 'n':
+        last = strtoull(optarg, NULL, 0);
+        break;
+      case 'r':
+        show_regs = 1;
+        break;
+      default:
+        printf("usage: %s [-n records] [-r] trace.bin\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    printf("usage: %s [-n records] [-r] trace.bin\n", argv[0]);
+    return 1;
+  }
+
+  fd = open(argv[optind], O_RDONLY);
+  if (fd == -1 || fstat(fd, &st) != 0 || st.st_size < M68K_ITRACE_HEADER_SIZE) {
+    printf("Failed to open %s.\n", argv[optind]);
+    return 1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    printf("Failed to map %s.\n", argv[optind]);
+    return 1;
+  }
+
+  h = (struct m68k_itrace_header *)map;
+  if (memcmp(h->magic, M68K_ITRACE_MAGIC, sizeof(h->magic)) != 0 || h->version != M68K_ITRACE_VERSION ||
+      M68K_ITRACE_HEADER_SIZE + (uint64_t)h->num_blocks * h->block_size > (uint64_t)st.st_size) {
+    printf("%s is not a trace file.\n", argv[optind]);
+    return 1;
+  }
+
+  // The block being written when recording stopped is the newest one, the
+  // one after it in the ring the oldest that is still complete.
+  first_seq = (h->block_seq + 1 > h->num_blocks) ? h->block_seq + 1 - h->num_blocks : 0;
+  if (first_seq == 0) {
+    memcpy(regs, h->regs, sizeof(regs));
+    regs_known = (1 << M68K_ITRACE_NUM_REGS) - 1;
+  }
+
+  for (uint64_t seq = first_seq; seq <= h->block_seq; seq++) {
+    struct m68k_itrace_block *b = (struct m68k_itrace_block *)(map + M68K_ITRACE_HEADER_SIZE + (seq % h->num_blocks) * h->block_size);
+    if (b->seq == seq)
+      total += b->records;
+  }
+  skip = (last && last < total) ? total - last : 0;
+
+  printf("%llu records in the trace, %llu written in total.\n", total, (unsigned long long)h->records);
+  if (first_seq != 0)
+    printf("The ring has wrapped, register values are unknown until they change.\n");
+
+  for (uint64_t seq = first_seq; seq <= h->block_seq; seq++) {
+    struct m68k_itrace_block *b = (struct m68k_itrace_block *)(map + M68K_ITRACE_HEADER_SIZE + (seq % h->num_blocks) * h->block_size);
+    uint8_t *p = (uint8_t *)(b + 1);
+    uint32_t offset = 0;
+
+    if (b->seq != seq || b->used > h->block_size - sizeof(*b))
+      continue;
+    while (offset < b->used) {
+      offset += print_record(p + offset, h->cpu_type, n >= skip);
+      n++;
+    }
+  }
+
+  munmap(map, st.st_size);
+  close(fd);
+  return 0;
+}
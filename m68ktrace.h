@@ -0,0 +1,82 @@
+/*
+    m68ktrace.h - binary instruction trace format
+
+    Written by the M68K_ITRACE recorder in m68kcpu.c, read back by the
+    m68ktrace decoder.  The file is a M68K_ITRACE_HEADER_SIZE header followed
+    by num_blocks blocks of block_size bytes that are used as a ring.  Records
+    never straddle a block and every block starts with its sequence number and
+    fill level, so the decoder can put the ring back in order even when the
+    emulator died in the middle of a run: the file is mmap'd shared, whatever
+    the CPU thread wrote is in the page cache.
+
+    All fields are in host byte order.
+*/
+
+#ifndef M68KTRACE__HEADER
+#define M68KTRACE__HEADER
+
+#include <stdint.h>
+
+#define M68K_ITRACE_MAGIC       "M68KTRC1"
+#define M68K_ITRACE_VERSION     1
+#define M68K_ITRACE_HEADER_SIZE 4096
+#define M68K_ITRACE_BLOCK_SIZE  65536
+
+#define M68K_ITRACE_MAX_WORDS   11  /* opcode plus extension words of the longest instruction */
+#define M68K_ITRACE_MAX_MEM     32  /* memory accesses kept per record */
+#define M68K_ITRACE_NUM_REGS    17  /* D0-D7, A0-A7 and SR, in reg_mask bit order */
+
+/* m68k_itrace_record.flags */
+#define M68K_ITRACE_MEM_OVERFLOW 0x01  /* more than M68K_ITRACE_MAX_MEM accesses, the rest were dropped */
+#define M68K_ITRACE_ABORTED      0x02  /* instruction left through a bus or address error */
+
+/* m68k_itrace_mem.info: access size in bytes in the low byte */
+#define M68K_ITRACE_WRITE        0x100
+
+struct m68k_itrace_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t cpu_type;
+	uint32_t block_size;
+	uint32_t num_blocks;
+	uint64_t block_seq;     /* sequence number of the block being written, it lives at block_seq % num_blocks */
+	uint64_t records;       /* records written in total */
+	uint32_t regs[M68K_ITRACE_NUM_REGS];  /* register state when recording started */
+};
+
+struct m68k_itrace_block
+{
+	uint64_t seq;
+	uint32_t used;          /* bytes of records following this header */
+	uint32_t records;
+};
+
+/* One executed instruction.  Followed by num_words 16-bit instruction words
+ * (padded to a multiple of 4 bytes), one 32-bit value for every bit set in
+ * reg_mask and num_mem m68k_itrace_mem entries.  Registers are compared
+ * against the previous record, so changes made between instructions (e.g.
+ * by interrupt processing) show up in the next one together with its stack
+ * accesses.
+ */
+struct m68k_itrace_record
+{
+	uint32_t pc;
+	uint8_t num_words;
+	uint8_t num_mem;
+	uint8_t flags;
+	uint8_t reserved;
+	uint32_t reg_mask;
+};
+
+struct m68k_itrace_mem
+{
+	uint32_t address;
+	uint32_t value;
+	uint32_t info;
+};
+
+#define M68K_ITRACE_MAX_RECORD (sizeof(struct m68k_itrace_record) + (M68K_ITRACE_MAX_WORDS + 1) * 2 + \
+                                M68K_ITRACE_NUM_REGS * 4 + M68K_ITRACE_MAX_MEM * sizeof(struct m68k_itrace_mem))
+
+#endif /* M68KTRACE__HEADER */
@@ -1,5 +1,6 @@
 #include "platforms/platforms.h"
 #include "amiga-autoconf.h"
+#include "snapshot/snapshot.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -344,3 +345,63 @@ void autoconfig_write_memory_8(struct emulator_config *cfg, unsigned int address
     }
   }
 }
+
+struct autoconfig_state {
+  int z2_current_pic, z2_done;
+  int z3_current_pic, z3_done;
+  unsigned int base[AC_PIC_LIMIT];
+  uint32_t piscsi_base;
+  int nib_latch;
+  uint32_t map_offset[MAX_NUM_MAPPED_ITEMS];
+};
+
+int autoconfig_save_state(struct emulator_config *cfg, FILE *out) {
+  struct autoconfig_state st;
+
+  memset(&st, 0, sizeof(st));
+  st.z2_current_pic = ac_z2_current_pic;
+  st.z2_done = ac_z2_done;
+  st.z3_current_pic = ac_z3_current_pic;
+  st.z3_done = ac_z3_done;
+  memcpy(st.base, ac_base, sizeof(st.base));
+  st.piscsi_base = piscsi_base;
+  st.nib_latch = nib_latch;
+  for (int i = 0; i < MAX_NUM_MAPPED_ITEMS; i++)
+    st.map_offset[i] = cfg->map_offset[i];
+
+  return snapshot_write_chunk(out, "ACFG", &st, sizeof(st));
+}
+
+// Puts the boards back where the saved system assigned them, without going through autoconfig again.
+int autoconfig_load_state(struct emulator_config *cfg, FILE *in) {
+  struct autoconfig_state st;
+
+  if (snapshot_read_chunk(in, "ACFG", &st, sizeof(st)) == -1)
+    return -1;
+
+  ac_z2_current_pic = st.z2_current_pic;
+  ac_z2_done = st.z2_done;
+  ac_z3_current_pic = st.z3_current_pic;
+  ac_z3_done = st.z3_done;
+  memcpy(ac_base, st.base, sizeof(st.base));
+  piscsi_base = st.piscsi_base;
+  nib_latch = st.nib_latch;
+
+  for (int i = 0; i < ac_z2_current_pic && i < ac_z2_pic_count; i++) {
+    if (ac_z2_type[i] == ACTYPE_MAPFAST_Z2) {
+      int index = ac_z2_index[i];
+      cfg->map_offset[index] = st.map_offset[index];
+      cfg->map_high[index] = cfg->map_offset[index] + cfg->map_size[index];
+      m68k_add_ram_range(cfg->map_offset[index], cfg->map_high[index], cfg->map_data[index]);
+    }
+  }
+  for (int i = 0; i < ac_z3_current_pic && i < ac_z3_pic_count; i++) {
+    int index = ac_z3_index[i];
+    cfg->map_offset[index] = st.map_offset[index];
+    cfg->map_high[index] = cfg->map_offset[index] + cfg->map_size[index];
+    m68k_add_ram_range(cfg->map_offset[index], cfg->map_high[index], cfg->map_data[index]);
+  }
+  adjust_ranges_amiga(cfg);
+
+  return 0;
+}
@@ -87,3 +87,6 @@ void autoconfig_write_memory_8(struct emulator_config *cfg, unsigned int address
 unsigned int autoconfig_read_memory_z3_8(struct emulator_config *cfg, unsigned int address);
 void autoconfig_write_memory_z3_8(struct emulator_config *cfg, unsigned int address, unsigned int value);
 void autoconfig_write_memory_z3_16(struct emulator_config *cfg, unsigned int address, unsigned int value);
+
+int autoconfig_save_state(struct emulator_config *cfg, FILE *out);
+int autoconfig_load_state(struct emulator_config *cfg, FILE *in);
@@ -4,6 +4,7 @@
 #include <ctype.h>
 #include "amiga-autoconf.h"
 #include "amiga-registers.h"
+#include "amiga-snapshot.h"
 #include "hunk-reloc.h"
 #include "net/pi-net-enums.h"
 #include "net/pi-net.h"
@@ -272,9 +273,9 @@ int setup_platform_amiga(struct emulator_config *cfg) {
             printf("%dMB.\n", resize_data / SIZE_MEGA);
         }
         if (resize_data) {
-            free(cfg->map_data[index]);
+            free_mapped_ram(cfg->map_data[index], cfg->map_size[index]);
             cfg->map_size[index] = resize_data;
-            cfg->map_data[index] = (unsigned char *)malloc(cfg->map_size[index]);
+            cfg->map_data[index] = alloc_mapped_ram(cfg->map_size[index]);
         }
         printf("%dMB of Z2 Fast RAM configured at $%lx\n", cfg->map_size[index] / SIZE_MEGA, cfg->map_offset[index]);
         ac_z2_type[ac_z2_pic_count] = ACTYPE_MAPFAST_Z2;
@@ -469,6 +470,8 @@ void create_platform_amiga(struct platform_config *cfg, char *subsys) {
     cfg->platform_initial_setup = setup_platform_amiga;
     cfg->handle_reset = handle_reset_amiga;
     cfg->shutdown = shutdown_platform_amiga;
+    cfg->save_state = save_state_amiga;
+    cfg->load_state = load_state_amiga;
 
     cfg->setvar = setvar_amiga;
     cfg->id = PLATFORM_AMIGA;
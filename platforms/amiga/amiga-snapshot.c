@@ -0,0 +1,196 @@
+// Amiga side of the save states (see snapshot/snapshot.c).
+//
+// Chip RAM lives on the motherboard and is copied over the bus: read a word at
+// a time when saving, written back with one ps_write_block_16() when
+// restoring.  The custom chips and CIAs can't be read back, their registers
+// are replayed from the shadow of the last values the CPU wrote to them.
+// DMA and interrupts stay off until Chip RAM and all other registers are in
+// place, the copper restarts from COP1LC.  Not covered: pending INTREQ bits,
+// the CIA TOD counters and AGA palette banks other than the last one written.
+
+#include "amiga-autoconf.h"
+#include "amiga-snapshot.h"
+#include "gpio/ps_protocol.h"
+#include "piscsi/piscsi.h"
+#include "platforms/shared/rtc.h"
+#include "rtg/rtg.h"
+#include "snapshot/snapshot.h"
+#include "emulator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CUSTOM_BASE 0xDFF000
+#define CUSTOM_COPJMP1 0x88
+#define CUSTOM_INTREQ 0x9C
+
+#define CIA_PRA 0x00
+#define CIA_PRB 0x01
+#define CIA_DDRA 0x02
+#define CIA_DDRB 0x03
+#define CIA_TALO 0x04
+#define CIA_TBHI 0x07
+#define CIA_CRA 0x0E
+#define CIA_CRB 0x0F
+#define CIA_CR_START 0x01
+#define CIA_CR_LOAD 0x10
+
+uint16_t amiga_custom_shadow[0x100];
+uint8_t amiga_custom_written[0x100];
+uint8_t amiga_cia_shadow[2][16];
+uint8_t amiga_cia_written[2][16];
+
+extern uint8_t rtg_enabled, piscsi_enabled;
+
+static const unsigned int cia_base[2] = { 0xBFE001, 0xBFD000 };
+
+struct chipset_state {
+  uint16_t custom[0x100];
+  uint8_t custom_written[0x100];
+  uint8_t cia[2][16];
+  uint8_t cia_written[2][16];
+};
+
+// Registers that start something when written (DMA, blits, copper jumps, serial output),
+// data registers fed by DMA, the read only ones below 0x20 and the set/clear ones handled separately.
+static int custom_replay(unsigned int reg) {
+  if (reg < 0x20)
+    return 0;
+  if (reg >= 0x110 && reg <= 0x11E)
+    return 0;
+
+  switch (reg) {
+    case 0x24: case 0x26: case 0x30:
+    case 0x38: case 0x3A: case 0x3C: case 0x3E:
+    case 0x58: case 0x5E:
+    case 0x88: case 0x8A: case 0x8C:
+    case CUSTOM_DMACON: case CUSTOM_INTENA: case CUSTOM_INTREQ: case CUSTOM_ADKCON:
+    case 0xAA: case 0xBA: case 0xCA: case 0xDA:
+      return 0;
+    default:
+      return 1;
+  }
+}
+
+static unsigned int chip_ram_size(struct emulator_config *cfg) {
+  // Fake Chip RAM in a mapped range is saved with the other regions.
+  int r = get_mapped_item_by_address(cfg, 0);
+  if (r != -1 && cfg->map_type[r] == MAPTYPE_RAM)
+    return 0;
+  return cfg->snapshot_chip_size;
+}
+
+static int save_chipset(struct emulator_config *cfg, FILE *out) {
+  struct chipset_state st;
+  unsigned int size = chip_ram_size(cfg);
+  uint8_t *chip = NULL;
+  int ret;
+
+  if (size) {
+    chip = malloc(size);
+    if (!chip)
+      return -1;
+    for (unsigned int i = 0; i < size; i += 2) {
+      unsigned int w = read16(i);
+      chip[i] = w >> 8;
+      chip[i + 1] = w;
+    }
+  }
+  ret = snapshot_write_chunk(out, "CHIP", chip, size);
+  free(chip);
+  if (ret == -1)
+    return -1;
+
+  memcpy(st.custom, amiga_custom_shadow, sizeof(st.custom));
+  memcpy(st.custom_written, amiga_custom_written, sizeof(st.custom_written));
+  memcpy(st.cia, amiga_cia_shadow, sizeof(st.cia));
+  memcpy(st.cia_written, amiga_cia_written, sizeof(st.cia_written));
+  return snapshot_write_chunk(out, "CSTM", &st, sizeof(st));
+}
+
+static void replay_cia(int cia, struct chipset_state *st) {
+  unsigned int base = cia_base[cia];
+  uint8_t *reg = st->cia[cia];
+  uint8_t *written = st->cia_written[cia];
+
+  // Stop the timers while their latches are written, a write to TxHI starts a one-shot timer.
+  m68k_write_memory_8(base + (CIA_CRA << 8), reg[CIA_CRA] & ~(CIA_CR_START | CIA_CR_LOAD));
+  m68k_write_memory_8(base + (CIA_CRB << 8), reg[CIA_CRB] & ~(CIA_CR_START | CIA_CR_LOAD));
+  for (unsigned int i = CIA_DDRA; i <= CIA_DDRB; i++) {
+    if (written[i])
+      m68k_write_memory_8(base + (i << 8), reg[i]);
+  }
+  for (unsigned int i = CIA_PRA; i <= CIA_PRB; i++) {
+    if (written[i])
+      m68k_write_memory_8(base + (i << 8), reg[i]);
+  }
+  for (unsigned int i = CIA_TALO; i <= CIA_TBHI; i++) {
+    if (written[i])
+      m68k_write_memory_8(base + (i << 8), reg[i]);
+  }
+  m68k_write_memory_8(base + (CIA_ICR << 8), 0x7F);
+  m68k_write_memory_8(base + (CIA_ICR << 8), 0x80 | reg[CIA_ICR]);
+  m68k_write_memory_8(base + (CIA_CRA << 8), (reg[CIA_CRA] | CIA_CR_LOAD));
+  m68k_write_memory_8(base + (CIA_CRB << 8), (reg[CIA_CRB] | CIA_CR_LOAD));
+}
+
+static int load_chipset(struct emulator_config *cfg, FILE *in) {
+  struct chipset_state st;
+  unsigned int size = chip_ram_size(cfg);
+  uint8_t *chip = NULL;
+
+  if (size && !(chip = malloc(size)))
+    return -1;
+  if (snapshot_read_chunk(in, "CHIP", chip, size) == -1 || snapshot_read_chunk(in, "CSTM", &st, sizeof(st)) == -1) {
+    free(chip);
+    return -1;
+  }
+
+  for (int i = 0; i < 2; i++)
+    replay_cia(i, &st);
+
+  m68k_write_memory_16(CUSTOM_BASE + CUSTOM_DMACON, 0x7FFF);
+  m68k_write_memory_16(CUSTOM_BASE + CUSTOM_INTENA, 0x7FFF);
+  m68k_write_memory_16(CUSTOM_BASE + CUSTOM_INTREQ, 0x7FFF);
+  if (size) {
+    ps_write_block_16(0, chip, size);
+    free(chip);
+  }
+
+  for (unsigned int i = 0; i < 0x100; i++) {
+    if (st.custom_written[i] && custom_replay(i << 1))
+      m68k_write_memory_16(CUSTOM_BASE + (i << 1), st.custom[i]);
+  }
+  m68k_write_memory_16(CUSTOM_BASE + CUSTOM_ADKCON, 0x7FFF);
+  m68k_write_memory_16(CUSTOM_BASE + CUSTOM_ADKCON, 0x8000 | st.custom[CUSTOM_ADKCON >> 1]);
+  m68k_write_memory_16(CUSTOM_BASE + CUSTOM_COPJMP1, 0);
+  m68k_write_memory_16(CUSTOM_BASE + CUSTOM_DMACON, 0x8000 | st.custom[CUSTOM_DMACON >> 1]);
+  m68k_write_memory_16(CUSTOM_BASE + CUSTOM_INTENA, 0x8000 | st.custom[CUSTOM_INTENA >> 1]);
+
+  // The replay went through the shadow as well, keep the saved state exactly.
+  memcpy(amiga_custom_shadow, st.custom, sizeof(st.custom));
+  memcpy(amiga_custom_written, st.custom_written, sizeof(st.custom_written));
+  memcpy(amiga_cia_shadow, st.cia, sizeof(st.cia));
+  memcpy(amiga_cia_written, st.cia_written, sizeof(st.cia_written));
+  return 0;
+}
+
+int save_state_amiga(struct emulator_config *cfg, FILE *out) {
+  if (save_chipset(cfg, out) == -1 || autoconfig_save_state(cfg, out) == -1 || rtc_save_state(out) == -1)
+    return -1;
+  if (piscsi_enabled && piscsi_save_state(out) == -1)
+    return -1;
+  if (rtg_enabled && rtg_save_state(out) == -1)
+    return -1;
+  return 0;
+}
+
+int load_state_amiga(struct emulator_config *cfg, FILE *in) {
+  if (load_chipset(cfg, in) == -1 || autoconfig_load_state(cfg, in) == -1 || rtc_load_state(in) == -1)
+    return -1;
+  if (piscsi_enabled && piscsi_load_state(in) == -1)
+    return -1;
+  if (rtg_enabled && rtg_load_state(in) == -1)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <stdio.h>
+
+struct emulator_config;
+
+// Most custom chip and many CIA registers are write only, so the last value
+// written to each is kept here to be written again after a snapshot restore.
+extern uint16_t amiga_custom_shadow[0x100];
+extern uint8_t amiga_custom_written[0x100];
+extern uint8_t amiga_cia_shadow[2][16];
+extern uint8_t amiga_cia_written[2][16];
+
+#define CUSTOM_DMACON 0x96
+#define CUSTOM_INTENA 0x9A
+#define CUSTOM_ADKCON 0x9E
+#define CIA_ICR 0x0D
+
+static inline void amiga_shadow_custom_write(unsigned int address, unsigned int value) {
+  if ((address & 0xFFFE00) != 0xDFF000)
+    return;
+
+  unsigned int reg = address & 0x1FE;
+  uint16_t *shadow = &amiga_custom_shadow[reg >> 1];
+  if (reg == CUSTOM_DMACON || reg == CUSTOM_INTENA || reg == CUSTOM_ADKCON) {
+    // Set/clear registers, keep the resulting bits
+    if (value & 0x8000)
+      *shadow |= value & 0x7FFF;
+    else
+      *shadow &= ~value;
+  }
+  else
+    *shadow = value;
+  amiga_custom_written[reg >> 1] = 1;
+}
+
+static inline void amiga_shadow_cia_write(unsigned int address, unsigned int value) {
+  int cia;
+
+  if ((address & 0xFFF0FF) == 0xBFE001)
+    cia = 0;
+  else if ((address & 0xFFF0FF) == 0xBFD000)
+    cia = 1;
+  else
+    return;
+
+  unsigned int reg = (address >> 8) & 0x0F;
+  if (reg == CIA_ICR) {
+    if (value & 0x80)
+      amiga_cia_shadow[cia][reg] |= value & 0x7F;
+    else
+      amiga_cia_shadow[cia][reg] &= ~value;
+  }
+  else
+    amiga_cia_shadow[cia][reg] = value;
+  amiga_cia_written[cia][reg] = 1;
+}
+
+int save_state_amiga(struct emulator_config *cfg, FILE *out);
+int load_state_amiga(struct emulator_config *cfg, FILE *in);
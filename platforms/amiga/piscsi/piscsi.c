@@ -5,12 +5,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <endian.h>
+#include <sys/stat.h>
 
 #include "config_file/config_file.h"
+#include "debugger/debugger.h"
 #include "gpio/ps_protocol.h"
 #include "piscsi-enums.h"
 #include "piscsi.h"
 #include "platforms/amiga/hunk-reloc.h"
+#include "snapshot/snapshot.h"
 
 #define BE(val) be32toh(val)
 #define BE16(val) be16toh(val)
@@ -315,6 +318,85 @@ void piscsi_unmap_drive(uint8_t index) {
     }
 }
 
+struct piscsi_state {
+    uint32_t u32[4];
+    uint32_t dbg[8];
+    uint8_t cur_drive;
+    uint32_t cur_partition, cur_fs;
+    struct {
+        uint64_t fs;
+        int64_t mtime;
+        uint32_t lba;
+    } dev[8];
+    struct {
+        uint32_t FS_ID;
+        uint32_t handler;
+        uint32_t base_offset;
+    } fs[NUM_FILESYSTEMS];
+};
+
+// The drives are not part of the snapshot, only enough about them to tell
+// whether they still are what the saved system has cached.
+int piscsi_save_state(FILE *out) {
+    struct piscsi_state st;
+    struct stat sb;
+
+    memset(&st, 0, sizeof(st));
+    memcpy(st.u32, piscsi_u32, sizeof(st.u32));
+    memcpy(st.dbg, piscsi_dbg, sizeof(st.dbg));
+    st.cur_drive = piscsi_cur_drive;
+    st.cur_partition = rom_cur_partition;
+    st.cur_fs = rom_cur_fs;
+    for (int i = 0; i < 8; i++) {
+        if (devs[i].fd == -1)
+            continue;
+        st.dev[i].fs = devs[i].fs;
+        st.dev[i].lba = devs[i].lba;
+        if (fstat(devs[i].fd, &sb) == 0)
+            st.dev[i].mtime = sb.st_mtime;
+    }
+    for (int i = 0; i < NUM_FILESYSTEMS; i++) {
+        st.fs[i].FS_ID = filesystems[i].FS_ID;
+        st.fs[i].handler = filesystems[i].handler;
+        st.fs[i].base_offset = filesystems[i].h_info.base_offset;
+    }
+
+    return snapshot_write_chunk(out, "SCSI", &st, sizeof(st));
+}
+
+int piscsi_load_state(FILE *in) {
+    struct piscsi_state st;
+    struct stat sb;
+
+    if (snapshot_read_chunk(in, "SCSI", &st, sizeof(st)) == -1)
+        return -1;
+
+    memcpy(piscsi_u32, st.u32, sizeof(st.u32));
+    memcpy(piscsi_dbg, st.dbg, sizeof(st.dbg));
+    piscsi_cur_drive = st.cur_drive;
+    rom_cur_partition = st.cur_partition;
+    rom_cur_fs = st.cur_fs;
+    for (int i = 0; i < 8; i++) {
+        if ((devs[i].fd == -1) != (st.dev[i].fs == 0) || (devs[i].fd != -1 && devs[i].fs != st.dev[i].fs)) {
+            printf("[PISCSI] Drive %d is not the one the snapshot was saved with.\n", i);
+            continue;
+        }
+        if (devs[i].fd == -1)
+            continue;
+        devs[i].lba = st.dev[i].lba;
+        if (fstat(devs[i].fd, &sb) == 0 && sb.st_mtime > st.dev[i].mtime)
+            printf("[PISCSI] Drive %d was written to after the snapshot was saved, the restored system may not match it.\n", i);
+    }
+    for (int i = 0; i < NUM_FILESYSTEMS; i++) {
+        if (filesystems[i].FS_ID != st.fs[i].FS_ID)
+            continue;
+        filesystems[i].handler = st.fs[i].handler;
+        filesystems[i].h_info.base_offset = st.fs[i].base_offset;
+    }
+
+    return 0;
+}
+
 char *io_cmd_name(int index) {
     switch (index) {
         case CMD_INVALID: return "INVALID";
@@ -539,6 +621,8 @@ void handle_piscsi_write(uint32_t addr, uint32_t val, uint8_t type) {
             r = get_mapped_item_by_address(cfg, piscsi_u32[2]);
             if (r != -1 && cfg->map_type[r] == MAPTYPE_RAM) {
                 DEBUG_TRIVIAL("[PISCSI-%d] \"DMA\" Read goes to mapped range %d.\n", val, r);
+                snapshot_touch(cfg->map_data[r] + piscsi_u32[2] - cfg->map_offset[r], piscsi_u32[1]);
+                debugger_touch(cfg->map_data[r] + piscsi_u32[2] - cfg->map_offset[r], piscsi_u32[1]);
                 read(d->fd, cfg->map_data[r] + piscsi_u32[2] - cfg->map_offset[r], piscsi_u32[1]);
             }
             else {
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdio.h>
 
 #include "platforms/amiga/hunk-reloc.h"
 
@@ -260,3 +261,5 @@ uint32_t handle_piscsi_read(uint32_t addr, uint8_t type);
 
 void piscsi_find_filesystems(struct piscsi_dev *d);
 void piscsi_refresh_drives();
+int piscsi_save_state(FILE *out);
+int piscsi_load_state(FILE *in);
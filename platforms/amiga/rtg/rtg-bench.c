@@ -0,0 +1,1102 @@
+// rtgbench - benchmarks the RTG host side without the PiStorm hardware.
+//
+// Runs the framebuffer conversions of the RTG output thread (rtg-convert.c)
+// over a synthetic frame with every kernel set built into the binary and
+// reports pixels per second, plus the frame rate that would leave for a
+// display of that size.  Kernels the CPU doesn't support are skipped, the
+// others are checked against the C versions first.
+//
+// After that the dirty tracking of the output thread is timed with the
+// fastest kernels: a full redraw of every frame (what the output thread did
+// before), an idle screen and a window being dragged around, with how many
+// bytes each frame would send to SDL_UpdateTexture().  Then the conversions
+// into a staging buffer that is copied to the texture are compared to ones
+// straight into locked texture memory.
+//
+// Next the fills, inverts and copies of rtg-gfx.c are timed with each set of
+// row kernels (rtg-span.c), for glyphs, window borders and the whole screen.
+// Every minterm of BlitRectNoMaskComplete and planar to chunky is checked
+// pixel by pixel against its truth table on a small blit.  The 16 minterms
+// of BlitRectNoMaskComplete follow, each checked against its truth table
+// first, then full screen planar to chunky conversions with 1 to
+// 8 planes, layer masks and minterms, and planar to RGB565 and RGB32 through
+// a CLUT (P2D).
+//
+// At the end small blits are issued the way the driver does, once through
+// the registers and once through the command FIFO in the scratch area, with
+// the rate of each and how many 68k writes it takes per blit.
+//
+// Last the mouse pointer is moved around an RGB565 screen, once drawn into
+// VRAM by P96 and once as the sprite the output thread puts over the frame,
+// with the 68k accesses and the time per move on both threads.
+//
+//   make rtgbench CFLAGS="-O3 -I."     (drop the Pi specific flags on x86)
+//
+// usage: rtgbench [-s WIDTHxHEIGHT] [-r runs]
+//   -s  frame size, default 1280x720
+//   -r  timed runs per kernel, the fastest one is reported (default 5)
+
+#include "platforms/amiga/rtg/rtg-convert.h"
+#include "platforms/amiga/rtg/rtg-span.h"
+#include "platforms/amiga/rtg/rtg.h"
+#include "config_file/config_file.h"
+#include "snapshot/snapshot.h"
+#include "m68k.h"
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *convert_names[RTG_CONVERT_NUM] = {
+    "clut8",
+    "swap16",
+    "swap32",
+};
+
+static const int convert_src_bytes[RTG_CONVERT_NUM] = { 1, 2, 4 };
+static const int convert_dst_bytes[RTG_CONVERT_NUM] = { 4, 2, 4 };
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Converts a whole frame row by row like rtgThread does, the source pitch is padded
+// so rows don't start on the same alignment as the destination ones.
+static void convert_frame(rtg_convert_func func, int kind, uint8_t *dst, const uint8_t *src, int width, int height, const uint32_t *palette) {
+    int pitch = width * convert_src_bytes[kind] + 16;
+
+    for (int y = 0; y < height; y++)
+        func(dst + y * width * convert_dst_bytes[kind], src + y * pitch, width, palette);
+}
+
+enum { SCENE_FULL, SCENE_IDLE, SCENE_DRAG, SCENE_NUM };
+
+static const char *scene_names[SCENE_NUM] = {
+    "full",
+    "idle",
+    "drag",
+};
+
+// One frame of the output thread, returns the bytes it uploads.  Dragging moves a 640x400 window by 8x4
+// pixels a frame, the blits mark where it is now and the refill of where it was.  The bands are converted
+// into dst like into the locked texture.
+static uint64_t dirty_frame(struct rtg_frame *frame, int scene, int n, struct rtg_dirty_band *bands, uint8_t *dst) {
+    int dst_bytes = (frame->kind == -1) ? 4 : convert_dst_bytes[frame->kind];
+    int win_w = (frame->width < 640) ? frame->width / 2 : 640, win_h = (frame->height < 400) ? frame->height / 2 : 400;
+    uint64_t bytes = 0;
+
+    if (scene == SCENE_DRAG) {
+        int range_x = frame->width - win_w - 8, range_y = frame->height - win_h - 4;
+        int x = (n * 8) % (range_x > 0 ? range_x : 1), y = (n * 4) % (range_y > 0 ? range_y : 1);
+        rtg_mark_dirty_rect(frame->addr + x * frame->bpp + y * frame->pitch, win_w * frame->bpp, win_h, frame->pitch);
+        rtg_mark_dirty_rect(frame->addr + (x + 8) * frame->bpp + (y + 4) * frame->pitch, win_w * frame->bpp, win_h, frame->pitch);
+    }
+
+    int num_bands = rtg_dirty_bands(frame, scene == SCENE_FULL, bands);
+    for (int i = 0; i < num_bands; i++) {
+        if (frame->kind != -1)
+            rtg_convert_band(frame, &bands[i], dst + bands[i].y * frame->width * dst_bytes + bands[i].x * dst_bytes, frame->width * dst_bytes);
+        bytes += (uint64_t)bands[i].w * bands[i].h * dst_bytes;
+    }
+    return bytes;
+}
+
+static void bench_dirty(uint8_t *src, uint8_t *dst, int width, int height, const uint32_t *palette, int runs) {
+    static const struct { const char *name; int bpp, kind; } modes[] = {
+        { "clut8", 1, RTG_CONVERT_CLUT8 },
+        { "rgb565", 2, RTG_CONVERT_SWAP16 },
+        { "rgb32", 4, -1 },
+    };
+    struct rtg_dirty_band *bands = malloc(height * sizeof(struct rtg_dirty_band));
+    struct rtg_frame frame;
+
+    rtg_convert_init();
+    printf("\n%-8s %-6s %12s %10s %14s\n", "mode", "screen", "us/frame", "cpu@60Hz", "upload KB/fr");
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        memset(&frame, 0, sizeof(frame));
+        frame.vram = src;
+        frame.width = width;
+        frame.height = height;
+        frame.pitch = width * modes[m].bpp;
+        frame.bpp = modes[m].bpp;
+        frame.kind = modes[m].kind;
+        frame.palette = palette;
+
+        for (int scene = 0; scene < SCENE_NUM; scene++) {
+            double best = 0;
+            uint64_t bytes = 0;
+            dirty_frame(&frame, SCENE_FULL, 0, bands, dst);
+            for (int r = 0; r < runs; r++) {
+                int frames = 0;
+                double start = now(), elapsed;
+                bytes = 0;
+                do {
+                    bytes += dirty_frame(&frame, scene, frames, bands, dst);
+                    frames++;
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+                if (frames / elapsed > best)
+                    best = frames / elapsed;
+                bytes /= frames;
+            }
+            printf("%-8s %-6s %12.1f %9.2f%% %14.1f\n", modes[m].name, scene_names[scene], 1e6 / best, 100.0 * 60 / best, bytes / 1024.0);
+        }
+    }
+    free(bands);
+}
+
+// Converting into a staging buffer that SDL_UpdateTexture() copies to the texture, against converting
+// into the locked texture memory directly.  The texture is just another buffer here.
+static void bench_stream(uint8_t *src, uint8_t *dst, int width, int height, const uint32_t *palette, int runs) {
+    uint8_t *texture = malloc((size_t)width * 4 * height);
+
+    printf("\n%-8s %-8s %12s %10s %14s\n", "convert", "upload", "frames/s", "cpu@60Hz", "MB moved/s@60");
+    for (int kind = RTG_CONVERT_CLUT8; kind <= RTG_CONVERT_SWAP16; kind++) {
+        size_t src_frame = (size_t)width * height * convert_src_bytes[kind];
+        size_t dst_frame = (size_t)width * height * convert_dst_bytes[kind];
+
+        for (int locked = 0; locked < 2; locked++) {
+            double best = 0;
+            for (int r = 0; r < runs; r++) {
+                int frames = 0;
+                double start = now(), elapsed;
+                do {
+                    for (int y = 0; y < height; y++)
+                        rtg_conv->func[kind]((locked ? texture : dst) + y * width * convert_dst_bytes[kind], src + y * width * convert_src_bytes[kind], width, palette);
+                    if (!locked)
+                        memcpy(texture, dst, dst_frame);
+                    frames++;
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+                if (frames / elapsed > best)
+                    best = frames / elapsed;
+            }
+            // Read the framebuffer and write the texture, the staging buffer adds a write and a read.
+            size_t moved = src_frame + dst_frame + (locked ? 0 : 2 * dst_frame);
+            printf("%-8s %-8s %12.1f %9.2f%% %14.1f\n", convert_names[kind], locked ? "locked" : "staging", best, 100.0 * 60 / best, moved * 60 / 1e6);
+        }
+    }
+    free(texture);
+}
+
+// What rtg.c needs from the rest of the emulator, the blits below go through the real rtg.c and
+// rtg-gfx.c code.
+struct emulator_config *cfg;
+int cpu_emulation_running;
+int init_rtg_data();
+extern uint8_t *rtg_mem;
+int get_mapped_item_by_address(struct emulator_config *config, uint32_t address) { (void)config; (void)address; return -1; }
+void m68k_end_timeslice(void) {}
+unsigned int ps_read_8(unsigned int address) { (void)address; return 0; }
+void rtg_set_clut_entry(uint8_t index, uint32_t xrgb) { (void)index; (void)xrgb; }
+uint32_t rtg_get_clut_entry(uint8_t index) { (void)index; return 0; }
+void rtg_init_display() {}
+void rtg_shutdown_display() {}
+int snapshot_add_region(const char *id, uint8_t *data, uint32_t size) { (void)id; (void)data; (void)size; return 0; }
+int snapshot_write_chunk(FILE *out, const char *tag, const void *data, uint32_t size) { (void)out; (void)tag; (void)data; (void)size; return 0; }
+int snapshot_read_chunk(FILE *in, const char *tag, void *data, uint32_t size) { (void)in; (void)tag; (void)data; (void)size; return 0; }
+
+// Musashi's mapped write range, the FIFO is the only one here.
+static uint32_t mapped_addr, mapped_upper;
+static uint8_t *mapped_data;
+static uint64_t bus_writes;
+
+void m68k_add_ram_range(uint32_t addr, uint32_t upper, unsigned char *ptr) {
+    mapped_addr = addr;
+    mapped_upper = upper;
+    mapped_data = ptr;
+}
+
+// A 68k write to the card: stored straight away in a mapped range, otherwise on to rtg_write().  In the
+// emulator the latter first goes past the platform's other address checks, which this leaves out.
+static void bus_write(uint32_t address, uint32_t value, uint8_t mode) {
+    bus_writes++;
+    if (address - mapped_addr < mapped_upper - mapped_addr) {
+        uint8_t *p = &mapped_data[address - mapped_addr];
+        if (mode == OP_TYPE_WORD)
+            *(uint16_t *)p = htobe16(value);
+        else
+            *(uint32_t *)p = htobe32(value);
+        return;
+    }
+    rtg_write(address & 0x0FFFFFFF, value, mode);
+}
+
+static uint64_t bus_reads;
+
+static uint32_t bus_read(uint32_t address, uint8_t mode) {
+    bus_reads++;
+    return rtg_read(address & 0x0FFFFFFF, mode);
+}
+
+// The driver side of both ways to issue a blit, like pigfx.c.
+#define BENCH_CARD_SCRATCH PIGFX_SCRATCH_AREA
+#define BENCH_FIFO(pos) (PIGFX_FIFO + (pos))
+
+static uint32_t fifo_pos = RTG_FIFO_RING, fifo_rec, fifo_mask, fifo_half;
+static int fifo_pending, fifo_words;
+
+static void fifo_begin() {
+    if (fifo_pos + RTG_FIFO_RECORD_MAX >= RTG_FIFO_SIZE) {
+        bus_write(BENCH_FIFO(fifo_pos), (uint32_t)RTG_FIFO_WRAP << 27, OP_TYPE_LONGWORD);
+        fifo_pos = RTG_FIFO_RING;
+        bus_write(PIGFX_RTG_BASE + RTG_FIFO, fifo_pos, OP_TYPE_LONGWORD);
+        fifo_pending = 0;
+    }
+    fifo_rec = fifo_pos + 4;
+    fifo_mask = 0;
+    fifo_words = 0;
+}
+
+// Two register words to a longword write, like the driver.
+static void fifo_short(uint32_t reg, uint16_t value) {
+    fifo_mask |= 1 << (reg >> 1);
+    if (fifo_words++ & 1) {
+        bus_write(BENCH_FIFO(fifo_rec), fifo_half | value, OP_TYPE_LONGWORD);
+        fifo_rec += 4;
+    }
+    else
+        fifo_half = (uint32_t)value << 16;
+}
+
+static void fifo_long(uint32_t reg, uint32_t value) {
+    fifo_short(reg, value >> 16);
+    fifo_short(reg + 2, value);
+}
+
+static void fifo_end(uint16_t cmd) {
+    if (fifo_words & 1) {
+        bus_write(BENCH_FIFO(fifo_rec), fifo_half, OP_TYPE_LONGWORD);
+        fifo_rec += 4;
+    }
+    bus_write(BENCH_FIFO(fifo_pos), (uint32_t)(cmd + 1) << 27 | fifo_mask >> 1, OP_TYPE_LONGWORD);
+    fifo_pos = fifo_rec;
+    if (++fifo_pending == RTG_FIFO_BATCH) {
+        bus_write(PIGFX_RTG_BASE + RTG_FIFO, fifo_pos, OP_TYPE_LONGWORD);
+        fifo_pending = 0;
+    }
+}
+
+static void reg_short(uint32_t reg, uint16_t value) {
+    bus_write(PIGFX_RTG_BASE + reg, value, OP_TYPE_WORD);
+}
+
+static void reg_long(uint32_t reg, uint32_t value) {
+    bus_write(PIGFX_RTG_BASE + reg, value, OP_TYPE_LONGWORD);
+}
+
+enum { BLIT_FILL, BLIT_COPY, BLIT_GLYPH, BLIT_NUM };
+
+static const char *blit_names[BLIT_NUM] = {
+    "fill",
+    "copy",
+    "glyph",
+};
+
+static void small_blit(int kind, int fifo, int x, int y, int size, int pitch) {
+    uint32_t fb = PIGFX_RTG_BASE + PIGFX_REG_SIZE;
+
+    if (kind == BLIT_GLYPH) {
+        // Templates from chip RAM are copied to the scratch area first, either way.
+        for (int i = 0; i < size * 2; i += 4)
+            bus_write(BENCH_CARD_SCRATCH + i, 0x55AA55AA ^ (x * i), OP_TYPE_LONGWORD);
+    }
+    if (!fifo) {
+        reg_long(RTG_ADDR1, kind == BLIT_GLYPH ? BENCH_CARD_SCRATCH : fb);
+        reg_long(RTG_ADDR2, fb);
+        reg_short(RTG_FORMAT, RTGFMT_RBG565);
+        reg_short(RTG_X1, kind == BLIT_COPY ? x + 1 : x);
+        reg_short(RTG_X2, kind == BLIT_FILL ? size : (kind == BLIT_COPY ? x : size));
+        reg_short(RTG_X3, kind == BLIT_FILL ? pitch : (kind == BLIT_COPY ? size : 0));
+        reg_short(RTG_Y1, y);
+        reg_short(RTG_Y2, kind == BLIT_COPY ? y + 1 : size);
+        if (kind != BLIT_FILL)
+            reg_short(RTG_Y3, kind == BLIT_COPY ? size : 0);
+        reg_long(RTG_RGB1, x * 0x10001);
+        if (kind == BLIT_GLYPH)
+            reg_long(RTG_RGB2, 0);
+        bus_write(PIGFX_RTG_BASE + RTG_U81, 0xFF, OP_TYPE_BYTE);
+        if (kind != BLIT_FILL)
+            reg_short(RTG_X4, pitch);
+        if (kind == BLIT_GLYPH) {
+            bus_write(PIGFX_RTG_BASE + RTG_U82, 1, OP_TYPE_BYTE);
+            reg_short(RTG_X5, 2);
+        }
+        reg_short(RTG_COMMAND, kind == BLIT_FILL ? RTGCMD_FILLRECT : (kind == BLIT_COPY ? RTGCMD_BLITRECT : RTGCMD_BLITTEMPLATE));
+        return;
+    }
+
+    fifo_begin();
+    fifo_short(RTG_X1, kind == BLIT_COPY ? x + 1 : x);
+    fifo_short(RTG_X2, kind == BLIT_FILL ? size : (kind == BLIT_COPY ? x : size));
+    fifo_short(RTG_X3, kind == BLIT_FILL ? pitch : (kind == BLIT_COPY ? size : 0));
+    fifo_short(RTG_Y1, y);
+    fifo_short(RTG_Y2, kind == BLIT_COPY ? y + 1 : size);
+    if (kind != BLIT_FILL)
+        fifo_short(RTG_Y3, kind == BLIT_COPY ? size : 0);
+    fifo_short(RTG_FORMAT, RTGFMT_RBG565);
+    fifo_long(RTG_RGB1, x * 0x10001);
+    if (kind == BLIT_GLYPH)
+        fifo_long(RTG_RGB2, 0);
+    fifo_long(RTG_ADDR1, kind == BLIT_GLYPH ? BENCH_CARD_SCRATCH : fb);
+    fifo_long(RTG_ADDR2, fb);
+    fifo_short(RTG_U81, kind == BLIT_GLYPH ? 0xFF01 : 0xFF00);
+    if (kind != BLIT_FILL)
+        fifo_short(RTG_X4, pitch);
+    if (kind == BLIT_GLYPH)
+        fifo_short(RTG_X5, 2);
+    fifo_end(kind == BLIT_FILL ? RTGCMD_FILLRECT : (kind == BLIT_COPY ? RTGCMD_BLITRECT : RTGCMD_BLITTEMPLATE));
+}
+
+enum { OP_FILL, OP_FILL_MASK, OP_INVERT, OP_COPY, OP_COPY_MASK, OP_NUM };
+
+static const char *op_names[OP_NUM] = {
+    "fill",
+    "fill/mask",
+    "invert",
+    "copy",
+    "copy/mask",
+};
+
+// One blit through rtg-gfx.c at x, y of a frame that fills VRAM from offset 0.  Copies move the
+// rectangle 8 pixels left and 4 up, so the rows overlap.
+static void blit_op(int op, int x, int y, int w, int h, int pitch, int format) {
+    switch (op) {
+        case OP_FILL:
+            rtg_fillrect_solid(x, y, w, h, 0x12345678 + x, pitch, format);
+            break;
+        case OP_FILL_MASK:
+            rtg_fillrect(x, y, w, h, 0x5A + x, pitch, format, 0x0F);
+            break;
+        case OP_INVERT:
+            rtg_invertrect(x, y, w, h, pitch, format, 0xFF);
+            break;
+        case OP_COPY:
+            rtg_blitrect_solid(x + 8, y + 4, x, y, w, h, pitch, format);
+            break;
+        case OP_COPY_MASK:
+            rtg_blitrect(x + 8, y + 4, x, y, w, h, pitch, format, 0x3C);
+            break;
+    }
+}
+
+// Fills, inverts and copies at the sizes the driver sees most, with every kernel set from rtg-span.c.
+// Masks only exist for 8-bit.  The kernels are checked against the C ones on odd positions first.
+static void bench_blit_ops(int width, int height, int runs) {
+    static const char *format_names[] = { "clut8", "rgb565", "rgb32" };
+    const struct { const char *name; int w, h; } rects[] = {
+        { "glyph", 8, 8 },
+        { "hborder", 640, 4 },
+        { "vborder", 4, 480 },
+        { "screen", width - 8, height - 4 },
+    };
+    const struct rtg_span_kernels *const *kernels, *selected = rtg_span;
+    int num_kernels = rtg_span_list(&kernels);
+    struct rtg_command cmd;
+    uint8_t *init, *ref;
+
+    memset(&cmd, 0, sizeof(cmd));
+    rtg_cmd = &cmd;
+    init = malloc(width * 4 * height);
+    ref = malloc(width * 4 * height);
+    if (!init || !ref) {
+        printf("Out of memory.\n");
+        free(init);
+        free(ref);
+        return;
+    }
+    for (int i = 0; i < width * 4 * height; i++)
+        init[i] = rand();
+
+    printf("\n%-6s %-9s %-7s %-6s %10s %12s\n", "format", "op", "rect", "kernel", "Mpixels/s", "us/blit");
+    for (int format = RTGFMT_8BIT; format <= RTGFMT_RGB32; format++) {
+        int pitch = width << format, bytes = pitch * height;
+        for (int op = 0; op < OP_NUM; op++) {
+            if ((op == OP_FILL_MASK || op == OP_COPY_MASK) && format != RTGFMT_8BIT)
+                continue;
+            for (size_t r = 0; r < sizeof(rects) / sizeof(rects[0]); r++) {
+                int w = rects[r].w, h = rects[r].h;
+                int range_x = width - w - 8, range_y = height - h - 4;
+                if (w > width - 8 || h > height - 4)
+                    continue;
+
+                for (int k = 0; k < num_kernels; k++) {
+                    if (!kernels[k]->supported())
+                        continue;
+
+                    // Odd positions and widths leave ends for the kernels to get right.
+                    int check_w = (w > 1 && !(w & 1)) ? w - 1 : w;
+                    rtg_span = kernels[0];
+                    memcpy(rtg_mem, init, bytes);
+                    blit_op(op, 3, 1, check_w, h, pitch, format);
+                    memcpy(ref, rtg_mem, bytes);
+                    rtg_span = kernels[k];
+                    memcpy(rtg_mem, init, bytes);
+                    blit_op(op, 3, 1, check_w, h, pitch, format);
+                    if (memcmp(ref, rtg_mem, bytes) != 0) {
+                        printf("%-6s %-9s %-7s %-6s %10s\n", format_names[format], op_names[op], rects[r].name, kernels[k]->name, "MISMATCH");
+                        continue;
+                    }
+
+                    double best = 0;
+                    for (int run = 0; run < runs; run++) {
+                        int blits = 0;
+                        double start = now(), elapsed;
+                        do {
+                            for (int i = 0; i < 64; i++, blits++)
+                                blit_op(op, (blits * 37) % (range_x + 1), (blits * 11) % (range_y + 1), w, h, pitch, format);
+                            elapsed = now() - start;
+                        } while (elapsed < 0.2);
+                        if (blits / elapsed > best)
+                            best = blits / elapsed;
+                    }
+                    printf("%-6s %-9s %-7s %-6s %10.1f %12.3f\n", format_names[format], op_names[op], rects[r].name, kernels[k]->name,
+                           best * w * h / 1e6, 1e6 / best);
+                }
+            }
+        }
+    }
+    rtg_span = selected;
+    rtg_cmd = NULL;
+    free(init);
+    free(ref);
+}
+
+static const char *minterm_names[16] = {
+    "false", "nor", "onlydst", "notsrc", "onlysrc", "invert", "eor", "nand",
+    "and", "neor", "dst", "notonlysrc", "src", "notonlydst", "or", "true",
+};
+
+// What a minterm does to one byte, straight from its truth table.
+static uint8_t minterm_byte(uint8_t minterm, uint8_t s, uint8_t d) {
+    uint8_t r = 0;
+    if (minterm & 0x08)
+        r |= s & d;
+    if (minterm & 0x04)
+        r |= s & ~d;
+    if (minterm & 0x02)
+        r |= ~s & d;
+    if (minterm & 0x01)
+        r |= ~s & ~d;
+    return r;
+}
+
+// BlitRectNoMaskComplete with all 16 minterms from one frame to another, 640x400 like a window.  Each
+// one is checked against minterm_byte() at an odd position first, and once with the frames overlapping.
+static void bench_minterms(int width, int height, int runs) {
+    static const char *format_names[] = { "clut8", "rgb565", "rgb32" };
+    uint32_t vram = PIGFX_RTG_BASE + PIGFX_REG_SIZE;
+    int w = (width < 648) ? width - 8 : 640, h = (height < 404) ? height - 4 : 400;
+    struct rtg_command cmd;
+    uint8_t *init, *expect;
+
+    memset(&cmd, 0, sizeof(cmd));
+    rtg_cmd = &cmd;
+    init = malloc(width * 4 * height * 2);
+    expect = malloc(width * 4 * height * 2);
+    if (!init || !expect) {
+        printf("Out of memory.\n");
+        free(init);
+        free(expect);
+        return;
+    }
+    for (int i = 0; i < width * 4 * height * 2; i++)
+        init[i] = rand();
+
+    printf("\n%-11s %12s %12s %12s   (Mpixels/s, %dx%d)\n", "minterm", format_names[0], format_names[1], format_names[2], w, h);
+    for (int minterm = 0; minterm < 16; minterm++) {
+        double rate[3];
+        int bad = 0;
+
+        for (int format = RTGFMT_8BIT; format <= RTGFMT_RGB32; format++) {
+            int pitch = width << format, bytes = pitch * height;
+
+            // From the first frame to the second, then within the first one moved 3 pixels right.
+            for (int overlap = 0; overlap < 2; overlap++) {
+                uint32_t dst = overlap ? 0 : bytes;
+                int sx = 5, sy = 3, dx = overlap ? 8 : 1, dy = overlap ? 3 : 2;
+                memcpy(rtg_mem, init, bytes * 2);
+                memcpy(expect, init, bytes * 2);
+                for (int y = 0; y < h; y++) {
+                    for (int x = 0; x < ((w - 1) << format); x++) {
+                        uint8_t s = init[(sy + y) * pitch + (sx << format) + x];
+                        uint8_t *d = &expect[dst + (dy + y) * pitch + (dx << format) + x];
+                        *d = minterm_byte(minterm, s, *d);
+                    }
+                }
+                rtg_blitrect_nomask_complete(sx, sy, dx, dy, w - 1, h, pitch, pitch, vram, vram + dst, format, minterm);
+                if (memcmp(rtg_mem, expect, bytes * 2) != 0)
+                    bad = 1;
+            }
+
+            rate[format] = 0;
+            for (int r = 0; r < runs; r++) {
+                int blits = 0;
+                double start = now(), elapsed;
+                do {
+                    rtg_blitrect_nomask_complete(4, 2, 0, 0, w, h, pitch, pitch, vram, vram + bytes, format, minterm);
+                    blits++;
+                    elapsed = now() - start;
+                } while (elapsed < 0.1);
+                if (blits / elapsed > rate[format])
+                    rate[format] = blits / elapsed;
+            }
+        }
+        printf("%-11s %12.1f %12.1f %12.1f%s\n", minterm_names[minterm], rate[0] * w * h / 1e6, rate[1] * w * h / 1e6, rate[2] * w * h / 1e6,
+               bad ? "  MISMATCH" : "");
+    }
+    rtg_cmd = NULL;
+    free(init);
+    free(expect);
+}
+
+// One bit at a time from the minterm's truth table, bit (s << 1 | d) of the minterm is the result.
+static uint8_t truth_table_byte(uint8_t minterm, uint8_t s, uint8_t d) {
+    uint8_t r = 0;
+    for (int bit = 0; bit < 8; bit++) {
+        int index = (((s >> bit) & 1) << 1) | ((d >> bit) & 1);
+        r |= ((minterm >> index) & 1) << bit;
+    }
+    return r;
+}
+
+// BlitRectNoMaskComplete and P2C with every minterm on a small blit at odd positions, each pixel
+// compared to truth_table_byte().  P2C goes through a plane mask, a plane of all ones and a write mask.
+static void check_minterms() {
+    const int width = 64, height = 16, w = 45, h = 7;
+    const int depth = 8, src_pitch = (w >> 3) + 2, plane_size = src_pitch * h;
+    const uint8_t layer_mask = 0xDB, ff_mask = 0x40, mask = 0x5A;
+    uint32_t vram = PIGFX_RTG_BASE + PIGFX_REG_SIZE;
+    uint8_t init[64 * 4 * 16 * 2], planes[8 * 8 * 7];
+    struct rtg_command cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.x[3] = width;
+    cmd.user[0] = (layer_mask << 8) | ff_mask;
+    rtg_cmd = &cmd;
+    for (size_t i = 0; i < sizeof(init); i++)
+        init[i] = rand();
+    for (size_t i = 0; i < sizeof(planes); i++)
+        planes[i] = rand();
+
+    printf("\n%-11s %8s %8s   (truth table, %dx%d)\n", "minterm", "nomask", "p2c", w, h);
+    for (int minterm = 0; minterm < 16; minterm++) {
+        int bad_blit = 0, bad_p2c = 0;
+
+        // From the first frame to the second, 5,3 to 1,2.
+        for (int format = RTGFMT_8BIT; format <= RTGFMT_RGB32; format++) {
+            int pitch = width << format, bytes = pitch * height;
+            memcpy(rtg_mem, init, bytes * 2);
+            rtg_blitrect_nomask_complete(5, 3, 1, 2, w, h, pitch, pitch, vram, vram + bytes, format, minterm);
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < pitch; x++) {
+                    uint8_t d = init[bytes + y * pitch + x];
+                    if (y >= 2 && y < 2 + h && x >= (1 << format) && x < ((1 + w) << format))
+                        d = truth_table_byte(minterm, init[(y + 1) * pitch + x + (4 << format)], d);
+                    if (rtg_mem[bytes + y * pitch + x] != d || rtg_mem[y * pitch + x] != init[y * pitch + x])
+                        bad_blit = 1;
+                }
+            }
+        }
+
+        // From bit 3 of the planes to 2,1 in the first frame.
+        memcpy(rtg_mem, init, width * height);
+        rtg_p2c(3, 0, 2, 1, w, h, minterm, depth, mask, layer_mask, src_pitch, planes);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint8_t d = init[y * width + x];
+                if (y >= 1 && y < 1 + h && x >= 2 && x < 2 + w) {
+                    int bit = 3 + x - 2;
+                    uint8_t index = 0;
+                    for (int plane = 0; plane < depth; plane++) {
+                        if (!(layer_mask & (1 << plane)))
+                            continue;
+                        if ((ff_mask & (1 << plane)) || (planes[plane * plane_size + (y - 1) * src_pitch + bit / 8] & (0x80 >> (bit % 8))))
+                            index |= 1 << plane;
+                    }
+                    d = (truth_table_byte(minterm, index, d) & mask) | (d & ~mask);
+                }
+                if (rtg_mem[y * width + x] != d)
+                    bad_p2c = 1;
+            }
+        }
+        printf("%-11s %8s %8s\n", minterm_names[minterm], bad_blit ? "MISMATCH" : "OK", bad_p2c ? "MISMATCH" : "OK");
+    }
+    rtg_cmd = NULL;
+}
+
+// What P2C should leave in one destination byte d, from planes copied to the scratch area the way the
+// driver does it, rows of src_pitch bytes that wrap around both ways.
+static uint8_t p2c_byte(const uint8_t *planes, int src_pitch, int plane_size, int depth, uint8_t layer_mask, uint8_t ff_mask,
+                        int sx, int sy, int h, int x, int y, uint8_t minterm, uint8_t mask, uint8_t d) {
+    int byte = ((sx + x) / 8) % src_pitch, row = (sy + y) % h;
+    uint8_t bit = 0x80 >> ((sx + x) % 8), s = 0;
+
+    for (int plane = 0; plane < depth; plane++) {
+        if (!(layer_mask & (1 << plane)))
+            continue;
+        if ((ff_mask & (1 << plane)) || (planes[plane * plane_size + row * src_pitch + byte] & bit))
+            s |= 1 << plane;
+    }
+    return (minterm_byte(minterm, s, d) & mask) | (d & ~mask);
+}
+
+// Planar to chunky over the whole screen, 8 planes like a promoted native screen and the fewer planes
+// and masks games and Workbench use, with every kernel set from rtg-span.c.  Each one is checked against
+// p2c_byte() first, at an odd source bit and with the source wrapping vertically.
+static void bench_p2c(int width, int height, int runs) {
+    const struct {
+        const char *name;
+        int depth;
+        uint8_t layer_mask, ff_mask, minterm, mask;
+    } cases[] = {
+        { "8 planes", 8, 0xFF, 0x00, MINTERM_SRC, 0xFF },
+        { "4 planes", 4, 0x0F, 0x00, MINTERM_SRC, 0xFF },
+        { "1 plane", 1, 0x01, 0x00, MINTERM_SRC, 0xFF },
+        { "layers", 8, 0xDB, 0x40, MINTERM_SRC, 0xFF },
+        { "notsrc", 8, 0xFF, 0x00, MINTERM_NOTSRC, 0xFF },
+        { "src/mask", 8, 0xFF, 0x00, MINTERM_SRC, 0x3C },
+        { "eor/mask", 8, 0xFF, 0x00, MINTERM_EOR, 0xF0 },
+    };
+    const struct rtg_span_kernels *const *kernels, *selected = rtg_span;
+    int num_kernels = rtg_span_list(&kernels);
+    int pitch = width, bytes = pitch * height;
+    int src_pitch = (width >> 3) + 2, plane_size = src_pitch * height;
+    struct rtg_command cmd;
+    uint8_t *planes, *init;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.x[3] = pitch;
+    rtg_cmd = &cmd;
+    planes = malloc(plane_size * 8);
+    init = malloc(bytes);
+    if (!planes || !init) {
+        printf("Out of memory.\n");
+        free(planes);
+        free(init);
+        return;
+    }
+    for (int i = 0; i < plane_size * 8; i++)
+        planes[i] = rand();
+    for (int i = 0; i < bytes; i++)
+        init[i] = rand();
+
+    printf("\n%-9s %-6s %10s %12s   (P2C %dx%d)\n", "p2c", "kernel", "Mpixels/s", "ms/frame", width, height);
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (int k = 0; k < num_kernels; k++) {
+            int w = width - 2, h = height - 1, bad = 0;
+            if (!kernels[k]->supported())
+                continue;
+            rtg_span = kernels[k];
+            cmd.user[0] = (cases[c].layer_mask << 8) | cases[c].ff_mask;
+
+            memcpy(rtg_mem, init, bytes);
+            rtg_p2c(3, 5, 1, 0, w - 1, h, cases[c].minterm, cases[c].depth, cases[c].mask, cases[c].layer_mask, src_pitch, planes);
+            for (int y = 0; y < height && !bad; y++) {
+                for (int x = 0; x < width; x++) {
+                    uint8_t d = init[y * pitch + x];
+                    if (y < h && x >= 1 && x < w)
+                        d = p2c_byte(planes, src_pitch, src_pitch * h, cases[c].depth, cases[c].layer_mask, cases[c].ff_mask, 3, 5, h,
+                                     x - 1, y, cases[c].minterm, cases[c].mask, d);
+                    if (rtg_mem[y * pitch + x] != d) {
+                        bad = 1;
+                        break;
+                    }
+                }
+            }
+
+            double best = 0;
+            for (int run = 0; run < runs; run++) {
+                int frames = 0;
+                double start = now(), elapsed;
+                do {
+                    rtg_p2c(0, 0, 0, 0, width, height, cases[c].minterm, cases[c].depth, cases[c].mask, cases[c].layer_mask, src_pitch, planes);
+                    frames++;
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+                if (frames / elapsed > best)
+                    best = frames / elapsed;
+            }
+            printf("%-9s %-6s %10.1f %12.3f%s\n", cases[c].name, kernels[k]->name, best * width * height / 1e6, 1e3 / best,
+                   bad ? "  MISMATCH" : "");
+        }
+    }
+    rtg_span = selected;
+    rtg_cmd = NULL;
+    free(planes);
+    free(init);
+}
+
+// Planar to RGB565 and RGB32 through a CLUT like BlitPlanar2Direct, which the 68k did itself before.
+// Checked against p2c_byte() and the CLUT first, like bench_p2c().
+static void bench_p2d(int width, int height, int runs) {
+    static const char *format_names[] = { "clut8", "rgb565", "rgb32" };
+    const struct {
+        const char *name;
+        int depth;
+        uint8_t layer_mask, ff_mask, minterm;
+    } cases[] = {
+        { "8 planes", 8, 0xFF, 0x00, MINTERM_SRC },
+        { "4 planes", 4, 0x0F, 0x00, MINTERM_SRC },
+        { "layers", 8, 0xDB, 0x40, MINTERM_SRC },
+        { "eor", 8, 0xFF, 0x00, MINTERM_EOR },
+    };
+    int src_pitch = (width >> 3) + 2, plane_size = src_pitch * height;
+    struct rtg_command cmd;
+    uint8_t *planes, *init, clut[256 * 4];
+
+    memset(&cmd, 0, sizeof(cmd));
+    rtg_cmd = &cmd;
+    planes = malloc(plane_size * 8);
+    init = malloc(width * 4 * height);
+    if (!planes || !init) {
+        printf("Out of memory.\n");
+        free(planes);
+        free(init);
+        return;
+    }
+    for (int i = 0; i < plane_size * 8; i++)
+        planes[i] = rand();
+    for (int i = 0; i < width * 4 * height; i++)
+        init[i] = rand();
+    for (size_t i = 0; i < sizeof(clut); i++)
+        clut[i] = rand();
+
+    printf("\n%-9s %-6s %10s %12s   (P2D %dx%d)\n", "p2d", "format", "Mpixels/s", "ms/frame", width, height);
+    for (int format = RTGFMT_RBG565; format <= RTGFMT_RGB32; format++) {
+        int pitch = width << format, bytes = pitch * height;
+        cmd.x[3] = pitch;
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            int w = width - 2, h = height - 1, bad = 0;
+            cmd.user[0] = (cases[c].layer_mask << 8) | cases[c].ff_mask;
+
+            memcpy(rtg_mem, init, bytes);
+            rtg_p2d(3, 5, 1, 0, w - 1, h, cases[c].minterm, cases[c].depth, cases[c].layer_mask, src_pitch, planes, clut, format);
+            for (int y = 0; y < height && !bad; y++) {
+                for (int x = 0; x < width && !bad; x++) {
+                    uint8_t index = 0;
+                    if (y < h && x >= 1 && x < w)
+                        index = p2c_byte(planes, src_pitch, src_pitch * h, cases[c].depth, cases[c].layer_mask, cases[c].ff_mask, 3, 5, h,
+                                         x - 1, y, MINTERM_SRC, 0xFF, 0);
+                    for (int i = 0; i < (1 << format); i++) {
+                        int offset = y * pitch + (x << format) + i;
+                        uint8_t d = init[offset];
+                        if (y < h && x >= 1 && x < w)
+                            d = minterm_byte(cases[c].minterm, clut[index * 4 + 4 - (1 << format) + i], d);
+                        if (rtg_mem[offset] != d)
+                            bad = 1;
+                    }
+                }
+            }
+
+            double best = 0;
+            for (int run = 0; run < runs; run++) {
+                int frames = 0;
+                double start = now(), elapsed;
+                do {
+                    rtg_p2d(0, 0, 0, 0, width, height, cases[c].minterm, cases[c].depth, cases[c].layer_mask, src_pitch, planes, clut, format);
+                    frames++;
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+                if (frames / elapsed > best)
+                    best = frames / elapsed;
+            }
+            printf("%-9s %-6s %10.1f %12.3f%s\n", cases[c].name, format_names[format], best * width * height / 1e6, 1e3 / best,
+                   bad ? "  MISMATCH" : "");
+        }
+    }
+    rtg_cmd = NULL;
+    free(planes);
+    free(init);
+}
+
+// Small RGB565 blits issued through the registers and through the command FIFO, where the per-register
+// trips to rtg_write() are most of the cost.
+static void bench_small_blits(int width, int height, int runs) {
+    static const int sizes[] = { 8, 16, 32 };
+    int pitch = width * 2;
+    uint8_t *ref = malloc(pitch * height);
+
+    if (!ref) {
+        printf("Out of memory.\n");
+        return;
+    }
+    // The doorbell from InitCard(), which maps the ring.
+    bus_write(PIGFX_RTG_BASE + RTG_FIFO, fifo_pos, OP_TYPE_LONGWORD);
+    printf("\n%-6s %-5s %10s %10s %14s %14s %8s\n", "blit", "size", "writes", "FIFO wr.", "blits/s", "FIFO blits/s", "speedup");
+    for (int kind = 0; kind < BLIT_NUM; kind++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            int size = sizes[s];
+            double best[2] = { 0, 0 };
+            uint64_t writes[2] = { 0, 0 };
+
+            if (kind == BLIT_GLYPH && size != 8)
+                continue;
+            // Both ways have to draw the same.
+            for (int fifo = 0; fifo < 2; fifo++) {
+                memset(rtg_mem, 0, pitch * height);
+                for (int i = 0; i < 1000; i++)
+                    small_blit(kind, fifo, (i * 37) % (width - size - 1), (i * 11) % (height - size - 1), size, pitch);
+                rtg_fifo_poll();
+                rtg_blitter_wait();
+                if (!fifo)
+                    memcpy(ref, rtg_mem, pitch * height);
+                else if (memcmp(ref, rtg_mem, pitch * height) != 0)
+                    printf("%-6s %-5d MISMATCH\n", blit_names[kind], size);
+            }
+
+            // The runs take turns, so both ways see the same machine.
+            for (int r = 0; r < runs * 2; r++) {
+                int fifo = r & 1, blits = 0;
+                double start = now(), elapsed;
+                bus_writes = 0;
+                do {
+                    for (int i = 0; i < 256; i++, blits++)
+                        small_blit(kind, fifo, (blits * 37) % (width - size - 1), (blits * 11) % (height - size - 1), size, pitch);
+                    rtg_fifo_poll();
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+                rtg_blitter_wait();
+                elapsed = now() - start;
+                if (blits / elapsed > best[fifo])
+                    best[fifo] = blits / elapsed;
+                writes[fifo] = bus_writes / blits;
+            }
+            printf("%-6s %2dx%-2d %10d %10d %14.0f %14.0f %7.2fx\n", blit_names[kind], size, size, (int)writes[0], (int)writes[1], best[0], best[1], best[1] / best[0]);
+        }
+    }
+    free(ref);
+}
+
+// A 16x16 arrow, plane 0 is the outline and plane 1 the inside.
+static uint16_t pointer_plane(int y, int plane) {
+    uint16_t shape = (y < 16) ? (uint16_t)(0xFFFF << (15 - y)) : 0;
+    uint16_t inside = (y > 1 && y < 15) ? (uint16_t)((0xFFFF << (16 - y)) & 0x7FFF) : 0;
+    return plane ? inside : (shape & ~inside);
+}
+
+// P96's own pointer on an RGB565 screen: the background under the old position put back, the one under the
+// new position saved and the arrow drawn, all through the card.  Against the sprite, which is a position
+// for the output thread.  Each move is followed by what the output thread does for the next frame.
+static void bench_pointer(int width, int height, int runs) {
+    static uint16_t saved[16][16];
+    struct rtg_dirty_band *bands = malloc(height * sizeof(struct rtg_dirty_band));
+    uint8_t *dst = malloc((size_t)width * 2 * height);
+    uint32_t fb = PIGFX_RTG_BASE + PIGFX_REG_SIZE;
+    int pitch = width * 2, range_x = width - 16, range_y = height - 16;
+    struct rtg_frame frame;
+    struct rtg_sprite sprite;
+
+    if (!bands || !dst) {
+        printf("Out of memory.\n");
+        free(bands);
+        free(dst);
+        return;
+    }
+
+    // The image as SetSpriteImage() leaves it in the scratch area, and the check that it comes out as drawn.
+    for (int y = 0; y < 16; y++) {
+        bus_write(BENCH_CARD_SCRATCH + y * 4, pointer_plane(y, 0), OP_TYPE_WORD);
+        bus_write(BENCH_CARD_SCRATCH + y * 4 + 2, pointer_plane(y, 1), OP_TYPE_WORD);
+    }
+    reg_long(RTG_ADDR1, BENCH_CARD_SCRATCH);
+    reg_short(RTG_X1, 16);
+    reg_short(RTG_Y1, 16);
+    bus_write(PIGFX_RTG_BASE + RTG_U81, 0, OP_TYPE_BYTE);
+    reg_short(RTG_COMMAND, RTGCMD_SETSPRITEIMAGE);
+    rtg_get_sprite(&sprite);
+    for (int y = 0; y < 16; y++) {
+        for (int x = 0; x < 16; x++) {
+            uint16_t bit = 0x8000 >> x;
+            int expect = ((pointer_plane(y, 0) & bit) ? 1 : 0) | ((pointer_plane(y, 1) & bit) ? 2 : 0);
+            if (sprite.image[y][x] != expect) {
+                printf("\npointer image MISMATCH at %d,%d\n", x, y);
+                y = 16;
+                break;
+            }
+        }
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.vram = rtg_mem;
+    frame.width = width;
+    frame.height = height;
+    frame.pitch = pitch;
+    frame.bpp = 2;
+    frame.kind = RTG_CONVERT_SWAP16;
+
+    printf("\n%-8s %12s %12s %12s %12s\n", "pointer", "accesses", "us/move", "us/frame", "cpu@60Hz");
+    for (int sprite_on = 0; sprite_on < 2; sprite_on++) {
+        double best_move = 0, best_frame = 0;
+        uint64_t accesses = 0;
+
+        reg_short(RTG_X1, sprite_on);
+        reg_short(RTG_COMMAND, RTGCMD_SETSPRITE);
+        rtg_dirty_bands(&frame, 1, bands);
+        for (int r = 0; r < runs; r++) {
+            int moves = 0, old_x = 0, old_y = 0;
+            double move_time = 0, frame_time = 0, start = now(), t;
+            uint32_t serial = 0;
+
+            bus_writes = bus_reads = 0;
+            do {
+                int x = (moves * 7) % range_x, y = (moves * 3) % range_y;
+
+                t = now();
+                if (!sprite_on) {
+                    for (int py = 0; py < 16; py++) {
+                        for (int px = 0; px < 16; px += 2) {
+                            uint32_t at = fb + (old_y + py) * pitch + (old_x + px) * 2;
+                            if (moves)
+                                bus_write(at, saved[py][px] << 16 | saved[py][px + 1], OP_TYPE_LONGWORD);
+                        }
+                    }
+                    for (int py = 0; py < 16; py++) {
+                        uint16_t outline = pointer_plane(py, 0), inside = pointer_plane(py, 1);
+                        for (int px = 0; px < 16; px += 2) {
+                            uint32_t at = fb + (y + py) * pitch + (x + px) * 2;
+                            uint32_t bg = bus_read(at, OP_TYPE_LONGWORD);
+                            saved[py][px] = bg >> 16;
+                            saved[py][px + 1] = bg;
+                        }
+                        for (int px = 0; px < 16; px++) {
+                            uint16_t bit = 0x8000 >> px;
+                            if ((outline | inside) & bit)
+                                bus_write(fb + (y + py) * pitch + (x + px) * 2, (outline & bit) ? 0x0000 : 0xFFFF, OP_TYPE_WORD);
+                        }
+                    }
+                }
+                else {
+                    reg_short(RTG_X1, x);
+                    reg_short(RTG_Y1, y);
+                    reg_short(RTG_COMMAND, RTGCMD_SETSPRITEPOS);
+                }
+                old_x = x;
+                old_y = y;
+                move_time += now() - t;
+
+                t = now();
+                int num_bands = rtg_dirty_bands(&frame, 0, bands);
+                for (int i = 0; i < num_bands; i++)
+                    rtg_convert_band(&frame, &bands[i], dst + bands[i].y * pitch + bands[i].x * 2, pitch);
+                if (rtg_sprite_serial() != serial) {
+                    rtg_get_sprite(&sprite);
+                    serial = sprite.serial;
+                }
+                frame_time += now() - t;
+                moves++;
+            } while (now() - start < 0.2);
+            if (!best_move || move_time / moves < best_move)
+                best_move = move_time / moves;
+            if (!best_frame || frame_time / moves < best_frame)
+                best_frame = frame_time / moves;
+            accesses = (bus_writes + bus_reads) / moves;
+        }
+        printf("%-8s %12d %12.2f %12.2f %11.2f%%\n", sprite_on ? "sprite" : "software", (int)accesses, best_move * 1e6, best_frame * 1e6, 100.0 * 60 * (best_move + best_frame));
+    }
+    reg_short(RTG_X1, 0);
+    reg_short(RTG_COMMAND, RTGCMD_SETSPRITE);
+    free(bands);
+    free(dst);
+}
+
+int main(int argc, char *argv[]) {
+    const struct rtg_convert_kernels *const *kernels;
+    int num_kernels = rtg_convert_list(&kernels);
+    int width = 1280, height = 720, runs = 5;
+    uint32_t palette[256];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:r:")) != -1) {
+        switch (opt) {
+            case 's':
+                if (sscanf(optarg, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                    printf("Bad frame size %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            default:
+                printf("usage: %s [-s WIDTHxHEIGHT] [-r runs]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (runs < 1)
+        runs = 1;
+
+    size_t src_size = (size_t)(width * 4 + 16) * height;
+    size_t dst_size = (size_t)width * 4 * height;
+    uint8_t *src = malloc(src_size);
+    uint8_t *dst = malloc(dst_size);
+    uint8_t *ref = malloc(dst_size);
+    if (!src || !dst || !ref) {
+        printf("Out of memory.\n");
+        return 1;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < src_size; i++)
+        src[i] = rand();
+    for (int i = 0; i < 256; i++)
+        palette[i] = 0xFF000000 | (rand() & 0xFFFFFF);
+
+    printf("%dx%d frame, %d pixels\n\n", width, height, width * height);
+    printf("%-8s %-6s %12s %10s\n", "convert", "kernel", "Mpixels/s", "frames/s");
+
+    for (int kind = 0; kind < RTG_CONVERT_NUM; kind++) {
+        convert_frame(kernels[0]->func[kind], kind, ref, src, width, height, palette);
+
+        for (int k = 0; k < num_kernels; k++) {
+            if (!kernels[k]->supported())
+                continue;
+
+            memset(dst, 0, dst_size);
+            convert_frame(kernels[k]->func[kind], kind, dst, src, width, height, palette);
+            if (memcmp(dst, ref, (size_t)width * height * convert_dst_bytes[kind]) != 0) {
+                printf("%-8s %-6s %12s\n", convert_names[kind], kernels[k]->name, "MISMATCH");
+                continue;
+            }
+
+            double best = 0;
+            for (int r = 0; r < runs; r++) {
+                int frames = 0;
+                double start = now(), elapsed;
+                do {
+                    convert_frame(kernels[k]->func[kind], kind, dst, src, width, height, palette);
+                    frames++;
+                    elapsed = now() - start;
+                } while (elapsed < 0.2);
+                if (frames / elapsed > best)
+                    best = frames / elapsed;
+            }
+            printf("%-8s %-6s %12.1f %10.1f\n", convert_names[kind], kernels[k]->name, best * width * height / 1e6, best);
+        }
+    }
+
+    bench_dirty(src, dst, width, height, palette, runs);
+    bench_stream(src, dst, width, height, palette, runs);
+    if (!init_rtg_data()) {
+        printf("Can't set up the RTG registers.\n");
+        return 1;
+    }
+    bench_blit_ops(width, height, runs);
+    check_minterms();
+    bench_minterms(width, height, runs);
+    bench_p2c(width, height, runs);
+    bench_p2d(width, height, runs);
+    bench_small_blits(width, height, runs);
+    bench_pointer(width, height, runs);
+
+    free(src);
+    free(dst);
+    free(ref);
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Blitter thread for the RTG commands (see handle_rtg_command() in rtg.c).
+//
+// Blits are copied from the registers into a ring of commands and run in
+// order on their own thread, the 68k goes on as soon as a command is queued.
+// The VRAM the queued blits read and write is kept as one range, CPU reads
+// and writes inside it wait until the queue is empty (rtg_blitter_sync()).
+// So do reads of RTG_WAITBLIT, for the driver's WaitBlitter().  Commands that
+// follow each other need nothing extra, they run in the order they came in.
+//
+// Only the CPU thread moves the head and only the blitter thread the tail,
+// like the profiler ring.  The mutex is only taken to sleep and to wake a
+// sleeping thread up, so a busy queue costs no system calls.
+
+#include "emulator.h"
+#include "rtg.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RTG_QUEUE_SIZE 64
+// Polls of the queue before a thread waiting for it goes to sleep.  The next blit of a burst, or the
+// end of the small one the CPU thread waits for, usually comes well before that.
+#define RTG_BLITTER_SPIN 2000
+
+static struct rtg_command queue[RTG_QUEUE_SIZE];
+static uint32_t queue_head, queue_tail;
+static int blitter_running, blitter_sleeping, cpu_waiting;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_done = PTHREAD_COND_INITIALIZER;
+
+uint32_t rtg_busy_start, rtg_busy_size;
+
+static void *rtg_blitter_task(void *arg) {
+    uint32_t tail = 0;
+    (void)arg;
+
+    for (;;) {
+        if (tail == __atomic_load_n(&queue_head, __ATOMIC_ACQUIRE)) {
+            int spin = 0;
+            while (spin < RTG_BLITTER_SPIN && tail == __atomic_load_n(&queue_head, __ATOMIC_ACQUIRE))
+                spin++;
+            if (spin == RTG_BLITTER_SPIN) {
+                pthread_mutex_lock(&queue_mutex);
+                __atomic_store_n(&blitter_sleeping, 1, __ATOMIC_SEQ_CST);
+                while (tail == __atomic_load_n(&queue_head, __ATOMIC_SEQ_CST))
+                    pthread_cond_wait(&queue_work, &queue_mutex);
+                __atomic_store_n(&blitter_sleeping, 0, __ATOMIC_RELAXED);
+                pthread_mutex_unlock(&queue_mutex);
+            }
+            continue;
+        }
+
+        rtg_run_command(&queue[tail % RTG_QUEUE_SIZE]);
+
+        tail++;
+        __atomic_store_n(&queue_tail, tail, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&cpu_waiting, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&queue_mutex);
+            pthread_cond_signal(&queue_done);
+            pthread_mutex_unlock(&queue_mutex);
+        }
+    }
+    return NULL;
+}
+
+// Waits on the CPU thread until at most pending commands are left in the queue.
+static void wait_queue(uint32_t pending) {
+    for (int spin = 0; spin < RTG_BLITTER_SPIN; spin++) {
+        if (queue_head - __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE) <= pending)
+            return;
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+    __atomic_store_n(&cpu_waiting, 1, __ATOMIC_SEQ_CST);
+    while (queue_head - __atomic_load_n(&queue_tail, __ATOMIC_SEQ_CST) > pending)
+        pthread_cond_wait(&queue_done, &queue_mutex);
+    __atomic_store_n(&cpu_waiting, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+int rtg_blitter_init() {
+    pthread_t tid;
+    int err;
+
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        printf("Only one CPU core, RTG blits run on the CPU thread.\n");
+        return 0;
+    }
+    err = pthread_create(&tid, NULL, &rtg_blitter_task, NULL);
+    if (err != 0) {
+        printf("Failed to create RTG blitter thread: [%s], blits run on the CPU thread.\n", strerror(err));
+        return 0;
+    }
+    pthread_setname_np(tid, "pistorm: blit");
+    blitter_running = 1;
+    return 1;
+}
+
+// Free command for the CPU thread to fill, NULL if there is no blitter thread.  A full queue is let
+// run down to half before the 68k goes on, rather than waking it up for every command.
+struct rtg_command *rtg_blitter_slot() {
+    if (!blitter_running)
+        return NULL;
+
+    if (queue_head - __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE) == RTG_QUEUE_SIZE)
+        wait_queue(RTG_QUEUE_SIZE / 2);
+    return &queue[queue_head % RTG_QUEUE_SIZE];
+}
+
+int rtg_blitter_idle() {
+    return queue_head == __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE);
+}
+
+// Queues the command from rtg_blitter_slot(), it uses VRAM offsets start to end.
+void rtg_blitter_submit(uint32_t start, uint32_t end) {
+    if (!rtg_busy_size) {
+        rtg_busy_start = start;
+        rtg_busy_size = end - start;
+    }
+    else {
+        uint32_t busy_end = rtg_busy_start + rtg_busy_size;
+        if (start < rtg_busy_start)
+            rtg_busy_start = start;
+        rtg_busy_size = ((end > busy_end) ? end : busy_end) - rtg_busy_start;
+    }
+
+    __atomic_store_n(&queue_head, queue_head + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&blitter_sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&queue_mutex);
+        pthread_cond_signal(&queue_work);
+        pthread_mutex_unlock(&queue_mutex);
+    }
+}
+
+void rtg_blitter_wait() {
+    if (blitter_running)
+        wait_queue(0);
+    rtg_busy_start = rtg_busy_size = 0;
+}
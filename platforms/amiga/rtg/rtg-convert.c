@@ -0,0 +1,354 @@
+// Pixel conversion kernels for the RTG output thread (see rtg-output.c).
+//
+// The visible part of the RTG framebuffer is converted row by row into the
+// format of the SDL texture.  There is a plain C version of each kernel plus
+// NEON ones for the Pi and SSE2/AVX2 ones for testing on x86,
+// rtg_convert_init() picks the fastest set the CPU supports.  The SIMD kernels
+// only exist for little endian hosts, on big endian ones the framebuffer
+// already is in host order and the C versions are all there is.
+//
+// Only VRAM that changed is converted.  CPU writes (rtg_write()) and the blits
+// in rtg-gfx.c set a flag per 256 byte block after writing, each frame the
+// output thread takes the flags of the blocks on screen and converts just the
+// rows and columns they cover, straight into the locked texture.  A frame
+// without any is skipped altogether.
+
+#include "rtg-convert.h"
+#include "rtg.h"
+
+#include <endian.h>
+#include <stdio.h>
+#include <string.h>
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RTG_CONVERT_NEON
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+#if defined(__SSE2__)
+#define RTG_CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RTG_CONVERT_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+static int always_supported(void) {
+    return 1;
+}
+
+static void clut8_c(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint32_t *d = (uint32_t *)dst;
+    for (int x = 0; x < pixels; x++) {
+        d[x] = palette[src[x]];
+    }
+}
+
+static void swap16_c(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint16_t *d = (uint16_t *)dst;
+    const uint16_t *s = (const uint16_t *)src;
+    (void)palette;
+    for (int x = 0; x < pixels; x++) {
+        d[x] = be16toh(s[x]);
+    }
+}
+
+static void swap32_c(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *s = (const uint32_t *)src;
+    (void)palette;
+    for (int x = 0; x < pixels; x++) {
+        d[x] = be32toh(s[x]);
+    }
+}
+
+static const struct rtg_convert_kernels kernels_c = {
+    "C", always_supported, { clut8_c, swap16_c, swap32_c },
+};
+
+#ifdef RTG_CONVERT_NEON
+static int neon_supported(void) {
+#if defined(__aarch64__) || !defined(HWCAP_NEON)
+    return 1;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+}
+
+// NEON has no gather, the lookups stay scalar but go out as full vector stores.
+static void clut8_neon(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint32_t *d = (uint32_t *)dst;
+    int x = 0;
+    for (; x + 8 <= pixels; x += 8) {
+        uint32x4_t lo = vdupq_n_u32(palette[src[x]]);
+        uint32x4_t hi = vdupq_n_u32(palette[src[x + 4]]);
+        lo = vsetq_lane_u32(palette[src[x + 1]], lo, 1);
+        hi = vsetq_lane_u32(palette[src[x + 5]], hi, 1);
+        lo = vsetq_lane_u32(palette[src[x + 2]], lo, 2);
+        hi = vsetq_lane_u32(palette[src[x + 6]], hi, 2);
+        lo = vsetq_lane_u32(palette[src[x + 3]], lo, 3);
+        hi = vsetq_lane_u32(palette[src[x + 7]], hi, 3);
+        vst1q_u32(d + x, lo);
+        vst1q_u32(d + x + 4, hi);
+    }
+    clut8_c(d + x, src + x, pixels - x, palette);
+}
+
+static void swap16_neon(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint8_t *d = (uint8_t *)dst;
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16) {
+        vst1q_u8(d + x * 2, vrev16q_u8(vld1q_u8(src + x * 2)));
+        vst1q_u8(d + x * 2 + 16, vrev16q_u8(vld1q_u8(src + x * 2 + 16)));
+    }
+    swap16_c(d + x * 2, src + x * 2, pixels - x, palette);
+}
+
+static void swap32_neon(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint8_t *d = (uint8_t *)dst;
+    int x = 0;
+    for (; x + 8 <= pixels; x += 8) {
+        vst1q_u8(d + x * 4, vrev32q_u8(vld1q_u8(src + x * 4)));
+        vst1q_u8(d + x * 4 + 16, vrev32q_u8(vld1q_u8(src + x * 4 + 16)));
+    }
+    swap32_c(d + x * 4, src + x * 4, pixels - x, palette);
+}
+
+static const struct rtg_convert_kernels kernels_neon = {
+    "NEON", neon_supported, { clut8_neon, swap16_neon, swap32_neon },
+};
+#endif
+
+#ifdef RTG_CONVERT_SSE2
+static void clut8_sse2(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint32_t *d = (uint32_t *)dst;
+    int x = 0;
+    for (; x + 4 <= pixels; x += 4) {
+        _mm_storeu_si128((__m128i *)(d + x), _mm_set_epi32(palette[src[x + 3]], palette[src[x + 2]], palette[src[x + 1]], palette[src[x]]));
+    }
+    clut8_c(d + x, src + x, pixels - x, palette);
+}
+
+static inline __m128i bswap16_sse2(__m128i v) {
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static void swap16_sse2(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint8_t *d = (uint8_t *)dst;
+    int x = 0;
+    for (; x + 8 <= pixels; x += 8) {
+        _mm_storeu_si128((__m128i *)(d + x * 2), bswap16_sse2(_mm_loadu_si128((const __m128i *)(src + x * 2))));
+    }
+    swap16_c(d + x * 2, src + x * 2, pixels - x, palette);
+}
+
+static void swap32_sse2(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint8_t *d = (uint8_t *)dst;
+    int x = 0;
+    for (; x + 4 <= pixels; x += 4) {
+        // Swap the bytes of each halfword, then the halfwords of each longword.
+        __m128i v = bswap16_sse2(_mm_loadu_si128((const __m128i *)(src + x * 4)));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+        _mm_storeu_si128((__m128i *)(d + x * 4), v);
+    }
+    swap32_c(d + x * 4, src + x * 4, pixels - x, palette);
+}
+
+static const struct rtg_convert_kernels kernels_sse2 = {
+    "SSE2", always_supported, { clut8_sse2, swap16_sse2, swap32_sse2 },
+};
+#endif
+
+#ifdef RTG_CONVERT_AVX2
+static int avx2_supported(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void clut8_avx2(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    uint32_t *d = (uint32_t *)dst;
+    int x = 0;
+    for (; x + 8 <= pixels; x += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x)));
+        _mm256_storeu_si256((__m256i *)(d + x), _mm256_i32gather_epi32((const int *)palette, idx, 4));
+    }
+    clut8_c(d + x, src + x, pixels - x, palette);
+}
+
+__attribute__((target("avx2")))
+static void swap_avx2(uint8_t *d, const uint8_t *src, int bytes, __m256i order) {
+    for (int i = 0; i + 32 <= bytes; i += 32) {
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + i)), order));
+    }
+}
+
+__attribute__((target("avx2")))
+static void swap16_avx2(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    const __m256i order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                           1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    int x = pixels & ~15;
+    swap_avx2((uint8_t *)dst, src, x * 2, order);
+    swap16_c((uint8_t *)dst + x * 2, src + x * 2, pixels - x, palette);
+}
+
+__attribute__((target("avx2")))
+static void swap32_avx2(void *dst, const uint8_t *src, int pixels, const uint32_t *palette) {
+    const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    int x = pixels & ~7;
+    swap_avx2((uint8_t *)dst, src, x * 4, order);
+    swap32_c((uint8_t *)dst + x * 4, src + x * 4, pixels - x, palette);
+}
+
+static const struct rtg_convert_kernels kernels_avx2 = {
+    "AVX2", avx2_supported, { clut8_avx2, swap16_avx2, swap32_avx2 },
+};
+#endif
+
+static const struct rtg_convert_kernels *const kernel_list[] = {
+    &kernels_c,
+#ifdef RTG_CONVERT_NEON
+    &kernels_neon,
+#endif
+#ifdef RTG_CONVERT_SSE2
+    &kernels_sse2,
+#endif
+#ifdef RTG_CONVERT_AVX2
+    &kernels_avx2,
+#endif
+};
+
+const struct rtg_convert_kernels *rtg_conv = &kernels_c;
+
+void rtg_convert_init(void) {
+    int num = sizeof(kernel_list) / sizeof(kernel_list[0]);
+
+    for (int i = num - 1; i >= 0; i--) {
+        if (kernel_list[i]->supported()) {
+            rtg_conv = kernel_list[i];
+            break;
+        }
+    }
+    printf("Using %s RTG pixel conversion.\n", rtg_conv->name);
+}
+
+int rtg_convert_list(const struct rtg_convert_kernels *const **list) {
+    *list = kernel_list;
+    return sizeof(kernel_list) / sizeof(kernel_list[0]);
+}
+
+uint8_t rtg_dirty[RTG_MEM_SIZE >> RTG_DIRTY_SHIFT] __attribute__((aligned(8)));
+static uint8_t dirty_all;
+// Flags of the blocks on screen as taken by the last rtg_convert_dirty(), from the first block on screen.
+static uint8_t dirty_taken[RTG_MEM_SIZE >> RTG_DIRTY_SHIFT];
+
+void rtg_mark_dirty_rect(uint32_t offset, uint32_t bytes, uint32_t rows, uint32_t pitch) {
+    if (!bytes)
+        return;
+
+    // The pixels have to be visible before any of the flags are.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (uint32_t y = 0; y < rows && offset < RTG_MEM_SIZE; y++, offset += pitch) {
+        uint32_t last = (bytes > RTG_MEM_SIZE - offset) ? RTG_MEM_SIZE - 1 : offset + bytes - 1;
+        for (uint32_t block = offset >> RTG_DIRTY_SHIFT; block <= last >> RTG_DIRTY_SHIFT; block++)
+            __atomic_store_n(&rtg_dirty[block], 1, __ATOMIC_RELAXED);
+    }
+}
+
+void rtg_mark_dirty_all() {
+    __atomic_store_n(&dirty_all, 1, __ATOMIC_RELEASE);
+}
+
+int rtg_take_dirty_all(void) {
+    return __atomic_exchange_n(&dirty_all, 0, __ATOMIC_ACQ_REL);
+}
+
+// Takes the flags of blocks first to last into dirty_taken[], clearing them.  Blocks written from now on are
+// flagged again and show up in the next frame.
+static void take_dirty_blocks(uint32_t first, uint32_t last) {
+    uint32_t block = first;
+
+    while (block <= last) {
+        // Idle screens are mostly clean, skip those eight blocks at a time.
+        if ((block & 7) == 0 && last - block >= 7 && __atomic_load_n((uint64_t *)&rtg_dirty[block], __ATOMIC_RELAXED) == 0) {
+            memset(&dirty_taken[block - first], 0, 8);
+            block += 8;
+            continue;
+        }
+        if (__atomic_load_n(&rtg_dirty[block], __ATOMIC_RELAXED))
+            dirty_taken[block - first] = __atomic_exchange_n(&rtg_dirty[block], 0, __ATOMIC_ACQ_REL);
+        else
+            dirty_taken[block - first] = 0;
+        block++;
+    }
+}
+
+int rtg_dirty_bands(const struct rtg_frame *frame, int full, struct rtg_dirty_band *bands) {
+    uint32_t row_bytes = frame->width * frame->bpp;
+    uint64_t end = frame->addr + (uint64_t)(frame->height - 1) * frame->pitch + row_bytes;
+    struct rtg_dirty_band *band = NULL;
+    int num_bands = 0;
+
+    if (!frame->width || !frame->height || end > RTG_MEM_SIZE)
+        return 0;
+
+    uint32_t first = frame->addr >> RTG_DIRTY_SHIFT;
+    take_dirty_blocks(first, (end - 1) >> RTG_DIRTY_SHIFT);
+
+    for (int y = 0; y < frame->height; y++) {
+        uint32_t row = frame->addr + y * frame->pitch;
+        uint32_t block = row >> RTG_DIRTY_SHIFT, last = (row + row_bytes - 1) >> RTG_DIRTY_SHIFT;
+        uint32_t left, right;
+
+        if (full) {
+            left = row;
+            right = row + row_bytes;
+        }
+        else {
+            // The leftmost and the rightmost dirty block of the row.
+            const uint8_t *next = memchr(&dirty_taken[block - first], 1, last - block + 1);
+            if (!next)
+                continue;
+            left = ((next - dirty_taken) + first) << RTG_DIRTY_SHIFT;
+            while (!dirty_taken[last - first])
+                last--;
+            right = (last + 1) << RTG_DIRTY_SHIFT;
+            if (left < row)
+                left = row;
+            if (right > row + row_bytes)
+                right = row + row_bytes;
+        }
+
+        int x = (left - row) / frame->bpp, x_end = (right - row + frame->bpp - 1) / frame->bpp;
+        if (band && band->y + band->h == y) {
+            int band_end = band->x + band->w;
+            if (x < band->x)
+                band->x = x;
+            band->w = ((x_end > band_end) ? x_end : band_end) - band->x;
+            band->h++;
+        }
+        else {
+            band = &bands[num_bands++];
+            band->x = x;
+            band->y = y;
+            band->w = x_end - x;
+            band->h = 1;
+        }
+    }
+
+    return num_bands;
+}
+
+void rtg_convert_band(const struct rtg_frame *frame, const struct rtg_dirty_band *band, uint8_t *dst, int dst_pitch) {
+    const uint8_t *src = frame->vram + frame->addr + band->y * frame->pitch + band->x * frame->bpp;
+
+    for (int y = 0; y < band->h; y++, src += frame->pitch, dst += dst_pitch)
+        rtg_conv->func[frame->kind](dst, src, band->w, frame->palette);
+}
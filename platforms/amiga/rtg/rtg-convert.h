@@ -0,0 +1,48 @@
+#include <stdint.h>
+
+// Converts one row of the RTG framebuffer into the pixel format of the SDL texture.
+typedef void (*rtg_convert_func)(void *dst, const uint8_t *src, int pixels, const uint32_t *palette);
+
+enum rtg_convert_kind {
+    RTG_CONVERT_CLUT8,   // 8-bit indices through the palette to ARGB8888
+    RTG_CONVERT_SWAP16,  // big endian R5G6B5/R5G5B5 to host order RGB565/RGB555
+    RTG_CONVERT_SWAP32,  // big endian A8R8G8B8 to host order ARGB8888
+    RTG_CONVERT_NUM,
+};
+
+struct rtg_convert_kernels {
+    const char *name;
+    int (*supported)(void);
+    rtg_convert_func func[RTG_CONVERT_NUM];
+};
+
+// Kernel set the output thread uses, the fastest one the CPU supports once rtg_convert_init() ran.
+extern const struct rtg_convert_kernels *rtg_conv;
+
+void rtg_convert_init(void);
+// All kernel sets built into this binary, scalar first, whether they run on this CPU or not.
+int rtg_convert_list(const struct rtg_convert_kernels *const **list);
+
+// What the output thread shows, offsets and pitches in bytes.
+struct rtg_frame {
+    const uint8_t *vram;
+    uint32_t addr;          // top left pixel
+    int width, height;
+    int pitch;
+    int bpp;                // bytes per framebuffer pixel
+    int kind;               // rtg_convert_kind, -1 if the texture takes the framebuffer as it is
+    const uint32_t *palette;
+};
+
+// Changed part of the frame in pixels, a run of consecutive rows.
+struct rtg_dirty_band {
+    int x, y, w, h;
+};
+
+// Lists what changed on screen since the last call in bands[] (room for one band per row), or all of it if
+// full is set.  Returns the number of bands, 0 if nothing changed.
+int rtg_dirty_bands(const struct rtg_frame *frame, int full, struct rtg_dirty_band *bands);
+// Converts all of a band to dst, which holds its top left pixel, usually locked texture memory.
+void rtg_convert_band(const struct rtg_frame *frame, const struct rtg_dirty_band *band, uint8_t *dst, int dst_pitch);
+// Set by rtg_mark_dirty_all(), the output thread takes it with rtg_take_dirty_all().
+int rtg_take_dirty_all(void);
@@ -7,216 +7,113 @@
 #include "gpio/ps_protocol.h"
 #endif
 #include "rtg.h"
+#include "rtg-span.h"
 
-extern uint32_t rtg_address[8];
-extern uint32_t rtg_address_adj[8];
 extern uint8_t *rtg_mem; // FIXME
 extern uint16_t rtg_display_format;
-extern uint16_t rtg_user[8];
-extern uint16_t rtg_x[8], rtg_y[8];
 
 extern uint8_t realtime_graphics_debug;
 
 void rtg_fillrect_solid(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t color, uint16_t pitch, uint16_t format) {
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[0] + (x << format) + (y * pitch)];
-    switch(format) {
-        case RTGFMT_8BIT: {
-            for (int xs = 0; xs < w; xs++) {
-                dptr[xs] = color & 0xFF;
-            }
-            break;
-        }
-        case RTGFMT_RBG565: {
-            color = htobe16((color & 0xFFFF));
-            uint16_t *ptr = (uint16_t *)dptr;
-            for (int xs = 0; xs < w; xs++) {
-                ptr[xs] = color;
-            }
-            break;
-        }
-        case RTGFMT_RGB32: {
-            color = htobe32(color);
-            uint32_t *ptr = (uint32_t *)dptr;
-            for (int xs = 0; xs < w; xs++) {
-                ptr[xs] = color;
-            }
-            break;
-        }
-    }
-    for (int ys = 1; ys < h; ys++) {
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (x << format) + (y * pitch)];
+    uint32_t pattern = rtg_pattern(color, format);
+
+    for (int ys = 0; ys < h; ys++) {
+        rtg_span->fill(dptr, pattern, w << format);
         dptr += pitch;
-        memcpy(dptr, (void *)(size_t)(dptr - pitch), (w << format));
     }
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[0] + (x << format) + (y * pitch), w << format, h, pitch);
 }
 
 void rtg_fillrect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t color, uint16_t pitch, uint16_t format, uint8_t mask) {
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[0] + (x << format) + (y * pitch)];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (x << format) + (y * pitch)];
+    uint32_t pattern = rtg_pattern(color, RTGFMT_8BIT), keep = rtg_pattern(~mask, RTGFMT_8BIT);
 
     for (int ys = 0; ys < h; ys++) {
-        for (int xs = 0; xs < w; xs++) {
-            SET_RTG_PIXEL_MASK(&dptr[xs], (color & 0xFF), format);
-        }
+        rtg_span->fill_mask(dptr, pattern, keep, w << format);
         dptr += pitch;
     }
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[0] + (x << format) + (y * pitch), w << format, h, pitch);
 }
 
 void rtg_invertrect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t pitch, uint16_t format, uint8_t mask) {
-    if (mask) {}
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[0] + (x << format) + (y * pitch)];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (x << format) + (y * pitch)];
+    // The mask only applies to 8-bit, other formats invert all of the pixel.
+    uint32_t pattern = (format == RTGFMT_8BIT) ? rtg_pattern(mask, RTGFMT_8BIT) : 0xFFFFFFFF;
+
     for (int ys = 0; ys < h; ys++) {
-        switch(format) {
-            case RTGFMT_8BIT: {
-                for (int xs = 0; xs < w; xs++) {
-                    dptr[xs] ^= mask;
-                }
-                break;
-            }
-            case RTGFMT_RBG565: {
-                for (int xs = 0; xs < w; xs++) {
-                    ((uint16_t *)dptr)[xs] = ~((uint16_t *)dptr)[xs];
-                }
-                break;
-            }
-            case RTGFMT_RGB32: {
-                for (int xs = 0; xs < w; xs++) {
-                    ((uint32_t *)dptr)[xs] = ~((uint32_t *)dptr)[xs];
-                }
-                break;
-            }
-        }
+        rtg_span->fill_mask(dptr, pattern, 0xFFFFFFFF, w << format);
         dptr += pitch;
     }
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[0] + (x << format) + (y * pitch), w << format, h, pitch);
 }
 
 void rtg_blitrect(uint16_t x, uint16_t y, uint16_t dx, uint16_t dy, uint16_t w, uint16_t h, uint16_t pitch, uint16_t format, uint8_t mask) {
-    if (mask) {}
-    uint8_t *sptr = &rtg_mem[rtg_address_adj[0] + (x << format) + (y * pitch)];
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[0] + (dx << format) + (dy * pitch)];
-
-    uint32_t xdir = 1, pitchstep = pitch;
+    uint8_t *sptr = &rtg_mem[rtg_cmd->address_adj[0] + (x << format) + (y * pitch)];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (dx << format) + (dy * pitch)];
+    uint32_t keep = rtg_pattern(~mask, RTGFMT_8BIT);
+    int32_t pitchstep = pitch;
 
+    // Rows bottom up if the destination is further down, the kernel takes care of the direction in a row.
     if (y < dy) {
         pitchstep = -pitch;
         sptr += ((h - 1) * pitch);
         dptr += ((h - 1) * pitch);
     }
-    if (x < dx) {
-        xdir = 0;
-    }
 
     for (int ys = 0; ys < h; ys++) {
-        if (xdir) {
-            for (int xs = 0; xs < w; xs++) {
-                SET_RTG_PIXEL_MASK(&dptr[xs], sptr[xs], format);
-            }
-        }
-        else {
-            for (int xs = w - 1; xs >= x; xs--) {
-                SET_RTG_PIXEL_MASK(&dptr[xs], sptr[xs], format);
-            }
-        }
+        rtg_span->copy_mask(dptr, sptr, keep, w << format);
         sptr += pitchstep;
         dptr += pitchstep;
     }
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[0] + (dx << format) + (dy * pitch), w << format, h, pitch);
 }
 
 void rtg_blitrect_solid(uint16_t x, uint16_t y, uint16_t dx, uint16_t dy, uint16_t w, uint16_t h, uint16_t pitch, uint16_t format) {
-    uint8_t *sptr = &rtg_mem[rtg_address_adj[0] + (x << format) + (y * pitch)];
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[0] + (dx << format) + (dy * pitch)];
-
-    uint32_t xdir = 1, pitchstep = pitch;
+    uint8_t *sptr = &rtg_mem[rtg_cmd->address_adj[0] + (x << format) + (y * pitch)];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (dx << format) + (dy * pitch)];
+    int32_t pitchstep = pitch;
 
     if (y < dy) {
         pitchstep = -pitch;
         sptr += ((h - 1) * pitch);
         dptr += ((h - 1) * pitch);
     }
-    if (x < dx) {
-        xdir = 0;
-    }
 
+    // Source and destination rows overlap when moving sideways, memcpy() isn't safe for either direction.
     for (int ys = 0; ys < h; ys++) {
-        if (xdir)
-            memcpy(dptr, sptr, w << format);
-        else
-            memmove(dptr, sptr, w << format);
+        memmove(dptr, sptr, w << format);
         sptr += pitchstep;
         dptr += pitchstep;
     }
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[0] + (dx << format) + (dy * pitch), w << format, h, pitch);
 }
 
 void rtg_blitrect_nomask_complete(uint16_t sx, uint16_t sy, uint16_t dx, uint16_t dy, uint16_t w, uint16_t h, uint16_t srcpitch, uint16_t dstpitch, uint32_t src_addr, uint32_t dst_addr, uint16_t format, uint8_t minterm) {
-    if (minterm) {}
     uint8_t *sptr = &rtg_mem[src_addr - (PIGFX_RTG_BASE + PIGFX_REG_SIZE) + (sx << format) + (sy * srcpitch)];
     uint8_t *dptr = &rtg_mem[dst_addr - (PIGFX_RTG_BASE + PIGFX_REG_SIZE) + (dx << format) + (dy * dstpitch)];
+    rtg_minterm_func func = rtg_minterm_kernel(minterm, 0);
+    int32_t src_pitchstep = srcpitch, dst_pitchstep = dstpitch;
 
-    uint32_t xdir = 1, src_pitchstep = srcpitch, dst_pitchstep = dstpitch;
-    uint8_t draw_mode = minterm;
-    uint32_t mask = 0xFF;
+    if (minterm == MINTERM_DST)
+        return;
 
-    if (src_addr == dst_addr) {
-        if (sy < dy) {
-            src_pitchstep = -srcpitch;
-            sptr += ((h - 1) * srcpitch);
-            dst_pitchstep = -dstpitch;
-            dptr += ((h - 1) * dstpitch);
-        }
-        if (sx < dx) {
-            xdir = 0;
-        }
+    if (src_addr == dst_addr && sy < dy) {
+        src_pitchstep = -srcpitch;
+        sptr += ((h - 1) * srcpitch);
+        dst_pitchstep = -dstpitch;
+        dptr += ((h - 1) * dstpitch);
     }
 
-    if (format == RTGFMT_RBG565)
-        mask = 0xFFFF;
-    if (format == RTGFMT_RGB32)
-        mask = 0xFFFFFFFF;
-
-    if (minterm == MINTERM_SRC) {
-        for (int ys = 0; ys < h; ys++) {
-            if (xdir)
-                memcpy(dptr, sptr, w << format);
-            else
-                memmove(dptr, sptr, w << format);
-            sptr += src_pitchstep;
-            dptr += dst_pitchstep;
-        }
-    }
-    else {
-        for (int ys = 0; ys < h; ys++) {
-            if (xdir) {
-                for (int xs = 0; xs < w; xs++) {
-                    switch (format) {
-                        case RTGFMT_8BIT:
-                            HANDLE_MINTERM_PIXEL(sptr[xs], dptr[xs], format);
-                            break;
-                        case RTGFMT_RBG565:
-                            HANDLE_MINTERM_PIXEL(((uint16_t *)sptr)[xs], ((uint16_t *)dptr)[xs], format);
-                            break;
-                        case RTGFMT_RGB32:
-                            HANDLE_MINTERM_PIXEL(((uint32_t *)sptr)[xs], ((uint32_t *)dptr)[xs], format);
-                            break;
-                    }
-                }
-            }
-            else {
-                for (int xs = w - 1; xs >= sx; xs--) {
-                    switch (format) {
-                        case RTGFMT_8BIT:
-                            HANDLE_MINTERM_PIXEL(sptr[xs], dptr[xs], format);
-                            break;
-                        case RTGFMT_RBG565:
-                            HANDLE_MINTERM_PIXEL(((uint16_t *)sptr)[xs], ((uint16_t *)dptr)[xs], format);
-                            break;
-                        case RTGFMT_RGB32:
-                            HANDLE_MINTERM_PIXEL(((uint32_t *)sptr)[xs], ((uint32_t *)dptr)[xs], format);
-                            break;
-                    }
-                }
-            }
-            sptr += src_pitchstep;
-            dptr += src_pitchstep;
-        }
+    for (int ys = 0; ys < h; ys++) {
+        if (minterm == MINTERM_SRC)
+            memmove(dptr, sptr, w << format);
+        else
+            func(dptr, sptr, 0, w << format);
+        sptr += src_pitchstep;
+        dptr += dst_pitchstep;
     }
+    rtg_mark_dirty_rect(dst_addr - (PIGFX_RTG_BASE + PIGFX_REG_SIZE) + (dx << format) + (dy * dstpitch), w << format, h, dstpitch);
 }
 
 extern struct emulator_config *cfg;
@@ -224,7 +121,7 @@ extern struct emulator_config *cfg;
 void rtg_blittemplate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t src_addr, uint32_t fgcol, uint32_t bgcol, uint16_t pitch, uint16_t t_pitch, uint16_t format, uint16_t offset_x, uint8_t mask, uint8_t draw_mode) {
     if (mask) {}
 
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[1] + (x << format) + (y * pitch)];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[1] + (x << format) + (y * pitch)];
     uint8_t *sptr = NULL;
     uint8_t cur_bit = 0, base_bit = 0, cur_byte = 0;
     uint8_t invert = (draw_mode & DRAWMODE_INVERSVID);
@@ -237,8 +134,8 @@ void rtg_blittemplate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t s
 
     if (realtime_graphics_debug) {
         printf("DEBUG: BlitTemplate - %d, %d (%dx%d)\n", x, y, w, h);
-        printf("Src: %.8X (%.8X)\n", src_addr, rtg_address_adj[0]);
-        printf("Dest: %.8X (%.8X)\n", rtg_address[1], rtg_address_adj[1]);
+        printf("Src: %.8X (%.8X)\n", src_addr, rtg_cmd->address_adj[0]);
+        printf("Dest: %.8X (%.8X)\n", rtg_cmd->address[1], rtg_cmd->address_adj[1]);
         printf("pitch: %d t_pitch: %d format: %d\n", pitch, t_pitch, format);
         printf("offset_x: %d mask: %.2X draw_mode: %d\n", offset_x, mask, draw_mode);
     }
@@ -254,10 +151,13 @@ void rtg_blittemplate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t s
         htobe32(bgcol),
     };
 
-    if (src_addr >= (PIGFX_RTG_BASE + PIGFX_REG_SIZE)) {
+    if (rtg_cmd->src) {
+        sptr = rtg_cmd->src;
+    }
+    else if (src_addr >= (PIGFX_RTG_BASE + PIGFX_REG_SIZE)) {
         sptr = &rtg_mem[src_addr - (PIGFX_RTG_BASE + PIGFX_REG_SIZE)];
         if (realtime_graphics_debug) {
-            printf("Origin: %.8X\n", rtg_address[2]);
+            printf("Origin: %.8X\n", rtg_cmd->address[2]);
             printf("Grabbing data from RTG memory.\nData:\n");
             for (int i = 0; i < h; i++) {
                 for (int j = 0; j < t_pitch; j++) {
@@ -269,7 +169,7 @@ void rtg_blittemplate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t s
             printf("Data available at origin:\n");
             for (int i = 0; i < h; i++) {
                 for (int j = 0; j < w; j++) {
-                    printf("%.2X", read8(rtg_address[2] + j + (i * t_pitch)));
+                    printf("%.2X", read8(rtg_cmd->address[2] + j + (i * t_pitch)));
                 }
                 printf("\n");
             }
@@ -331,7 +231,7 @@ void rtg_blittemplate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t s
                 }
                 TEMPLATE_LOOPY;
             }
-            return;
+            break;
         case DRAWMODE_JAM2:
             for (uint16_t ys = 0; ys < h; ys++) {
                 cur_byte = (invert) ? sptr[tmpl_x] ^ 0xFF : sptr[tmpl_x];
@@ -365,7 +265,7 @@ void rtg_blittemplate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t s
                 }
                 TEMPLATE_LOOPY;
             }
-            return;
+            break;
         case DRAWMODE_COMPLEMENT:
             for (uint16_t ys = 0; ys < h; ys++) {
                 cur_byte = (invert) ? sptr[tmpl_x] ^ 0xFF : sptr[tmpl_x];
@@ -390,14 +290,15 @@ void rtg_blittemplate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t s
                 }
                 TEMPLATE_LOOPY;
             }
-            return;
+            break;
     }
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[1] + (x << format) + (y * pitch), w << format, h, pitch);
 }
 
 void rtg_blitpattern(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t src_addr, uint32_t fgcol, uint32_t bgcol, uint16_t pitch, uint16_t format, uint16_t offset_x, uint16_t offset_y, uint8_t mask, uint8_t draw_mode, uint8_t loop_rows) {
     if (mask) {}
 
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[1] + (x << format) + (y * pitch)];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[1] + (x << format) + (y * pitch)];
     uint8_t *sptr = NULL, *sptr_base = NULL;
     uint8_t cur_bit = 0, base_bit = 0, cur_byte = 0;
     uint8_t invert = (draw_mode & DRAWMODE_INVERSVID);
@@ -420,7 +321,9 @@ void rtg_blitpattern(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t sr
     };
 
 
-    if (src_addr >= (PIGFX_RTG_BASE + PIGFX_REG_SIZE))
+    if (rtg_cmd->src)
+        sptr = rtg_cmd->src;
+    else if (src_addr >= (PIGFX_RTG_BASE + PIGFX_REG_SIZE))
         sptr = &rtg_mem[src_addr - (PIGFX_RTG_BASE + PIGFX_REG_SIZE)];
     else {
         int i = get_mapped_item_by_address(cfg, src_addr);
@@ -471,7 +374,7 @@ void rtg_blitpattern(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t sr
                 }
                 PATTERN_LOOPY;
             }
-            return;
+            break;
         case DRAWMODE_JAM2:
             for (uint16_t ys = 0; ys < h; ys++) {
                 cur_byte = (invert) ? sptr[tmpl_x] ^ 0xFF : sptr[tmpl_x];
@@ -505,7 +408,7 @@ void rtg_blitpattern(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t sr
                 }
                 PATTERN_LOOPY;
             }
-            return;
+            break;
         case DRAWMODE_COMPLEMENT:
             for (uint16_t ys = 0; ys < h; ys++) {
                 cur_byte = (invert) ? sptr[tmpl_x] ^ 0xFF : sptr[tmpl_x];
@@ -530,8 +433,18 @@ void rtg_blitpattern(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t sr
                 }
                 PATTERN_LOOPY;
             }
-            return;
+            break;
     }
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[1] + (x << format) + (y * pitch), w << format, h, pitch);
+}
+
+// Lines are drawn pixel by pixel, mark the box between the first pixel and the last one.
+static void mark_line_dirty(uint8_t *first_row, int16_t first_x, uint8_t *last_row, int16_t last_x, uint16_t pitch, uint16_t format) {
+    uint8_t *top = (first_row < last_row) ? first_row : last_row;
+    int16_t left = (first_x < last_x) ? first_x : last_x;
+    uint32_t rows = pitch ? (uint32_t)(((first_row < last_row) ? last_row - first_row : first_row - last_row) / pitch) + 1 : 1;
+
+    rtg_mark_dirty_rect((top - rtg_mem) + (left << format), (abs(last_x - first_x) + 1) << format, rows, pitch);
 }
 
 void rtg_drawline_solid(int16_t x1_, int16_t y1_, int16_t x2_, int16_t y2_, uint16_t len, uint32_t fgcol, uint16_t pitch, uint16_t format) {
@@ -544,7 +457,7 @@ void rtg_drawline_solid(int16_t x1_, int16_t y1_, int16_t x2_, int16_t y2_, uint
         htobe32(fgcol),
     };
 
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[0] + (y1 * pitch)];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (y1 * pitch)];
 
 	int32_t line_step = pitch;
 	int8_t x_step = 1;
@@ -591,6 +504,7 @@ void rtg_drawline_solid(int16_t x1_, int16_t y1_, int16_t x2_, int16_t y2_, uint
 			SET_RTG_PIXEL(&dptr[x << format], fg_color[format], format);
 		}
 	}
+    mark_line_dirty(&rtg_mem[rtg_cmd->address_adj[0] + (y1 * pitch)], x1, dptr, x, pitch, format);
 }
 
 #define DRAW_LINE_PIXEL \
@@ -631,7 +545,7 @@ void rtg_drawline (int16_t x1_, int16_t y1_, int16_t x2_, int16_t y2_, uint16_t
         htobe32(bgcol),
     };
 
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[0] + (y1 * pitch)];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (y1 * pitch)];
 
 	int32_t line_step = pitch;
 	int8_t x_step = 1;
@@ -685,30 +599,94 @@ void rtg_drawline (int16_t x1_, int16_t y1_, int16_t x2_, int16_t y2_, uint16_t
 			DRAW_LINE_PIXEL;
 		}
 	}
+    mark_line_dirty(&rtg_mem[rtg_cmd->address_adj[0] + (y1 * pitch)], x1, dptr, x, pitch, format);
 }
 
-void rtg_p2c (int16_t sx, int16_t sy, int16_t dx, int16_t dy, int16_t w, int16_t h, uint8_t draw_mode, uint8_t planes, uint8_t mask, uint8_t layer_mask, uint16_t src_line_pitch, uint8_t *bmp_data_src) {
-    uint16_t pitch = rtg_x[3];
-    uint8_t *dptr = &rtg_mem[rtg_address_adj[0] + (dy * pitch)];
+// Pixels converted from planar in one go, 8 bytes more for the bit offset of the first one.
+#define P2C_PIXELS 256
+
+// Bitplanes the way the driver copies them to the scratch area for P2C and P2D, pitch bytes a row and h
+// rows a plane.  The source wraps around both ways, from sx and sy on.  The plane bytes under a piece of
+// a row are gathered into bits and converted from there.  Planes that are missing or masked out by
+// layer_mask stay 0, planes the driver passes as all ones (0xFFFFFFFF) and doesn't copy stay 0xFF.
+struct planar_source {
+    uint8_t *data, *row;
+    uint32_t plane_size;
+    uint16_t pitch;
+    int16_t y, h;
+    int planes, bit_offset, base_byte;
+    uint8_t read_mask;
+    uint8_t bits[8][P2C_PIXELS / 8 + 1];
+};
+
+static void planar_source_init(struct planar_source *p, uint8_t *data, int16_t sx, int16_t sy, int16_t h, uint16_t pitch, uint8_t planes, uint8_t layer_mask, uint8_t ff_mask) {
+    p->data = data;
+    p->plane_size = pitch * h;
+    p->pitch = pitch;
+    p->y = sy % h;
+    p->h = h;
+    p->row = data + p->y * pitch;
+    p->planes = (planes > 8) ? 8 : planes;
+    p->bit_offset = sx & 7;
+    p->base_byte = (sx / 8) % pitch;
+    p->read_mask = 0;
+
+    for (int plane = 0; plane < 8; plane++) {
+        if (plane < p->planes && (layer_mask & ff_mask & (1 << plane)))
+            memset(p->bits[plane], 0xFF, sizeof(p->bits[plane]));
+        else if (plane < p->planes && (layer_mask & (1 << plane)))
+            p->read_mask |= (1 << plane);
+        else
+            memset(p->bits[plane], 0x00, sizeof(p->bits[plane]));
+    }
+}
 
-	uint8_t cur_bit, base_bit, base_byte;
-	uint16_t cur_byte = 0, u8_fg = 0;
-    //uint32_t color_mask = 0xFFFFFFFF;
+// n <= P2C_PIXELS chunky pixels from x on in the current row, converted into line.  Returns the first one.
+static uint8_t *planar_source_read(struct planar_source *p, uint8_t *line, int x, int n) {
+    int bytes = (p->bit_offset + n + 7) / 8, byte = (p->base_byte + x / 8) % p->pitch;
 
-	uint32_t plane_size = src_line_pitch * h;
-	uint8_t *bmp_data = bmp_data_src;
+    for (int plane = 0; plane < p->planes; plane++) {
+        uint8_t *src = p->row + p->plane_size * plane;
+        if (!(p->read_mask & (1 << plane)))
+            continue;
+        if (byte + bytes <= p->pitch) {
+            memcpy(p->bits[plane], src + byte, bytes);
+        }
+        else {
+            for (int i = 0, b = byte; i < bytes; i++, b = (b + 1) % p->pitch)
+                p->bits[plane][i] = src[b];
+        }
+    }
+    rtg_span->planar(line, p->bits[0], sizeof(p->bits[0]), bytes);
+    return line + p->bit_offset;
+}
+
+static void planar_source_next_row(struct planar_source *p) {
+    if (++p->y == p->h) {
+        p->y = 0;
+        p->row = p->data;
+    }
+    else {
+        p->row += p->pitch;
+    }
+}
 
-	cur_bit = base_bit = (0x80 >> (sx % 8));
-	cur_byte = base_byte = ((sx / 8) % src_line_pitch);
+void rtg_p2c (int16_t sx, int16_t sy, int16_t dx, int16_t dy, int16_t w, int16_t h, uint8_t draw_mode, uint8_t planes, uint8_t mask, uint8_t layer_mask, uint16_t src_line_pitch, uint8_t *bmp_data_src) {
+    uint16_t pitch = rtg_cmd->x[3];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (dy * pitch)];
+    // Planes the driver passes as all ones (0xFFFFFFFF) are not copied to the scratch area.
+    uint8_t ff_mask = rtg_cmd->user[0] & 0xFF;
+
+	uint32_t plane_size = src_line_pitch * h;
 
     if (realtime_graphics_debug) {
         printf("P2C: %d,%d - %d,%d (%dx%d) %d, %.2X\n", sx, sy, dx, dy, w, h, planes, layer_mask);
         printf("Mask: %.2X Minterm: %.2X\n", mask, draw_mode);
-        printf("Pitch: %d Src Pitch: %d (!!!: %.4X)\n", pitch, src_line_pitch, rtg_user[0]);
-        printf("Curbyte: %d Curbit: %d\n", cur_byte, cur_bit);
+        printf("Pitch: %d Src Pitch: %d (!!!: %.4X)\n", pitch, src_line_pitch, rtg_cmd->user[0]);
+        printf("Startbyte: %d Startbit: %d\n", sx / 8, sx % 8);
         printf("Plane size: %d Total size: %d (%X)\n", plane_size, plane_size * planes, plane_size * planes);
-        printf("Source: %.8X - %.8X\n", rtg_address[1], rtg_address_adj[1]);
-        printf("Target: %.8X - %.8X\n", rtg_address[0], rtg_address_adj[0]);
+        printf("Source: %.8X - %.8X\n", rtg_cmd->address[1], rtg_cmd->address_adj[1]);
+        printf("Target: %.8X - %.8X\n", rtg_cmd->address[0], rtg_cmd->address_adj[0]);
         fflush(stdout);
 
         printf("Grabbing data from RTG memory.\nData:\n");
@@ -723,37 +701,76 @@ void rtg_p2c (int16_t sx, int16_t sy, int16_t dx, int16_t dy, int16_t w, int16_t
         }
     }
 
-	for (int16_t line_y = 0; line_y < h; line_y++) {
-		for (int16_t x = dx; x < dx + w; x++) {
-			u8_fg = 0;
-			if (draw_mode & 0x01) {
-				DECODE_INVERTED_PLANAR_PIXEL(u8_fg)
-            }
-			else {
-				DECODE_PLANAR_PIXEL(u8_fg)
-            }
-
-			if (mask == 0xFF && (draw_mode == MINTERM_SRC || draw_mode == MINTERM_NOTSRC)) {
-				dptr[x] = u8_fg;
-				goto skip;
-			}
-
-            HANDLE_MINTERM_PIXEL(u8_fg, dptr[x], rtg_display_format);
+    if (w <= 0 || h <= 0 || !src_line_pitch)
+        return;
 
-			skip:;
-			if ((cur_bit >>= 1) == 0) {
-				cur_bit = 0x80;
-				cur_byte++;
-				cur_byte %= src_line_pitch;
-			}
+    // Rows go through the minterm kernel a piece at a time.
+    struct planar_source src;
+    uint32_t keep = rtg_pattern(~mask, RTGFMT_8BIT);
+    rtg_minterm_func func = rtg_minterm_kernel(draw_mode, keep);
+    uint8_t line[P2C_PIXELS + 8];
 
+    planar_source_init(&src, bmp_data_src, sx, sy, h, src_line_pitch, planes, layer_mask, ff_mask);
+	for (int16_t line_y = 0; line_y < h; line_y++) {
+		for (int16_t x = 0; x < w; x += P2C_PIXELS) {
+			int n = (w - x < P2C_PIXELS) ? w - x : P2C_PIXELS;
+			func(&dptr[dx + x], planar_source_read(&src, line, x, n), keep, n);
 		}
 		dptr += pitch;
-		if ((line_y + sy + 1) % h)
-			bmp_data += src_line_pitch;
-		else
-			bmp_data = bmp_data_src;
-		cur_bit = base_bit;
-		cur_byte = base_byte;
+		planar_source_next_row(&src);
 	}
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[0] + (dy * pitch) + dx, w, h, pitch);
+}
+
+// Chunky pixels to RGB565 or RGB32 ones through the CLUT of P2D, big endian longwords the way the driver
+// copied ColorIndexMapping.Colors[], so the bytes of an entry are already the ones VRAM wants.
+static void clut_expand(uint8_t *d, const uint8_t *index, const uint8_t *clut, int n, uint16_t format) {
+    if (format == RTGFMT_RGB32) {
+        for (int i = 0; i < n; i++)
+            memcpy(&d[i * 4], &clut[index[i] * 4], 4);
+    }
+    else {
+        for (int i = 0; i < n; i++)
+            memcpy(&d[i * 2], &clut[index[i] * 4 + 2], 2);
+    }
+}
+
+void rtg_p2d (int16_t sx, int16_t sy, int16_t dx, int16_t dy, int16_t w, int16_t h, uint8_t draw_mode, uint8_t planes, uint8_t layer_mask, uint16_t src_line_pitch, uint8_t *bmp_data_src, const uint8_t *clut, uint16_t format) {
+    uint16_t pitch = rtg_cmd->x[3];
+    uint8_t *dptr = &rtg_mem[rtg_cmd->address_adj[0] + (dy * pitch) + (dx << format)];
+    uint8_t ff_mask = rtg_cmd->user[0] & 0xFF;
+
+    if (realtime_graphics_debug) {
+        printf("P2D: %d,%d - %d,%d (%dx%d) %d, %.2X (%.2X)\n", sx, sy, dx, dy, w, h, planes, layer_mask, ff_mask);
+        printf("Minterm: %.2X Format: %d Pitch: %d Src Pitch: %d\n", draw_mode, format, pitch, src_line_pitch);
+        printf("Source: %.8X - %.8X\n", rtg_cmd->address[1], rtg_cmd->address_adj[1]);
+        printf("Target: %.8X - %.8X\n", rtg_cmd->address[0], rtg_cmd->address_adj[0]);
+    }
+
+    if (w <= 0 || h <= 0 || !src_line_pitch || (format != RTGFMT_RBG565 && format != RTGFMT_RGB32))
+        return;
+
+    // The colors go straight to VRAM for MINTERM_SRC, other minterms expand them into pixels first.
+    struct planar_source src;
+    rtg_minterm_func func = rtg_minterm_kernel(draw_mode, 0);
+    uint8_t line[P2C_PIXELS + 8];
+    uint8_t pixels[P2C_PIXELS * 4];
+
+    planar_source_init(&src, bmp_data_src, sx, sy, h, src_line_pitch, planes, layer_mask, ff_mask);
+    for (int16_t line_y = 0; line_y < h; line_y++) {
+        for (int16_t x = 0; x < w; x += P2C_PIXELS) {
+            int n = (w - x < P2C_PIXELS) ? w - x : P2C_PIXELS;
+            uint8_t *index = planar_source_read(&src, line, x, n);
+            if (draw_mode == MINTERM_SRC) {
+                clut_expand(&dptr[x << format], index, clut, n, format);
+            }
+            else {
+                clut_expand(pixels, index, clut, n, format);
+                func(&dptr[x << format], pixels, 0, n << format);
+            }
+        }
+        dptr += pitch;
+        planar_source_next_row(&src);
+    }
+    rtg_mark_dirty_rect(rtg_cmd->address_adj[0] + (dy * pitch) + (dx << format), w << format, h, pitch);
 }
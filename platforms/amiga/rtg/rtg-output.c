@@ -1,5 +1,6 @@
 #include "emulator.h"
 #include "rtg.h"
+#include "rtg-convert.h"
 
 #include <pthread.h>
 #include <SDL2/SDL.h>
@@ -35,19 +36,41 @@ struct rtg_shared_data {
 SDL_Window *win = NULL;
 SDL_Renderer *renderer = NULL;
 SDL_Texture *img = NULL;
+SDL_Texture *pointer = NULL;
 
 struct rtg_shared_data rtg_share_data;
 static uint32_t palette[256];
 
 void rtg_update_screen() {}
 
+// RGB32 is B8G8R8A8 in VRAM, a texture with the same byte order takes it without any conversion.
 uint32_t rtg_to_sdl2[RTGFMT_NUM] = {
     SDL_PIXELFORMAT_ARGB8888,
     SDL_PIXELFORMAT_RGB565,
-    SDL_PIXELFORMAT_ARGB8888,
+    SDL_PIXELFORMAT_BGRA32,
     SDL_PIXELFORMAT_RGB555,
 };
 
+// Takes the driver's sprite if it changed, returns 1 if the display has to be presented again for it.  The
+// texture is only updated for a new image or new colors, not when the pointer just moved.
+static int update_pointer(struct rtg_sprite *current, int force) {
+    struct rtg_sprite next;
+
+    if (!force && rtg_sprite_serial() == current->serial)
+        return 0;
+    rtg_get_sprite(&next);
+    if (force || memcmp(next.image, current->image, sizeof(next.image)) != 0 || memcmp(next.colors, current->colors, sizeof(next.colors)) != 0) {
+        uint32_t pixels[RTG_SPRITE_HEIGHT][RTG_SPRITE_WIDTH];
+        for (int y = 0; y < RTG_SPRITE_HEIGHT; y++) {
+            for (int x = 0; x < RTG_SPRITE_WIDTH; x++)
+                pixels[y][x] = next.colors[next.image[y][x]];
+        }
+        SDL_UpdateTexture(pointer, NULL, pixels, sizeof(pixels[0]));
+    }
+    *current = next;
+    return 1;
+}
+
 void *rtgThread(void *args) {
 
     printf("RTG thread running\n");
@@ -56,7 +79,8 @@ void *rtgThread(void *args) {
     int reinit = 0;
     rtg_on = 1;
 
-    uint32_t *indexed_buf = NULL;
+    struct rtg_dirty_band *dirty_bands = NULL;
+    int blanked = 0;
 
     rtg_share_data.format = &rtg_display_format;
     rtg_share_data.width = &rtg_display_width;
@@ -74,6 +98,8 @@ void *rtgThread(void *args) {
     uint16_t format = rtg_display_format;
     uint16_t pitch = rtg_pitch;
 
+    rtg_convert_init();
+
     printf("Initializing SDL2...\n");
     if (SDL_Init(0) < 0) {
         printf("Failed to initialize SDL2.\n");
@@ -91,10 +117,6 @@ reinit_sdl:;
         height = rtg_display_height;
         format = rtg_display_format;
         pitch = rtg_pitch;
-        if (indexed_buf) {
-            free(indexed_buf);
-            indexed_buf = NULL;
-        }
         reinit = 0;
     }
 
@@ -118,7 +140,7 @@ reinit_sdl:;
     }
 
     printf("Creating SDL2 texture...\n");
-    img = SDL_CreateTexture(renderer, rtg_to_sdl2[format], SDL_TEXTUREACCESS_TARGET, width, height);
+    img = SDL_CreateTexture(renderer, rtg_to_sdl2[format], SDL_TEXTUREACCESS_STREAMING, width, height);
     if (!img) {
         RTG_INIT_ERR("Failed create SDL2 texture.\n");
     }
@@ -126,60 +148,99 @@ reinit_sdl:;
         printf("Created %dx%d texture.\n", width, height);
     }
 
+    // The pointer is blended over the display when it is presented, VRAM never has it.
+    pointer = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, RTG_SPRITE_WIDTH, RTG_SPRITE_HEIGHT);
+    if (!pointer) {
+        printf("Failed create SDL2 pointer texture, there is no hardware sprite.\n");
+    }
+    else {
+        SDL_SetTextureBlendMode(pointer, SDL_BLENDMODE_BLEND);
+    }
+    struct rtg_sprite sprite;
+    int new_pointer = 1;
+
+    struct rtg_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.vram = data->memory;
+    frame.width = width;
+    frame.height = height;
+    frame.palette = palette;
+
     switch (format) {
         case RTGFMT_8BIT:
-            indexed_buf = calloc(1, width * height * 4);
+            frame.bpp = 1;
+            frame.kind = RTG_CONVERT_CLUT8;
             break;
         case RTGFMT_RBG565:
-            indexed_buf = calloc(1, width * height * 2);
+        case RTGFMT_RGB555:
+            frame.bpp = 2;
+            frame.kind = RTG_CONVERT_SWAP16;
             break;
         default:
+            frame.bpp = 4;
+            frame.kind = -1;
             break;
     }
 
+    dirty_bands = realloc(dirty_bands, height * sizeof(struct rtg_dirty_band));
+    int full_redraw = 1;
+
     uint64_t frame_start = 0, frame_end = 0;
     float elapsed = 0.0f;
 
     while (1) {
         if (renderer && win && img) {
             frame_start = SDL_GetPerformanceCounter();
-            SDL_RenderClear(renderer);
-            if (*data->running) {
-                switch (format) {
-                    case RTGFMT_RGB32:
-                        SDL_UpdateTexture(img, NULL, &data->memory[*data->addr], pitch);
-                        break;
-                    case RTGFMT_RBG565:
-                        SDL_UpdateTexture(img, NULL, (uint8_t *)indexed_buf, width * 2);
-                        break;
-                    case RTGFMT_8BIT:
-                        SDL_UpdateTexture(img, NULL, (uint8_t *)indexed_buf, width * 4);
-                        break;
-                }
-                SDL_RenderCopy(renderer, img, NULL, NULL);
-            }
-            SDL_RenderPresent(renderer);
-            //usleep(16667); //ghetto 60hz
             if (height != *data->height || width != *data->width || format != *data->format) {
                 printf("Reinitializing due to something change.\n");
                 reinit = 1;
                 goto shutdown_sdl;
             }
-            switch (format) {
-                case RTGFMT_8BIT:
-                    for (int y = 0; y < height; y++) {
-                        for (int x = 0; x < width; x++) {
-                            indexed_buf[x + (y * width)] = palette[data->memory[*data->addr + x + (y * pitch)]];
-                        }
+            if (*data->running) {
+                // Panning or a new framebuffer shows different VRAM, the blocks in it may not be flagged.
+                if (rtg_take_dirty_all() || frame.addr != *data->addr || frame.pitch != pitch)
+                    full_redraw = 1;
+                frame.addr = *data->addr;
+                frame.pitch = pitch;
+
+                // Only what changed is converted and uploaded, idle frames aren't presented at all.  The
+                // conversions write straight into the locked texture, RGB32 goes to SDL from VRAM as it is.
+                int num_bands = rtg_dirty_bands(&frame, full_redraw, dirty_bands);
+                full_redraw = 0;
+                for (int i = 0; i < num_bands; i++) {
+                    SDL_Rect rect = { dirty_bands[i].x, dirty_bands[i].y, dirty_bands[i].w, dirty_bands[i].h };
+                    if (frame.kind == -1) {
+                        SDL_UpdateTexture(img, &rect, &data->memory[frame.addr + rect.y * pitch + rect.x * 4], pitch);
                     }
-                    break;
-                case RTGFMT_RBG565:
-                    for (int y = 0; y < height; y++) {
-                        for (int x = 0; x < width; x++) {
-                            ((uint16_t *)indexed_buf)[x + (y * width)] = be16toh(((uint16_t *)data->memory)[(*data->addr / 2) + x + (y * (pitch / 2))]);
+                    else {
+                        void *pixels;
+                        int tex_pitch;
+                        if (SDL_LockTexture(img, &rect, &pixels, &tex_pitch) == 0) {
+                            rtg_convert_band(&frame, &dirty_bands[i], pixels, tex_pitch);
+                            SDL_UnlockTexture(img);
                         }
                     }
-                    break;
+                }
+                int pointer_changed = pointer ? update_pointer(&sprite, new_pointer) : 0;
+                new_pointer = 0;
+                if (num_bands || pointer_changed) {
+                    SDL_RenderClear(renderer);
+                    SDL_RenderCopy(renderer, img, NULL, NULL);
+                    if (pointer && sprite.enabled) {
+                        SDL_Rect src = { 0, 0, sprite.width, sprite.height };
+                        SDL_Rect dst = { sprite.x, sprite.y, sprite.width * sprite.scale, sprite.height * sprite.scale };
+                        SDL_RenderCopy(renderer, pointer, &src, &dst);
+                    }
+                    SDL_RenderPresent(renderer);
+                }
+                blanked = 0;
+            }
+            else if (!blanked) {
+                SDL_RenderClear(renderer);
+                SDL_RenderPresent(renderer);
+                blanked = 1;
+                full_redraw = 1;
+                new_pointer = 1;
             }
             frame_end = SDL_GetPerformanceCounter();
             elapsed = (frame_end - frame_start) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
@@ -194,19 +255,20 @@ reinit_sdl:;
     printf("RTG thread shut down.\n");
 
 shutdown_sdl:;
+    if (pointer) SDL_DestroyTexture(pointer);
     if (img) SDL_DestroyTexture(img);
     if (renderer) SDL_DestroyRenderer(renderer);
     if (win) SDL_DestroyWindow(win);
 
     win = NULL;
     img = NULL;
+    pointer = NULL;
     renderer = NULL;
 
     if (reinit)
         goto reinit_sdl;
 
-    if (indexed_buf)
-        free(indexed_buf);
+    free(dirty_bands);
 
     SDL_QuitSubSystem(SDL_INIT_VIDEO);
     SDL_Quit();
@@ -215,7 +277,14 @@ shutdown_sdl:;
 }
 
 void rtg_set_clut_entry(uint8_t index, uint32_t xrgb) {
-    palette[index] = xrgb;
+    if (palette[index] != xrgb) {
+        palette[index] = xrgb;
+        rtg_mark_dirty_all();
+    }
+}
+
+uint32_t rtg_get_clut_entry(uint8_t index) {
+    return palette[index];
 }
 
 void rtg_init_display() {
@@ -0,0 +1,400 @@
+// Row kernels for the fills, inverts and blits in rtg-gfx.c.
+//
+// Solid fills used to write the first row pixel by pixel and copy it to the
+// others, masked 8-bit fills and blits went through SET_RTG_PIXEL_MASK for
+// every pixel.  Now each row is one call to a kernel that works on bytes, a
+// pixel of any format is spread over a four byte pattern first.  There are C
+// versions plus NEON ones for the Pi and SSE2 ones for testing on x86 like
+// for the conversions in rtg-convert.c, rtg_span_init() picks the fastest set
+// the CPU supports.  Plain copies stay with memmove(), which is as fast.
+//
+// The minterms of BlitRectNoMaskComplete and P2C get a kernel each from a
+// table, written out by a macro so every one is a loop without branches.
+//
+// P2C used to test one bit of every plane for each pixel.  The planar
+// kernels take a byte of each of the 8 planes at a time and turn them into 8
+// pixels with a bit matrix transpose, three rounds of shifts and masks on a
+// 64-bit word.  NEON and SSE2 interleave 16 bytes of each plane first and do
+// 16 of those transposes at once.
+
+#include "rtg-span.h"
+#include "rtg.h"
+
+#include <endian.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RTG_SPAN_NEON
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+#if defined(__SSE2__)
+#define RTG_SPAN_SSE2
+#include <emmintrin.h>
+#endif
+
+uint32_t rtg_pattern(uint32_t color, uint16_t format) {
+    switch (format) {
+        case RTGFMT_8BIT:
+            return (color & 0xFF) * 0x01010101;
+        case RTGFMT_RBG565:
+        case RTGFMT_RGB555: {
+            uint32_t c = htobe16(color & 0xFFFF);
+            return c | (c << 16);
+        }
+        default:
+            return htobe32(color);
+    }
+}
+
+static int always_supported(void) {
+    return 1;
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void store32(uint8_t *p, uint32_t v) {
+    memcpy(p, &v, 4);
+}
+
+// Byte i of a pattern, for the ends of rows.
+static inline uint8_t pattern_byte(uint32_t pattern, int i) {
+    return ((const uint8_t *)&pattern)[i & 3];
+}
+
+static void fill_c(uint8_t *d, uint32_t pattern, int bytes) {
+    int i = 0;
+    for (; i + 4 <= bytes; i += 4)
+        store32(d + i, pattern);
+    for (; i < bytes; i++)
+        d[i] = pattern_byte(pattern, i);
+}
+
+static void fill_mask_c(uint8_t *d, uint32_t pattern, uint32_t keep, int bytes) {
+    int i = 0;
+    for (; i + 4 <= bytes; i += 4)
+        store32(d + i, (load32(d + i) & keep) ^ pattern);
+    for (; i < bytes; i++)
+        d[i] = (d[i] & pattern_byte(keep, i)) ^ pattern_byte(pattern, i);
+}
+
+// Goes backwards if d is inside s, longwords are read before they are written so that is all it takes.
+static void copy_mask_c(uint8_t *d, const uint8_t *s, uint32_t keep, int bytes) {
+    int i = 0;
+    if (d > s && d < s + bytes) {
+        for (i = bytes; i >= 4; i -= 4)
+            store32(d + i - 4, load32(s + i - 4) ^ (load32(d + i - 4) & keep));
+        while (i-- > 0)
+            d[i] = s[i] ^ (d[i] & pattern_byte(keep, i));
+        return;
+    }
+    for (; i + 4 <= bytes; i += 4)
+        store32(d + i, load32(s + i) ^ (load32(d + i) & keep));
+    for (; i < bytes; i++)
+        d[i] = s[i] ^ (d[i] & pattern_byte(keep, i));
+}
+
+// The 8x8 bit matrix in x transposed along the anti-diagonal.  With a byte of plane 7 in the lowest byte
+// of x and plane 0 in the highest one, the leftmost pixel ends up in the lowest byte.
+static inline uint64_t planar_transpose(uint64_t x) {
+    uint64_t t;
+    t = (x ^ (x >> 36)) & 0x000000000F0F0F0FULL;
+    x ^= t ^ (t << 36);
+    t = (x ^ (x >> 18)) & 0x0000333300003333ULL;
+    x ^= t ^ (t << 18);
+    t = (x ^ (x >> 9)) & 0x0055005500550055ULL;
+    x ^= t ^ (t << 9);
+    return x;
+}
+
+static void planar_c(uint8_t *d, const uint8_t *p, int stride, int bytes) {
+    for (int i = 0; i < bytes; i++, d += 8) {
+        uint64_t x = 0;
+        for (int plane = 0; plane < 8; plane++)
+            x |= (uint64_t)p[plane * stride + i] << (8 * (7 - plane));
+        x = htole64(planar_transpose(x));
+        memcpy(d, &x, 8);
+    }
+}
+
+static const struct rtg_span_kernels kernels_c = {
+    "C", always_supported, fill_c, fill_mask_c, copy_mask_c, planar_c,
+};
+
+#ifdef RTG_SPAN_NEON
+static int neon_supported(void) {
+#if defined(__aarch64__) || !defined(HWCAP_NEON)
+    return 1;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+}
+
+static void fill_neon(uint8_t *d, uint32_t pattern, int bytes) {
+    uint8x16_t p = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+    int i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        vst1q_u8(d + i, p);
+        vst1q_u8(d + i + 16, p);
+    }
+    for (; i + 16 <= bytes; i += 16)
+        vst1q_u8(d + i, p);
+    fill_c(d + i, pattern, bytes - i);
+}
+
+static void fill_mask_neon(uint8_t *d, uint32_t pattern, uint32_t keep, int bytes) {
+    uint8x16_t p = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+    uint8x16_t k = vreinterpretq_u8_u32(vdupq_n_u32(keep));
+    int i = 0;
+    for (; i + 16 <= bytes; i += 16)
+        vst1q_u8(d + i, veorq_u8(vandq_u8(vld1q_u8(d + i), k), p));
+    fill_mask_c(d + i, pattern, keep, bytes - i);
+}
+
+static void copy_mask_neon(uint8_t *d, const uint8_t *s, uint32_t keep, int bytes) {
+    uint8x16_t k = vreinterpretq_u8_u32(vdupq_n_u32(keep));
+    int i = 0;
+    if (d > s && d < s + bytes) {
+        for (i = bytes; i >= 16; i -= 16)
+            vst1q_u8(d + i - 16, veorq_u8(vld1q_u8(s + i - 16), vandq_u8(vld1q_u8(d + i - 16), k)));
+        copy_mask_c(d, s, keep, i);
+        return;
+    }
+    for (; i + 16 <= bytes; i += 16)
+        vst1q_u8(d + i, veorq_u8(vld1q_u8(s + i), vandq_u8(vld1q_u8(d + i), k)));
+    copy_mask_c(d + i, s + i, keep, bytes - i);
+}
+
+static inline uint64x2_t planar_transpose_neon(uint64x2_t x) {
+    uint64x2_t t;
+    t = vandq_u64(veorq_u64(x, vshrq_n_u64(x, 36)), vdupq_n_u64(0x000000000F0F0F0FULL));
+    x = veorq_u64(x, veorq_u64(t, vshlq_n_u64(t, 36)));
+    t = vandq_u64(veorq_u64(x, vshrq_n_u64(x, 18)), vdupq_n_u64(0x0000333300003333ULL));
+    x = veorq_u64(x, veorq_u64(t, vshlq_n_u64(t, 18)));
+    t = vandq_u64(veorq_u64(x, vshrq_n_u64(x, 9)), vdupq_n_u64(0x0055005500550055ULL));
+    x = veorq_u64(x, veorq_u64(t, vshlq_n_u64(t, 9)));
+    return x;
+}
+
+// Zipping planes 7 and 6, 5 and 4 and so on, then those pairs and those quads gives the 64-bit words of
+// planar_c() for 16 plane bytes.
+static void planar_neon(uint8_t *d, const uint8_t *p, int stride, int bytes) {
+    int i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        uint8x16x2_t a[4];
+        uint16x8x2_t b[4];
+        for (int k = 0; k < 4; k++)
+            a[k] = vzipq_u8(vld1q_u8(p + (7 - 2 * k) * stride + i), vld1q_u8(p + (6 - 2 * k) * stride + i));
+        for (int h = 0; h < 2; h++) {
+            b[h] = vzipq_u16(vreinterpretq_u16_u8(a[0].val[h]), vreinterpretq_u16_u8(a[1].val[h]));
+            b[2 + h] = vzipq_u16(vreinterpretq_u16_u8(a[2].val[h]), vreinterpretq_u16_u8(a[3].val[h]));
+        }
+        for (int q = 0; q < 4; q++) {
+            uint32x4x2_t c = vzipq_u32(vreinterpretq_u32_u16(b[q / 2].val[q & 1]), vreinterpretq_u32_u16(b[2 + q / 2].val[q & 1]));
+            vst1q_u8(d + (i + q * 4) * 8, vreinterpretq_u8_u64(planar_transpose_neon(vreinterpretq_u64_u32(c.val[0]))));
+            vst1q_u8(d + (i + q * 4 + 2) * 8, vreinterpretq_u8_u64(planar_transpose_neon(vreinterpretq_u64_u32(c.val[1]))));
+        }
+    }
+    planar_c(d + i * 8, p + i, stride, bytes - i);
+}
+
+static const struct rtg_span_kernels kernels_neon = {
+    "NEON", neon_supported, fill_neon, fill_mask_neon, copy_mask_neon, planar_neon,
+};
+#endif
+
+#ifdef RTG_SPAN_SSE2
+static void fill_sse2(uint8_t *d, uint32_t pattern, int bytes) {
+    __m128i p = _mm_set1_epi32(pattern);
+    int i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        _mm_storeu_si128((__m128i *)(d + i), p);
+        _mm_storeu_si128((__m128i *)(d + i + 16), p);
+    }
+    for (; i + 16 <= bytes; i += 16)
+        _mm_storeu_si128((__m128i *)(d + i), p);
+    fill_c(d + i, pattern, bytes - i);
+}
+
+static void fill_mask_sse2(uint8_t *d, uint32_t pattern, uint32_t keep, int bytes) {
+    __m128i p = _mm_set1_epi32(pattern), k = _mm_set1_epi32(keep);
+    int i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(d + i));
+        _mm_storeu_si128((__m128i *)(d + i), _mm_xor_si128(_mm_and_si128(v, k), p));
+    }
+    fill_mask_c(d + i, pattern, keep, bytes - i);
+}
+
+static void copy_mask_sse2(uint8_t *d, const uint8_t *s, uint32_t keep, int bytes) {
+    __m128i k = _mm_set1_epi32(keep);
+    int i = 0;
+    if (d > s && d < s + bytes) {
+        for (i = bytes; i >= 16; i -= 16) {
+            __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(d + i - 16)), k);
+            _mm_storeu_si128((__m128i *)(d + i - 16), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(s + i - 16)), v));
+        }
+        copy_mask_c(d, s, keep, i);
+        return;
+    }
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(d + i)), k);
+        _mm_storeu_si128((__m128i *)(d + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(s + i)), v));
+    }
+    copy_mask_c(d + i, s + i, keep, bytes - i);
+}
+
+static inline __m128i planar_transpose_sse2(__m128i x) {
+    __m128i t;
+    t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 36)), _mm_set1_epi64x(0x000000000F0F0F0FULL));
+    x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 36)));
+    t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 18)), _mm_set1_epi64x(0x0000333300003333ULL));
+    x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 18)));
+    t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 9)), _mm_set1_epi64x(0x0055005500550055ULL));
+    x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 9)));
+    return x;
+}
+
+// Like planar_neon(), with the unpacks for the zips.
+static void planar_sse2(uint8_t *d, const uint8_t *p, int stride, int bytes) {
+    int i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i a[8], b[8];
+        for (int k = 0; k < 4; k++) {
+            __m128i hi = _mm_loadu_si128((const __m128i *)(p + (7 - 2 * k) * stride + i));
+            __m128i lo = _mm_loadu_si128((const __m128i *)(p + (6 - 2 * k) * stride + i));
+            a[2 * k] = _mm_unpacklo_epi8(hi, lo);
+            a[2 * k + 1] = _mm_unpackhi_epi8(hi, lo);
+        }
+        for (int h = 0; h < 2; h++) {
+            b[h * 2] = _mm_unpacklo_epi16(a[h], a[2 + h]);
+            b[h * 2 + 1] = _mm_unpackhi_epi16(a[h], a[2 + h]);
+            b[4 + h * 2] = _mm_unpacklo_epi16(a[4 + h], a[6 + h]);
+            b[4 + h * 2 + 1] = _mm_unpackhi_epi16(a[4 + h], a[6 + h]);
+        }
+        for (int q = 0; q < 4; q++) {
+            _mm_storeu_si128((__m128i *)(d + (i + q * 4) * 8), planar_transpose_sse2(_mm_unpacklo_epi32(b[q], b[4 + q])));
+            _mm_storeu_si128((__m128i *)(d + (i + q * 4 + 2) * 8), planar_transpose_sse2(_mm_unpackhi_epi32(b[q], b[4 + q])));
+        }
+    }
+    planar_c(d + i * 8, p + i, stride, bytes - i);
+}
+
+static const struct rtg_span_kernels kernels_sse2 = {
+    "SSE2", always_supported, fill_sse2, fill_mask_sse2, copy_mask_sse2, planar_sse2,
+};
+#endif
+
+// One kernel for each minterm and whether there are bits to keep, each a plain loop over longwords the
+// compiler vectorizes.  S and D are the source and destination in the expression f.
+#define MINTERM_KERNEL(name, f) \
+static inline __attribute__((always_inline)) void minterm_##name##_row(uint8_t *d, const uint8_t *s, uint32_t keep, int bytes) { \
+    int i = 0; \
+    if (d > s && d < s + bytes) { \
+        for (i = bytes; i >= 4; i -= 4) { \
+            uint32_t S = load32(s + i - 4), D = load32(d + i - 4); \
+            (void)S; \
+            store32(d + i - 4, ((f) & ~keep) | (D & keep)); \
+        } \
+        while (i-- > 0) { \
+            uint8_t S = s[i], D = d[i], k = pattern_byte(keep, i); \
+            (void)S; \
+            d[i] = ((f) & ~k) | (D & k); \
+        } \
+        return; \
+    } \
+    for (; i + 4 <= bytes; i += 4) { \
+        uint32_t S = load32(s + i), D = load32(d + i); \
+        (void)S; \
+        store32(d + i, ((f) & ~keep) | (D & keep)); \
+    } \
+    for (; i < bytes; i++) { \
+        uint8_t S = s[i], D = d[i], k = pattern_byte(keep, i); \
+        (void)S; \
+        d[i] = ((f) & ~k) | (D & k); \
+    } \
+} \
+static void minterm_##name(uint8_t *d, const uint8_t *s, uint32_t keep, int bytes) { \
+    (void)keep; \
+    minterm_##name##_row(d, s, 0, bytes); \
+} \
+static void minterm_##name##_mask(uint8_t *d, const uint8_t *s, uint32_t keep, int bytes) { \
+    minterm_##name##_row(d, s, keep, bytes); \
+}
+
+MINTERM_KERNEL(false, 0)
+MINTERM_KERNEL(nor, ~(S | D))
+MINTERM_KERNEL(onlydst, ~S & D)
+MINTERM_KERNEL(notsrc, ~S)
+MINTERM_KERNEL(onlysrc, S & ~D)
+MINTERM_KERNEL(invert, ~D)
+MINTERM_KERNEL(eor, S ^ D)
+MINTERM_KERNEL(nand, ~(S & D))
+MINTERM_KERNEL(and, S & D)
+MINTERM_KERNEL(neor, ~(S ^ D))
+MINTERM_KERNEL(dst, D)
+MINTERM_KERNEL(notonlysrc, ~S | D)
+MINTERM_KERNEL(src, S)
+MINTERM_KERNEL(notonlydst, S | ~D)
+MINTERM_KERNEL(or, S | D)
+MINTERM_KERNEL(true, ~0U)
+
+static const rtg_minterm_func minterm_kernels[16][2] = {
+    { minterm_false, minterm_false_mask },
+    { minterm_nor, minterm_nor_mask },
+    { minterm_onlydst, minterm_onlydst_mask },
+    { minterm_notsrc, minterm_notsrc_mask },
+    { minterm_onlysrc, minterm_onlysrc_mask },
+    { minterm_invert, minterm_invert_mask },
+    { minterm_eor, minterm_eor_mask },
+    { minterm_nand, minterm_nand_mask },
+    { minterm_and, minterm_and_mask },
+    { minterm_neor, minterm_neor_mask },
+    { minterm_dst, minterm_dst_mask },
+    { minterm_notonlysrc, minterm_notonlysrc_mask },
+    { minterm_src, minterm_src_mask },
+    { minterm_notonlydst, minterm_notonlydst_mask },
+    { minterm_or, minterm_or_mask },
+    { minterm_true, minterm_true_mask },
+};
+
+rtg_minterm_func rtg_minterm_kernel(uint8_t minterm, uint32_t keep) {
+    return minterm_kernels[minterm & 0x0F][keep != 0];
+}
+
+static const struct rtg_span_kernels *const kernel_list[] = {
+    &kernels_c,
+#ifdef RTG_SPAN_NEON
+    &kernels_neon,
+#endif
+#ifdef RTG_SPAN_SSE2
+    &kernels_sse2,
+#endif
+};
+
+const struct rtg_span_kernels *rtg_span = &kernels_c;
+
+void rtg_span_init(void) {
+    int num = sizeof(kernel_list) / sizeof(kernel_list[0]);
+
+    for (int i = num - 1; i >= 0; i--) {
+        if (kernel_list[i]->supported()) {
+            rtg_span = kernel_list[i];
+            break;
+        }
+    }
+    printf("Using %s RTG blit kernels.\n", rtg_span->name);
+}
+
+int rtg_span_list(const struct rtg_span_kernels *const **list) {
+    *list = kernel_list;
+    return sizeof(kernel_list) / sizeof(kernel_list[0]);
+}
@@ -0,0 +1,35 @@
+#include <stdint.h>
+
+// Row kernels for the blits in rtg-gfx.c.  A pattern is four bytes in the order they go to VRAM, repeated
+// from the start of the row, so it is the same for all formats once a pixel is spread over it (rtg_pattern()).
+// Bits set in keep are left as they are in VRAM.
+struct rtg_span_kernels {
+    const char *name;
+    int (*supported)(void);
+    void (*fill)(uint8_t *d, uint32_t pattern, int bytes);
+    // d = (d & keep) ^ pattern, an invert keeps all of d.
+    void (*fill_mask)(uint8_t *d, uint32_t pattern, uint32_t keep, int bytes);
+    // d = s ^ (d & keep), s and d may overlap either way.
+    void (*copy_mask)(uint8_t *d, const uint8_t *s, uint32_t keep, int bytes);
+    // Planar to chunky, bytes bytes of each of the 8 planes at p + plane * stride to bytes * 8 pixels of
+    // 8 bits, the most significant bit of a plane byte is the leftmost pixel.
+    void (*planar)(uint8_t *d, const uint8_t *p, int stride, int bytes);
+};
+
+// Kernel set the blits use, the fastest one the CPU supports once rtg_span_init() ran.
+extern const struct rtg_span_kernels *rtg_span;
+
+void rtg_span_init(void);
+// All kernel sets built into this binary, C first, whether they run on this CPU or not.
+int rtg_span_list(const struct rtg_span_kernels *const **list);
+
+// A pixel of the given format as a pattern.
+uint32_t rtg_pattern(uint32_t color, uint16_t format);
+
+// Minterm kernels, d = minterm(s, d) for the bits not set in keep.  The minterm is the truth table of
+// MINTERM_FALSE to MINTERM_TRUE: bit 3 for s & d, 2 for s & ~d, 1 for ~s & d and 0 for ~s & ~d.  Like
+// copy_mask() s and d may overlap either way.
+typedef void (*rtg_minterm_func)(uint8_t *d, const uint8_t *s, uint32_t keep, int bytes);
+
+// The kernel for a minterm, picked once per blit.  One that ignores keep if it is 0.
+rtg_minterm_func rtg_minterm_kernel(uint8_t minterm, uint32_t keep);
@@ -1,11 +1,15 @@
 #include <stdint.h>
 #include <endian.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/mman.h>
 #include "rtg.h"
+#include "rtg-span.h"
 #include "config_file/config_file.h"
+#include "snapshot/snapshot.h"
 
 uint8_t rtg_u8[4];
 uint16_t rtg_x[8], rtg_y[8];
@@ -23,15 +27,22 @@ uint16_t rtg_pitch, rtg_total_rows;
 uint16_t rtg_offset_x, rtg_offset_y;
 
 uint8_t *rtg_mem; // FIXME
+uint32_t *rtg_fifo;
+uint32_t rtg_fifo_read;
+static uint8_t fifo_mapped;
 
 uint32_t framebuffer_addr = 0;
 uint32_t framebuffer_addr_adj = 0;
 
+static struct rtg_sprite sprite = { .scale = 1 };
+static pthread_mutex_t sprite_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static void handle_rtg_command(uint32_t cmd);
 //static struct timespec f1, f2;
 
 uint8_t realtime_graphics_debug = 0;
 extern int cpu_emulation_running;
+extern struct emulator_config *cfg;
 /*
 static const char *op_type_names[OP_TYPE_NUM] = {
     "BYTE",
@@ -47,26 +58,133 @@ static const char *rtg_format_names[RTGFMT_NUM] = {
     "15BPP RGB (555)",
 };
 */
+
 int init_rtg_data() {
-    rtg_mem = calloc(1, 40 * SIZE_MEGA);
-    if (!rtg_mem) {
+    // From mmap rather than calloc so snapshots can track and map it like mapped RAM.
+    rtg_mem = mmap(NULL, RTG_MEM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (rtg_mem == MAP_FAILED) {
+        rtg_mem = NULL;
         printf("Failed to allocate RTG video memory.\n");
         return 0;
     }
+    snapshot_add_region("rtg_vram", rtg_mem, RTG_MEM_SIZE);
+    rtg_span_init();
+    rtg_blitter_init();
+
+    rtg_fifo = (uint32_t *)&rtg_mem[PIGFX_FIFO - (PIGFX_RTG_BASE + PIGFX_REG_SIZE)];
+    rtg_fifo_read = RTG_FIFO_RING;
+    rtg_fifo[0] = htobe32(rtg_fifo_read);
 
     return 1;
 }
 
+struct rtg_state {
+    uint8_t u8[4];
+    uint16_t x[8], y[8], user[8];
+    uint16_t format;
+    uint32_t address[8], address_adj[8], rgb[8];
+    uint16_t display_width, display_height, display_format;
+    uint16_t pitch, total_rows, offset_x, offset_y;
+    uint32_t framebuffer_addr, framebuffer_addr_adj;
+    uint8_t display_enabled;
+    uint32_t palette[256];
+    struct rtg_sprite sprite;
+};
+
+int rtg_save_state(FILE *out) {
+    struct rtg_state st;
+
+    rtg_fifo_poll();
+    rtg_blitter_wait();
+    memset(&st, 0, sizeof(st));
+    memcpy(st.u8, rtg_u8, sizeof(st.u8));
+    memcpy(st.x, rtg_x, sizeof(st.x));
+    memcpy(st.y, rtg_y, sizeof(st.y));
+    memcpy(st.user, rtg_user, sizeof(st.user));
+    st.format = rtg_format;
+    memcpy(st.address, rtg_address, sizeof(st.address));
+    memcpy(st.address_adj, rtg_address_adj, sizeof(st.address_adj));
+    memcpy(st.rgb, rtg_rgb, sizeof(st.rgb));
+    st.display_width = rtg_display_width;
+    st.display_height = rtg_display_height;
+    st.display_format = rtg_display_format;
+    st.pitch = rtg_pitch;
+    st.total_rows = rtg_total_rows;
+    st.offset_x = rtg_offset_x;
+    st.offset_y = rtg_offset_y;
+    st.framebuffer_addr = framebuffer_addr;
+    st.framebuffer_addr_adj = framebuffer_addr_adj;
+    st.display_enabled = display_enabled;
+    for (int i = 0; i < 256; i++)
+        st.palette[i] = rtg_get_clut_entry(i);
+    rtg_get_sprite(&st.sprite);
+
+    return snapshot_write_chunk(out, "RTG ", &st, sizeof(st));
+}
+
+int rtg_load_state(FILE *in) {
+    struct rtg_state st;
+
+    rtg_blitter_wait();
+    if (snapshot_read_chunk(in, "RTG ", &st, sizeof(st)) == -1)
+        return -1;
+
+    memcpy(rtg_u8, st.u8, sizeof(st.u8));
+    memcpy(rtg_x, st.x, sizeof(st.x));
+    memcpy(rtg_y, st.y, sizeof(st.y));
+    memcpy(rtg_user, st.user, sizeof(st.user));
+    rtg_format = st.format;
+    memcpy(rtg_address, st.address, sizeof(st.address));
+    memcpy(rtg_address_adj, st.address_adj, sizeof(st.address_adj));
+    memcpy(rtg_rgb, st.rgb, sizeof(st.rgb));
+    rtg_display_width = st.display_width;
+    rtg_display_height = st.display_height;
+    rtg_display_format = st.display_format;
+    rtg_pitch = st.pitch;
+    rtg_total_rows = st.total_rows;
+    rtg_offset_x = st.offset_x;
+    rtg_offset_y = st.offset_y;
+    framebuffer_addr = st.framebuffer_addr;
+    framebuffer_addr_adj = st.framebuffer_addr_adj;
+    // The FIFO was empty when the snapshot was saved.
+    rtg_fifo_read = be32toh(rtg_fifo[0]);
+    for (int i = 0; i < 256; i++)
+        rtg_set_clut_entry(i, st.palette[i]);
+    // A new serial, so the output thread picks the sprite up even if the saved one matches its copy.
+    pthread_mutex_lock(&sprite_mutex);
+    st.sprite.serial = sprite.serial;
+    sprite = st.sprite;
+    __atomic_store_n(&sprite.serial, sprite.serial + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sprite_mutex);
+    rtg_mark_dirty_all();
+
+    if (display_enabled != st.display_enabled) {
+        display_enabled = st.display_enabled;
+        if (display_enabled == 1)
+            rtg_init_display();
+        else
+            rtg_shutdown_display();
+    }
+
+    return 0;
+}
+
 //extern uint8_t busy, rtg_on;
 //void rtg_update_screen();
 
 unsigned int rtg_read(uint32_t address, uint8_t mode) {
     //printf("%s read from RTG: %.8X\n", op_type_names[mode], address);
+    rtg_fifo_poll();
     if (address == RTG_COMMAND) {
         return 0xFFCF;
     }
+    if (address == RTG_WAITBLIT) {
+        rtg_blitter_wait();
+        return 0;
+    }
     if (address >= PIGFX_REG_SIZE) {
         if (rtg_mem && (address - PIGFX_REG_SIZE) < PIGFX_UPPER) {
+            rtg_blitter_sync(address - PIGFX_REG_SIZE, 1 << mode);
             switch (mode) {
                 case OP_TYPE_BYTE:
                     return (rtg_mem[address - PIGFX_REG_SIZE]);
@@ -101,22 +219,86 @@ struct timespec diff(struct timespec start, struct timespec end)
 
 #define CHKREG(a, b) case a: b = value; break;
 
+static void write_register(uint32_t address, uint32_t value, uint8_t mode) {
+    switch (mode) {
+        case OP_TYPE_BYTE:
+            switch (address) {
+                CHKREG(RTG_U81, rtg_u8[0]);
+                CHKREG(RTG_U82, rtg_u8[1]);
+                CHKREG(RTG_U83, rtg_u8[2]);
+                CHKREG(RTG_U84, rtg_u8[3]);
+            }
+            break;
+        case OP_TYPE_WORD:
+            switch (address) {
+                CHKREG(RTG_X1, rtg_x[0]);
+                CHKREG(RTG_X2, rtg_x[1]);
+                CHKREG(RTG_X3, rtg_x[2]);
+                CHKREG(RTG_X4, rtg_x[3]);
+                CHKREG(RTG_X5, rtg_x[4]);
+                CHKREG(RTG_Y1, rtg_y[0]);
+                CHKREG(RTG_Y2, rtg_y[1]);
+                CHKREG(RTG_Y3, rtg_y[2]);
+                CHKREG(RTG_Y4, rtg_y[3]);
+                CHKREG(RTG_Y5, rtg_y[4]);
+                CHKREG(RTG_U1, rtg_user[0]);
+                CHKREG(RTG_U2, rtg_user[1]);
+                CHKREG(RTG_FORMAT, rtg_format);
+                case RTG_COMMAND:
+                    handle_rtg_command(value);
+                    break;
+            }
+            break;
+        case OP_TYPE_LONGWORD:
+            switch (address) {
+                case RTG_ADDR1:
+                    rtg_address[0] = value;
+                    rtg_address_adj[0] = value - (PIGFX_RTG_BASE + PIGFX_REG_SIZE);
+                    break;
+                case RTG_ADDR2:
+                    rtg_address[1] = value;
+                    rtg_address_adj[1] = value - (PIGFX_RTG_BASE + PIGFX_REG_SIZE);
+                    break;
+                CHKREG(RTG_ADDR3, rtg_address[2]);
+                CHKREG(RTG_ADDR4, rtg_address[3]);
+                CHKREG(RTG_RGB1, rtg_rgb[0]);
+                CHKREG(RTG_RGB2, rtg_rgb[1]);
+                case RTG_FIFO:
+                    // The doorbell, rtg_write() ran the new records already.  The first one comes from
+                    // InitCard(), after autoconf mapped the RAM boards, and maps the ring so the driver's
+                    // records go straight to memory.  Without a free range they still get here through
+                    // rtg_write(), only slower.
+                    if (!fifo_mapped) {
+                        m68k_add_ram_range(PIGFX_FIFO, PIGFX_FIFO + RTG_FIFO_SIZE, (unsigned char *)rtg_fifo);
+                        fifo_mapped = 1;
+                    }
+                    break;
+            }
+            break;
+    }
+}
+
 void rtg_write(uint32_t address, uint32_t value, uint8_t mode) {
     //printf("%s write to RTG: %.8X (%.8X)\n", op_type_names[mode], address, value);
+    rtg_fifo_poll();
     if (address >= PIGFX_REG_SIZE) {
         /*if ((address - PIGFX_REG_SIZE) < framebuffer_addr) {// || (address - PIGFX_REG_SIZE) > framebuffer_addr + ((rtg_display_width << rtg_display_format) * rtg_display_height)) {
             printf("Write to RTG memory outside frame buffer %.8X (%.8X).\n", (address - PIGFX_REG_SIZE), framebuffer_addr);
         }*/
         if (rtg_mem && (address - PIGFX_REG_SIZE) < PIGFX_UPPER) {
+            rtg_blitter_sync(address - PIGFX_REG_SIZE, 1 << mode);
             switch (mode) {
                 case OP_TYPE_BYTE:
                     rtg_mem[address - PIGFX_REG_SIZE] = value;
+                    rtg_mark_dirty(address - PIGFX_REG_SIZE, 1);
                     break;
                 case OP_TYPE_WORD:
                     *(( uint16_t *) (&rtg_mem[address - PIGFX_REG_SIZE])) = htobe16(value);
+                    rtg_mark_dirty(address - PIGFX_REG_SIZE, 2);
                     break;
                 case OP_TYPE_LONGWORD:
                     *(( uint32_t *) (&rtg_mem[address - PIGFX_REG_SIZE])) = htobe32(value);
+                    rtg_mark_dirty(address - PIGFX_REG_SIZE, 4);
                     break;
                 default:
                     return;
@@ -124,59 +306,267 @@ void rtg_write(uint32_t address, uint32_t value, uint8_t mode) {
         }
     }
     else {
-        switch (mode) {
-            case OP_TYPE_BYTE:
-                switch (address) {
-                    CHKREG(RTG_U81, rtg_u8[0]);
-                    CHKREG(RTG_U82, rtg_u8[1]);
-                    CHKREG(RTG_U83, rtg_u8[2]);
-                    CHKREG(RTG_U84, rtg_u8[3]);
-                }
-                break;
-            case OP_TYPE_WORD:
-                switch (address) {
-                    CHKREG(RTG_X1, rtg_x[0]);
-                    CHKREG(RTG_X2, rtg_x[1]);
-                    CHKREG(RTG_X3, rtg_x[2]);
-                    CHKREG(RTG_X4, rtg_x[3]);
-                    CHKREG(RTG_X5, rtg_x[4]);
-                    CHKREG(RTG_Y1, rtg_y[0]);
-                    CHKREG(RTG_Y2, rtg_y[1]);
-                    CHKREG(RTG_Y3, rtg_y[2]);
-                    CHKREG(RTG_Y4, rtg_y[3]);
-                    CHKREG(RTG_Y5, rtg_y[4]);
-                    CHKREG(RTG_U1, rtg_user[0]);
-                    CHKREG(RTG_U2, rtg_user[1]);
-                    CHKREG(RTG_FORMAT, rtg_format);
-                    case RTG_COMMAND:
-                        handle_rtg_command(value);
-                        break;
-                }
-                break;
-            case OP_TYPE_LONGWORD:
-                switch (address) {
-                    case RTG_ADDR1:
-                        rtg_address[0] = value;
-                        rtg_address_adj[0] = value - (PIGFX_RTG_BASE + PIGFX_REG_SIZE);
-                        break;
-                    case RTG_ADDR2:
-                        rtg_address[1] = value;
-                        rtg_address_adj[1] = value - (PIGFX_RTG_BASE + PIGFX_REG_SIZE);
-                        break;
-                    CHKREG(RTG_ADDR3, rtg_address[2]);
-                    CHKREG(RTG_ADDR4, rtg_address[3]);
-                    CHKREG(RTG_RGB1, rtg_rgb[0]);
-                    CHKREG(RTG_RGB2, rtg_rgb[1]);
-                }
-                break;
-        }
+        write_register(address, value, mode);
     }
 
     return;
 }
 
+// One register word from a FIFO record.  Longword registers come as two words, the high one first.
+static inline void fifo_word(uint32_t reg, uint16_t value) {
+    switch (reg) {
+        case RTG_X1: rtg_x[0] = value; break;
+        case RTG_X2: rtg_x[1] = value; break;
+        case RTG_X3: rtg_x[2] = value; break;
+        case RTG_Y1: rtg_y[0] = value; break;
+        case RTG_Y2: rtg_y[1] = value; break;
+        case RTG_Y3: rtg_y[2] = value; break;
+        case RTG_FORMAT: rtg_format = value; break;
+        case RTG_RGB1: rtg_rgb[0] = (rtg_rgb[0] & 0xFFFF) | (uint32_t)value << 16; break;
+        case RTG_RGB1 + 2: rtg_rgb[0] = (rtg_rgb[0] & 0xFFFF0000) | value; break;
+        case RTG_RGB2: rtg_rgb[1] = (rtg_rgb[1] & 0xFFFF) | (uint32_t)value << 16; break;
+        case RTG_RGB2 + 2: rtg_rgb[1] = (rtg_rgb[1] & 0xFFFF0000) | value; break;
+        case RTG_ADDR1: rtg_address[0] = (rtg_address[0] & 0xFFFF) | (uint32_t)value << 16; break;
+        case RTG_ADDR1 + 2: rtg_address[0] = (rtg_address[0] & 0xFFFF0000) | value; break;
+        case RTG_ADDR2: rtg_address[1] = (rtg_address[1] & 0xFFFF) | (uint32_t)value << 16; break;
+        case RTG_ADDR2 + 2: rtg_address[1] = (rtg_address[1] & 0xFFFF0000) | value; break;
+        case RTG_U81: rtg_u8[0] = value >> 8; rtg_u8[1] = value; break;
+        case RTG_U83: rtg_u8[2] = value >> 8; rtg_u8[3] = value; break;
+        case RTG_X4: rtg_x[3] = value; break;
+        case RTG_X5: rtg_x[4] = value; break;
+        case RTG_Y4: rtg_y[3] = value; break;
+        case RTG_Y5: rtg_y[4] = value; break;
+        case RTG_U1: rtg_user[0] = value; break;
+        case RTG_U2: rtg_user[1] = value; break;
+        case RTG_ADDR3: rtg_address[2] = (rtg_address[2] & 0xFFFF) | (uint32_t)value << 16; break;
+        case RTG_ADDR3 + 2: rtg_address[2] = (rtg_address[2] & 0xFFFF0000) | value; break;
+        case RTG_ADDR4: rtg_address[3] = (rtg_address[3] & 0xFFFF) | (uint32_t)value << 16; break;
+        case RTG_ADDR4 + 2: rtg_address[3] = (rtg_address[3] & 0xFFFF0000) | value; break;
+    }
+}
+
+// Runs the records the driver finished, up to the first header that is still clear.  A record is the
+// registers a blit would have written and then its command, so it ends up in handle_rtg_command() like
+// written registers do.
+void rtg_fifo_run() {
+    uint8_t *fifo = (uint8_t *)rtg_fifo;
+    uint32_t head;
+
+    while ((head = be32toh(rtg_fifo[rtg_fifo_read / 4])) != 0) {
+        uint32_t cmd = head >> 27, mask = (head << 1) & 0x0FFFFFFE;
+        uint32_t size = (4 + __builtin_popcount(mask) * 2 + 3) & ~3;
+        uint16_t *values = (uint16_t *)&fifo[rtg_fifo_read + 4];
+
+        if (cmd == RTG_FIFO_WRAP) {
+            rtg_fifo[rtg_fifo_read / 4] = 0;
+            rtg_fifo_read = RTG_FIFO_RING;
+            continue;
+        }
+        // The driver wraps before a record could run past the end.
+        if (rtg_fifo_read + RTG_FIFO_RECORD_MAX >= RTG_FIFO_SIZE) {
+            printf("[RTG] Bad command FIFO record at %.4X, going back to the start.\n", rtg_fifo_read);
+            rtg_fifo[rtg_fifo_read / 4] = 0;
+            rtg_fifo_read = RTG_FIFO_RING;
+            break;
+        }
+
+        for (uint32_t m = mask; m; m &= m - 1)
+            fifo_word(__builtin_ctz(m) * 2, be16toh(*values++));
+        if (mask & (1 << (RTG_ADDR1 / 2) | 1 << (RTG_ADDR1 / 2 + 1)))
+            rtg_address_adj[0] = rtg_address[0] - (PIGFX_RTG_BASE + PIGFX_REG_SIZE);
+        if (mask & (1 << (RTG_ADDR2 / 2) | 1 << (RTG_ADDR2 / 2 + 1)))
+            rtg_address_adj[1] = rtg_address[1] - (PIGFX_RTG_BASE + PIGFX_REG_SIZE);
+        // Cleared whole, the next lap's headers can land where values were.
+        memset(&fifo[rtg_fifo_read], 0, size);
+        rtg_fifo_read += size;
+        handle_rtg_command(cmd - 1);
+    }
+    // Where the driver goes on after a reset, saved with the VRAM for snapshots.
+    rtg_fifo[0] = htobe32(rtg_fifo_read);
+}
+
 #define gdebug(a) if (realtime_graphics_debug) { printf(a); m68k_end_timeslice(); cpu_emulation_running = 0; }
 
+// Blits that move less than this many bytes run on the CPU thread if the blitter is idle, handing them
+// over would take longer than doing them.
+#define RTG_BLIT_INLINE 16384
+
+static struct rtg_command sync_cmd;
+static uint32_t blit_bytes;
+
+// Grows the VRAM range [*start, *end) by rows of bytes at offset, clipped to VRAM.
+static void add_range(uint32_t *start, uint32_t *end, int64_t offset, int64_t bytes, int64_t rows, int64_t pitch) {
+    int64_t last = offset + (rows - 1) * pitch + bytes;
+
+    if (rows <= 0 || bytes <= 0)
+        return;
+    blit_bytes += bytes * rows;
+    if (offset < 0)
+        offset = 0;
+    if (last > RTG_MEM_SIZE)
+        last = RTG_MEM_SIZE;
+    if (offset >= last)
+        return;
+    if (*start == *end || offset < *start)
+        *start = offset;
+    if (last > *end)
+        *end = last;
+}
+
+// Copies a template or pattern into the command, the 68k may reuse its memory once the command is
+// queued.  The driver puts them in the VRAM scratch area for every blit, so those are copied as well
+// rather than keeping queued blits and the next template apart.  Returns 0 if it is too large or not
+// in mapped memory.
+static int copy_source(struct rtg_command *c, uint32_t addr, uint32_t size) {
+    if (size >= RTG_CMD_DATA_SIZE)
+        return 0;
+
+    if (addr >= PIGFX_RTG_BASE + PIGFX_REG_SIZE) {
+        uint32_t offset = addr - (PIGFX_RTG_BASE + PIGFX_REG_SIZE);
+        if (offset > RTG_MEM_SIZE - size)
+            return 0;
+        rtg_blitter_sync(offset, size);
+        memcpy(c->data, &rtg_mem[offset], size);
+    }
+    else {
+        int i = get_mapped_item_by_address(cfg, addr);
+        if (i == -1 || addr - cfg->map_offset[i] + size > cfg->map_size[i])
+            return 0;
+        memcpy(c->data, &cfg->map_data[i][addr - cfg->map_offset[i]], size);
+    }
+    c->src = c->data;
+    return 1;
+}
+
+// Takes the blit's parameters from the registers and queues it for the blitter thread.  Blits that can't be
+// queued run right here, once the ones before them are done.
+static void issue_blit(uint16_t cmd) {
+    struct rtg_command *c = rtg_blitter_slot();
+    uint32_t start = 0, end = 0;
+    int queue = (c != NULL && !realtime_graphics_debug);
+
+    if (!c)
+        c = &sync_cmd;
+    c->cmd = cmd;
+    memcpy(c->u8, rtg_u8, sizeof(c->u8));
+    memcpy(c->x, rtg_x, sizeof(c->x));
+    memcpy(c->y, rtg_y, sizeof(c->y));
+    memcpy(c->user, rtg_user, sizeof(c->user));
+    c->format = rtg_format;
+    memcpy(c->address, rtg_address, sizeof(c->address));
+    memcpy(c->address_adj, rtg_address_adj, sizeof(c->address_adj));
+    memcpy(c->rgb, rtg_rgb, sizeof(c->rgb));
+    c->src = NULL;
+
+    blit_bytes = 0;
+    uint16_t f = c->format;
+    uint32_t src_vram = c->address[0] - (PIGFX_RTG_BASE + PIGFX_REG_SIZE);
+    switch (cmd) {
+        case RTGCMD_FILLRECT:
+        case RTGCMD_INVERTRECT:
+            add_range(&start, &end, c->address_adj[0] + (c->x[0] << f) + c->y[0] * c->x[2], c->x[1] << f, c->y[1], c->x[2]);
+            break;
+        case RTGCMD_BLITRECT:
+            add_range(&start, &end, c->address_adj[0] + (c->x[0] << f) + c->y[0] * c->x[3], c->x[2] << f, c->y[2], c->x[3]);
+            add_range(&start, &end, c->address_adj[0] + (c->x[1] << f) + c->y[1] * c->x[3], c->x[2] << f, c->y[2], c->x[3]);
+            break;
+        case RTGCMD_BLITRECT_NOMASK_COMPLETE:
+            add_range(&start, &end, src_vram + (c->x[0] << f) + c->y[0] * c->x[3], c->x[2] << f, c->y[2], c->x[3]);
+            add_range(&start, &end, c->address[1] - (PIGFX_RTG_BASE + PIGFX_REG_SIZE) + (c->x[1] << f) + c->y[1] * c->x[4], c->x[2] << f, c->y[2], c->x[4]);
+            break;
+        case RTGCMD_BLITPATTERN:
+        case RTGCMD_BLITTEMPLATE: {
+            uint32_t size = (cmd == RTGCMD_BLITPATTERN) ? 2 * c->u8[2] : c->x[4] * c->y[1];
+            add_range(&start, &end, c->address_adj[1] + (c->x[0] << f) + c->y[0] * c->x[3], c->x[1] << f, c->y[1], c->x[3]);
+            if (queue && !copy_source(c, c->address[0], size)) {
+                if (c->address[0] >= PIGFX_RTG_BASE + PIGFX_REG_SIZE)
+                    add_range(&start, &end, src_vram, size, 1, 0);
+                else
+                    queue = 0;
+            }
+            break;
+        }
+        case RTGCMD_DRAWLINE: {
+            // Whole rows as far as the line could reach.
+            int32_t reach = abs((int16_t)c->y[1]) + c->x[2];
+            add_range(&start, &end, c->address_adj[0] + ((int16_t)c->y[0] - reach) * (int64_t)c->x[3], (2 * reach + 1) * (int64_t)c->x[3], 1, 0);
+            break;
+        }
+        case RTGCMD_P2C:
+            add_range(&start, &end, c->address_adj[0] + c->y[1] * c->x[3] + c->x[1], c->x[2], c->y[2], c->x[3]);
+            add_range(&start, &end, c->address_adj[1], c->x[4] * c->y[2] * c->u8[2], 1, 0);
+            break;
+        case RTGCMD_P2D:
+            add_range(&start, &end, c->address_adj[0] + c->y[1] * c->x[3] + (c->x[1] << f), c->x[2] << f, c->y[2], c->x[3]);
+            add_range(&start, &end, c->address_adj[1], c->x[4] * c->y[2] * c->u8[2], 1, 0);
+            // The colors the planes can reach go with the command.
+            if (!copy_source(c, c->address[2], 4 << ((c->u8[2] > 8) ? 8 : c->u8[2])))
+                printf("[RTG] P2D CLUT at %.8X is not in mapped memory, skipping the blit.\n", c->address[2]);
+            break;
+    }
+
+    if (queue && (blit_bytes >= RTG_BLIT_INLINE || !rtg_blitter_idle())) {
+        rtg_blitter_submit(start, end);
+    }
+    else {
+        rtg_blitter_wait();
+        rtg_run_command(c);
+    }
+}
+
+uint32_t rtg_sprite_serial() {
+    return __atomic_load_n(&sprite.serial, __ATOMIC_ACQUIRE);
+}
+
+void rtg_get_sprite(struct rtg_sprite *s) {
+    pthread_mutex_lock(&sprite_mutex);
+    *s = sprite;
+    pthread_mutex_unlock(&sprite_mutex);
+}
+
+// SetSprite*() from the driver.  A move is only two registers and this, P96 no longer saves, restores and
+// draws the pointer in VRAM for it.
+static void set_sprite(uint32_t cmd) {
+    pthread_mutex_lock(&sprite_mutex);
+    switch (cmd) {
+        case RTGCMD_SETSPRITE:
+            sprite.enabled = rtg_x[0] & 0x01;
+            break;
+        case RTGCMD_SETSPRITEPOS:
+            sprite.x = (int16_t)rtg_x[0];
+            sprite.y = (int16_t)rtg_y[0];
+            break;
+        case RTGCMD_SETSPRITECOLOR:
+            // Colors 1 to 3 of the sprite, 0 is transparent.
+            if (rtg_u8[0] < 3)
+                sprite.colors[rtg_u8[0] + 1] = 0xFF000000 | (rtg_rgb[0] & 0xFFFFFF);
+            break;
+        case RTGCMD_SETSPRITEIMAGE: {
+            // Two planes of (width + 15) / 16 words a row in the scratch area, plane 0 first.
+            uint32_t row = ((rtg_x[0] + 15) / 16) * 4, size = row * rtg_y[0];
+            if (rtg_address_adj[0] > RTG_MEM_SIZE - size) {
+                printf("[RTG] Sprite image at %.8X is outside VRAM.\n", rtg_address[0]);
+                break;
+            }
+            sprite.width = (rtg_x[0] < RTG_SPRITE_WIDTH) ? rtg_x[0] : RTG_SPRITE_WIDTH;
+            sprite.height = (rtg_y[0] < RTG_SPRITE_HEIGHT) ? rtg_y[0] : RTG_SPRITE_HEIGHT;
+            sprite.scale = (rtg_u8[0] & 0x01) ? 2 : 1;
+            rtg_blitter_sync(rtg_address_adj[0], size);
+            const uint8_t *src = &rtg_mem[rtg_address_adj[0]];
+            memset(sprite.image, 0, sizeof(sprite.image));
+            for (int y = 0; y < sprite.height; y++, src += row) {
+                for (int x = 0; x < sprite.width; x++) {
+                    uint8_t bit = 0x80 >> (x & 7);
+                    sprite.image[y][x] = ((src[x >> 3] & bit) ? 1 : 0) | ((src[row / 2 + (x >> 3)] & bit) ? 2 : 0);
+                }
+            }
+            break;
+        }
+    }
+    __atomic_store_n(&sprite.serial, sprite.serial + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sprite_mutex);
+}
+
 static void handle_rtg_command(uint32_t cmd) {
     //printf("Handling RTG command %d (%.8X)\n", cmd, cmd);
     switch (cmd) {
@@ -236,54 +626,82 @@ static void handle_rtg_command(uint32_t cmd) {
             }
             break;
         case RTGCMD_FILLRECT:
-            if (rtg_u8[0] == 0xFF || rtg_format != RTGFMT_8BIT) {
-                rtg_fillrect_solid(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_rgb[0], rtg_x[2], rtg_format);
+        case RTGCMD_INVERTRECT:
+        case RTGCMD_BLITRECT:
+        case RTGCMD_BLITRECT_NOMASK_COMPLETE:
+        case RTGCMD_BLITPATTERN:
+        case RTGCMD_BLITTEMPLATE:
+        case RTGCMD_DRAWLINE:
+        case RTGCMD_P2C:
+        case RTGCMD_P2D:
+            issue_blit(cmd);
+            break;
+        case RTGCMD_SETSPRITE:
+        case RTGCMD_SETSPRITEPOS:
+        case RTGCMD_SETSPRITEIMAGE:
+        case RTGCMD_SETSPRITECOLOR:
+            set_sprite(cmd);
+            break;
+    }
+}
+
+struct rtg_command *rtg_cmd;
+
+void rtg_run_command(struct rtg_command *c) {
+    rtg_cmd = c;
+    switch (c->cmd) {
+        case RTGCMD_FILLRECT:
+            if (c->u8[0] == 0xFF || c->format != RTGFMT_8BIT) {
+                rtg_fillrect_solid(c->x[0], c->y[0], c->x[1], c->y[1], c->rgb[0], c->x[2], c->format);
                 gdebug("FillRect Solid\n");
             }
             else {
-                rtg_fillrect(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_rgb[0], rtg_x[2], rtg_format, rtg_u8[0]);
+                rtg_fillrect(c->x[0], c->y[0], c->x[1], c->y[1], c->rgb[0], c->x[2], c->format, c->u8[0]);
                 gdebug("FillRect Masked\n");
             }
             break;
         case RTGCMD_INVERTRECT:
-            rtg_invertrect(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_x[2], rtg_format, rtg_u8[0]);
+            rtg_invertrect(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->format, c->u8[0]);
             gdebug("InvertRect\n");
             break;
         case RTGCMD_BLITRECT:
-            if (rtg_u8[0] == 0xFF || rtg_format != RTGFMT_8BIT) {
-                rtg_blitrect_solid(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_x[2], rtg_y[2], rtg_x[3], rtg_format);
+            if (c->u8[0] == 0xFF || c->format != RTGFMT_8BIT) {
+                rtg_blitrect_solid(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->y[2], c->x[3], c->format);
                 gdebug("BlitRect Solid\n");
             }
             else {
-                rtg_blitrect(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_x[2], rtg_y[2], rtg_x[3], rtg_format, rtg_u8[0]);
+                rtg_blitrect(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->y[2], c->x[3], c->format, c->u8[0]);
                 gdebug("BlitRect Masked\n");
             }
             break;
         case RTGCMD_BLITRECT_NOMASK_COMPLETE:
-            rtg_blitrect_nomask_complete(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_x[2], rtg_y[2], rtg_x[3], rtg_x[4], rtg_address[0], rtg_address[1], rtg_format, rtg_u8[0]);
+            rtg_blitrect_nomask_complete(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->y[2], c->x[3], c->x[4], c->address[0], c->address[1], c->format, c->u8[0]);
             gdebug("BlitRectNoMaskComplete\n");
             break;
         case RTGCMD_BLITPATTERN:
-            rtg_blitpattern(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_address[0], rtg_rgb[0], rtg_rgb[1], rtg_x[3], rtg_format, rtg_x[2], rtg_y[2], rtg_u8[0], rtg_u8[1], rtg_u8[2]);
+            rtg_blitpattern(c->x[0], c->y[0], c->x[1], c->y[1], c->address[0], c->rgb[0], c->rgb[1], c->x[3], c->format, c->x[2], c->y[2], c->u8[0], c->u8[1], c->u8[2]);
             gdebug("BlitPattern\n");
-            return;
+            break;
         case RTGCMD_BLITTEMPLATE:
-            rtg_blittemplate(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_address[0], rtg_rgb[0], rtg_rgb[1], rtg_x[3], rtg_x[4], rtg_format, rtg_x[2], rtg_u8[0], rtg_u8[1]);
+            rtg_blittemplate(c->x[0], c->y[0], c->x[1], c->y[1], c->address[0], c->rgb[0], c->rgb[1], c->x[3], c->x[4], c->format, c->x[2], c->u8[0], c->u8[1]);
             gdebug("BlitTemplate\n");
             break;
         case RTGCMD_DRAWLINE:
-            if (rtg_u8[0] == 0xFF && rtg_y[2] == 0xFFFF)
-                rtg_drawline_solid(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_x[2], rtg_rgb[0], rtg_x[3], rtg_format);
+            if (c->u8[0] == 0xFF && c->y[2] == 0xFFFF)
+                rtg_drawline_solid(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->rgb[0], c->x[3], c->format);
             else
-                rtg_drawline(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_x[2], rtg_y[2], rtg_x[4], rtg_rgb[0], rtg_rgb[1],  rtg_x[3], rtg_format, rtg_u8[0], rtg_u8[1]);
+                rtg_drawline(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->y[2], c->x[4], c->rgb[0], c->rgb[1],  c->x[3], c->format, c->u8[0], c->u8[1]);
             gdebug("DrawLine\n");
             break;
         case RTGCMD_P2C:
-            rtg_p2c(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_x[2], rtg_y[2], rtg_u8[1], rtg_u8[2], rtg_u8[0], (rtg_user[0] >> 0x8), rtg_x[4], (uint8_t *)&rtg_mem[rtg_address_adj[1]]);
-            //rtg_p2c_broken(rtg_x[0], rtg_y[0], rtg_x[1], rtg_y[1], rtg_x[2], rtg_y[2], rtg_x[3], rtg_u8[0], rtg_u8[1], rtg_u8[2], rtg_user[0]);
+            rtg_p2c(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->y[2], c->u8[1], c->u8[2], c->u8[0], (c->user[0] >> 0x8), c->x[4], (uint8_t *)&rtg_mem[c->address_adj[1]]);
+            //rtg_p2c_broken(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->y[2], c->x[3], c->u8[0], c->u8[1], c->u8[2], c->user[0]);
             gdebug("Planar2Chunky\n");
             break;
         case RTGCMD_P2D:
+            if (c->src)
+                rtg_p2d(c->x[0], c->y[0], c->x[1], c->y[1], c->x[2], c->y[2], c->u8[1], c->u8[2], (c->user[0] >> 0x8), c->x[4], (uint8_t *)&rtg_mem[c->address_adj[1]], c->src, c->format);
+            gdebug("Planar2Direct\n");
             break;
     }
 }
@@ -5,16 +5,106 @@
 #define PIGFX_SCRATCH_AREA 0x72010000
 #define PIGFX_UPPER        0x72810000
 
+#define RTG_MEM_SIZE       (40 * 1024 * 1024)
+
 #define CARD_OFFSET 0
 
+#include <stdint.h>
+#include <stdio.h>
 #include "rtg_driver_amiga/rtg_enums.h"
 
+#define PIGFX_FIFO (PIGFX_SCRATCH_AREA + RTG_FIFO_OFFSET)
+
 void rtg_write(uint32_t address, uint32_t value, uint8_t mode);
 unsigned int rtg_read(uint32_t address, uint8_t mode);
 void rtg_set_clut_entry(uint8_t index, uint32_t xrgb);
+uint32_t rtg_get_clut_entry(uint8_t index);
 void rtg_init_display();
 void rtg_shutdown_display();
 
+// The driver's hardware sprite, the mouse pointer, drawn over the display by the output thread rather
+// than into VRAM by P96.  The size is the largest P96 asks for, MAXSPRITEWIDTH x MAXSPRITEHEIGHT.
+#define RTG_SPRITE_WIDTH 32
+#define RTG_SPRITE_HEIGHT 48
+
+struct rtg_sprite {
+    uint32_t serial;            // goes up with every change
+    uint8_t enabled, scale;
+    int16_t x, y;
+    uint16_t width, height;
+    uint32_t colors[4];         // ARGB, 0 is transparent
+    uint8_t image[RTG_SPRITE_HEIGHT][RTG_SPRITE_WIDTH];
+};
+
+// The serial of the sprite right now, and a copy of it that isn't half way through a change.
+uint32_t rtg_sprite_serial();
+void rtg_get_sprite(struct rtg_sprite *sprite);
+int rtg_save_state(FILE *out);
+int rtg_load_state(FILE *in);
+
+// Changed VRAM, one flag per (1 << RTG_DIRTY_SHIFT) bytes.  Set after the pixels are written, the output
+// thread clears them before it converts (see rtg_convert_dirty()).
+#define RTG_DIRTY_SHIFT 8
+extern uint8_t rtg_dirty[RTG_MEM_SIZE >> RTG_DIRTY_SHIFT];
+
+static inline void rtg_mark_dirty(uint32_t offset, uint32_t size) {
+    if (offset <= RTG_MEM_SIZE - size) {
+        __atomic_store_n(&rtg_dirty[offset >> RTG_DIRTY_SHIFT], 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&rtg_dirty[(offset + size - 1) >> RTG_DIRTY_SHIFT], 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Marks rows of bytes starting at offset, for a blit with its top left corner there.
+void rtg_mark_dirty_rect(uint32_t offset, uint32_t bytes, uint32_t rows, uint32_t pitch);
+// Everything on screen has to be converted again, after a palette change or a snapshot load.
+void rtg_mark_dirty_all();
+
+// The command FIFO in VRAM, NULL without RTG, and the offset of the next record to run.
+extern uint32_t *rtg_fifo;
+extern uint32_t rtg_fifo_read;
+void rtg_fifo_run();
+
+// Runs the records the driver added to the FIFO since the last time.  Called before anything that
+// could see what they do, and once per CPU loop so they don't wait for the next doorbell.
+static inline void rtg_fifo_poll() {
+    if (rtg_fifo && rtg_fifo[rtg_fifo_read / 4])
+        rtg_fifo_run();
+}
+
+// Templates and patterns up to this size are copied into the command.
+#define RTG_CMD_DATA_SIZE 4096
+
+// A blit and the registers it was issued with.  The blitter thread (see rtg-blitter.c) runs it from
+// this copy while the registers are set up for the next one.
+struct rtg_command {
+    uint16_t cmd;
+    uint8_t u8[4];
+    uint16_t x[8], y[8], user[8];
+    uint16_t format;
+    uint32_t address[8], address_adj[8], rgb[8];
+    uint8_t *src;           // NULL, or the template/pattern copied to data[]
+    uint8_t data[RTG_CMD_DATA_SIZE];
+};
+
+// The command the functions in rtg-gfx.c are running for.
+extern struct rtg_command *rtg_cmd;
+void rtg_run_command(struct rtg_command *c);
+
+int rtg_blitter_init();
+struct rtg_command *rtg_blitter_slot();
+int rtg_blitter_idle();
+void rtg_blitter_submit(uint32_t start, uint32_t end);
+void rtg_blitter_wait();
+
+// VRAM the queued blits read or write, [rtg_busy_start, rtg_busy_start + rtg_busy_size).
+extern uint32_t rtg_busy_start, rtg_busy_size;
+
+// CPU accesses to VRAM a queued blit still uses wait for the blitter to finish.
+static inline void rtg_blitter_sync(uint32_t offset, uint32_t size) {
+    if (offset + size - 1 - rtg_busy_start < rtg_busy_size + size - 1)
+        rtg_blitter_wait();
+}
+
 void rtg_fillrect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t color, uint16_t pitch, uint16_t format, uint8_t mask);
 void rtg_fillrect_solid(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t color, uint16_t pitch, uint16_t format);
 void rtg_invertrect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t pitch, uint16_t format, uint8_t mask);
@@ -27,6 +117,7 @@ void rtg_drawline_solid(int16_t x1_, int16_t y1_, int16_t x2_, int16_t y2_, uint
 void rtg_drawline (int16_t x1_, int16_t y1_, int16_t x2_, int16_t y2_, uint16_t len, uint16_t pattern, uint16_t pattern_offset, uint32_t fgcol, uint32_t bgcol, uint16_t pitch, uint16_t format, uint8_t mask, uint8_t draw_mode);
 
 void rtg_p2c (int16_t sx, int16_t sy, int16_t dx, int16_t dy, int16_t w, int16_t h, uint8_t draw_mode, uint8_t planes, uint8_t mask, uint8_t layer_mask, uint16_t src_line_pitch, uint8_t *bmp_data_src);
+void rtg_p2d (int16_t sx, int16_t sy, int16_t dx, int16_t dy, int16_t w, int16_t h, uint8_t draw_mode, uint8_t planes, uint8_t layer_mask, uint16_t src_line_pitch, uint8_t *bmp_data_src, const uint8_t *clut, uint16_t format);
 
 #define PATTERN_LOOPX \
     tmpl_x ^= 0x01; \
@@ -213,81 +304,3 @@ void rtg_p2c (int16_t sx, int16_t sy, int16_t dx, int16_t dy, int16_t w, int16_t
             *((uint32_t *)dest) = ~*((uint32_t *)dest); \
             break; \
     }
-
-#define HANDLE_MINTERM_PIXEL(s, d, f) \
-      switch(draw_mode) {\
-            case MINTERM_NOR: \
-                  s &= ~(d); \
-            SET_RTG_PIXEL_MASK(&d, s, f); break; \
-            case MINTERM_ONLYDST: \
-                  d = d & ~(s); break; \
-            case MINTERM_NOTSRC: \
-            SET_RTG_PIXEL_MASK(&d, s, f); break; \
-            case MINTERM_ONLYSRC: \
-                  s &= (d ^ 0xFF); \
-            SET_RTG_PIXEL_MASK(&d, s, f); break; \
-            case MINTERM_INVERT: \
-                  d ^= 0xFF; break; \
-            case MINTERM_EOR: \
-                  d ^= s; break; \
-            case MINTERM_NAND: \
-                  s = ~(d & ~(s)) & mask; \
-            SET_RTG_PIXEL_MASK(&d, s, f); break; \
-            case MINTERM_AND: \
-                  s &= d; \
-            SET_RTG_PIXEL_MASK(&d, s, f); break; \
-            case MINTERM_NEOR: \
-                  d ^= (s & mask); break; \
-            case MINTERM_DST: /* This one does nothing. */ \
-                  return; break; \
-            case MINTERM_NOTONLYSRC: \
-                  d |= (s & mask); break; \
-            case MINTERM_SRC: \
-            SET_RTG_PIXEL_MASK(&d, s, f); break; \
-            case MINTERM_NOTONLYDST: \
-                  s = ~(d & s) & mask; \
-            SET_RTG_PIXEL_MASK(&d, s, f); break; \
-            case MINTERM_OR: \
-                  d |= (s & mask); break; \
-      }
-
-
-#define DECODE_PLANAR_PIXEL(a) \
-	switch (planes) { \
-		case 8: if (layer_mask & 0x80 && bmp_data[(plane_size * 7) + cur_byte] & cur_bit) a |= 0x80; \
-        /* Fallthrough */ \
-		case 7: if (layer_mask & 0x40 && bmp_data[(plane_size * 6) + cur_byte] & cur_bit) a |= 0x40; \
-        /* Fallthrough */ \
-		case 6: if (layer_mask & 0x20 && bmp_data[(plane_size * 5) + cur_byte] & cur_bit) a |= 0x20; \
-        /* Fallthrough */ \
-		case 5: if (layer_mask & 0x10 && bmp_data[(plane_size * 4) + cur_byte] & cur_bit) a |= 0x10; \
-        /* Fallthrough */ \
-		case 4: if (layer_mask & 0x08 && bmp_data[(plane_size * 3) + cur_byte] & cur_bit) a |= 0x08; \
-        /* Fallthrough */ \
-		case 3: if (layer_mask & 0x04 && bmp_data[(plane_size * 2) + cur_byte] & cur_bit) a |= 0x04; \
-        /* Fallthrough */ \
-		case 2: if (layer_mask & 0x02 && bmp_data[plane_size + cur_byte] & cur_bit) a |= 0x02; \
-        /* Fallthrough */ \
-		case 1: if (layer_mask & 0x01 && bmp_data[cur_byte] & cur_bit) a |= 0x01; \
-			break; \
-	}
-
-#define DECODE_INVERTED_PLANAR_PIXEL(a) \
-	switch (planes) { \
-		case 8: if (layer_mask & 0x80 && (bmp_data[(plane_size * 7) + cur_byte] ^ 0xFF) & cur_bit) a |= 0x80; \
-        /* Fallthrough */ \
-		case 7: if (layer_mask & 0x40 && (bmp_data[(plane_size * 6) + cur_byte] ^ 0xFF) & cur_bit) a |= 0x40; \
-        /* Fallthrough */ \
-		case 6: if (layer_mask & 0x20 && (bmp_data[(plane_size * 5) + cur_byte] ^ 0xFF) & cur_bit) a |= 0x20; \
-        /* Fallthrough */ \
-		case 5: if (layer_mask & 0x10 && (bmp_data[(plane_size * 4) + cur_byte] ^ 0xFF) & cur_bit) a |= 0x10; \
-        /* Fallthrough */ \
-		case 4: if (layer_mask & 0x08 && (bmp_data[(plane_size * 3) + cur_byte] ^ 0xFF) & cur_bit) a |= 0x08; \
-        /* Fallthrough */ \
-		case 3: if (layer_mask & 0x04 && (bmp_data[(plane_size * 2) + cur_byte] ^ 0xFF) & cur_bit) a |= 0x04; \
-        /* Fallthrough */ \
-		case 2: if (layer_mask & 0x02 && (bmp_data[plane_size + cur_byte] ^ 0xFF) & cur_bit) a |= 0x02; \
-        /* Fallthrough */ \
-		case 1: if (layer_mask & 0x01 && (bmp_data[cur_byte] ^ 0xFF) & cur_bit) a |= 0x01; \
-			break; \
-	}
@@ -20,6 +20,7 @@
 #define WRITESHORT(cmd, val) *(unsigned short *)((unsigned long)(b->RegisterBase)+cmd) = val;
 #define WRITELONG(cmd, val) *(unsigned long *)((unsigned long)(b->RegisterBase)+cmd) = val;
 #define WRITEBYTE(cmd, val) *(unsigned char *)((unsigned long)(b->RegisterBase)+cmd) = val;
+#define READSHORT(cmd, var) var = *(volatile unsigned short *)((unsigned long)(b->RegisterBase)+cmd);
 
 #define CHECKRTG *((unsigned short *)(CARD_OFFSET))
 
@@ -27,9 +28,21 @@
 #define CARD_REGSIZE  0x00010000
 #define CARD_MEMSIZE  0x02000000 // 32MB "VRAM"
 #define CARD_SCRATCH  0x72010000
+#define CARD_SCRATCH_SIZE RTG_FIFO_OFFSET // Blit sources staged by the driver, the FIFO follows
 
 #define CHIP_RAM_SIZE 0x00200000 // Chip RAM offset, 2MB
 
+// Blits are written as records to the command FIFO at the end of the scratch area (see rtg_enums.h),
+// in register order.  The register words are packed two to a longword, so a record takes about half
+// the writes to the card the registers would, and the Pi maps the ring as RAM, so the writes don't go
+// through its register code.  It runs the records when the doorbell is written, before the next access
+// to the card and from its CPU loop.  FIFO_CTRL is the offset the Pi got to.
+#define FIFO_ADDR(pos) (CARD_SCRATCH + RTG_FIFO_OFFSET + (pos))
+#define FIFO_CTRL *(volatile unsigned long *)FIFO_ADDR(0)
+#define FIFO_SHORT(reg, val) fifo_short(&fifo, (reg), (val))
+#define FIFO_LONG(reg, val) { unsigned long v_ = (val); fifo_short(&fifo, (reg), v_ >> 16); fifo_short(&fifo, (reg) + 2, v_); }
+#define FIFO_BYTES(reg, hi, lo) FIFO_SHORT(reg, ((hi) << 8) | (lo))
+
 const unsigned short rgbf_to_rtg[16] = {
   RTGFMT_8BIT,      // 0x00
   RTGFMT_8BIT,      // 0x01
@@ -80,6 +93,12 @@ void SetClearMask (__REGA0(struct BoardInfo *b), __REGD0(UBYTE mask));
 void SetReadPlane (__REGA0(struct BoardInfo *b), __REGD0(UBYTE plane));
 
 void WaitVerticalSync (__REGA0(struct BoardInfo *b), __REGD0(BOOL toggle));
+void WaitBlitter (__REGA0(struct BoardInfo *b));
+
+BOOL SetSprite (__REGA0(struct BoardInfo *b), __REGD0(BOOL activate), __REGD7(RGBFTYPE format));
+void SetSpritePosition (__REGA0(struct BoardInfo *b), __REGD0(WORD x), __REGD1(WORD y), __REGD7(RGBFTYPE format));
+void SetSpriteImage (__REGA0(struct BoardInfo *b), __REGD7(RGBFTYPE format));
+void SetSpriteColor (__REGA0(struct BoardInfo *b), __REGD0(UBYTE idx), __REGD1(UBYTE R), __REGD2(UBYTE G), __REGD3(UBYTE B), __REGD7(RGBFTYPE format));
 
 void FillRect (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *r), __REGD0(WORD x), __REGD1(WORD y), __REGD2(WORD w), __REGD3(WORD h), __REGD4(ULONG color), __REGD5(UBYTE mask), __REGD7(RGBFTYPE format));
 void InvertRect (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *r), __REGD0(WORD x), __REGD1(WORD y), __REGD2(WORD w), __REGD3(WORD h), __REGD4(UBYTE mask), __REGD7(RGBFTYPE format));
@@ -224,6 +243,51 @@ static struct GFXData *gfxdata;
 static BYTE card_already_found;
 static BYTE card_initialized;
 
+static unsigned long fifo_pos;
+static unsigned short fifo_pending;
+
+// The record being written, kept on the stack so it stays in registers.
+struct fifo_rec {
+  unsigned long *out;   // next longword of the record
+  unsigned long mask;   // one bit per register word in it
+  unsigned long half;   // a word waiting for the one after it
+  unsigned short words;
+};
+
+static inline void fifo_begin(struct BoardInfo *b, struct fifo_rec *f) {
+  if (fifo_pos + RTG_FIFO_RECORD_MAX >= RTG_FIFO_SIZE) {
+    *(unsigned long *)FIFO_ADDR(fifo_pos) = (unsigned long)RTG_FIFO_WRAP << 27;
+    fifo_pos = RTG_FIFO_RING;
+    // The Pi has to be done with the records at the start before they are written again.
+    WRITELONG(RTG_FIFO, fifo_pos);
+    fifo_pending = 0;
+  }
+  f->out = (unsigned long *)FIFO_ADDR(fifo_pos + 4);
+  f->mask = 0;
+  f->words = 0;
+}
+
+static inline void fifo_short(struct fifo_rec *f, unsigned short reg, unsigned short val) {
+  f->mask |= 1UL << (reg >> 1);
+  if (f->words++ & 1)
+    *f->out++ = f->half | val;
+  else
+    f->half = (unsigned long)val << 16;
+}
+
+// Ends the record for cmd, flush rings the doorbell right away for blits from memory the caller may reuse.
+// The header goes last, the Pi takes the record once it is there.
+static inline void fifo_end(struct BoardInfo *b, struct fifo_rec *f, unsigned short cmd, BOOL flush) {
+  if (f->words & 1)
+    *f->out++ = f->half;
+  *(unsigned long *)FIFO_ADDR(fifo_pos) = ((unsigned long)(cmd + 1) << 27) | (f->mask >> 1);
+  fifo_pos += 4 + ((f->words + 1) >> 1) * 4;
+  if (flush || ++fifo_pending == RTG_FIFO_BATCH) {
+    WRITELONG(RTG_FIFO, fifo_pos);
+    fifo_pending = 0;
+  }
+}
+
 int FindCard(__REGA0(struct BoardInfo* b)) {
   //if (card_already_found)
 //    return 1;
@@ -272,7 +336,7 @@ int InitCard(__REGA0(struct BoardInfo* b)) {
   b->PaletteChipType = PCT_MNT_ZZ9000;
   b->GraphicsControllerType = GCT_MNT_ZZ9000;
 
-  b->Flags = BIF_INDISPLAYCHAIN | BIF_GRANTDIRECTACCESS;
+  b->Flags = BIF_INDISPLAYCHAIN | BIF_GRANTDIRECTACCESS | BIF_HARDWARESPRITE;
   b->RGBFormats = 1 | 2 | 512 | 1024 | 2048;
   b->SoftSpriteFlags = 0;
   b->BitsPerCannon = 8;
@@ -287,6 +351,12 @@ int InitCard(__REGA0(struct BoardInfo* b)) {
 
   b->MemoryClock = CLOCK_HZ;
 
+  // Go on where the Pi is, it keeps its place in the FIFO over Amiga resets.  The doorbell has the Pi
+  // map the ring, now that autoconf has placed the RAM boards.
+  fifo_pos = FIFO_CTRL;
+  fifo_pending = 0;
+  WRITELONG(RTG_FIFO, fifo_pos);
+
   //b->AllocCardMem = (void *)NULL;
   //b->FreeCardMem = (void *)NULL;
   b->SetSwitch = (void *)SetSwitch;
@@ -311,13 +381,13 @@ int InitCard(__REGA0(struct BoardInfo* b)) {
   b->WaitVerticalSync = (void *)WaitVerticalSync;
   //b->SetInterrupt = (void *)NULL;
 
-  //b->WaitBlitter = (void *)NULL;
+  b->WaitBlitter = (void *)WaitBlitter;
 
   //b->ScrollPlanar = (void *)NULL;
   //b->UpdatePlanar = (void *)NULL;
 
   //b->BlitPlanar2Chunky = (void *)BlitPlanar2Chunky;
-  //b->BlitPlanar2Direct = (void *)NULL;
+  b->BlitPlanar2Direct = (void *)BlitPlanar2Direct;
 
   b->FillRect = (void *)FillRect;
   b->InvertRect = (void *)InvertRect;
@@ -341,10 +411,10 @@ int InitCard(__REGA0(struct BoardInfo* b)) {
   //b->FreeBitMap = (void *)NULL;
   //b->GetBitMapAttr = (void *)NULL;
 
-  //b->SetSprite = (void *)NULL;
-  //b->SetSpritePosition = (void *)NULL;
-  //b->SetSpriteImage = (void *)NULL;
-  //b->SetSpriteColor = (void *)NULL;
+  b->SetSprite = (void *)SetSprite;
+  b->SetSpritePosition = (void *)SetSpritePosition;
+  b->SetSpriteImage = (void *)SetSpriteImage;
+  b->SetSpriteColor = (void *)SetSpriteColor;
 
   //b->CreateFeature = (void *)NULL;
   //b->SetFeatureAttrs = (void *)NULL;
@@ -488,171 +558,223 @@ void WaitVerticalSync (__REGA0(struct BoardInfo *b), __REGD0(BOOL toggle)) {
   // I don't know why this one has a bool in D0, but it isn't used for anything.
 }
 
+void WaitBlitter (__REGA0(struct BoardInfo *b)) {
+  // The blits run on their own thread on the Pi, the read only returns once all of them are done.
+  unsigned short dummy;
+  READSHORT(RTG_WAITBLIT, dummy);
+  (void)dummy;
+}
+
+// The mouse pointer is drawn over the display on the Pi, P96 doesn't have to save, restore and draw it in
+// VRAM every time it moves.
+BOOL SetSprite (__REGA0(struct BoardInfo *b), __REGD0(BOOL activate), __REGD7(RGBFTYPE format)) {
+  WRITESHORT(RTG_X1, activate ? 1 : 0);
+  WRITESHORT(RTG_COMMAND, RTGCMD_SETSPRITE);
+  return TRUE;
+}
+
+void SetSpritePosition (__REGA0(struct BoardInfo *b), __REGD0(WORD x), __REGD1(WORD y), __REGD7(RGBFTYPE format)) {
+  if (!b)
+    return;
+
+  // Relative to the visible part of the screen, like the panning the Pi shows.
+  b->MouseX = x;
+  b->MouseY = y;
+  WRITESHORT(RTG_X1, x - b->XOffset);
+  WRITESHORT(RTG_Y1, y - b->YOffset);
+  WRITESHORT(RTG_COMMAND, RTGCMD_SETSPRITEPOS);
+}
+
+void SetSpriteImage (__REGA0(struct BoardInfo *b), __REGD7(RGBFTYPE format)) {
+  if (!b || !b->MouseImage)
+    return;
+
+  // Sprite data like the Amiga's, a row of control words first and then rows of the two planes.  The
+  // copy to the scratch area goes through the Pi, which runs the records before it.
+  unsigned short words = (b->MouseWidth + 15) >> 4;
+  memcpy((unsigned char *)CARD_SCRATCH, b->MouseImage + 2 * words, words * 4 * b->MouseHeight);
+
+  WRITELONG(RTG_ADDR1, CARD_SCRATCH);
+  WRITESHORT(RTG_X1, b->MouseWidth);
+  WRITESHORT(RTG_Y1, b->MouseHeight);
+  WRITEBYTE(RTG_U81, (b->Flags & BIF_BIGSPRITE) ? 1 : 0);
+  WRITESHORT(RTG_COMMAND, RTGCMD_SETSPRITEIMAGE);
+}
+
+void SetSpriteColor (__REGA0(struct BoardInfo *b), __REGD0(UBYTE idx), __REGD1(UBYTE R), __REGD2(UBYTE G), __REGD3(UBYTE B), __REGD7(RGBFTYPE format)) {
+  // Colors 1 to 3 of the sprite, 0 is transparent.
+  unsigned long xrgb = ((unsigned long)R << 16) | ((unsigned long)G << 8) | B;
+  WRITEBYTE(RTG_U81, idx);
+  WRITELONG(RTG_RGB1, xrgb);
+  WRITESHORT(RTG_COMMAND, RTGCMD_SETSPRITECOLOR);
+}
+
 void FillRect (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *r), __REGD0(WORD x), __REGD1(WORD y), __REGD2(WORD w), __REGD3(WORD h), __REGD4(ULONG color), __REGD5(UBYTE mask), __REGD7(RGBFTYPE format)) {
   if (!r)
     return;
 
-  WRITELONG(RTG_ADDR1, (unsigned long)r->Memory);
-  
-  WRITESHORT(RTG_FORMAT, rgbf_to_rtg[format]);
-  WRITESHORT(RTG_X1, x);
-  WRITESHORT(RTG_X2, w);
-  WRITESHORT(RTG_Y1, y);
-  WRITESHORT(RTG_Y2, h);
-  WRITELONG(RTG_RGB1, color);
-  WRITESHORT(RTG_X3, r->BytesPerRow);
-  WRITEBYTE(RTG_U81, mask);
-  WRITESHORT(RTG_COMMAND, RTGCMD_FILLRECT);
+  struct fifo_rec fifo;
+  fifo_begin(b, &fifo);
+  FIFO_SHORT(RTG_X1, x);
+  FIFO_SHORT(RTG_X2, w);
+  FIFO_SHORT(RTG_X3, r->BytesPerRow);
+  FIFO_SHORT(RTG_Y1, y);
+  FIFO_SHORT(RTG_Y2, h);
+  FIFO_SHORT(RTG_FORMAT, rgbf_to_rtg[format]);
+  FIFO_LONG(RTG_RGB1, color);
+  FIFO_LONG(RTG_ADDR1, (unsigned long)r->Memory);
+  FIFO_BYTES(RTG_U81, mask, 0);
+  fifo_end(b, &fifo, RTGCMD_FILLRECT, FALSE);
 }
 
 void InvertRect (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *r), __REGD0(WORD x), __REGD1(WORD y), __REGD2(WORD w), __REGD3(WORD h), __REGD4(UBYTE mask), __REGD7(RGBFTYPE format)) {
   if (!r)
     return;
-  WRITELONG(RTG_ADDR1, (unsigned long)r->Memory);
-  
-  WRITESHORT(RTG_FORMAT, rgbf_to_rtg[format]);
-  WRITESHORT(RTG_X1, x);
-  WRITESHORT(RTG_X2, w);
-  WRITESHORT(RTG_Y1, y);
-  WRITESHORT(RTG_Y2, h);
-  WRITESHORT(RTG_X3, r->BytesPerRow);
-  WRITEBYTE(RTG_U81, mask);
-  WRITESHORT(RTG_COMMAND, RTGCMD_INVERTRECT);
+  struct fifo_rec fifo;
+  fifo_begin(b, &fifo);
+  FIFO_SHORT(RTG_X1, x);
+  FIFO_SHORT(RTG_X2, w);
+  FIFO_SHORT(RTG_X3, r->BytesPerRow);
+  FIFO_SHORT(RTG_Y1, y);
+  FIFO_SHORT(RTG_Y2, h);
+  FIFO_SHORT(RTG_FORMAT, rgbf_to_rtg[format]);
+  FIFO_LONG(RTG_ADDR1, (unsigned long)r->Memory);
+  FIFO_BYTES(RTG_U81, mask, 0);
+  fifo_end(b, &fifo, RTGCMD_INVERTRECT, FALSE);
 }
 
 void BlitRect (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *r), __REGD0(WORD x), __REGD1(WORD y), __REGD2(WORD dx), __REGD3(WORD dy), __REGD4(WORD w), __REGD5(WORD h), __REGD6(UBYTE mask), __REGD7(RGBFTYPE format)) {
   if (!r)
     return;
 
-  WRITELONG(RTG_ADDR1, (unsigned long)r->Memory);
-
-  WRITESHORT(RTG_FORMAT, rgbf_to_rtg[format]);
-  WRITESHORT(RTG_X1, x);
-  WRITESHORT(RTG_X2, dx);
-  WRITESHORT(RTG_X3, w);
-  WRITESHORT(RTG_Y1, y);
-  WRITESHORT(RTG_Y2, dy);
-  WRITESHORT(RTG_Y3, h);
-  WRITESHORT(RTG_X4, r->BytesPerRow);
-  WRITEBYTE(RTG_U81, mask);
-  WRITESHORT(RTG_COMMAND, RTGCMD_BLITRECT);
+  struct fifo_rec fifo;
+  fifo_begin(b, &fifo);
+  FIFO_SHORT(RTG_X1, x);
+  FIFO_SHORT(RTG_X2, dx);
+  FIFO_SHORT(RTG_X3, w);
+  FIFO_SHORT(RTG_Y1, y);
+  FIFO_SHORT(RTG_Y2, dy);
+  FIFO_SHORT(RTG_Y3, h);
+  FIFO_SHORT(RTG_FORMAT, rgbf_to_rtg[format]);
+  FIFO_LONG(RTG_ADDR1, (unsigned long)r->Memory);
+  FIFO_BYTES(RTG_U81, mask, 0);
+  FIFO_SHORT(RTG_X4, r->BytesPerRow);
+  fifo_end(b, &fifo, RTGCMD_BLITRECT, FALSE);
 }
 
 void BlitRectNoMaskComplete (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *rs), __REGA2(struct RenderInfo *rt), __REGD0(WORD x), __REGD1(WORD y), __REGD2(WORD dx), __REGD3(WORD dy), __REGD4(WORD w), __REGD5(WORD h), __REGD6(UBYTE minterm), __REGD7(RGBFTYPE format)) {
   if (!rs || !rt)
     return;
 
-  WRITESHORT(RTG_FORMAT, rgbf_to_rtg[format]);
-  WRITELONG(RTG_ADDR1, (unsigned long)rs->Memory);
-  WRITELONG(RTG_ADDR2, (unsigned long)rt->Memory);
-  WRITESHORT(RTG_X1, x);
-  WRITESHORT(RTG_X2, dx);
-  WRITESHORT(RTG_X3, w);
-  WRITESHORT(RTG_Y1, y);
-  WRITESHORT(RTG_Y2, dy);
-  WRITESHORT(RTG_Y3, h);
-  WRITESHORT(RTG_X4, rs->BytesPerRow);
-  WRITESHORT(RTG_X5, rt->BytesPerRow);
-  WRITEBYTE(RTG_U81, minterm);
-  WRITESHORT(RTG_COMMAND, RTGCMD_BLITRECT_NOMASK_COMPLETE);
+  struct fifo_rec fifo;
+  fifo_begin(b, &fifo);
+  FIFO_SHORT(RTG_X1, x);
+  FIFO_SHORT(RTG_X2, dx);
+  FIFO_SHORT(RTG_X3, w);
+  FIFO_SHORT(RTG_Y1, y);
+  FIFO_SHORT(RTG_Y2, dy);
+  FIFO_SHORT(RTG_Y3, h);
+  FIFO_SHORT(RTG_FORMAT, rgbf_to_rtg[format]);
+  FIFO_LONG(RTG_ADDR1, (unsigned long)rs->Memory);
+  FIFO_LONG(RTG_ADDR2, (unsigned long)rt->Memory);
+  FIFO_BYTES(RTG_U81, minterm, 0);
+  FIFO_SHORT(RTG_X4, rs->BytesPerRow);
+  FIFO_SHORT(RTG_X5, rt->BytesPerRow);
+  fifo_end(b, &fifo, RTGCMD_BLITRECT_NOMASK_COMPLETE, FALSE);
 }
 
 void BlitTemplate (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *r), __REGA2(struct Template *t), __REGD0(WORD x), __REGD1(WORD y), __REGD2(WORD w), __REGD3(WORD h), __REGD4(UBYTE mask), __REGD7(RGBFTYPE format)) {
   if (!r || !t) return;
   if (w < 1 || h < 1) return;
 
-  WRITELONG(RTG_ADDR2, (unsigned long)r->Memory);
-
-  WRITESHORT(RTG_FORMAT, rgbf_to_rtg[format]);
-  WRITESHORT(RTG_X1, x);
-  WRITESHORT(RTG_X2, w);
-  WRITESHORT(RTG_X3, t->XOffset);
-  WRITESHORT(RTG_Y1, y);
-  WRITESHORT(RTG_Y2, h);
-  WRITESHORT(RTG_Y3, 0);
+  BOOL in_chip = ((unsigned long)t->Memory <= CHIP_RAM_SIZE);
+  unsigned long src = (unsigned long)t->Memory;
 
-  if ((unsigned long)t->Memory > CHIP_RAM_SIZE) {
-    WRITELONG(RTG_ADDR1, (unsigned long)t->Memory);
-  }
-  else {
-    unsigned long dest = CARD_SCRATCH;
-    memcpy((unsigned char *)dest, t->Memory, (t->BytesPerRow * h));
-    WRITELONG(RTG_ADDR1, (unsigned long)dest);
-    WRITELONG(RTG_ADDR3, (unsigned long)t->Memory);
+  // Templates in chip RAM are staged in the scratch area, P96 draws the ones that don't fit.
+  if (in_chip && (unsigned long)t->BytesPerRow * h > CARD_SCRATCH_SIZE) {
+    b->BlitTemplateDefault(b, r, t, x, y, w, h, mask, format);
+    return;
   }
 
-  WRITELONG(RTG_RGB1, t->FgPen);
-  WRITELONG(RTG_RGB2, t->BgPen);
-
-  WRITESHORT(RTG_X4, r->BytesPerRow);
-  WRITESHORT(RTG_X5, t->BytesPerRow);
+  // The copy to the scratch area goes through the Pi, which runs the records before it.
+  if (in_chip) {
+    src = CARD_SCRATCH;
+    memcpy((unsigned char *)src, t->Memory, (t->BytesPerRow * h));
+  }
 
-  WRITEBYTE(RTG_U81, mask);
-  WRITEBYTE(RTG_U82, t->DrawMode);
-  WRITESHORT(RTG_COMMAND, RTGCMD_BLITTEMPLATE);
+  struct fifo_rec fifo;
+  fifo_begin(b, &fifo);
+  FIFO_SHORT(RTG_X1, x);
+  FIFO_SHORT(RTG_X2, w);
+  FIFO_SHORT(RTG_X3, t->XOffset);
+  FIFO_SHORT(RTG_Y1, y);
+  FIFO_SHORT(RTG_Y2, h);
+  FIFO_SHORT(RTG_Y3, 0);
+  FIFO_SHORT(RTG_FORMAT, rgbf_to_rtg[format]);
+  FIFO_LONG(RTG_RGB1, t->FgPen);
+  FIFO_LONG(RTG_RGB2, t->BgPen);
+  FIFO_LONG(RTG_ADDR1, src);
+  FIFO_LONG(RTG_ADDR2, (unsigned long)r->Memory);
+  FIFO_BYTES(RTG_U81, mask, t->DrawMode);
+  FIFO_SHORT(RTG_X4, r->BytesPerRow);
+  FIFO_SHORT(RTG_X5, t->BytesPerRow);
+  if (in_chip)
+    FIFO_LONG(RTG_ADDR3, (unsigned long)t->Memory);
+  fifo_end(b, &fifo, RTGCMD_BLITTEMPLATE, !in_chip);
 }
 
 void BlitPattern (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *r), __REGA2(struct Pattern *p), __REGD0(WORD x), __REGD1(WORD y), __REGD2(WORD w), __REGD3(WORD h), __REGD4(UBYTE mask), __REGD7(RGBFTYPE format)) {
   if (!r || !p) return;
   if (w < 1 || h < 1) return;
 
-  WRITELONG(RTG_ADDR2, (unsigned long)r->Memory);
+  BOOL in_chip = ((unsigned long)p->Memory <= CHIP_RAM_SIZE);
+  unsigned long src = (unsigned long)p->Memory;
 
-  WRITESHORT(RTG_FORMAT, rgbf_to_rtg[format]);
-  WRITESHORT(RTG_X1, x);
-  WRITESHORT(RTG_X2, w);
-  WRITESHORT(RTG_X3, p->XOffset);
-  WRITESHORT(RTG_Y1, y);
-  WRITESHORT(RTG_Y2, h);
-  WRITESHORT(RTG_Y3, p->YOffset);
-
-  if ((unsigned long)p->Memory > CHIP_RAM_SIZE) {
-    WRITELONG(RTG_ADDR1, (unsigned long)p->Memory);
-  }
-  else {
-    unsigned long dest = CARD_SCRATCH;
-    memcpy((unsigned char *)dest, p->Memory, (2 * (1 << p->Size)));
-    WRITELONG(RTG_ADDR1, (unsigned long)dest);
+  if (in_chip) {
+    src = CARD_SCRATCH;
+    memcpy((unsigned char *)src, p->Memory, (2 * (1 << p->Size)));
   }
 
-  WRITELONG(RTG_RGB1, p->FgPen);
-  WRITELONG(RTG_RGB2, p->BgPen);
-
-  WRITESHORT(RTG_X4, r->BytesPerRow);
-  WRITESHORT(RTG_X5, (1 << p->Size));
-
-  WRITEBYTE(RTG_U81, mask);
-  WRITEBYTE(RTG_U82, p->DrawMode);
-  WRITEBYTE(RTG_U83, (1 << p->Size));
-  WRITESHORT(RTG_COMMAND, RTGCMD_BLITPATTERN);
+  struct fifo_rec fifo;
+  fifo_begin(b, &fifo);
+  FIFO_SHORT(RTG_X1, x);
+  FIFO_SHORT(RTG_X2, w);
+  FIFO_SHORT(RTG_X3, p->XOffset);
+  FIFO_SHORT(RTG_Y1, y);
+  FIFO_SHORT(RTG_Y2, h);
+  FIFO_SHORT(RTG_Y3, p->YOffset);
+  FIFO_SHORT(RTG_FORMAT, rgbf_to_rtg[format]);
+  FIFO_LONG(RTG_RGB1, p->FgPen);
+  FIFO_LONG(RTG_RGB2, p->BgPen);
+  FIFO_LONG(RTG_ADDR1, src);
+  FIFO_LONG(RTG_ADDR2, (unsigned long)r->Memory);
+  FIFO_BYTES(RTG_U81, mask, p->DrawMode);
+  FIFO_BYTES(RTG_U83, (1 << p->Size), 0);
+  FIFO_SHORT(RTG_X4, r->BytesPerRow);
+  FIFO_SHORT(RTG_X5, (1 << p->Size));
+  fifo_end(b, &fifo, RTGCMD_BLITPATTERN, !in_chip);
 }
 
 void DrawLine (__REGA0(struct BoardInfo *b), __REGA1(struct RenderInfo *r), __REGA2(struct Line *l), __REGD0(UBYTE mask), __REGD7(RGBFTYPE format)) {
   if (!r || !b) return;
 
-  WRITELONG(RTG_ADDR1, (unsigned long)r->Memory);
-
-  WRITELONG(RTG_RGB1, l->FgPen);
-  WRITELONG(RTG_RGB2, l->BgPen);
-
-  WRITESHORT(RTG_FORMAT, rgbf_to_rtg[format]);
-
-  WRITESHORT(RTG_X1, l->X);
-  WRITESHORT(RTG_X2, l->dX);
-  WRITESHORT(RTG_Y1, l->Y);
-  WRITESHORT(RTG_Y2, l->dY);
-
-  WRITESHORT(RTG_X3, l->Length);
-  WRITESHORT(RTG_Y3, l->LinePtrn);
-
-  WRITESHORT(RTG_X4, r->BytesPerRow);
-  WRITESHORT(RTG_X5, l->PatternShift);
-
-  WRITEBYTE(RTG_U81, mask);
-  WRITEBYTE(RTG_U82, l->DrawMode);
-  WRITEBYTE(RTG_U83, l->pad);
-
-  WRITESHORT(RTG_COMMAND, RTGCMD_DRAWLINE);
+  struct fifo_rec fifo;
+  fifo_begin(b, &fifo);
+  FIFO_SHORT(RTG_X1, l->X);
+  FIFO_SHORT(RTG_X2, l->dX);
+  FIFO_SHORT(RTG_X3, l->Length);
+  FIFO_SHORT(RTG_Y1, l->Y);
+  FIFO_SHORT(RTG_Y2, l->dY);
+  FIFO_SHORT(RTG_Y3, l->LinePtrn);
+  FIFO_SHORT(RTG_FORMAT, rgbf_to_rtg[format]);
+  FIFO_LONG(RTG_RGB1, l->FgPen);
+  FIFO_LONG(RTG_RGB2, l->BgPen);
+  FIFO_LONG(RTG_ADDR1, (unsigned long)r->Memory);
+  FIFO_BYTES(RTG_U81, mask, l->DrawMode);
+  FIFO_BYTES(RTG_U83, l->pad, 0);
+  FIFO_SHORT(RTG_X4, r->BytesPerRow);
+  FIFO_SHORT(RTG_X5, l->PatternShift);
+  fifo_end(b, &fifo, RTGCMD_DRAWLINE, FALSE);
 }
 
 void BlitPlanar2Chunky_Broken (__REGA0(struct BoardInfo *b), __REGA1(struct BitMap *bm), __REGA2(struct RenderInfo *r), __REGD0(SHORT x), __REGD1(SHORT y), __REGD2(SHORT dx), __REGD3(SHORT dy), __REGD4(SHORT w), __REGD5(SHORT h), __REGD6(UBYTE minterm), __REGD7(UBYTE mask)) {
@@ -725,6 +847,12 @@ void BlitPlanar2Chunky (__REGA0(struct BoardInfo *b), __REGA1(struct BitMap *bm)
   uint32_t output_plane_size = line_size * h;
   uint16_t x_offset = (x >> 3);
 
+  // The planes are staged in the scratch area, P96 converts the ones that don't fit.
+  if (output_plane_size * bm->Depth > CARD_SCRATCH_SIZE) {
+    b->BlitPlanar2ChunkyDefault(b, bm, r, x, y, dx, dy, w, h, minterm, mask);
+    return;
+  }
+
   WRITELONG(RTG_ADDR1, (unsigned long)r->Memory);
   WRITELONG(RTG_ADDR2, template_addr);
   WRITESHORT(RTG_X4, r->BytesPerRow);
@@ -770,5 +898,74 @@ void BlitPlanar2Chunky (__REGA0(struct BoardInfo *b), __REGA1(struct BitMap *bm)
 }
 
 void BlitPlanar2Direct (__REGA0(struct BoardInfo *b), __REGA1(struct BitMap *bmp), __REGA2(struct RenderInfo *r), __REGA3(struct ColorIndexMapping *clut), __REGD0(SHORT x), __REGD1(SHORT y), __REGD2(SHORT dx), __REGD3(SHORT dy), __REGD4(SHORT w), __REGD5(SHORT h), __REGD6(UBYTE minterm), __REGD7(UBYTE mask)) {
+  if (!b || !r || !bmp || !clut)
+    return;
+  if (w < 1 || h < 1)
+    return;
+
+  unsigned short format = rgbf_to_rtg[r->RGBFormat];
+  if (format != RTGFMT_RBG565 && format != RTGFMT_RGB32) {
+    b->BlitPlanar2DirectDefault(b, bmp, r, clut, x, y, dx, dy, w, h, minterm, mask);
+    return;
+  }
+
+  uint8_t depth = (bmp->Depth > 8) ? 8 : bmp->Depth;
+  uint32_t template_addr = CARD_SCRATCH;
+
+  uint16_t plane_mask = mask;
+  uint8_t ff_mask = 0x00;
+  uint8_t cur_plane = 0x01;
+
+  uint16_t line_size = (w >> 3) + 2;
+  uint32_t output_plane_size = line_size * h;
+
+  // The planes and then the colors are staged in the scratch area, P96 draws what doesn't fit.
+  if (((output_plane_size * depth + 3) & ~3) + (4 << depth) > CARD_SCRATCH_SIZE) {
+    b->BlitPlanar2DirectDefault(b, bmp, r, clut, x, y, dx, dy, w, h, minterm, mask);
+    return;
+  }
+
+  // The copies to the scratch area go through the Pi, which runs the records before them.
+  for (int16_t i = 0; i < depth; i++) {
+    if ((uint32_t)bmp->Planes[i] == 0xFFFFFFFF) {
+      ff_mask |= cur_plane;
+    }
+    else if (bmp->Planes[i] != NULL) {
+      uint8_t* bmp_mem = (uint8_t*)bmp->Planes[i] + (y * bmp->BytesPerRow) + (x >> 3);
+      uint8_t* dest = (uint8_t*)((uint32_t)template_addr);
+      for (int16_t y_line = 0; y_line < h; y_line++) {
+        memcpy(dest, bmp_mem, line_size);
+        dest += line_size;
+        bmp_mem += bmp->BytesPerRow;
+      }
+    }
+    else {
+      plane_mask &= (cur_plane ^ 0xFF);
+    }
+    cur_plane <<= 1;
+    template_addr += output_plane_size;
+  }
 
+  // Only the colors the planes can reach, the Pi copies them into the blit.
+  template_addr = (template_addr + 3) & ~3;
+  memcpy((unsigned char *)template_addr, clut->Colors, 4 << depth);
+
+  struct fifo_rec fifo;
+  fifo_begin(b, &fifo);
+  FIFO_SHORT(RTG_X1, (x & 0x07));
+  FIFO_SHORT(RTG_X2, dx);
+  FIFO_SHORT(RTG_X3, w);
+  FIFO_SHORT(RTG_Y1, 0);
+  FIFO_SHORT(RTG_Y2, dy);
+  FIFO_SHORT(RTG_Y3, h);
+  FIFO_SHORT(RTG_FORMAT, format);
+  FIFO_LONG(RTG_ADDR1, (unsigned long)r->Memory);
+  FIFO_LONG(RTG_ADDR2, CARD_SCRATCH);
+  FIFO_BYTES(RTG_U81, mask, minterm);
+  FIFO_BYTES(RTG_U83, depth, 0);
+  FIFO_SHORT(RTG_X4, r->BytesPerRow);
+  FIFO_SHORT(RTG_X5, line_size);
+  FIFO_SHORT(RTG_U1, (plane_mask << 8 | ff_mask));
+  FIFO_LONG(RTG_ADDR3, template_addr);
+  fifo_end(b, &fifo, RTGCMD_P2D, FALSE);
 }
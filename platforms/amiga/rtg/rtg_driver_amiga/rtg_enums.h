@@ -24,8 +24,26 @@ enum pi_regs {
   RTG_U2      = 0x2E,
   RTG_ADDR3   = 0x30,
   RTG_ADDR4   = 0x34,
+  RTG_WAITBLIT = 0x38, // Reads once all queued blits are done
+  RTG_FIFO    = 0x3C, // Doorbell, runs the records in the command FIFO
 };
 
+// Command FIFO at the end of the scratch area.  The first longword is the offset of the next record the
+// host runs, the records from RTG_FIFO_RING on are a header longword and the register values for the
+// command in register order, padded to a longword.  The header is command + 1 << 27 | the bits for the
+// register words at offset 2 to 0x36 with a value, bit n - 1 for offset n * 2.  The driver writes it
+// after the values, the host clears the record once it ran it.  A header with RTG_FIFO_WRAP as the
+// command sends the host back to RTG_FIFO_RING.
+enum rtg_fifo {
+  RTG_FIFO_OFFSET     = 0x7F0000, // from the start of the scratch area
+  RTG_FIFO_SIZE       = 0x10000,
+  RTG_FIFO_RING       = 0x10,
+  RTG_FIFO_RECORD_MAX = 0x40,
+  RTG_FIFO_BATCH      = 16,       // records the driver writes before it rings the doorbell
+  RTG_FIFO_WRAP       = 0x1F,
+};
+
+// Commands go into the FIFO header as command + 1, so they have to stay below RTG_FIFO_WRAP - 1.
 enum rtg_cmds {
   RTGCMD_SETGC,
   RTGCMD_SETPAN,
@@ -42,6 +60,10 @@ enum rtg_cmds {
   RTGCMD_DRAWLINE,
   RTGCMD_P2C,
   RTGCMD_P2D,
+  RTGCMD_SETSPRITE,
+  RTGCMD_SETSPRITEPOS,
+  RTGCMD_SETSPRITEIMAGE,
+  RTGCMD_SETSPRITECOLOR,
 };
 
 enum rtg_formats {
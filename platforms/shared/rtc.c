@@ -1,7 +1,9 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include "rtc.h"
+#include "snapshot/snapshot.h"
 
 static unsigned char rtc_mystery_reg[3];
 unsigned char ricoh_memory[0x0F];
@@ -184,3 +186,24 @@ uint8_t get_rtc_byte(uint32_t address_, uint8_t rtc_type) {
 
   return 0x00;
 }
+
+// The time itself comes from the host clock, only the registers and the RAM are state.
+int rtc_save_state(FILE *out) {
+  unsigned char st[sizeof(rtc_mystery_reg) + sizeof(ricoh_memory) + sizeof(ricoh_alarm)];
+
+  memcpy(st, rtc_mystery_reg, sizeof(rtc_mystery_reg));
+  memcpy(st + sizeof(rtc_mystery_reg), ricoh_memory, sizeof(ricoh_memory));
+  memcpy(st + sizeof(rtc_mystery_reg) + sizeof(ricoh_memory), ricoh_alarm, sizeof(ricoh_alarm));
+  return snapshot_write_chunk(out, "RTC ", st, sizeof(st));
+}
+
+int rtc_load_state(FILE *in) {
+  unsigned char st[sizeof(rtc_mystery_reg) + sizeof(ricoh_memory) + sizeof(ricoh_alarm)];
+
+  if (snapshot_read_chunk(in, "RTC ", st, sizeof(st)) == -1)
+    return -1;
+  memcpy(rtc_mystery_reg, st, sizeof(rtc_mystery_reg));
+  memcpy(ricoh_memory, st + sizeof(rtc_mystery_reg), sizeof(ricoh_memory));
+  memcpy(ricoh_alarm, st + sizeof(rtc_mystery_reg) + sizeof(ricoh_memory), sizeof(ricoh_alarm));
+  return 0;
+}
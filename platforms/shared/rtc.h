@@ -1,5 +1,9 @@
+#include <stdio.h>
+
 void put_rtc_byte(uint32_t address_, uint8_t value, uint8_t rtc_type);
 uint8_t get_rtc_byte(uint32_t address_, uint8_t rtc_type);
+int rtc_save_state(FILE *out);
+int rtc_load_state(FILE *in);
 
 enum rtc_types {
     RTC_TYPE_MSM,
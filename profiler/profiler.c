@@ -0,0 +1,308 @@
+// Guest PC sampling profiler.
+//
+// Every interval-th pass through the CPU loop the CPU thread records the
+// current PC and the top of the guest stack into a lock-free single producer,
+// single consumer ring.  A helper thread drains the ring into a table of
+// unique call stacks, which profiler_dump() writes out in the folded format
+// understood by flamegraph.pl, speedscope and friends:
+//
+//   kickstart+0x1A2C;kickstart+0x3F10;ram+0x1200 [move.l (A0)+, D0] 412
+//
+// Callers are found heuristically: a stack longword is only taken as a
+// return address if the code in front of it is a BSR or JSR.  Both the stack
+// and the code have to live in host memory (mapped ROM/RAM), the Amiga bus is
+// never touched from here.
+
+#include "config_file/config_file.h"
+#include "m68k.h"
+#include "profiler.h"
+
+#include <endian.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PROFILER_RING_SIZE 4096
+#define PROFILER_STACKS_SIZE 65536
+#define PROFILER_DRAIN_USEC 100000
+// Longest 68k instruction, for the leaf disassembly.
+#define PROFILER_MAX_INSTR 22
+
+struct profiler_stack {
+  uint32_t frames[PROFILER_MAX_DEPTH + 1];
+  uint32_t depth;
+  uint64_t count;
+};
+
+unsigned int profiler_countdown = 0;
+
+static struct emulator_config *prof_cfg;
+static char *prof_filename;
+static unsigned int prof_interval, prof_cpu_type;
+static volatile int prof_dump_requested;
+
+static struct profiler_sample ring[PROFILER_RING_SIZE];
+static uint32_t ring_head, ring_tail;
+
+static pthread_mutex_t stacks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct profiler_stack *stacks;
+static uint64_t samples_total, samples_dropped, samples_overflow, stacks_used;
+
+// Host pointer for a guest address in mapped ROM/RAM, and the number of bytes
+// that can be read from it in one go.
+static uint8_t *host_ptr(uint32_t addr, uint32_t *avail) {
+  int i = get_mapped_item_by_address(prof_cfg, addr);
+  uint32_t offset, size;
+
+  if (i == -1 || (prof_cfg->map_type[i] != MAPTYPE_ROM && prof_cfg->map_type[i] != MAPTYPE_RAM))
+    return NULL;
+
+  offset = addr - prof_cfg->map_offset[i];
+  size = prof_cfg->map_high[i] - prof_cfg->map_offset[i];
+  if (prof_cfg->map_type[i] == MAPTYPE_ROM) {
+    offset %= prof_cfg->rom_size[i];
+    size = prof_cfg->rom_size[i];
+  }
+
+  *avail = size - offset;
+  return prof_cfg->map_data[i] + offset;
+}
+
+static int code_word(uint32_t addr, uint16_t *word) {
+  uint32_t avail;
+  uint8_t *p = host_ptr(addr, &avail);
+
+  if (!p || avail < 2)
+    return 0;
+  *word = (p[0] << 8) | p[1];
+  return 1;
+}
+
+// Is addr preceded by an instruction that pushes it as return address?
+static int is_return_address(uint32_t addr) {
+  uint16_t w;
+
+  if ((addr & 1) || addr < 6)
+    return 0;
+
+  if (code_word(addr - 2, &w)) {
+    if ((w & 0xFF00) == 0x6100 && (w & 0xFF) != 0x00 && (w & 0xFF) != 0xFF)
+      return 1; // bsr.s
+    if ((w & 0xFFF8) == 0x4E90)
+      return 1; // jsr (An)
+  }
+  if (code_word(addr - 4, &w)) {
+    if (w == 0x6100)
+      return 1; // bsr.w
+    if ((w & 0xFFF0) == 0x4EA0 && (w & 0x0F) >= 0x08)
+      return 1; // jsr d16(An)
+    if ((w & 0xFFF8) == 0x4EB0 || w == 0x4EB8 || w == 0x4EBA || w == 0x4EBB)
+      return 1; // jsr d8(An,Xn) / abs.w / d16(PC) / d8(PC,Xn)
+  }
+  if (code_word(addr - 6, &w)) {
+    if (w == 0x4EB9 || w == 0x61FF)
+      return 1; // jsr abs.l / bsr.l
+  }
+
+  return 0;
+}
+
+// Runs on the CPU thread, so it can look at the registers directly.
+void profiler_take_sample(void) {
+  uint32_t head = ring_head, sp, avail = 0;
+  struct profiler_sample *s;
+  uint8_t *stack;
+
+  profiler_countdown = prof_interval;
+
+  if (prof_dump_requested) {
+    prof_dump_requested = 0;
+    profiler_dump();
+  }
+
+  if (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) >= PROFILER_RING_SIZE) {
+    samples_dropped++;
+    return;
+  }
+
+  s = &ring[head & (PROFILER_RING_SIZE - 1)];
+  s->pc = m68k_get_reg(NULL, M68K_REG_PC);
+  s->stack_words = 0;
+
+  sp = m68k_get_reg(NULL, M68K_REG_A7);
+  stack = (sp & 1) ? NULL : host_ptr(sp, &avail);
+  if (stack) {
+    unsigned int words = avail / 2;
+    if (words > PROFILER_STACK_SCAN)
+      words = PROFILER_STACK_SCAN;
+    for (unsigned int i = 0; i < words; i++)
+      s->stack[i] = be16toh(((uint16_t *)stack)[i]);
+    s->stack_words = words;
+  }
+
+  __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void add_stack(uint32_t *frames, uint32_t depth) {
+  uint32_t hash = 2166136261u;
+
+  for (uint32_t i = 0; i < depth; i++)
+    hash = (hash ^ frames[i]) * 16777619u;
+
+  for (uint32_t n = 0; n < PROFILER_STACKS_SIZE; n++) {
+    struct profiler_stack *st = &stacks[(hash + n) & (PROFILER_STACKS_SIZE - 1)];
+
+    if (st->depth == 0) {
+      if (stacks_used >= PROFILER_STACKS_SIZE * 3 / 4)
+        break;
+      memcpy(st->frames, frames, depth * sizeof(uint32_t));
+      st->depth = depth;
+      st->count = 1;
+      stacks_used++;
+      return;
+    }
+    if (st->depth == depth && memcmp(st->frames, frames, depth * sizeof(uint32_t)) == 0) {
+      st->count++;
+      return;
+    }
+  }
+
+  samples_overflow++;
+}
+
+// Must be called with stacks_mutex held, which makes the holder the ring's only consumer.
+static void drain_ring(void) {
+  uint32_t tail = ring_tail, head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+
+  while (tail != head) {
+    struct profiler_sample *s = &ring[tail & (PROFILER_RING_SIZE - 1)];
+    uint32_t frames[PROFILER_MAX_DEPTH + 1], depth = 0;
+
+    frames[depth++] = s->pc;
+    for (unsigned int i = 0; i + 1 < s->stack_words && depth <= PROFILER_MAX_DEPTH; i++) {
+      uint32_t addr = ((uint32_t)s->stack[i] << 16) | s->stack[i + 1];
+      if (is_return_address(addr)) {
+        frames[depth++] = addr;
+        i++;
+      }
+    }
+
+    add_stack(frames, depth);
+    samples_total++;
+    tail++;
+  }
+
+  __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+}
+
+static void *profiler_task() {
+  while (1) {
+    usleep(PROFILER_DRAIN_USEC);
+    pthread_mutex_lock(&stacks_mutex);
+    drain_ring();
+    pthread_mutex_unlock(&stacks_mutex);
+  }
+  return (void *)NULL;
+}
+
+static void write_frame(FILE *out, uint32_t addr, int leaf) {
+  int i = get_mapped_item_by_address(prof_cfg, addr);
+
+  if (i != -1)
+    fprintf(out, "%s+0x%lX", prof_cfg->map_id[i] ? prof_cfg->map_id[i] : "mapped", addr - prof_cfg->map_offset[i]);
+  else
+    fprintf(out, "bus+0x%.8X", addr);
+
+  if (leaf) {
+    uint8_t code[PROFILER_MAX_INSTR];
+    uint32_t avail = 0;
+    uint8_t *p = host_ptr(addr, &avail);
+    char disasm[256];
+
+    if (p) {
+      memset(code, 0x00, sizeof(code));
+      memcpy(code, p, (avail < sizeof(code)) ? avail : sizeof(code));
+      m68k_disassemble_raw(disasm, addr, code, NULL, prof_cpu_type);
+      fprintf(out, " [%s]", disasm);
+    }
+  }
+}
+
+// Writes all stacks seen so far, root first.  The disassembler is not
+// reentrant, so this should run on the CPU thread: use profiler_request_dump()
+// from anywhere else.
+int profiler_dump(void) {
+  FILE *out;
+
+  if (!stacks)
+    return -1;
+
+  out = fopen(prof_filename, "w");
+  if (!out) {
+    printf("[PROF] Failed to open %s for writing.\n", prof_filename);
+    return -1;
+  }
+
+  pthread_mutex_lock(&stacks_mutex);
+  drain_ring();
+  for (uint32_t n = 0; n < PROFILER_STACKS_SIZE; n++) {
+    struct profiler_stack *st = &stacks[n];
+    if (st->depth == 0)
+      continue;
+    for (int i = st->depth - 1; i >= 0; i--) {
+      write_frame(out, st->frames[i], i == 0);
+      fputc(i ? ';' : ' ', out);
+    }
+    fprintf(out, "%llu\n", (unsigned long long)st->count);
+  }
+  printf("[PROF] Wrote %llu unique stacks from %llu samples to %s (%llu dropped, %llu over table size).\n",
+         (unsigned long long)stacks_used, (unsigned long long)samples_total, prof_filename,
+         (unsigned long long)samples_dropped, (unsigned long long)samples_overflow);
+  pthread_mutex_unlock(&stacks_mutex);
+
+  fclose(out);
+  return 0;
+}
+
+void profiler_request_dump(void) {
+  if (!stacks) {
+    printf("[PROF] Profiling is not enabled, add a profile line to the config file.\n");
+    return;
+  }
+  printf("[PROF] Writing profile to %s.\n", prof_filename);
+  prof_dump_requested = 1;
+}
+
+int profiler_init(struct emulator_config *cfg, unsigned int cpu_type) {
+  pthread_t prof_tid;
+  int err;
+
+  if (!cfg->profile_file)
+    return 0;
+
+  stacks = calloc(PROFILER_STACKS_SIZE, sizeof(struct profiler_stack));
+  if (!stacks) {
+    printf("[PROF] Failed to allocate memory for the profiler.\n");
+    return -1;
+  }
+
+  prof_cfg = cfg;
+  prof_filename = cfg->profile_file;
+  prof_interval = cfg->profile_interval ? cfg->profile_interval : 1000;
+  prof_cpu_type = cpu_type;
+
+  err = pthread_create(&prof_tid, NULL, &profiler_task, NULL);
+  if (err != 0) {
+    printf("[PROF] Cannot create profiler thread: [%s]\n", strerror(err));
+    free(stacks);
+    stacks = NULL;
+    return -1;
+  }
+  pthread_setname_np(prof_tid, "pistorm: prof");
+
+  profiler_countdown = prof_interval;
+  printf("[PROF] Sampling every %d CPU loop iterations into %s.\n", prof_interval, prof_filename);
+  return 0;
+}
@@ -0,0 +1,27 @@
+#include <stdint.h>
+
+struct emulator_config;
+
+// Number of 16-bit words copied from the top of the guest stack for every sample.
+#define PROFILER_STACK_SCAN 32
+// Maximum number of callers recorded above the sampled PC.
+#define PROFILER_MAX_DEPTH 4
+
+struct profiler_sample {
+  uint32_t pc;
+  uint8_t stack_words;
+  uint16_t stack[PROFILER_STACK_SCAN];
+};
+
+extern unsigned int profiler_countdown;
+
+int profiler_init(struct emulator_config *cfg, unsigned int cpu_type);
+void profiler_take_sample(void);
+int profiler_dump(void);
+void profiler_request_dump(void);
+
+// Called once per CPU loop iteration, only does real work every interval-th time.
+static inline void profiler_tick(void) {
+  if (profiler_countdown && --profiler_countdown == 0)
+    profiler_take_sample();
+}
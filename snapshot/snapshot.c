@@ -0,0 +1,413 @@
+// Save states.
+//
+// A snapshot file holds a header, one page aligned image per host memory
+// region (mapped RAM, RTG VRAM) and a list of tagged chunks with the CPU
+// context and the platform's device state:
+//
+//   [header][region 0 pages][region 1 pages]...[CPU ][platform chunks...]
+//
+// While snapshots are enabled all regions are kept write protected, the first
+// write to a page after a save lands in snapshot_fault(), which marks the page
+// dirty and unprotects it.  Saving again to the same file then only writes the
+// dirty pages.  Restoring maps the page images straight from the file with
+// MAP_PRIVATE | MAP_FIXED over the regions, so only the pages the guest
+// touches are ever read back in.
+
+#include "config_file/config_file.h"
+#include "m68k.h"
+#include "snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "PISNAP01"
+#define SNAPSHOT_VERSION 1
+
+struct snapshot_region {
+  char id[SNAPSHOT_ID_LEN];
+  uint8_t *data;
+  uint32_t size;
+  uint32_t pages;
+  volatile uint8_t *dirty;
+};
+
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t page_size;
+  uint32_t cpu_type;
+  uint32_t context_size;
+  uint32_t num_regions;
+  uint32_t pad;
+  uint64_t boot_nsec;
+  uint64_t state_offset;
+  struct {
+    char id[SNAPSHOT_ID_LEN];
+    uint32_t size;
+    uint32_t pad;
+    uint64_t offset;
+  } region[SNAPSHOT_MAX_REGIONS];
+};
+
+struct snapshot_chunk {
+  char tag[4];
+  uint32_t size;
+};
+
+static struct snapshot_region regions[SNAPSHOT_MAX_REGIONS];
+static int num_regions;
+static long page_size;
+static int tracking;
+// The file the clean pages in memory are identical to, only that one can be saved to incrementally.
+static char *synced_file;
+// Time the machine has been running since its cold start, carried over by restores.
+static struct timespec start_time, run_start;
+static uint64_t run_base_nsec;
+
+static inline uint64_t elapsed_ns(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1000000000ULL + b->tv_nsec - a->tv_nsec;
+}
+
+int snapshot_add_region(const char *id, uint8_t *data, uint32_t size) {
+  if (num_regions == SNAPSHOT_MAX_REGIONS || tracking) {
+    printf("[SNAP] Can't add snapshot region %s.\n", id);
+    return -1;
+  }
+
+  struct snapshot_region *r = &regions[num_regions++];
+  snprintf(r->id, sizeof(r->id), "%s", id);
+  r->data = data;
+  r->size = size;
+  return 0;
+}
+
+static struct snapshot_region *find_region(void *addr) {
+  for (int i = 0; i < num_regions; i++) {
+    if ((uint8_t *)addr >= regions[i].data && (uint8_t *)addr < regions[i].data + regions[i].size)
+      return &regions[i];
+  }
+  return NULL;
+}
+
+static void snapshot_fault(int sig, siginfo_t *info, void *context) {
+  struct snapshot_region *r = find_region(info->si_addr);
+  (void)context;
+
+  if (!r) {
+    // Not one of ours, crash the usual way when the access is repeated.
+    signal(sig, SIG_DFL);
+    return;
+  }
+
+  uint32_t page = ((uint8_t *)info->si_addr - r->data) / page_size;
+  r->dirty[page] = 1;
+  mprotect(r->data + page * page_size, page_size, PROT_READ | PROT_WRITE);
+}
+
+void snapshot_touch(void *data, uint32_t size) {
+  struct snapshot_region *r;
+
+  if (!tracking || !size || !(r = find_region(data)))
+    return;
+
+  uint32_t first = ((uint8_t *)data - r->data) / page_size;
+  uint32_t last = ((uint8_t *)data + size - 1 - r->data) / page_size;
+  if (last >= r->pages)
+    last = r->pages - 1;
+  for (uint32_t i = first; i <= last; i++)
+    r->dirty[i] = 1;
+  mprotect(r->data + first * page_size, (last - first + 1) * page_size, PROT_READ | PROT_WRITE);
+}
+
+int snapshot_page_protection(void *page) {
+  struct snapshot_region *r;
+
+  if (!tracking || !(r = find_region(page)))
+    return PROT_READ | PROT_WRITE;
+  return r->dirty[((uint8_t *)page - r->data) / page_size] ? PROT_READ | PROT_WRITE : PROT_READ;
+}
+
+int snapshot_init(struct emulator_config *cfg) {
+  struct sigaction sa;
+  char id[SNAPSHOT_ID_LEN];
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  run_start = start_time;
+  if (!cfg->snapshot_file)
+    return 0;
+
+  page_size = sysconf(_SC_PAGESIZE);
+
+  for (int i = 0; i < MAX_NUM_MAPPED_ITEMS; i++) {
+    if (cfg->map_type[i] != MAPTYPE_RAM || !cfg->map_data[i])
+      continue;
+    if (cfg->map_id[i])
+      snprintf(id, SNAPSHOT_ID_LEN, "%s", cfg->map_id[i]);
+    else
+      snprintf(id, SNAPSHOT_ID_LEN, "ram_%.8lX", cfg->map_offset[i]);
+    snapshot_add_region(id, cfg->map_data[i], cfg->map_size[i]);
+  }
+
+  for (int i = 0; i < num_regions; i++) {
+    regions[i].pages = (regions[i].size + page_size - 1) / page_size;
+    regions[i].dirty = calloc(1, regions[i].pages);
+    if (!regions[i].dirty) {
+      printf("[SNAP] Failed to allocate dirty page map for %s.\n", regions[i].id);
+      return -1;
+    }
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = snapshot_fault;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGSEGV, &sa, NULL) == -1) {
+    printf("[SNAP] Failed to install page fault handler: %s\n", strerror(errno));
+    return -1;
+  }
+
+  // Nothing in memory matches a file yet, the first save writes all pages.
+  for (int i = 0; i < num_regions; i++) {
+    memset((void *)regions[i].dirty, 1, regions[i].pages);
+    mprotect(regions[i].data, regions[i].pages * page_size, PROT_READ);
+  }
+  tracking = 1;
+
+  printf("[SNAP] Tracking changed pages in %d regions for snapshots to %s.\n", num_regions, cfg->snapshot_file);
+  return 0;
+}
+
+static void make_header(struct snapshot_header *h) {
+  uint64_t offset;
+
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+  h->version = SNAPSHOT_VERSION;
+  h->page_size = page_size;
+  h->cpu_type = m68k_get_reg(NULL, M68K_REG_CPU_TYPE);
+  h->context_size = m68k_context_size();
+  h->num_regions = num_regions;
+
+  offset = (sizeof(*h) + page_size - 1) & ~(uint64_t)(page_size - 1);
+  for (int i = 0; i < num_regions; i++) {
+    memcpy(h->region[i].id, regions[i].id, SNAPSHOT_ID_LEN);
+    h->region[i].size = regions[i].size;
+    h->region[i].offset = offset;
+    offset += (uint64_t)regions[i].pages * page_size;
+  }
+  h->state_offset = offset;
+}
+
+// Everything but the timestamp has to match for the page images to be usable.
+static int same_layout(struct snapshot_header *a, struct snapshot_header *b) {
+  return memcmp(a, b, offsetof(struct snapshot_header, boot_nsec)) == 0 &&
+         a->state_offset == b->state_offset && memcmp(a->region, b->region, sizeof(a->region)) == 0;
+}
+
+int snapshot_write_chunk(FILE *out, const char *tag, const void *data, uint32_t size) {
+  struct snapshot_chunk c;
+
+  memcpy(c.tag, tag, sizeof(c.tag));
+  c.size = size;
+  if (fwrite(&c, sizeof(c), 1, out) != 1 || (size && fwrite(data, size, 1, out) != 1))
+    return -1;
+  return 0;
+}
+
+int snapshot_read_chunk(FILE *in, const char *tag, void *data, uint32_t size) {
+  struct snapshot_chunk c;
+
+  if (fread(&c, sizeof(c), 1, in) != 1) {
+    printf("[SNAP] Snapshot ends before the %.4s chunk.\n", tag);
+    return -1;
+  }
+  if (memcmp(c.tag, tag, sizeof(c.tag)) != 0 || c.size != size) {
+    printf("[SNAP] Expected %.4s chunk of %u bytes, found %.4s of %u bytes.\n", tag, size, c.tag, c.size);
+    return -1;
+  }
+  if (size && fread(data, size, 1, in) != 1)
+    return -1;
+  return 0;
+}
+
+// Writes the dirty (or all) pages of a region in runs and write protects them again.
+static int save_region(int fd, struct snapshot_region *r, uint64_t offset, int full, uint32_t *written) {
+  uint32_t page = 0;
+
+  while (page < r->pages) {
+    if (!full && !r->dirty[page]) {
+      page++;
+      continue;
+    }
+    uint32_t run = page;
+    while (run < r->pages && (full || r->dirty[run]))
+      r->dirty[run++] = 0;
+
+    uint8_t *src = r->data + (uint64_t)page * page_size;
+    size_t len = (size_t)(run - page) * page_size;
+    uint64_t pos = offset + (uint64_t)page * page_size;
+    mprotect(src, len, PROT_READ);
+    while (len) {
+      ssize_t n = pwrite(fd, src, len, pos);
+      if (n <= 0) {
+        printf("[SNAP] Failed to write %s: %s\n", r->id, strerror(errno));
+        return -1;
+      }
+      src += n;
+      pos += n;
+      len -= n;
+    }
+    *written += run - page;
+    page = run;
+  }
+
+  return 0;
+}
+
+int snapshot_save(struct emulator_config *cfg, const char *filename) {
+  struct snapshot_header h, old;
+  struct timespec t0, t1;
+  uint32_t written = 0, total = 0;
+  void *context = NULL;
+  FILE *out = NULL;
+  int full, ret = -1;
+
+  if (!tracking) {
+    printf("[SNAP] Snapshots are not enabled.\n");
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  int fd = open(filename, O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    printf("[SNAP] Failed to open %s for writing: %s\n", filename, strerror(errno));
+    return -1;
+  }
+
+  make_header(&h);
+  full = !synced_file || strcmp(synced_file, filename) != 0 ||
+         pread(fd, &old, sizeof(old), 0) != sizeof(old) || !same_layout(&h, &old);
+
+  for (int i = 0; i < num_regions; i++) {
+    if (save_region(fd, &regions[i], h.region[i].offset, full, &written) == -1)
+      goto save_failed;
+    total += regions[i].pages;
+  }
+
+  if (ftruncate(fd, h.state_offset) == -1 || lseek(fd, h.state_offset, SEEK_SET) == -1)
+    goto save_failed;
+  out = fdopen(dup(fd), "wb");
+  context = malloc(h.context_size);
+  if (!out || !context)
+    goto save_failed;
+  m68k_get_context(context);
+  if (snapshot_write_chunk(out, "CPU ", context, h.context_size) == -1)
+    goto save_failed;
+  if (cfg->platform->save_state && cfg->platform->save_state(cfg, out) == -1)
+    goto save_failed;
+  if (fflush(out) != 0)
+    goto save_failed;
+
+  // The header goes last, a snapshot that failed halfway doesn't restore.
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  h.boot_nsec = run_base_nsec + elapsed_ns(&run_start, &t1);
+  if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h) || fsync(fd) == -1)
+    goto save_failed;
+
+  free(synced_file);
+  synced_file = strdup(filename);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("[SNAP] Saved %s: %u of %u pages written (%s), %.1f ms.\n", filename, written, total,
+         full ? "full" : "changed only", elapsed_ns(&t0, &t1) / 1000000.0);
+  ret = 0;
+  goto save_done;
+
+save_failed:
+  printf("[SNAP] Failed to save snapshot to %s.\n", filename);
+  // Whatever was written may be stale now, start over with a full save.
+  free(synced_file);
+  synced_file = NULL;
+  memset(&old, 0, sizeof(old));
+  pwrite(fd, &old, sizeof(old), 0);
+save_done:
+  if (out)
+    fclose(out);
+  free(context);
+  close(fd);
+  return ret;
+}
+
+int snapshot_restore(struct emulator_config *cfg, const char *filename) {
+  struct snapshot_header h, expect;
+  struct timespec t0, t1;
+  void *context = NULL;
+  FILE *in = NULL;
+  int ret = -1;
+
+  if (!tracking) {
+    printf("[SNAP] Snapshots are not enabled.\n");
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    printf("[SNAP] Failed to open %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+
+  make_header(&expect);
+  if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0) {
+    printf("[SNAP] %s is not a snapshot.\n", filename);
+    goto restore_done;
+  }
+  if (!same_layout(&h, &expect)) {
+    printf("[SNAP] %s was saved with a different CPU, memory or RTG configuration.\n", filename);
+    goto restore_done;
+  }
+
+  context = malloc(h.context_size);
+  in = fdopen(dup(fd), "rb");
+  if (!context || !in || fseek(in, h.state_offset, SEEK_SET) == -1 ||
+      snapshot_read_chunk(in, "CPU ", context, h.context_size) == -1)
+    goto restore_done;
+
+  // From here on the running state is replaced.
+  for (int i = 0; i < num_regions; i++) {
+    struct snapshot_region *r = &regions[i];
+    if (mmap(r->data, (size_t)r->pages * page_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, h.region[i].offset) == MAP_FAILED) {
+      printf("[SNAP] Failed to map %s from %s: %s\n", r->id, filename, strerror(errno));
+      goto restore_done;
+    }
+    memset((void *)r->dirty, 0, r->pages);
+  }
+  free(synced_file);
+  synced_file = strdup(filename);
+
+  m68k_restore_context(context);
+  if (cfg->platform->load_state && cfg->platform->load_state(cfg, in) == -1) {
+    printf("[SNAP] Device state in %s could not be restored completely.\n", filename);
+    goto restore_done;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  run_start = t1;
+  run_base_nsec = h.boot_nsec;
+  printf("[SNAP] Restored %s in %.1f ms, %.1f s after startup. The saved state was reached %.1f s after a cold start.\n",
+         filename, elapsed_ns(&t0, &t1) / 1000000.0, elapsed_ns(&start_time, &t1) / 1000000000.0, h.boot_nsec / 1000000000.0);
+  ret = 0;
+
+restore_done:
+  if (in)
+    fclose(in);
+  free(context);
+  close(fd);
+  return ret;
+}
@@ -0,0 +1,25 @@
+#include <stdint.h>
+#include <stdio.h>
+
+struct emulator_config;
+
+// Host memory regions saved as page images: mapped RAM plus whatever else registers itself.
+#define SNAPSHOT_MAX_REGIONS 16
+#define SNAPSHOT_ID_LEN 32
+
+int snapshot_add_region(const char *id, uint8_t *data, uint32_t size);
+int snapshot_init(struct emulator_config *cfg);
+int snapshot_save(struct emulator_config *cfg, const char *filename);
+int snapshot_restore(struct emulator_config *cfg, const char *filename);
+
+// Has to be called before the kernel writes into a region, e.g. read() from a disk image,
+// those writes don't go through the write protection that finds the changed pages.
+void snapshot_touch(void *data, uint32_t size);
+
+// The protection a host page needs for the changed page tracking, for others that mprotect() it for a while.
+int snapshot_page_protection(void *page);
+
+// Device state is stored as a sequence of tagged chunks after the page images,
+// read back in the same order they were written.
+int snapshot_write_chunk(FILE *out, const char *tag, const void *data, uint32_t size);
+int snapshot_read_chunk(FILE *in, const char *tag, void *data, uint32_t size);
@@ -501,30 +501,106 @@ int floatx80_ftan(floatx80 *a)
 //   f(x) ~ [ p(x) + x * q(x) ]
 //
 
+/*----------------------------------------------------------------------------
+| float128 multiply and add for the approximation polynomials.  Arguments,
+| coefficients and partial sums are always normal numbers here, so the NaN,
+| infinity, zero and subnormal screening of `float128_mul' and `float128_add'
+| is skipped and the significands are taken apart only once.  Rounding still
+| goes through `roundAndPackFloat128', so results and exception flags are
+| bit-identical; any operand that is not normal takes the generic routine.
+| Defining SOFTFLOAT_GENERIC_POLY builds the plain softfloat versions, which
+| fpkerneltest uses as the reference.
+*----------------------------------------------------------------------------*/
+
+#ifdef SOFTFLOAT_GENERIC_POLY
+#define poly_mul float128_mul
+#define poly_add float128_add
+#else
+
+#define POLY_EXP(a)  ((int32_t) ((a).high >> 48) & 0x7FFF)
+#define POLY_SIGN(a) ((flag) ((a).high >> 63))
+#define POLY_FRAC0(a) ((a).high & 0x0000FFFFFFFFFFFFU)
+#define POLY_NORMAL(e) ((uint32_t) ((e) - 1) < 0x7FFE)
+
+static inline float128 poly_mul(float128 a, float128 b)
+{
+	int32 aExp = POLY_EXP(a), bExp = POLY_EXP(b), zExp;
+	bits64 aSig0, aSig1, bSig0, bSig1, zSig0, zSig1, zSig2, zSig3;
+
+	if (! POLY_NORMAL(aExp) || ! POLY_NORMAL(bExp))
+		return float128_mul(a, b);
+
+	zExp = aExp + bExp - 0x4000;
+	aSig0 = POLY_FRAC0(a) | 0x0001000000000000U;
+	aSig1 = a.low;
+	bSig0 = (POLY_FRAC0(b) << 16) | (b.low >> 48);
+	bSig1 = b.low << 16;
+	mul128To256(aSig0, aSig1, bSig0, bSig1, &zSig0, &zSig1, &zSig2, &zSig3);
+	add128(zSig0, zSig1, aSig0, aSig1, &zSig0, &zSig1);
+	zSig2 |= (zSig3 != 0);
+	if (0x0002000000000000U <= zSig0) {
+		shift128ExtraRightJamming(zSig0, zSig1, zSig2, 1, &zSig0, &zSig1, &zSig2);
+		++zExp;
+	}
+	return roundAndPackFloat128(POLY_SIGN(a) ^ POLY_SIGN(b), zExp, zSig0, zSig1, zSig2);
+}
+
+static inline float128 poly_add(float128 a, float128 b)
+{
+	int32 aExp = POLY_EXP(a), bExp = POLY_EXP(b), zExp;
+	int32 expDiff = aExp - bExp;
+	bits64 aSig0, aSig1, bSig0, bSig1, zSig0, zSig1, zSig2;
+
+	/* the Horner steps only ever add like signs */
+	if (POLY_SIGN(a) != POLY_SIGN(b) || ! POLY_NORMAL(aExp) || ! POLY_NORMAL(bExp))
+		return float128_add(a, b);
+
+	aSig0 = POLY_FRAC0(a);
+	aSig1 = a.low;
+	bSig0 = POLY_FRAC0(b);
+	bSig1 = b.low;
+	if (expDiff == 0) {
+		add128(aSig0, aSig1, bSig0, bSig1, &zSig0, &zSig1);
+		zSig0 |= 0x0002000000000000U;
+		shift128ExtraRightJamming(zSig0, zSig1, 0, 1, &zSig0, &zSig1, &zSig2);
+		return roundAndPackFloat128(POLY_SIGN(a), aExp, zSig0, zSig1, zSig2);
+	}
+	if (0 < expDiff) {
+		shift128ExtraRightJamming(bSig0 | 0x0001000000000000U, bSig1, 0, expDiff, &bSig0, &bSig1, &zSig2);
+		zExp = aExp;
+	}
+	else {
+		shift128ExtraRightJamming(aSig0 | 0x0001000000000000U, aSig1, 0, - expDiff, &aSig0, &aSig1, &zSig2);
+		zExp = bExp;
+	}
+	add128(aSig0 | 0x0001000000000000U, aSig1, bSig0, bSig1, &zSig0, &zSig1);
+	--zExp;
+	if (0x0002000000000000U <= zSig0) {
+		++zExp;
+		shift128ExtraRightJamming(zSig0, zSig1, zSig2, 1, &zSig0, &zSig1, &zSig2);
+	}
+	return roundAndPackFloat128(POLY_SIGN(a), zExp, zSig0, zSig1, zSig2);
+}
+#endif
+
 float128 EvalPoly(float128 x, float128 *arr, unsigned n)
 {
-	float128 x2 = float128_mul(x, x);
+	float128 x2 = poly_mul(x, x);
+	float128 r1, r2;
 	unsigned i;
 
 	assert(n > 1);
 
-	float128 r1 = arr[--n];
-	i = n;
-	while(i >= 2) {
-		r1 = float128_mul(r1, x2);
-		i -= 2;
-		r1 = float128_add(r1, arr[i]);
-	}
-	if (i) r1 = float128_mul(r1, x);
-
-	float128 r2 = arr[--n];
-	i = n;
-	while(i >= 2) {
-		r2 = float128_mul(r2, x2);
-		i -= 2;
-		r2 = float128_add(r2, arr[i]);
+	/* both Horner chains are independent, so run them side by side */
+	r1 = arr[n - 1];
+	r2 = arr[n - 2];
+	for (i = n - 1; i >= 2; i -= 2) {
+		r1 = poly_add(poly_mul(r1, x2), arr[i - 2]);
+		if (i >= 3)
+			r2 = poly_add(poly_mul(r2, x2), arr[i - 3]);
 	}
-	if (i) r2 = float128_mul(r2, x);
+	if (i) r1 = poly_mul(r1, x);
+	else r2 = poly_mul(r2, x);
 
 	return float128_add(r1, r2);
 }